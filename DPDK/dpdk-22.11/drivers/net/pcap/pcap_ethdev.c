@@ -5,7 +5,9 @@
  */
 
 #include <stdlib.h>
+#include <errno.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include <pcap.h>
 
@@ -21,6 +23,10 @@
 
 #include "pcap_osdep.h"
 #include "rte_pcap_file_pool.h"
+#include "rte_pcap_file_split.h"
+#include "rte_pcap_file_index.h"
+#include "rte_pcap_stream.h"
+#include "rte_pcap_shm.h"
 
 #define RTE_ETH_PCAP_SNAPSHOT_LEN 65535
 #define RTE_ETH_PCAP_SNAPLEN RTE_ETHER_MAX_JUMBO_FRAME_LEN
@@ -35,10 +41,19 @@
 #define ETH_PCAP_IFACE_ARG    "iface"
 #define ETH_PCAP_PHY_MAC_ARG  "phy_mac"
 #define ETH_PCAP_INFINITE_RX_ARG  "infinite_rx"
+#define ETH_PCAP_NUMA_BIND_ARG  "numa_bind"
+#define ETH_PCAP_RX_SPLIT_ARG  "rx_split"
+#define ETH_PCAP_TX_INDEX_ARG  "tx_index"
+#define ETH_PCAP_TX_ROTATE_ARG  "tx_rotate"
+#define ETH_PCAP_RX_TS_FROM_ARG  "rx_ts_from"
+#define ETH_PCAP_RX_TS_TO_ARG  "rx_ts_to"
+#define ETH_PCAP_RX_IP_ARG  "rx_ip"
+#define ETH_PCAP_RX_STREAM_ARG  "rx_stream"
+#define ETH_PCAP_RX_SHM_ARG  "rx_shm"
 
 #define ETH_PCAP_ARG_MAXLEN	64
 
-#define RTE_PMD_PCAP_MAX_QUEUES 1
+#define RTE_PMD_PCAP_MAX_QUEUES PCAP_SPLIT_MAX_RANGES
 
 static char errbuf[PCAP_ERRBUF_SIZE];
 static struct timespec start_time;
@@ -68,6 +83,9 @@ struct queue_missed_stat {
 struct pcap_rx_queue {
 	uint16_t port_id;
 	uint16_t queue_id;
+	int socket_id;
+	/* polling lcore socket has been checked against socket_id */
+	unsigned int numa_checked;
 	struct rte_mempool *mb_pool;
 	struct queue_stat rx_stat;
 	struct queue_missed_stat missed_stat;
@@ -78,6 +96,15 @@ struct pcap_rx_queue {
 	struct rte_ring *pkts;
     	
 	struct rte_pcap_file_pool fpool;
+
+	/* Reader of this queue's byte range in rx_split mode */
+	struct rte_pcap_split_reader sreader;
+
+	/* FIFO or stdin pcap stream in rx_stream mode */
+	struct rte_pcap_stream stream;
+
+	/* Shared memory ring of a local producer in rx_shm mode */
+	struct rte_pcap_shm shm;
 };
 
 struct pcap_tx_queue {
@@ -86,6 +113,14 @@ struct pcap_tx_queue {
 	struct queue_stat tx_stat;
 	char name[PATH_MAX];
 	char type[ETH_PCAP_ARG_MAXLEN];
+
+	/* Sidecar index of the dumped file, written on stop or rotation */
+	struct rte_pcap_index index;
+
+	/* tx_rotate mode: file being written in the name directory */
+	char fname[PATH_MAX];
+	/* secs the next file is started at, 0 before the first */
+	uint64_t rotate_at;
 };
 
 struct pmd_internals {
@@ -97,6 +132,19 @@ struct pmd_internals {
 	int single_iface;
 	int phy_mac;
 	unsigned int infinite_rx;
+	unsigned int numa_bind;
+	/* Number of rx queues sharing one large pcap file, 0 if off */
+	unsigned int rx_split;
+	struct rte_pcap_file_split split;
+	/* Record stride of tx dumper indexes, 0 if not indexed */
+	unsigned int tx_index;
+	/* Secs per file of tx dumpers writing to a directory, 0 if off */
+	unsigned int tx_rotate;
+	struct rte_pcap_index_filter rx_filter;
+	/* rx queues read pcap streams instead of files */
+	unsigned int rx_stream;
+	/* rx queues attach to shared memory rings of a local producer */
+	unsigned int rx_shm;
 };
 
 struct pmd_process_private {
@@ -124,7 +172,14 @@ struct pmd_devargs_all {
 	unsigned int is_tx_iface;
 	unsigned int is_rx_pcap;
 	unsigned int is_rx_iface;
+	unsigned int is_rx_stream;
+	unsigned int is_rx_shm;
 	unsigned int infinite_rx;
+	unsigned int numa_bind;
+	unsigned int rx_split;
+	unsigned int tx_index;
+	unsigned int tx_rotate;
+	struct rte_pcap_index_filter rx_filter;
 };
 
 static const char *valid_arguments[] = {
@@ -136,6 +191,15 @@ static const char *valid_arguments[] = {
 	ETH_PCAP_IFACE_ARG,
 	ETH_PCAP_PHY_MAC_ARG,
 	ETH_PCAP_INFINITE_RX_ARG,
+	ETH_PCAP_NUMA_BIND_ARG,
+	ETH_PCAP_RX_SPLIT_ARG,
+	ETH_PCAP_TX_INDEX_ARG,
+	ETH_PCAP_TX_ROTATE_ARG,
+	ETH_PCAP_RX_TS_FROM_ARG,
+	ETH_PCAP_RX_TS_TO_ARG,
+	ETH_PCAP_RX_IP_ARG,
+	ETH_PCAP_RX_STREAM_ARG,
+	ETH_PCAP_RX_SHM_ARG,
 	NULL
 };
 
@@ -275,6 +339,79 @@ eth_pcap_rx_infinite(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
 
 
 
+/*
+ * Packets are copied from the file reader buffer into mbufs by the polling
+ * lcore, so warn once if that copy crosses a socket boundary.
+ */
+static void
+eth_pcap_rx_numa_check(struct pcap_rx_queue *pcap_q)
+{
+	int lcore_socket = (int)rte_socket_id();
+
+	pcap_q->numa_checked = 1;
+
+	if (pcap_q->socket_id == SOCKET_ID_ANY || lcore_socket == SOCKET_ID_ANY)
+		return;
+
+	if (lcore_socket != pcap_q->socket_id)
+		PMD_LOG(WARNING,
+			"port %u rx queue %u is set up on socket %d but polled from lcore %u on socket %d",
+			pcap_q->port_id, pcap_q->queue_id, pcap_q->socket_id,
+			rte_lcore_id(), lcore_socket);
+}
+
+/* Length, capture timestamp and port of a freshly filled mbuf */
+static inline void
+eth_pcap_rx_mbuf_meta(struct pcap_rx_queue *pcap_q, struct rte_mbuf *mbuf,
+		const struct pcap_pkthdr *header)
+{
+	mbuf->pkt_len = (uint16_t)header->caplen;
+	*RTE_MBUF_DYNFIELD(mbuf, timestamp_dynfield_offset,
+		rte_mbuf_timestamp_t *) =
+			(uint64_t)header->ts.tv_sec * 1000000 +
+			header->ts.tv_usec;
+	mbuf->ol_flags |= timestamp_rx_dynflag;
+	mbuf->port = pcap_q->port_id;
+}
+
+/*
+ * Copies one pcap record into a newly allocated mbuf (chain),
+ * returns NULL and accounts the failure in the queue stats.
+ */
+static inline struct rte_mbuf *
+eth_pcap_rx_mbuf(struct pcap_rx_queue *pcap_q,
+		const struct pcap_pkthdr *header, const u_char *packet)
+{
+	struct rte_mbuf *mbuf;
+
+	mbuf = rte_pktmbuf_alloc(pcap_q->mb_pool);
+	if (unlikely(mbuf == NULL)) {
+		pcap_q->rx_stat.rx_nombuf++;
+		return NULL;
+	}
+
+	if (header->caplen <= rte_pktmbuf_tailroom(mbuf)) {
+		/* pcap packet will fit in the mbuf, can copy it */
+		rte_memcpy(rte_pktmbuf_mtod(mbuf, void *), packet,
+				header->caplen);
+		mbuf->data_len = (uint16_t)header->caplen;
+	} else {
+		/* Try read jumbo frame into multi mbufs. */
+		if (unlikely(eth_pcap_rx_jumbo(pcap_q->mb_pool,
+					       mbuf,
+					       packet,
+					       header->caplen) == -1)) {
+			pcap_q->rx_stat.err_pkts++;
+			rte_pktmbuf_free(mbuf);
+			return NULL;
+		}
+	}
+
+	eth_pcap_rx_mbuf_meta(pcap_q, mbuf, header);
+
+	return mbuf;
+}
+
 static uint16_t
 eth_pcap_rx(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
 {
@@ -295,52 +432,176 @@ eth_pcap_rx(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
 	if (unlikely(nb_pkts == 0))
 		return 0;
 
+	if (unlikely(!pcap_q->numa_checked))
+		eth_pcap_rx_numa_check(pcap_q);
+
 	/* Reads the given number of packets from the pcap file one by one
 	 * and copies the packet data into a newly allocated mbuf to return.
 	 */
 	for (i = 0; i < nb_pkts; i++) {
-		/* Get the next PCAP packet */
 		/* Get the next PCAP packet */
 		packet = rte_pcap_file_pool_read(fpool, &header);
 		if (unlikely(packet == NULL))
 			break;
 
-		mbuf = rte_pktmbuf_alloc(pcap_q->mb_pool);
-		if (unlikely(mbuf == NULL)) {
-			pcap_q->rx_stat.rx_nombuf++;
+		mbuf = eth_pcap_rx_mbuf(pcap_q, &header, packet);
+		if (unlikely(mbuf == NULL))
 			break;
-		}
 
-		if (header.caplen <= rte_pktmbuf_tailroom(mbuf)) {
-			/* pcap packet will fit in the mbuf, can copy it */
-			rte_memcpy(rte_pktmbuf_mtod(mbuf, void *), packet,
-					header.caplen);
-			mbuf->data_len = (uint16_t)header.caplen;
+		bufs[num_rx] = mbuf;
+		num_rx++;
+		rx_bytes += header.caplen;
+	}
+	pcap_q->rx_stat.pkts += num_rx;
+	pcap_q->rx_stat.bytes += rx_bytes;
+
+	return num_rx;
+}
+
+/*
+ * rx_split mode: every queue reads its own byte range of the same file.
+ * Packets keep file order within a queue and carry their capture timestamp,
+ * but nothing orders them across queues: a flow crossing a range boundary
+ * comes in from two queues interleaved out of time order, and the queues
+ * are at different times of the capture. It suits per packet work and
+ * wall clock flow aging, not capture time aging, defragmentation,
+ * reassembly or anything else that needs a flow's packets in order.
+ */
+static uint16_t
+eth_pcap_rx_split(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
+{
+	unsigned int i;
+	struct pcap_pkthdr header;
+	const u_char *packet;
+	struct rte_mbuf *mbuf;
+	struct pcap_rx_queue *pcap_q = queue;
+	uint16_t num_rx = 0;
+	uint32_t rx_bytes = 0;
+
+	if (unlikely(nb_pkts == 0))
+		return 0;
+
+	if (unlikely(!pcap_q->numa_checked))
+		eth_pcap_rx_numa_check(pcap_q);
+
+	for (i = 0; i < nb_pkts; i++) {
+		packet = rte_pcap_split_reader_read(&pcap_q->sreader, &header);
+		if (unlikely(packet == NULL))
+			break;
+
+		mbuf = eth_pcap_rx_mbuf(pcap_q, &header, packet);
+		if (unlikely(mbuf == NULL))
+			break;
+
+		bufs[num_rx] = mbuf;
+		num_rx++;
+		rx_bytes += header.caplen;
+	}
+	pcap_q->rx_stat.pkts += num_rx;
+	pcap_q->rx_stat.bytes += rx_bytes;
+
+	return num_rx;
+}
+
+/*
+ * rx_stream mode: records come from a FIFO or stdin, a burst returns
+ * whatever complete records are buffered and never waits for more.
+ */
+static uint16_t
+eth_pcap_rx_stream(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
+{
+	unsigned int i;
+	struct pcap_pkthdr header;
+	const u_char *packet;
+	struct rte_mbuf *mbuf;
+	struct pcap_rx_queue *pcap_q = queue;
+	uint16_t num_rx = 0;
+	uint32_t rx_bytes = 0;
+	uint64_t bad_records = pcap_q->stream.bad_records;
+
+	if (unlikely(nb_pkts == 0))
+		return 0;
+
+	if (unlikely(!pcap_q->numa_checked))
+		eth_pcap_rx_numa_check(pcap_q);
+
+	for (i = 0; i < nb_pkts; i++) {
+		packet = rte_pcap_stream_read(&pcap_q->stream, &header);
+		if (unlikely(packet == NULL))
+			break;
+
+		mbuf = eth_pcap_rx_mbuf(pcap_q, &header, packet);
+		if (unlikely(mbuf == NULL))
+			break;
+
+		bufs[num_rx] = mbuf;
+		num_rx++;
+		rx_bytes += header.caplen;
+	}
+	pcap_q->rx_stat.pkts += num_rx;
+	pcap_q->rx_stat.bytes += rx_bytes;
+	pcap_q->rx_stat.err_pkts += pcap_q->stream.bad_records - bad_records;
+
+	return num_rx;
+}
+
+/*
+ * rx_shm mode: mbufs are attached to the packet bytes in the producer's
+ * ring, ring space is handed back once the mbufs are freed.
+ */
+static uint16_t
+eth_pcap_rx_shm(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
+{
+	unsigned int i;
+	struct pcap_pkthdr header;
+	struct rte_mbuf_ext_shared_info *shinfo;
+	const u_char *packet;
+	struct rte_mbuf *mbuf;
+	struct pcap_rx_queue *pcap_q = queue;
+	uint16_t num_rx = 0;
+	uint32_t rx_bytes = 0;
+	uint64_t errors = pcap_q->shm.errors;
+
+	if (unlikely(nb_pkts == 0))
+		return 0;
+
+	if (unlikely(!pcap_q->numa_checked))
+		eth_pcap_rx_numa_check(pcap_q);
+
+	rte_pcap_shm_reclaim(&pcap_q->shm);
+
+	for (i = 0; i < nb_pkts; i++) {
+		packet = rte_pcap_shm_read(&pcap_q->shm, &header, &shinfo);
+		if (unlikely(packet == NULL))
+			break;
+
+		/* Too long for one external buffer, copy it out */
+		if (unlikely(header.caplen > UINT16_MAX)) {
+			mbuf = eth_pcap_rx_mbuf(pcap_q, &header, packet);
+			rte_pcap_shm_done(shinfo);
+			if (unlikely(mbuf == NULL))
+				break;
 		} else {
-			/* Try read jumbo frame into multi mbufs. */
-			if (unlikely(eth_pcap_rx_jumbo(pcap_q->mb_pool,
-						       mbuf,
-						       packet,
-						       header.caplen) == -1)) {
-				pcap_q->rx_stat.err_pkts++;
-				rte_pktmbuf_free(mbuf);
+			mbuf = rte_pktmbuf_alloc(pcap_q->mb_pool);
+			if (unlikely(mbuf == NULL)) {
+				pcap_q->rx_stat.rx_nombuf++;
+				rte_pcap_shm_done(shinfo);
 				break;
 			}
+
+			rte_pktmbuf_attach_extbuf(mbuf, (void *)(uintptr_t)packet,
+					RTE_BAD_IOVA, (uint16_t)header.caplen, shinfo);
+			mbuf->data_len = (uint16_t)header.caplen;
+			eth_pcap_rx_mbuf_meta(pcap_q, mbuf, &header);
 		}
 
-		mbuf->pkt_len = (uint16_t)header.caplen;
-		*RTE_MBUF_DYNFIELD(mbuf, timestamp_dynfield_offset,
-			rte_mbuf_timestamp_t *) =
-				(uint64_t)header.ts.tv_sec * 1000000 +
-				header.ts.tv_usec;
-		mbuf->ol_flags |= timestamp_rx_dynflag;
-		mbuf->port = pcap_q->port_id;
 		bufs[num_rx] = mbuf;
 		num_rx++;
 		rx_bytes += header.caplen;
 	}
 	pcap_q->rx_stat.pkts += num_rx;
 	pcap_q->rx_stat.bytes += rx_bytes;
+	pcap_q->rx_stat.err_pkts += pcap_q->shm.errors - errors;
 
 	return num_rx;
 }
@@ -376,6 +637,60 @@ calculate_timestamp(struct timeval *ts) {
 	}
 }
 
+static int open_single_tx_pcap(const char *pcap_filename,
+		pcap_dumper_t **dumper);
+
+/*
+ * tx_rotate mode: a queue writes cap_<queue>_<secs>.pcap files in the
+ * pool naming to its directory. Each is written as .part and renamed
+ * once its index is out, so a file pool never opens one without it.
+ */
+static void
+tx_rotate_close(struct pcap_tx_queue *tx, pcap_dumper_t **dumper)
+{
+	char part[PATH_MAX + 8];
+
+	if (*dumper == NULL)
+		return;
+
+	pcap_dump_close(*dumper);
+	*dumper = NULL;
+
+	if (tx->index.bloom != NULL) {
+		if (rte_pcap_index_write(&tx->index, tx->fname) < 0)
+			PMD_LOG(ERR, "Couldn't write index of %s", tx->fname);
+		rte_pcap_index_free(&tx->index);
+	}
+
+	snprintf(part, sizeof(part), "%s.part", tx->fname);
+	if (rename(part, tx->fname) < 0)
+		PMD_LOG(ERR, "Couldn't rename %s: %s", part, strerror(errno));
+}
+
+static void
+tx_rotate(struct pcap_tx_queue *tx, pcap_dumper_t **dumper,
+		const struct pmd_internals *internals, uint64_t now)
+{
+	char part[PATH_MAX + 8];
+
+	tx_rotate_close(tx, dumper);
+
+	/* a directory that can't be written to is retried next period */
+	tx->rotate_at = now + internals->tx_rotate;
+
+	snprintf(tx->fname, sizeof(tx->fname), "%s/%s_%u_%llu.%s", tx->name,
+		PCAP_FILE_PREFIX, tx->queue_id, (unsigned long long)now,
+		PCAP_FILE_EXTNAME);
+	snprintf(part, sizeof(part), "%s.part", tx->fname);
+
+	if (open_single_tx_pcap(part, dumper) < 0)
+		return;
+
+	if (internals->tx_index &&
+			rte_pcap_index_init(&tx->index, internals->tx_index) < 0)
+		PMD_LOG(WARNING, "No memory to index %s", tx->fname);
+}
+
 /*
  * Callback to handle writing packets to a pcap file.
  */
@@ -386,14 +701,26 @@ eth_pcap_tx_dumper(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
 	struct rte_mbuf *mbuf;
 	struct pmd_process_private *pp;
 	struct pcap_tx_queue *dumper_q = queue;
+	struct pmd_internals *internals;
 	uint16_t num_tx = 0;
 	uint32_t tx_bytes = 0;
 	struct pcap_pkthdr header;
+	struct timeval now;
 	pcap_dumper_t *dumper;
 	unsigned char temp_data[RTE_ETH_PCAP_SNAPLEN];
+	const u_char *data;
 	size_t len, caplen;
 
 	pp = rte_eth_devices[dumper_q->port_id].process_private;
+	internals = rte_eth_devices[dumper_q->port_id].data->dev_private;
+
+	if (internals->tx_rotate && nb_pkts > 0) {
+		calculate_timestamp(&now);
+		if ((uint64_t)now.tv_sec >= dumper_q->rotate_at)
+			tx_rotate(dumper_q, &pp->tx_dumper[dumper_q->queue_id],
+				internals, now.tv_sec);
+	}
+
 	dumper = pp->tx_dumper[dumper_q->queue_id];
 
 	if (dumper == NULL || nb_pkts == 0)
@@ -416,8 +743,15 @@ eth_pcap_tx_dumper(void *queue, struct rte_mbuf **bufs, uint16_t nb_pkts)
 		 * in the mbuf (when the mbuf is contiguous) or, otherwise,
 		 * a pointer to temp_data after copying into it.
 		 */
-		pcap_dump((u_char *)dumper, &header,
-			rte_pktmbuf_read(mbuf, 0, caplen, temp_data));
+		data = rte_pktmbuf_read(mbuf, 0, caplen, temp_data);
+
+		/* dumper timestamps are in nanoseconds, the index uses usec */
+		if (dumper_q->index.bloom != NULL)
+			rte_pcap_index_add(&dumper_q->index,
+				(uint64_t)header.ts.tv_sec * 1000000 +
+				header.ts.tv_usec / 1000, data, caplen);
+
+		pcap_dump((u_char *)dumper, &header, data);
 
 		num_tx++;
 		tx_bytes += caplen;
@@ -632,6 +966,12 @@ eth_dev_start(struct rte_eth_dev *dev)
 	for (i = 0; i < dev->data->nb_tx_queues; i++) {
 		tx = &internals->tx_queue[i];
 
+		/* Rotating dumpers open their first file on the first burst */
+		if (internals->tx_rotate) {
+			tx->rotate_at = 0;
+			continue;
+		}
+
 		if (!pp->tx_dumper[i] &&
 				strcmp(tx->type, ETH_PCAP_TX_PCAP_ARG) == 0) {
 			if (open_single_tx_pcap(tx->name,
@@ -642,12 +982,109 @@ eth_dev_start(struct rte_eth_dev *dev)
 			if (open_single_iface(tx->name, &pp->tx_pcap[i]) < 0)
 				return -1;
 		}
+
+		if (internals->tx_index && tx->index.bloom == NULL &&
+				strcmp(tx->type, ETH_PCAP_TX_PCAP_ARG) == 0 &&
+				rte_pcap_index_init(&tx->index,
+					internals->tx_index) < 0)
+			PMD_LOG(WARNING, "No memory to index %s", tx->name);
+	}
+
+	/* Streams keep their own double buffer, no file pool behind them */
+	if (internals->rx_stream) {
+		for (i = 0; i < dev->data->nb_rx_queues; i++) {
+			rx = &internals->rx_queue[i];
+			rx->numa_checked = 0;
+
+			if (rx->stream.buf[0] != NULL)
+				continue;
+
+			if (rte_pcap_stream_open(&rx->stream, rx->name,
+					rx->socket_id) < 0) {
+				PMD_LOG(ERR, "Couldn't open pcap stream %s",
+					rx->name);
+				return -1;
+			}
+		}
+
+		goto status_up;
+	}
+
+	if (internals->rx_shm) {
+		for (i = 0; i < dev->data->nb_rx_queues; i++) {
+			rx = &internals->rx_queue[i];
+			rx->numa_checked = 0;
+
+			if (rx->shm.ring != NULL)
+				continue;
+
+			if (rte_pcap_shm_open(&rx->shm, rx->name,
+					rx->socket_id) < 0) {
+				PMD_LOG(ERR, "Couldn't attach to shared memory ring at %s",
+					rx->name);
+				return -1;
+			}
+		}
+
+		goto status_up;
 	}
 
 	/* If not open already, open rx pcaps */
 	for (i = 0; i < dev->data->nb_rx_queues; i++) {
 		rx = &internals->rx_queue[i];
 		rte_pcap_file_pool_init(&rx->fpool,rx->name);
+
+		if (internals->numa_bind &&
+				(rx->socket_id < 0 || rx->socket_id >= RTE_MAX_NUMA_NODES))
+			PMD_LOG(WARNING,
+				"rx queue %u has no socket to bind to (%d), numa_bind ignored",
+				i, rx->socket_id);
+
+		if (rte_pcap_file_pool_numa_setup(&rx->fpool, rx->socket_id,
+				internals->numa_bind) < 0)
+			PMD_LOG(WARNING,
+				"No reader buffer for rx queue %u on socket %d, using libpcap default",
+				i, rx->socket_id);
+
+		rx->numa_checked = 0;
+
+		rte_pcap_file_pool_filter_set(&rx->fpool,
+				&internals->rx_filter);
+	}
+
+	/* Scan the shared file once, then give each queue its own range */
+	if (internals->rx_split) {
+		struct rte_pcap_file_split *split = &internals->split;
+
+		if (rte_pcap_file_split_load(split, internals->rx_queue[0].name,
+				dev->data->nb_rx_queues) < 0 &&
+				rte_pcap_file_split_scan(split,
+				internals->rx_queue[0].name,
+				dev->data->nb_rx_queues) < 0) {
+			PMD_LOG(ERR, "Couldn't split pcap file %s into %u ranges",
+				internals->rx_queue[0].name,
+				dev->data->nb_rx_queues);
+			return -1;
+		}
+
+		for (i = 0; i < dev->data->nb_rx_queues; i++) {
+			rx = &internals->rx_queue[i];
+
+			if (rte_pcap_split_reader_open(&rx->sreader, split, i,
+					rx->fpool.rbuf, rx->fpool.rbuf_size) < 0) {
+				PMD_LOG(ERR, "Couldn't open range %u of %s",
+					i, split->fname);
+				while (i-- > 0)
+					rte_pcap_split_reader_close(
+						&internals->rx_queue[i].sreader);
+				return -1;
+			}
+
+			PMD_LOG(INFO, "rx queue %u reads %s [%" PRIu64 ", %" PRIu64
+				"), %" PRIu64 " packets",
+				i, split->fname, split->ranges[i].start,
+				split->ranges[i].end, split->ranges[i].pkts);
+		}
 	}
 
 status_up:
@@ -673,6 +1110,7 @@ eth_dev_stop(struct rte_eth_dev *dev)
 	unsigned int i;
 	struct pmd_internals *internals = dev->data->dev_private;
 	struct pmd_process_private *pp = dev->process_private;
+	struct pcap_rx_queue *rx;
 
 	/* Special iface case. Single pcap is open and shared between tx/rx. */
 	if (internals->single_iface) {
@@ -686,11 +1124,26 @@ eth_dev_stop(struct rte_eth_dev *dev)
 	}
 
 	for (i = 0; i < dev->data->nb_tx_queues; i++) {
+		struct pcap_tx_queue *tx = &internals->tx_queue[i];
+
+		if (internals->tx_rotate) {
+			tx_rotate_close(tx, &pp->tx_dumper[i]);
+			continue;
+		}
+
 		if (pp->tx_dumper[i] != NULL) {
 			pcap_dump_close(pp->tx_dumper[i]);
 			pp->tx_dumper[i] = NULL;
 		}
 
+		/* The index goes next to the now complete capture file */
+		if (tx->index.bloom != NULL) {
+			if (rte_pcap_index_write(&tx->index, tx->name) < 0)
+				PMD_LOG(ERR, "Couldn't write index of %s",
+					tx->name);
+			rte_pcap_index_free(&tx->index);
+		}
+
 		if (pp->tx_pcap[i] != NULL) {
 			pcap_close(pp->tx_pcap[i]);
 			pp->tx_pcap[i] = NULL;
@@ -700,7 +1153,27 @@ eth_dev_stop(struct rte_eth_dev *dev)
 	for (i = 0; i < dev->data->nb_rx_queues; i++) {
 		rx = &internals->rx_queue[i];
 
-        rte_pcap_file_pool_init(&rx->fpool,rx->name);
+		if (internals->rx_stream) {
+			rte_pcap_stream_close(&rx->stream);
+			continue;
+		}
+
+		if (internals->rx_shm) {
+			if (rx->shm.ring == NULL)
+				continue;
+
+			rte_pcap_shm_reclaim(&rx->shm);
+			if (rte_pcap_shm_inflight(&rx->shm))
+				PMD_LOG(WARNING,
+					"%u packets of %s still held, ring left mapped",
+					rte_pcap_shm_inflight(&rx->shm), rx->name);
+			rte_pcap_shm_close(&rx->shm);
+			continue;
+		}
+
+		rte_pcap_split_reader_close(&rx->sreader);
+		rte_pcap_file_pool_fin(&rx->fpool);
+		rte_pcap_file_pool_init(&rx->fpool,rx->name);
 	}
 
 status_down:
@@ -864,7 +1337,7 @@ static int
 eth_rx_queue_setup(struct rte_eth_dev *dev,
 		uint16_t rx_queue_id,
 		uint16_t nb_rx_desc __rte_unused,
-		unsigned int socket_id __rte_unused,
+		unsigned int socket_id,
 		const struct rte_eth_rxconf *rx_conf __rte_unused,
 		struct rte_mempool *mb_pool)
 {
@@ -874,8 +1347,19 @@ eth_rx_queue_setup(struct rte_eth_dev *dev,
 	pcap_q->mb_pool = mb_pool;
 	pcap_q->port_id = dev->data->port_id;
 	pcap_q->queue_id = rx_queue_id;
+	pcap_q->socket_id = (int)socket_id;
+	pcap_q->numa_checked = 0;
 	dev->data->rx_queues[rx_queue_id] = pcap_q;
 
+	if (pcap_q->socket_id != SOCKET_ID_ANY &&
+			mb_pool->socket_id != SOCKET_ID_ANY &&
+			mb_pool->socket_id != pcap_q->socket_id)
+		PMD_LOG(WARNING,
+			"port %u rx queue %u on socket %d uses mempool %s from socket %d, "
+			"every packet copy will cross sockets",
+			pcap_q->port_id, rx_queue_id, pcap_q->socket_id,
+			mb_pool->name, mb_pool->socket_id);
+
 	if (internals->infinite_rx) {
 		struct pmd_process_private *pp;
 		char ring_name[RTE_RING_NAMESIZE];
@@ -1062,6 +1546,24 @@ open_tx_pcap(const char *key, const char *value, void *extra_args)
 	return 0;
 }
 
+/*
+ * tx_rotate mode: the tx_pcap value is the directory the rotated files
+ * go to, nothing is opened before the first burst.
+ */
+static int
+open_tx_pcap_dir(const char *key, const char *value, void *extra_args)
+{
+	struct pmd_devargs *dumpers = extra_args;
+	struct stat st;
+
+	if (stat(value, &st) < 0 || !S_ISDIR(st.st_mode)) {
+		PMD_LOG(ERR, "%s is not a directory to rotate files in", value);
+		return -1;
+	}
+
+	return add_queue(dumpers, value, key, NULL, NULL);
+}
+
 /*
  * Opens an interface for reading and writing
  */
@@ -1182,6 +1684,90 @@ get_infinite_rx_arg(const char *key __rte_unused,
 	return 0;
 }
 
+static int
+get_rx_split_arg(const char *key __rte_unused,
+		const char *value, void *extra_args)
+{
+	if (extra_args) {
+		const int rx_split = atoi(value);
+		unsigned int *nb_split = extra_args;
+
+		if (rx_split < 0 || rx_split > RTE_PMD_PCAP_MAX_QUEUES)
+			return -1;
+
+		*nb_split = rx_split > 1 ? rx_split : 0;
+	}
+	return 0;
+}
+
+static int
+get_tx_index_arg(const char *key __rte_unused,
+		const char *value, void *extra_args)
+{
+	if (extra_args) {
+		const int stride = atoi(value);
+		unsigned int *tx_index = extra_args;
+
+		if (stride < 0)
+			return -1;
+
+		*tx_index = stride;
+	}
+	return 0;
+}
+
+static int
+get_tx_rotate_arg(const char *key __rte_unused,
+		const char *value, void *extra_args)
+{
+	if (extra_args) {
+		const int secs = atoi(value);
+		unsigned int *tx_rotate = extra_args;
+
+		if (secs < 0)
+			return -1;
+
+		*tx_rotate = secs;
+	}
+	return 0;
+}
+
+static int
+get_rx_filter_arg(const char *key,
+		const char *value, void *extra_args)
+{
+	struct rte_pcap_index_filter *filter = extra_args;
+
+	if (filter == NULL)
+		return 0;
+
+	if (strcmp(key, ETH_PCAP_RX_TS_FROM_ARG) == 0)
+		filter->ts_from = strtoull(value, NULL, 10);
+	else if (strcmp(key, ETH_PCAP_RX_TS_TO_ARG) == 0)
+		filter->ts_to = strtoull(value, NULL, 10);
+	else if (strcmp(key, ETH_PCAP_RX_IP_ARG) == 0 &&
+			rte_pcap_index_filter_add_ip(filter, value) < 0) {
+		PMD_LOG(ERR, "Invalid or too many %s: %s", key, value);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+get_numa_bind_arg(const char *key __rte_unused,
+		const char *value, void *extra_args)
+{
+	if (extra_args) {
+		const int numa_bind = atoi(value);
+		unsigned int *enable_numa_bind = extra_args;
+
+		if (numa_bind > 0)
+			*enable_numa_bind = 1;
+	}
+	return 0;
+}
+
 static int
 pmd_init_internals(struct rte_vdev_device *vdev,
 		const unsigned int nb_rx_queues,
@@ -1341,9 +1927,22 @@ eth_from_pcaps(struct rte_vdev_device *vdev,
 	}
 
 	internals->infinite_rx = infinite_rx;
+	internals->numa_bind = devargs_all->numa_bind;
+	internals->rx_split = devargs_all->rx_split;
+	internals->tx_index = devargs_all->tx_index;
+	internals->tx_rotate = devargs_all->tx_rotate;
+	internals->rx_filter = devargs_all->rx_filter;
+	internals->rx_stream = devargs_all->is_rx_stream;
+	internals->rx_shm = devargs_all->is_rx_shm;
 	/* Assign rx ops. */
 	if (infinite_rx)
 		eth_dev->rx_pkt_burst = eth_pcap_rx_infinite;
+	else if (devargs_all->is_rx_stream)
+		eth_dev->rx_pkt_burst = eth_pcap_rx_stream;
+	else if (devargs_all->is_rx_shm)
+		eth_dev->rx_pkt_burst = eth_pcap_rx_shm;
+	else if (devargs_all->rx_split)
+		eth_dev->rx_pkt_burst = eth_pcap_rx_split;
 	else if (devargs_all->is_rx_pcap || devargs_all->is_rx_iface ||
 			single_iface)
 		eth_dev->rx_pkt_burst = eth_pcap_rx;
@@ -1473,6 +2072,10 @@ pmd_pcap_probe(struct rte_vdev_device *dev)
 	 */
 	devargs_all.is_rx_pcap =
 		rte_kvargs_count(kvlist, ETH_PCAP_RX_PCAP_ARG) ? 1 : 0;
+	devargs_all.is_rx_stream =
+		rte_kvargs_count(kvlist, ETH_PCAP_RX_STREAM_ARG) ? 1 : 0;
+	devargs_all.is_rx_shm =
+		rte_kvargs_count(kvlist, ETH_PCAP_RX_SHM_ARG) ? 1 : 0;
 	devargs_all.is_rx_iface =
 		(rte_kvargs_count(kvlist, ETH_PCAP_RX_IFACE_ARG) +
 		 rte_kvargs_count(kvlist, ETH_PCAP_RX_IFACE_IN_ARG)) ? 1 : 0;
@@ -1484,7 +2087,24 @@ pmd_pcap_probe(struct rte_vdev_device *dev)
 		rte_kvargs_count(kvlist, ETH_PCAP_TX_IFACE_ARG) ? 1 : 0;
 	dumpers.num_of_queue = 0;
 
-	if (devargs_all.is_rx_pcap) {
+	if (devargs_all.is_rx_pcap + devargs_all.is_rx_stream +
+			devargs_all.is_rx_shm > 1) {
+		PMD_LOG(ERR, "%s, %s and %s can't be mixed on one device",
+			ETH_PCAP_RX_PCAP_ARG, ETH_PCAP_RX_STREAM_ARG,
+			ETH_PCAP_RX_SHM_ARG);
+		ret = -EINVAL;
+		goto free_kvlist;
+	}
+
+	if (devargs_all.is_rx_stream) {
+		/* Only the path is kept, streams are opened on start */
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_STREAM_ARG,
+				&open_rx_pcap, &pcaps);
+	} else if (devargs_all.is_rx_shm) {
+		/* One producer socket per queue, attached on start */
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_SHM_ARG,
+				&open_rx_pcap, &pcaps);
+	} else if (devargs_all.is_rx_pcap) {
 		/*
 		 * We check whether we want to infinitely rx the pcap file.
 		 */
@@ -1508,8 +2128,51 @@ pmd_pcap_probe(struct rte_vdev_device *dev)
 					"for %s", name);
 		}
 
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_NUMA_BIND_ARG,
+				&get_numa_bind_arg, &devargs_all.numa_bind);
+		if (ret < 0)
+			goto free_kvlist;
+
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_SPLIT_ARG,
+				&get_rx_split_arg, &devargs_all.rx_split);
+		if (ret < 0)
+			goto free_kvlist;
+
+		/* Files and ranges outside these are skipped by their index */
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_TS_FROM_ARG,
+				&get_rx_filter_arg, &devargs_all.rx_filter);
+		if (ret == 0)
+			ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_TS_TO_ARG,
+				&get_rx_filter_arg, &devargs_all.rx_filter);
+		if (ret == 0)
+			ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_IP_ARG,
+				&get_rx_filter_arg, &devargs_all.rx_filter);
+		if (ret < 0)
+			goto free_kvlist;
+
 		ret = rte_kvargs_process(kvlist, ETH_PCAP_RX_PCAP_ARG,
 				&open_rx_pcap, &pcaps);
+
+		/*
+		 * rx_split: one rx_pcap file is read by rx_split queues,
+		 * each of them gets a copy of the file queue.
+		 */
+		if (ret == 0 && devargs_all.rx_split) {
+			unsigned int i;
+
+			if (pcaps.num_of_queue != 1 || devargs_all.infinite_rx) {
+				PMD_LOG(ERR, "%s needs exactly one %s and no %s",
+					ETH_PCAP_RX_SPLIT_ARG,
+					ETH_PCAP_RX_PCAP_ARG,
+					ETH_PCAP_INFINITE_RX_ARG);
+				ret = -EINVAL;
+				goto free_kvlist;
+			}
+
+			for (i = 1; i < devargs_all.rx_split && ret == 0; i++)
+				ret = add_queue(&pcaps, pcaps.queue[0].name,
+						pcaps.queue[0].type, NULL, NULL);
+		}
 	} else if (devargs_all.is_rx_iface) {
 		ret = rte_kvargs_process(kvlist, NULL,
 				&rx_iface_args_process, &pcaps);
@@ -1541,7 +2204,18 @@ pmd_pcap_probe(struct rte_vdev_device *dev)
 	 * a pcap file, or drop packets on tx
 	 */
 	if (devargs_all.is_tx_pcap) {
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_TX_INDEX_ARG,
+				&get_tx_index_arg, &devargs_all.tx_index);
+		if (ret < 0)
+			goto free_kvlist;
+
+		ret = rte_kvargs_process(kvlist, ETH_PCAP_TX_ROTATE_ARG,
+				&get_tx_rotate_arg, &devargs_all.tx_rotate);
+		if (ret < 0)
+			goto free_kvlist;
+
 		ret = rte_kvargs_process(kvlist, ETH_PCAP_TX_PCAP_ARG,
+				devargs_all.tx_rotate ? &open_tx_pcap_dir :
 				&open_tx_pcap, &dumpers);
 	} else if (devargs_all.is_tx_iface) {
 		ret = rte_kvargs_process(kvlist, ETH_PCAP_TX_IFACE_ARG,
@@ -1591,7 +2265,14 @@ create_eth:
 		}
 
 		eth_dev->process_private = pp;
-		eth_dev->rx_pkt_burst = eth_pcap_rx;
+		if (internal->rx_stream)
+			eth_dev->rx_pkt_burst = eth_pcap_rx_stream;
+		else if (internal->rx_shm)
+			eth_dev->rx_pkt_burst = eth_pcap_rx_shm;
+		else if (internal->rx_split)
+			eth_dev->rx_pkt_burst = eth_pcap_rx_split;
+		else
+			eth_dev->rx_pkt_burst = eth_pcap_rx;
 		if (devargs_all.is_tx_pcap)
 			eth_dev->tx_pkt_burst = eth_pcap_tx_dumper;
 		else
@@ -1648,4 +2329,13 @@ RTE_PMD_REGISTER_PARAM_STRING(net_pcap,
 	ETH_PCAP_TX_IFACE_ARG "=<ifc> "
 	ETH_PCAP_IFACE_ARG "=<ifc> "
 	ETH_PCAP_PHY_MAC_ARG "=<int>"
-	ETH_PCAP_INFINITE_RX_ARG "=<0|1>");
+	ETH_PCAP_INFINITE_RX_ARG "=<0|1> "
+	ETH_PCAP_NUMA_BIND_ARG "=<0|1> "
+	ETH_PCAP_RX_SPLIT_ARG "=<int> "
+	ETH_PCAP_TX_INDEX_ARG "=<int> "
+	ETH_PCAP_TX_ROTATE_ARG "=<int> "
+	ETH_PCAP_RX_TS_FROM_ARG "=<usec> "
+	ETH_PCAP_RX_TS_TO_ARG "=<usec> "
+	ETH_PCAP_RX_IP_ARG "=<ip> "
+	ETH_PCAP_RX_STREAM_ARG "=<path|-> "
+	ETH_PCAP_RX_SHM_ARG "=<socket>");
@@ -0,0 +1,438 @@
+#include "rte_pcap_file_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define PCAP_INDEX_NAME_LEN 1024
+#define PCAP_INDEX_FILE_HDR_LEN 24
+#define PCAP_INDEX_REC_HDR_LEN 16
+#define PCAP_INDEX_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_INDEX_MAGIC_NSEC 0xa1b23c4d
+
+#define ETHER_HDR_LEN 14
+#define ETHER_TYPE_VLAN 0x8100
+#define ETHER_TYPE_QINQ 0x88a8
+#define ETHER_TYPE_IPV4 0x0800
+#define ETHER_TYPE_IPV6 0x86dd
+
+static inline uint64_t fmix64(uint64_t k){
+
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+static uint64_t ip_hash(const uint8_t *addr,uint8_t len){
+
+    uint64_t h = len,w;
+    uint8_t i;
+
+    for(i = 0;i<len;i += 4){
+
+        uint32_t v;
+        memcpy(&v,addr+i,sizeof(v));
+        w = v;
+        h = fmix64(h^w);
+    }
+
+    return h;
+}
+
+static void bloom_add(struct rte_pcap_index *idx,const uint8_t *addr,uint8_t len){
+
+    uint64_t h = ip_hash(addr,len);
+    uint32_t h1 = (uint32_t)h,h2 = (uint32_t)(h>>32);
+    uint32_t i,bit;
+
+    for(i = 0;i<idx->hdr.bloom_hashes;i++){
+
+        bit = (h1+i*h2)%idx->hdr.bloom_bits;
+        idx->bloom[bit>>6] |= 1ULL<<(bit&63);
+    }
+}
+
+int rte_pcap_index_has_ip(const struct rte_pcap_index *idx,const uint8_t *addr,uint8_t len){
+
+    uint64_t h = ip_hash(addr,len);
+    uint32_t h1 = (uint32_t)h,h2 = (uint32_t)(h>>32);
+    uint32_t i,bit;
+
+    for(i = 0;i<idx->hdr.bloom_hashes;i++){
+
+        bit = (h1+i*h2)%idx->hdr.bloom_bits;
+        if((idx->bloom[bit>>6]&(1ULL<<(bit&63))) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+static inline uint16_t rd16be(const u_char *p){
+
+    return (uint16_t)((p[0]<<8)|p[1]);
+}
+
+/*minimal L2/L3 walk,just enough to find the addresses*/
+static void index_pkt_ips(struct rte_pcap_index *idx,const u_char *data,uint32_t caplen){
+
+    uint32_t off = ETHER_HDR_LEN;
+    uint16_t type;
+
+    if(caplen<ETHER_HDR_LEN)
+        return;
+
+    type = rd16be(data+12);
+
+    while((type == ETHER_TYPE_VLAN||type == ETHER_TYPE_QINQ)&&off+4<=caplen){
+        type = rd16be(data+off+2);
+        off += 4;
+    }
+
+    if(type == ETHER_TYPE_IPV4&&off+20<=caplen){
+
+        bloom_add(idx,data+off+12,4);
+        bloom_add(idx,data+off+16,4);
+    }else if(type == ETHER_TYPE_IPV6&&off+40<=caplen){
+
+        bloom_add(idx,data+off+8,16);
+        bloom_add(idx,data+off+24,16);
+    }
+}
+
+static void index_reset(struct rte_pcap_index *idx,uint32_t stride){
+
+    memset(&idx->hdr,0,sizeof(idx->hdr));
+
+    idx->hdr.magic = PCAP_INDEX_MAGIC;
+    idx->hdr.version = PCAP_INDEX_VERSION;
+    idx->hdr.hdr_len = sizeof(idx->hdr);
+    idx->hdr.stride = stride;
+    idx->hdr.bloom_bits = PCAP_INDEX_BLOOM_BITS;
+    idx->hdr.bloom_hashes = PCAP_INDEX_BLOOM_HASHES;
+
+    idx->offset = PCAP_INDEX_FILE_HDR_LEN;
+}
+
+int rte_pcap_index_init(struct rte_pcap_index *idx,uint32_t stride){
+
+    index_reset(idx,stride == 0?PCAP_INDEX_STRIDE_DEFAULT:stride);
+
+    idx->max_points = 0;
+    idx->points = NULL;
+
+    idx->bloom = calloc(PCAP_INDEX_BLOOM_BITS/64,sizeof(uint64_t));
+    if(idx->bloom == NULL)
+        return -1;
+
+    return 0;
+}
+
+void rte_pcap_index_free(struct rte_pcap_index *idx){
+
+    free(idx->points);
+    free(idx->bloom);
+
+    idx->points = NULL;
+    idx->bloom = NULL;
+    idx->max_points = 0;
+    idx->hdr.nb_points = 0;
+}
+
+static struct rte_pcap_index_point * new_point(struct rte_pcap_index *idx){
+
+    struct rte_pcap_index_point *points;
+    uint32_t n;
+
+    if(idx->hdr.nb_points == idx->max_points){
+
+        n = idx->max_points?idx->max_points*2:256;
+        points = realloc(idx->points,n*sizeof(*points));
+        if(points == NULL)
+            return NULL;
+
+        idx->points = points;
+        idx->max_points = n;
+    }
+
+    return &idx->points[idx->hdr.nb_points++];
+}
+
+void rte_pcap_index_add(struct rte_pcap_index *idx,uint64_t ts,const u_char *data,uint32_t caplen){
+
+    struct rte_pcap_index_point *point;
+
+    if(idx->bloom == NULL)
+        return;
+
+    if(idx->hdr.pkts%idx->hdr.stride == 0){
+
+        point = new_point(idx);
+        if(point == NULL){
+            /*out of memory,stop indexing rather than write a wrong index*/
+            rte_pcap_index_free(idx);
+            return;
+        }
+
+        point->offset = idx->offset;
+        point->ts_min = ts;
+        point->ts_max = ts;
+    }else{
+
+        point = &idx->points[idx->hdr.nb_points-1];
+        if(ts<point->ts_min)
+            point->ts_min = ts;
+        if(ts>point->ts_max)
+            point->ts_max = ts;
+    }
+
+    if(idx->hdr.pkts == 0||ts<idx->hdr.ts_min)
+        idx->hdr.ts_min = ts;
+    if(ts>idx->hdr.ts_max)
+        idx->hdr.ts_max = ts;
+
+    index_pkt_ips(idx,data,caplen);
+
+    idx->hdr.pkts++;
+    idx->offset += PCAP_INDEX_REC_HDR_LEN+caplen;
+}
+
+static void index_fname(char *buf,const char *pcap_fname){
+
+    snprintf(buf,PCAP_INDEX_NAME_LEN,"%s.%s",pcap_fname,PCAP_INDEX_EXTNAME);
+}
+
+int rte_pcap_index_write(struct rte_pcap_index *idx,const char *pcap_fname){
+
+    char fname[PCAP_INDEX_NAME_LEN];
+    char tmp_fname[PCAP_INDEX_NAME_LEN+8];
+    FILE *fp;
+    int rc = 0;
+
+    if(idx->bloom == NULL)
+        return -1;
+
+    index_fname(fname,pcap_fname);
+    snprintf(tmp_fname,sizeof(tmp_fname),"%s.tmp",fname);
+
+    fp = fopen(tmp_fname,"wb");
+    if(fp == NULL)
+        return -1;
+
+    if(fwrite(&idx->hdr,sizeof(idx->hdr),1,fp)!=1)
+        rc = -1;
+
+    if(rc == 0&&idx->hdr.nb_points&&
+            fwrite(idx->points,sizeof(*idx->points),idx->hdr.nb_points,fp)!=idx->hdr.nb_points)
+        rc = -1;
+
+    if(rc == 0&&fwrite(idx->bloom,idx->hdr.bloom_bits/8,1,fp)!=1)
+        rc = -1;
+
+    if(fclose(fp))
+        rc = -1;
+
+    /*readers only ever see a complete index*/
+    if(rc == 0&&rename(tmp_fname,fname))
+        rc = -1;
+
+    if(rc)
+        unlink(tmp_fname);
+
+    return rc;
+}
+
+static inline int is_pcap_magic(uint32_t magic){
+
+    return magic == PCAP_INDEX_MAGIC_USEC||magic == PCAP_INDEX_MAGIC_NSEC||
+        magic == __builtin_bswap32(PCAP_INDEX_MAGIC_USEC)||magic == __builtin_bswap32(PCAP_INDEX_MAGIC_NSEC);
+}
+
+int rte_pcap_index_build(struct rte_pcap_index *idx,const char *pcap_fname,uint32_t stride){
+
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    uint32_t magic;
+    pcap_t *pcap;
+    FILE *fp;
+
+    fp = fopen(pcap_fname,"rb");
+    if(fp == NULL)
+        return -1;
+
+    /*the offsets are of pcap records,pcapng blocks can't be indexed*/
+    if(fread(&magic,sizeof(magic),1,fp)!=1||!is_pcap_magic(magic)||fseek(fp,0,SEEK_SET)){
+        fclose(fp);
+        return -1;
+    }
+
+    pcap = pcap_fopen_offline(fp,errbuf);
+    if(pcap == NULL){
+        fclose(fp);
+        return -1;
+    }
+
+    if(rte_pcap_index_init(idx,stride)){
+        pcap_close(pcap);
+        return -1;
+    }
+
+    /*a truncated last record ends the index where the readers stop too*/
+    while(pcap_next_ex(pcap,&hdr,&data) == 1)
+        rte_pcap_index_add(idx,(uint64_t)hdr->ts.tv_sec*1000000+hdr->ts.tv_usec,data,hdr->caplen);
+
+    pcap_close(pcap);
+
+    /*out of memory on the way*/
+    if(idx->bloom == NULL)
+        return -1;
+
+    return 0;
+}
+
+int rte_pcap_index_load(struct rte_pcap_index *idx,const char *pcap_fname){
+
+    char fname[PCAP_INDEX_NAME_LEN];
+    FILE *fp;
+    struct rte_pcap_index_hdr hdr;
+
+    idx->points = NULL;
+    idx->bloom = NULL;
+    idx->max_points = 0;
+
+    index_fname(fname,pcap_fname);
+
+    fp = fopen(fname,"rb");
+    if(fp == NULL)
+        return -1;
+
+    if(fread(&hdr,sizeof(hdr),1,fp)!=1||hdr.magic!=PCAP_INDEX_MAGIC||
+            hdr.version!=PCAP_INDEX_VERSION||hdr.hdr_len!=sizeof(hdr)||
+            hdr.stride == 0||hdr.bloom_bits == 0||hdr.bloom_bits%64)
+        goto fail;
+
+    idx->hdr = hdr;
+    idx->points = malloc((hdr.nb_points?hdr.nb_points:1)*sizeof(*idx->points));
+    idx->bloom = malloc(hdr.bloom_bits/8);
+
+    if(idx->points == NULL||idx->bloom == NULL)
+        goto fail;
+
+    idx->max_points = hdr.nb_points;
+
+    if(hdr.nb_points&&fread(idx->points,sizeof(*idx->points),hdr.nb_points,fp)!=hdr.nb_points)
+        goto fail;
+
+    if(fread(idx->bloom,hdr.bloom_bits/8,1,fp)!=1)
+        goto fail;
+
+    fclose(fp);
+
+    return 0;
+
+fail:
+    fclose(fp);
+    rte_pcap_index_free(idx);
+
+    return -1;
+}
+
+void rte_pcap_index_unlink(const char *pcap_fname){
+
+    char fname[PCAP_INDEX_NAME_LEN];
+
+    index_fname(fname,pcap_fname);
+    unlink(fname);
+}
+
+int rte_pcap_index_filter_add_ip(struct rte_pcap_index_filter *filter,const char *ip){
+
+    uint8_t len;
+
+    if(filter->nb_ips>=PCAP_INDEX_MAX_IPS)
+        return -1;
+
+    if(inet_pton(AF_INET,ip,filter->ips[filter->nb_ips].addr) == 1)
+        len = 4;
+    else if(inet_pton(AF_INET6,ip,filter->ips[filter->nb_ips].addr) == 1)
+        len = 16;
+    else
+        return -1;
+
+    filter->ips[filter->nb_ips].len = len;
+    filter->nb_ips++;
+
+    return 0;
+}
+
+static inline int point_match(const struct rte_pcap_index_point *point,
+        const struct rte_pcap_index_filter *filter){
+
+    if(filter->ts_from&&point->ts_max<filter->ts_from)
+        return 0;
+
+    if(filter->ts_to&&point->ts_min>filter->ts_to)
+        return 0;
+
+    return 1;
+}
+
+int rte_pcap_index_select(const struct rte_pcap_index *idx,const struct rte_pcap_index_filter *filter,
+        uint64_t *start,uint64_t *pkts){
+
+    uint32_t first,last;
+    uint64_t end_pkt;
+    uint16_t i;
+
+    if(idx->hdr.nb_points == 0)
+        return 0;
+
+    if(filter->nb_ips){
+
+        for(i = 0;i<filter->nb_ips;i++){
+            if(rte_pcap_index_has_ip(idx,filter->ips[i].addr,filter->ips[i].len))
+                break;
+        }
+
+        if(i == filter->nb_ips)
+            return 0;
+    }
+
+    for(first = 0;first<idx->hdr.nb_points;first++){
+        if(point_match(&idx->points[first],filter))
+            break;
+    }
+
+    if(first == idx->hdr.nb_points)
+        return 0;
+
+    for(last = idx->hdr.nb_points-1;last>first;last--){
+        if(point_match(&idx->points[last],filter))
+            break;
+    }
+
+    end_pkt = (uint64_t)(last+1)*idx->hdr.stride;
+    if(end_pkt>idx->hdr.pkts)
+        end_pkt = idx->hdr.pkts;
+
+    *start = idx->points[first].offset;
+    *pkts = end_pkt-(uint64_t)first*idx->hdr.stride;
+
+    return 1;
+}
+
+void rte_pcap_index_dump(struct rte_pcap_index *idx,FILE *out){
+
+    fprintf(out,"index.stride:%lu\n",(unsigned long)idx->hdr.stride);
+    fprintf(out,"index.points:%lu\n",(unsigned long)idx->hdr.nb_points);
+    fprintf(out,"index.pkts:%llu\n",(unsigned long long)idx->hdr.pkts);
+    fprintf(out,"index.ts:[%llu,%llu]\n",(unsigned long long)idx->hdr.ts_min,
+            (unsigned long long)idx->hdr.ts_max);
+    fprintf(out,"index.bloom:%lu bits,%lu hashes\n",(unsigned long)idx->hdr.bloom_bits,
+            (unsigned long)idx->hdr.bloom_hashes);
+}
@@ -0,0 +1,120 @@
+#ifndef _RTE_PCAP_FILE_INDEX_H_
+#define _RTE_PCAP_FILE_INDEX_H_
+
+#include <pcap.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Sidecar record index written next to a capture file as <file>.idx:
+ *
+ *   rte_pcap_index_hdr
+ *   rte_pcap_index_point[nb_points]   one per stride records
+ *   uint64_t bloom[bloom_bits/64]     every IPv4/IPv6 address in the file
+ *
+ * Fields are stored in host byte order.
+ */
+
+#define PCAP_INDEX_MAGIC 0x58444950 /*PIDX*/
+#define PCAP_INDEX_VERSION 1
+#define PCAP_INDEX_EXTNAME "idx"
+
+#define PCAP_INDEX_STRIDE_DEFAULT 1024
+#define PCAP_INDEX_BLOOM_BITS (64*1024)
+#define PCAP_INDEX_BLOOM_HASHES 3
+
+#define PCAP_INDEX_MAX_IPS 8
+
+struct rte_pcap_index_hdr {
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_len;
+
+    uint32_t stride;
+    uint32_t nb_points;
+
+    uint64_t pkts;
+
+    /*usec*/
+    uint64_t ts_min;
+    uint64_t ts_max;
+
+    uint32_t bloom_bits;
+    uint32_t bloom_hashes;
+};
+
+struct rte_pcap_index_point {
+
+    uint64_t offset; /*file offset of record number i*stride*/
+
+    uint64_t ts_min;
+    uint64_t ts_max;
+};
+
+struct rte_pcap_index {
+
+    struct rte_pcap_index_hdr hdr;
+
+    struct rte_pcap_index_point *points;
+    uint32_t max_points;
+
+    uint64_t *bloom;
+
+    /*writer:offset of the next record*/
+    uint64_t offset;
+};
+
+struct rte_pcap_index_filter {
+
+    /*usec,0 means open*/
+    uint64_t ts_from;
+    uint64_t ts_to;
+
+    uint16_t nb_ips;
+
+    struct {
+        uint8_t len;
+        uint8_t addr[16];
+    }ips[PCAP_INDEX_MAX_IPS];
+};
+
+int rte_pcap_index_init(struct rte_pcap_index *idx,uint32_t stride);
+
+void rte_pcap_index_free(struct rte_pcap_index *idx);
+
+/*account the record about to be written at idx->offset*/
+void rte_pcap_index_add(struct rte_pcap_index *idx,uint64_t ts,const u_char *data,uint32_t caplen);
+
+int rte_pcap_index_write(struct rte_pcap_index *idx,const char *pcap_fname);
+
+/*
+ * Index a capture file already on disk,for files written by other tools.
+ * Only classic pcap,idx is left freed on failure.
+ */
+int rte_pcap_index_build(struct rte_pcap_index *idx,const char *pcap_fname,uint32_t stride);
+
+int rte_pcap_index_load(struct rte_pcap_index *idx,const char *pcap_fname);
+
+void rte_pcap_index_unlink(const char *pcap_fname);
+
+int rte_pcap_index_has_ip(const struct rte_pcap_index *idx,const uint8_t *addr,uint8_t len);
+
+static inline int rte_pcap_index_filter_on(const struct rte_pcap_index_filter *filter){
+
+    return filter&&(filter->ts_from||filter->ts_to||filter->nb_ips);
+}
+
+int rte_pcap_index_filter_add_ip(struct rte_pcap_index_filter *filter,const char *ip);
+
+/*
+ * Decide what part of the indexed file the filter needs:
+ * returns 0 if the whole file can be skipped,
+ * otherwise 1 with the first record offset and the record count to read.
+ */
+int rte_pcap_index_select(const struct rte_pcap_index *idx,const struct rte_pcap_index_filter *filter,
+        uint64_t *start,uint64_t *pkts);
+
+void rte_pcap_index_dump(struct rte_pcap_index *idx,FILE *out);
+
+#endif /*_RTE_PCAP_FILE_INDEX_H_*/
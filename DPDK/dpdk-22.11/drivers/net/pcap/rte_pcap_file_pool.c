@@ -1,9 +1,34 @@
 #include "rte_pcap_file_pool.h"
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_malloc.h>
+
+#ifdef RTE_HAS_LIBNUMA
+#include <numaif.h>
+#endif
 
 static char errbuf[PCAP_ERRBUF_SIZE];
 
+static inline int _numa_node_valid(int socket_id){
+
+    return socket_id>=0&&socket_id<RTE_MAX_NUMA_NODES;
+}
+
+#ifdef RTE_HAS_LIBNUMA
+static inline void _numa_mask(unsigned long *mask,int socket_id){
+
+    const unsigned int bits = sizeof(unsigned long)*8;
+
+    memset(mask,0,sizeof(unsigned long)*PCAP_FILE_NUMA_MASK_LONGS);
+    mask[socket_id/bits] |= 1UL<<(socket_id%bits);
+}
+#endif
+
 static int make_pcap_file_entry(struct rte_pcap_file *fentry,const char *fname){
 
     char *endptr;
@@ -153,25 +178,217 @@ void rte_pcap_file_pool_init(struct rte_pcap_file_pool *fpool,const char *dir){
     fpool->num = 0;
 
     fpool->fentry = NULL;
+
+    fpool->socket_id = SOCKET_ID_ANY;
+    fpool->numa_bind = 0;
+    fpool->numa_bound = 0;
+
+    fpool->filter = NULL;
+    fpool->left = UINT64_MAX;
+    fpool->skip_files = 0;
+    fpool->skip_bytes = 0;
+}
+
+void rte_pcap_file_pool_filter_set(struct rte_pcap_file_pool *fpool,const struct rte_pcap_index_filter *filter){
+
+    fpool->filter = rte_pcap_index_filter_on(filter)?filter:NULL;
+}
+
+int rte_pcap_file_pool_numa_setup(struct rte_pcap_file_pool *fpool,int socket_id,unsigned int numa_bind){
+
+    /*SOCKET_ID_ANY and the like just leave placement to the kernel*/
+    if(!_numa_node_valid(socket_id))
+        numa_bind = 0;
+
+    fpool->socket_id = socket_id;
+    fpool->numa_bind = numa_bind;
+    fpool->numa_bound = 0;
+
+    if(fpool->rbuf)
+        return 0;
+
+    fpool->rbuf_size = PCAP_FILE_RBUF_SIZE;
+    fpool->rbuf = rte_malloc_socket("pcap_fpool_rbuf",fpool->rbuf_size,
+            RTE_CACHE_LINE_SIZE,socket_id);
+
+    if(fpool->rbuf){
+        fpool->rbuf_hugepage = 1;
+        return 0;
+    }
+
+    /*no hugepage memory left on this socket,fall back to normal pages*/
+    fpool->rbuf = mmap(NULL,fpool->rbuf_size,PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+
+    if(fpool->rbuf == MAP_FAILED){
+        fpool->rbuf = NULL;
+        return -1;
+    }
+
+    fpool->rbuf_hugepage = 0;
+
+#ifdef RTE_HAS_LIBNUMA
+    if(numa_bind){
+
+        unsigned long mask[PCAP_FILE_NUMA_MASK_LONGS];
+
+        _numa_mask(mask,socket_id);
+
+        /*pages are not touched yet,so this decides where they land*/
+        mbind(fpool->rbuf,fpool->rbuf_size,MPOL_PREFERRED,mask,sizeof(mask)*8,0);
+    }
+#endif
+
+    return 0;
+}
+
+static void _free_rbuf(struct rte_pcap_file_pool *fpool){
+
+    if(fpool->rbuf == NULL)
+        return;
+
+    if(fpool->rbuf_hugepage)
+        rte_free(fpool->rbuf);
+    else
+        munmap(fpool->rbuf,fpool->rbuf_size);
+
+    fpool->rbuf = NULL;
+    fpool->rbuf_size = 0;
+}
+
+/*
+ * page cache pages are allocated by the reading thread's memory policy,
+ * so prefer the queue's socket on the lcore that reads the files while it
+ * has files to read. The policy it had is saved to be put back after.
+ */
+static void _numa_bind_reader(struct rte_pcap_file_pool *fpool){
+
+#ifdef RTE_HAS_LIBNUMA
+    unsigned long mask[PCAP_FILE_NUMA_MASK_LONGS];
+
+    if(get_mempolicy(&fpool->numa_old_mode,fpool->numa_old_mask,
+                sizeof(fpool->numa_old_mask)*8,NULL,0))
+        return;
+
+    _numa_mask(mask,fpool->socket_id);
+
+    if(set_mempolicy(MPOL_PREFERRED,mask,sizeof(mask)*8) == 0)
+        fpool->numa_bound = 1;
+#else
+    (void)fpool;
+#endif
+}
+
+/*from the reading lcore only,the policy is per thread*/
+static void _numa_unbind_reader(struct rte_pcap_file_pool *fpool){
+
+    if(!fpool->numa_bound)
+        return;
+
+    fpool->numa_bound = 0;
+
+#ifdef RTE_HAS_LIBNUMA
+    set_mempolicy(fpool->numa_old_mode,fpool->numa_old_mask,
+            sizeof(fpool->numa_old_mask)*8);
+#endif
+}
+
+static pcap_t *
+open_pcap_fp(struct rte_pcap_file_pool *fpool,const char *fname)
+{
+
+    FILE *fp;
+    pcap_t *pcap;
+
+    if(fpool->numa_bind&&!fpool->numa_bound)
+        _numa_bind_reader(fpool);
+
+    if(fpool->rbuf == NULL)
+        return pcap_open_offline(fname, errbuf);
+
+    fp = fopen(fname,"rb");
+    if(fp == NULL)
+        return NULL;
+
+    /*must be set before the first read on fp*/
+    setvbuf(fp,fpool->rbuf,_IOFBF,fpool->rbuf_size);
+    posix_fadvise(fileno(fp),0,0,POSIX_FADV_SEQUENTIAL);
+
+    pcap = pcap_fopen_offline(fp,errbuf);
+    if(pcap == NULL)
+        fclose(fp);
+
+    return pcap;
+}
+
+static inline void pcap_file_name(struct rte_pcap_file_pool *fpool,struct rte_pcap_file *fentry,char *fname){
+
+    snprintf(fname,PCAP_FILE_NAME_LEN,"%s/%s_%lu_%llu.%s",
+            fpool->dir,PCAP_FILE_PREFIX,(unsigned long)fentry->id,
+            (unsigned long long)fentry->ts,PCAP_FILE_EXTNAME);
+}
+
+/*
+ * Use the sidecar index to seek to the records the filter wants,
+ * returns 0 if nothing in this file matches.
+ * Files without an index are read in full.
+ */
+static int index_select(struct rte_pcap_file_pool *fpool,const char *fname,pcap_t *pcap){
+
+    struct rte_pcap_index idx;
+    uint64_t start,pkts;
+    int rc;
+
+    if(rte_pcap_index_load(&idx,fname))
+        return 1;
+
+    rc = rte_pcap_index_select(&idx,fpool->filter,&start,&pkts);
+
+    rte_pcap_index_free(&idx);
+
+    if(rc == 0)
+        return 0;
+
+    if(fseeko(pcap_file(pcap),(off_t)start,SEEK_SET) == 0){
+
+        fpool->skip_bytes += start;
+        fpool->left = pkts;
+    }
+
+    return 1;
 }
 
 static pcap_t *
-open_pcap_file(const char *root_dir,struct rte_pcap_file *fentry)
+open_pcap_file(struct rte_pcap_file_pool *fpool,struct rte_pcap_file *fentry)
 {
 
     pcap_t *pcap = NULL;
 
     char fname[PCAP_FILE_NAME_LEN];
 
-    snprintf(fname,PCAP_FILE_NAME_LEN,"%s/%s_%lu_%llu.%s",
-            root_dir,PCAP_FILE_PREFIX,fentry->id,fentry->ts,PCAP_FILE_EXTNAME);
+    pcap_file_name(fpool,fentry,fname);
     
-    pcap = pcap_open_offline(fname, errbuf);
+    pcap = open_pcap_fp(fpool,fname);
 
     if(pcap == NULL){
 
         /*error pcap file,remove it*/
         unlink(fname);
+        rte_pcap_index_unlink(fname);
+        return NULL;
+    }
+
+    fpool->left = UINT64_MAX;
+
+    if(fpool->filter&&index_select(fpool,fname,pcap) == 0){
+
+        /*nothing wanted in this file,consume it without decoding*/
+        pcap_close(pcap);
+        unlink(fname);
+        rte_pcap_index_unlink(fname);
+        fpool->skip_files++;
+
+        return NULL;
     }
 
     return pcap;
@@ -195,7 +412,7 @@ static pcap_t * _open_pcap(struct rte_pcap_file_pool *fpool){
         fentry = &fpool->files[fpool->pos];
         fpool->pos++;
 
-        pcap = open_pcap_file(fpool->dir,fentry);
+        pcap = open_pcap_file(fpool,fentry);
 
         if(pcap)
         {
@@ -215,14 +432,14 @@ static void _close_pcap(struct rte_pcap_file_pool *fpool){
     struct rte_pcap_file *fentry = fpool->fentry;
 
     char fname[PCAP_FILE_NAME_LEN];
-    snprintf(fname,PCAP_FILE_NAME_LEN,"%s/%s_%lu_%llu.%s",
-            fpool->dir,PCAP_FILE_PREFIX,fentry->id,fentry->ts,PCAP_FILE_EXTNAME);
+    pcap_file_name(fpool,fentry,fname);
 
 	pcap_close(fpool->pcap);
 	fpool->pcap = NULL;
     fpool->fentry = NULL;
 
     unlink(fname);
+    rte_pcap_index_unlink(fname);
 }
 
 const u_char * rte_pcap_file_pool_read(struct rte_pcap_file_pool *fpool,struct pcap_pkthdr *pkt_hdr){
@@ -230,14 +447,21 @@ const u_char * rte_pcap_file_pool_read(struct rte_pcap_file_pool *fpool,struct p
     const u_char *packet = NULL;
     pcap_t *pcap;
 
+    /*the selected range of this file has been read*/
+    if(fpool->pcap&&fpool->left == 0)
+        _close_pcap(fpool);
+
     if(fpool->pcap)
         pcap = fpool->pcap;
     else
         pcap = _open_pcap(fpool);
 
-    /*no pcap to read*/
-    if(pcap == NULL)
+    /*no pcap to read,give the lcore its own policy back until there is*/
+    if(pcap == NULL){
+
+        _numa_unbind_reader(fpool);
         return NULL;
+    }
 
     packet = pcap_next(pcap, pkt_hdr);
 
@@ -245,6 +469,9 @@ const u_char * rte_pcap_file_pool_read(struct rte_pcap_file_pool *fpool,struct p
         /*this pcap file read over,close it and remove it*/
 
         _close_pcap(fpool);
+    }else if(fpool->left!=UINT64_MAX){
+
+        fpool->left--;
     }
 
     return packet;
@@ -256,6 +483,8 @@ void rte_pcap_file_pool_fin(struct rte_pcap_file_pool *fpool){
         _close_pcap(fpool);
 
     fpool->pcap = NULL;
+
+    _free_rbuf(fpool);
 }
 
 void rte_pcap_file_pool_dump(struct rte_pcap_file_pool *fpool,FILE *out){
@@ -264,6 +493,11 @@ void rte_pcap_file_pool_dump(struct rte_pcap_file_pool *fpool,FILE *out){
     fprintf(out,"fpool.dir:%s\n",fpool->dir);
     fprintf(out,"fpool.pos:%lu\n",(unsigned long)fpool->pos);
     fprintf(out,"fpool.num:%lu\n",(unsigned long)fpool->num);
+    fprintf(out,"fpool.socket:%d\n",fpool->socket_id);
+    fprintf(out,"fpool.rbuf:%lu(%s)\n",(unsigned long)fpool->rbuf_size,
+            fpool->rbuf_hugepage?"hugepage":"normal");
+    fprintf(out,"fpool.skip_files:%llu\n",(unsigned long long)fpool->skip_files);
+    fprintf(out,"fpool.skip_bytes:%llu\n",(unsigned long long)fpool->skip_bytes);
 
     int i = 0;
 
@@ -8,11 +8,21 @@
 #include <unistd.h>
 #include <stdint.h>
 
+#include <rte_config.h>
+
+#include "rte_pcap_file_index.h"
+
 #define PCAP_FILE_POOL_SIZE 100
 #define PCAP_FILE_PREFIX "cap"
 #define PCAP_FILE_EXTNAME "pcap"
 #define PCAP_FILE_NAME_LEN 1024
 
+/*stdio buffer used to read pcap files,allocated on the rx queue's socket*/
+#define PCAP_FILE_RBUF_SIZE (1024*1024)
+
+/*longs of a node mask covering every socket*/
+#define PCAP_FILE_NUMA_MASK_LONGS ((RTE_MAX_NUMA_NODES+sizeof(unsigned long)*8-1)/(sizeof(unsigned long)*8))
+
 struct rte_pcap_file {
 
     uint8_t id;
@@ -32,10 +42,39 @@ struct rte_pcap_file_pool {
 
     struct rte_pcap_file files[PCAP_FILE_POOL_SIZE];
 
+    /*numa placement of the reader*/
+    int socket_id;
+    unsigned int numa_bind;
+    unsigned int numa_bound;
+
+    /*policy of the reading lcore before it was bound,put back once it runs out of files*/
+    int numa_old_mode;
+    unsigned long numa_old_mask[PCAP_FILE_NUMA_MASK_LONGS];
+
+    /*per socket stdio read buffer*/
+    char *rbuf;
+    size_t rbuf_size;
+    unsigned int rbuf_hugepage;
+
+    /*skip files and record ranges by their sidecar index*/
+    const struct rte_pcap_index_filter *filter;
+    uint64_t left; /*records left in the selected range of current file*/
+    uint64_t skip_files;
+    uint64_t skip_bytes;
+
 };
 
 void rte_pcap_file_pool_init(struct rte_pcap_file_pool *fpool,const char *dir);
 
+/*
+ * place the read buffer on socket_id,numa_bind prefers socket_id for file
+ * pages too while the rx lcore has files to read. numa_bind is dropped for
+ * a socket that is not a node,as SOCKET_ID_ANY. Returns -1 without a buffer.
+ */
+int rte_pcap_file_pool_numa_setup(struct rte_pcap_file_pool *fpool,int socket_id,unsigned int numa_bind);
+
+void rte_pcap_file_pool_filter_set(struct rte_pcap_file_pool *fpool,const struct rte_pcap_index_filter *filter);
+
 const u_char * rte_pcap_file_pool_read(struct rte_pcap_file_pool *fpool,struct pcap_pkthdr *pkt_hdr);
 
 void rte_pcap_file_pool_fin(struct rte_pcap_file_pool *fpool);
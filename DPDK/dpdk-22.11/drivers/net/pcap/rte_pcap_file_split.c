@@ -0,0 +1,308 @@
+#include "rte_pcap_file_split.h"
+#include "rte_pcap_file_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char errbuf[PCAP_ERRBUF_SIZE];
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+static inline uint32_t rd32(const u_char *p,int swapped){
+
+    uint32_t v;
+
+    memcpy(&v,p,sizeof(v));
+
+    return swapped?__builtin_bswap32(v):v;
+}
+
+static int parse_file_hdr(struct rte_pcap_file_split *split,const u_char *hdr){
+
+    uint32_t magic;
+
+    memcpy(&magic,hdr,sizeof(magic));
+
+    split->swapped = 0;
+    split->nsec = 0;
+
+    switch(magic){
+
+    case PCAP_MAGIC_USEC:
+        break;
+    case PCAP_MAGIC_NSEC:
+        split->nsec = 1;
+        break;
+    default:
+        magic = __builtin_bswap32(magic);
+        if(magic == PCAP_MAGIC_USEC)
+            split->swapped = 1;
+        else if(magic == PCAP_MAGIC_NSEC){
+            split->swapped = 1;
+            split->nsec = 1;
+        }else{
+            /*pcapng or garbage*/
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void cut_range(struct rte_pcap_file_split *split,uint16_t r,uint64_t off){
+
+    split->ranges[r].end = off;
+    split->ranges[r+1].start = off;
+    split->ranges[r+1].end = off;
+    split->ranges[r+1].pkts = 0;
+}
+
+int rte_pcap_file_split_scan(struct rte_pcap_file_split *split,const char *fname,uint16_t nb_ranges){
+
+    int fd;
+    struct stat st;
+    u_char fhdr[PCAP_SPLIT_FILE_HDR_LEN];
+    u_char *buf,*rhdr;
+    ssize_t rlen;
+    uint64_t off,buf_off = 0,buf_len = 0;
+    uint64_t target;
+    uint32_t incl_len;
+    uint16_t r = 0,i;
+    int rc = -1;
+
+    if(nb_ranges == 0||nb_ranges>PCAP_SPLIT_MAX_RANGES)
+        return -1;
+
+    memset(split,0,sizeof(*split));
+    split->fname = fname;
+    split->nb_ranges = nb_ranges;
+
+    fd = open(fname,O_RDONLY);
+    if(fd<0)
+        return -1;
+
+    if(fstat(fd,&st)||pread(fd,fhdr,sizeof(fhdr),0)!=(ssize_t)sizeof(fhdr)
+            ||parse_file_hdr(split,fhdr)){
+        close(fd);
+        return -1;
+    }
+
+    buf = malloc(PCAP_SPLIT_SCAN_BUF_SIZE);
+    if(buf == NULL){
+        close(fd);
+        return -1;
+    }
+
+    posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+
+    split->fsize = (uint64_t)st.st_size;
+    off = PCAP_SPLIT_FILE_HDR_LEN;
+
+    for(i = 0;i<nb_ranges;i++){
+        split->ranges[i].start = off;
+        split->ranges[i].end = off;
+        split->ranges[i].pkts = 0;
+    }
+
+    target = split->fsize/nb_ranges;
+
+    while(off+PCAP_SPLIT_REC_HDR_LEN<=split->fsize){
+
+        /*only the record headers are needed,so large records are skipped by pread*/
+        if(off+PCAP_SPLIT_REC_HDR_LEN>buf_off+buf_len){
+
+            rlen = pread(fd,buf,PCAP_SPLIT_SCAN_BUF_SIZE,off);
+            if(rlen<PCAP_SPLIT_REC_HDR_LEN)
+                break;
+
+            buf_off = off;
+            buf_len = (uint64_t)rlen;
+        }
+
+        rhdr = buf+(off-buf_off);
+        incl_len = rd32(rhdr+8,split->swapped);
+
+        if(incl_len>PCAP_SPLIT_MAX_CAPLEN)
+            goto out;
+
+        /*truncated last record*/
+        if(off+PCAP_SPLIT_REC_HDR_LEN+incl_len>split->fsize)
+            break;
+
+        if(off>=target&&r+1<nb_ranges){
+
+            cut_range(split,r,off);
+            r++;
+            target = split->fsize/nb_ranges*(r+1);
+        }
+
+        split->ranges[r].pkts++;
+        off += PCAP_SPLIT_REC_HDR_LEN+incl_len;
+    }
+
+    split->ranges[r].end = off;
+
+    /*small files leave the tail ranges empty*/
+    for(i = r+1;i<nb_ranges;i++){
+        split->ranges[i].start = off;
+        split->ranges[i].end = off;
+    }
+
+    rc = 0;
+
+out:
+    free(buf);
+    close(fd);
+
+    return rc;
+}
+
+int rte_pcap_file_split_load(struct rte_pcap_file_split *split,const char *fname,uint16_t nb_ranges){
+
+    struct rte_pcap_index idx;
+    struct stat st;
+    uint64_t target,cut_pkt,prev_pkt = 0;
+    uint32_t p = 0;
+    uint16_t r;
+
+    if(nb_ranges == 0||nb_ranges>PCAP_SPLIT_MAX_RANGES)
+        return -1;
+
+    if(stat(fname,&st)||rte_pcap_index_load(&idx,fname))
+        return -1;
+
+    if(idx.hdr.nb_points == 0){
+        rte_pcap_index_free(&idx);
+        return -1;
+    }
+
+    memset(split,0,sizeof(*split));
+    split->fname = fname;
+    split->fsize = (uint64_t)st.st_size;
+    split->nb_ranges = nb_ranges;
+
+    split->ranges[0].start = idx.points[0].offset;
+
+    for(r = 1;r<nb_ranges;r++){
+
+        target = split->fsize/nb_ranges*r;
+
+        while(p<idx.hdr.nb_points&&idx.points[p].offset<target)
+            p++;
+
+        if(p<idx.hdr.nb_points){
+            cut_range(split,r-1,idx.points[p].offset);
+            cut_pkt = (uint64_t)p*idx.hdr.stride;
+        }else{
+            cut_range(split,r-1,split->fsize);
+            cut_pkt = idx.hdr.pkts;
+        }
+
+        split->ranges[r-1].pkts = cut_pkt-prev_pkt;
+        prev_pkt = cut_pkt;
+    }
+
+    split->ranges[nb_ranges-1].end = split->fsize;
+    split->ranges[nb_ranges-1].pkts = idx.hdr.pkts-prev_pkt;
+
+    rte_pcap_index_free(&idx);
+
+    return 0;
+}
+
+int rte_pcap_split_reader_open(struct rte_pcap_split_reader *reader,
+        const struct rte_pcap_file_split *split,uint16_t idx,
+        char *rbuf,size_t rbuf_size){
+
+    FILE *fp;
+    const struct rte_pcap_split_range *range;
+
+    reader->pcap = NULL;
+    reader->range = NULL;
+    reader->left = 0;
+
+    if(idx>=split->nb_ranges)
+        return -1;
+
+    range = &split->ranges[idx];
+
+    fp = fopen(split->fname,"rb");
+    if(fp == NULL)
+        return -1;
+
+    if(rbuf)
+        setvbuf(fp,rbuf,_IOFBF,rbuf_size);
+
+    reader->pcap = pcap_fopen_offline(fp,errbuf);
+    if(reader->pcap == NULL){
+        fclose(fp);
+        return -1;
+    }
+
+    /*libpcap has consumed the file header,jump to the first record of our range*/
+    if(fseeko(fp,(off_t)range->start,SEEK_SET)){
+        pcap_close(reader->pcap);
+        reader->pcap = NULL;
+        return -1;
+    }
+
+    posix_fadvise(fileno(fp),(off_t)range->start,
+            (off_t)(range->end-range->start),POSIX_FADV_SEQUENTIAL);
+
+    reader->range = range;
+    reader->left = range->pkts;
+
+    return 0;
+}
+
+const u_char * rte_pcap_split_reader_read(struct rte_pcap_split_reader *reader,struct pcap_pkthdr *pkt_hdr){
+
+    const u_char *packet;
+
+    /*counting records avoids an ftello() syscall per packet*/
+    if(reader->left == 0||reader->pcap == NULL)
+        return NULL;
+
+    packet = pcap_next(reader->pcap,pkt_hdr);
+    if(packet == NULL){
+        reader->left = 0;
+        return NULL;
+    }
+
+    reader->left--;
+
+    return packet;
+}
+
+void rte_pcap_split_reader_close(struct rte_pcap_split_reader *reader){
+
+    if(reader->pcap)
+        pcap_close(reader->pcap);
+
+    reader->pcap = NULL;
+    reader->range = NULL;
+    reader->left = 0;
+}
+
+void rte_pcap_file_split_dump(struct rte_pcap_file_split *split,FILE *out){
+
+    uint16_t i;
+    struct rte_pcap_split_range *range;
+
+    fprintf(out,"split.file:%s\n",split->fname);
+    fprintf(out,"split.size:%llu\n",(unsigned long long)split->fsize);
+    fprintf(out,"split.ranges:%lu\n",(unsigned long)split->nb_ranges);
+
+    for(i = 0;i<split->nb_ranges;i++){
+
+        range = &split->ranges[i];
+
+        fprintf(out,"Range[%u]:[%llu,%llu) pkts:%llu\n",(unsigned int)i,
+                (unsigned long long)range->start,
+                (unsigned long long)range->end,
+                (unsigned long long)range->pkts);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef _RTE_PCAP_FILE_SPLIT_H_
+#define _RTE_PCAP_FILE_SPLIT_H_
+
+#include <pcap.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Split a single large pcap file into disjoint byte ranges that start on
+ * record boundaries,so several rx queues can read the same file at once.
+ * Each queue reads its range in file order.
+ */
+
+#define PCAP_SPLIT_MAX_RANGES 16
+#define PCAP_SPLIT_SCAN_BUF_SIZE (4*1024*1024)
+
+/*pcap savefile layout*/
+#define PCAP_SPLIT_FILE_HDR_LEN 24
+#define PCAP_SPLIT_REC_HDR_LEN 16
+#define PCAP_SPLIT_MAX_CAPLEN (256*1024)
+
+struct rte_pcap_split_range {
+
+    uint64_t start; /*offset of the first record*/
+    uint64_t end;   /*offset just past the last record*/
+    uint64_t pkts;  /*records in [start,end)*/
+};
+
+struct rte_pcap_file_split {
+
+    const char *fname;
+
+    uint64_t fsize;
+
+    int swapped;
+    int nsec;
+
+    uint16_t nb_ranges;
+
+    struct rte_pcap_split_range ranges[PCAP_SPLIT_MAX_RANGES];
+};
+
+struct rte_pcap_split_reader {
+
+    pcap_t *pcap;
+
+    const struct rte_pcap_split_range *range;
+
+    uint64_t left; /*records still to read in range*/
+};
+
+/*cut fname into nb_ranges ranges at the record offsets of its sidecar index*/
+int rte_pcap_file_split_load(struct rte_pcap_file_split *split,const char *fname,uint16_t nb_ranges);
+
+/*walk the record headers of fname once and cut it into nb_ranges ranges*/
+int rte_pcap_file_split_scan(struct rte_pcap_file_split *split,const char *fname,uint16_t nb_ranges);
+
+int rte_pcap_split_reader_open(struct rte_pcap_split_reader *reader,
+        const struct rte_pcap_file_split *split,uint16_t idx,
+        char *rbuf,size_t rbuf_size);
+
+const u_char * rte_pcap_split_reader_read(struct rte_pcap_split_reader *reader,struct pcap_pkthdr *pkt_hdr);
+
+void rte_pcap_split_reader_close(struct rte_pcap_split_reader *reader);
+
+void rte_pcap_file_split_dump(struct rte_pcap_file_split *split,FILE *out);
+
+#endif /*_RTE_PCAP_FILE_SPLIT_H_*/
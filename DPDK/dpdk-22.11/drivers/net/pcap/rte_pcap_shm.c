@@ -0,0 +1,260 @@
+#include "rte_pcap_shm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_malloc.h>
+
+#define PCAP_SHM_SLOT_MASK (PCAP_SHM_MAX_INFLIGHT-1)
+
+static void _slot_free_cb(void *addr __rte_unused,void *opaque){
+
+    struct rte_pcap_shm_slot *slot = opaque;
+
+    /*runs on whatever lcore frees the last reference*/
+    __atomic_store_n(&slot->done,1,__ATOMIC_RELEASE);
+}
+
+static int _recv_fds(const char *name,int *memfd,int *evfd){
+
+    struct sockaddr_un addr;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(2*sizeof(int))];
+    char dummy;
+    int fds[2];
+    int sock;
+    ssize_t n;
+
+    if(strlen(name)>=sizeof(addr.sun_path))
+        return -1;
+
+    sock = socket(AF_UNIX,SOCK_SEQPACKET,0);
+    if(sock<0)
+        return -1;
+
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,name);
+
+    if(connect(sock,(struct sockaddr*)&addr,sizeof(addr))<0)
+        goto fail;
+
+    memset(&msg,0,sizeof(msg));
+    iov.iov_base = &dummy;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    n = recvmsg(sock,&msg,0);
+    if(n<=0)
+        goto fail;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if(cmsg == NULL||cmsg->cmsg_level!=SOL_SOCKET||cmsg->cmsg_type!=SCM_RIGHTS||
+            cmsg->cmsg_len!=CMSG_LEN(2*sizeof(int)))
+        goto fail;
+
+    memcpy(fds,CMSG_DATA(cmsg),sizeof(fds));
+
+    /*the mapping and the eventfd outlive the control connection*/
+    close(sock);
+
+    *memfd = fds[0];
+    *evfd = fds[1];
+
+    return 0;
+
+fail:
+    close(sock);
+    return -1;
+}
+
+int rte_pcap_shm_open(struct rte_pcap_shm *shm,const char *name,int socket_id){
+
+    struct stat st;
+    struct pcap_shm_ring *ring;
+    uint32_t i;
+
+    memset(shm,0,sizeof(*shm));
+
+    shm->name = name;
+    shm->memfd = -1;
+    shm->evfd = -1;
+
+    if(_recv_fds(name,&shm->memfd,&shm->evfd))
+        return -1;
+
+    if(fstat(shm->memfd,&st)<0||(size_t)st.st_size<PCAP_SHM_HDR_SIZE)
+        goto fail;
+
+    shm->map_size = (size_t)st.st_size;
+    shm->ring = mmap(NULL,shm->map_size,PROT_READ|PROT_WRITE,MAP_SHARED,shm->memfd,0);
+
+    if(shm->ring == MAP_FAILED){
+        shm->ring = NULL;
+        goto fail;
+    }
+
+    ring = shm->ring;
+
+    if(__atomic_load_n(&ring->magic,__ATOMIC_ACQUIRE)!=PCAP_SHM_MAGIC||
+            ring->version!=PCAP_SHM_VERSION||
+            ring->size == 0||(ring->size&(ring->size-1))||
+            ring->size+PCAP_SHM_HDR_SIZE>shm->map_size)
+        goto fail;
+
+    shm->slots = rte_zmalloc_socket("pcap_shm_slots",
+            sizeof(struct rte_pcap_shm_slot)*PCAP_SHM_MAX_INFLIGHT,
+            RTE_CACHE_LINE_SIZE,socket_id);
+    if(shm->slots == NULL)
+        goto fail;
+
+    for(i = 0;i<PCAP_SHM_MAX_INFLIGHT;i++){
+
+        shm->slots[i].shinfo.free_cb = _slot_free_cb;
+        shm->slots[i].shinfo.fcb_opaque = &shm->slots[i];
+    }
+
+    /*pick up where a previous consumer left the ring*/
+    shm->rpos = __atomic_load_n(&ring->tail,__ATOMIC_ACQUIRE);
+
+    return 0;
+
+fail:
+    rte_pcap_shm_close(shm);
+    return -1;
+}
+
+const u_char * rte_pcap_shm_read(struct rte_pcap_shm *shm,struct pcap_pkthdr *pkt_hdr,
+        struct rte_mbuf_ext_shared_info **shinfo){
+
+    struct pcap_shm_ring *ring = shm->ring;
+    const struct pcap_shm_rec_hdr *rec;
+    struct rte_pcap_shm_slot *slot;
+    uint64_t head,rec_len;
+    uint32_t caplen;
+
+    if(unlikely(rte_pcap_shm_inflight(shm) == PCAP_SHM_MAX_INFLIGHT)){
+        shm->slot_full++;
+        return NULL;
+    }
+
+    rec = pcap_shm_ring_peek(shm->ring,&shm->rpos);
+    if(rec == NULL)
+        return NULL;
+
+    /*the producer shares the page,read caplen once and check it against what it published*/
+    caplen = __atomic_load_n(&rec->caplen,__ATOMIC_RELAXED);
+    head = __atomic_load_n(&ring->head,__ATOMIC_ACQUIRE);
+    rec_len = pcap_shm_rec_len(caplen);
+
+    slot = &shm->slots[shm->slot_head&PCAP_SHM_SLOT_MASK];
+
+    if(unlikely((ring->snaplen&&caplen>ring->snaplen)||rec_len>head-shm->rpos||
+                (shm->rpos&(ring->size-1))+rec_len>ring->size)){
+
+        /*framing is lost,skip all published and give it back once the slots before are done*/
+        shm->errors++;
+        shm->rpos = head;
+
+        slot->end = head;
+        slot->done = 1;
+        shm->slot_head++;
+
+        return NULL;
+    }
+
+    pkt_hdr->ts.tv_sec = rec->ts_sec;
+    pkt_hdr->ts.tv_usec = rec->ts_usec;
+    pkt_hdr->caplen = caplen;
+    pkt_hdr->len = rec->len;
+
+    shm->rpos += rec_len;
+
+    slot->end = shm->rpos;
+    slot->done = 0;
+    rte_mbuf_ext_refcnt_set(&slot->shinfo,1);
+    shm->slot_head++;
+
+    *shinfo = &slot->shinfo;
+
+    return (const u_char*)(rec+1);
+}
+
+void rte_pcap_shm_reclaim(struct rte_pcap_shm *shm){
+
+    struct rte_pcap_shm_slot *slot;
+    uint64_t end = 0;
+
+    while(shm->slot_tail!=shm->slot_head){
+
+        slot = &shm->slots[shm->slot_tail&PCAP_SHM_SLOT_MASK];
+
+        if(!__atomic_load_n(&slot->done,__ATOMIC_ACQUIRE))
+            break;
+
+        end = slot->end;
+        shm->slot_tail++;
+    }
+
+    if(end == 0)
+        return;
+
+    if(pcap_shm_ring_release(shm->ring,end)){
+
+        uint64_t one = 1;
+
+        if(write(shm->evfd,&one,sizeof(one)) == sizeof(one))
+            shm->kicks++;
+    }
+}
+
+void rte_pcap_shm_close(struct rte_pcap_shm *shm){
+
+    if(shm->slots)
+        rte_pcap_shm_reclaim(shm);
+
+    if(shm->ring){
+
+        if(rte_pcap_shm_inflight(shm)){
+            /*mbufs still point into the ring,leave it mapped*/
+            shm->ring = NULL;
+            shm->slots = NULL;
+        }else
+            munmap(shm->ring,shm->map_size);
+    }
+
+    rte_free(shm->slots);
+
+    if(shm->memfd>=0)
+        close(shm->memfd);
+    if(shm->evfd>=0)
+        close(shm->evfd);
+
+    shm->ring = NULL;
+    shm->slots = NULL;
+    shm->memfd = -1;
+    shm->evfd = -1;
+}
+
+void rte_pcap_shm_dump(struct rte_pcap_shm *shm,FILE *out){
+
+    fprintf(out,"shm.name:%s\n",shm->name);
+    fprintf(out,"shm.size:%lu\n",shm->ring?(unsigned long)shm->ring->size:0UL);
+    fprintf(out,"shm.rpos:%llu\n",(unsigned long long)shm->rpos);
+    fprintf(out,"shm.inflight:%u\n",rte_pcap_shm_inflight(shm));
+    fprintf(out,"shm.slot_full:%llu\n",(unsigned long long)shm->slot_full);
+    fprintf(out,"shm.kicks:%llu\n",(unsigned long long)shm->kicks);
+    fprintf(out,"shm.errors:%llu\n",(unsigned long long)shm->errors);
+}
@@ -0,0 +1,82 @@
+#ifndef _RTE_PCAP_SHM_H_
+#define _RTE_PCAP_SHM_H_
+
+#include <pcap.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+#include "rte_pcap_shm_ring.h"
+
+/*
+ * Consumer of a pcap_shm_ring published by a local producer on a unix
+ * socket: the producer passes its memfd and eventfd with SCM_RIGHTS.
+ * Packets are handed out zero-copy,each one holds an in-flight slot
+ * whose free callback marks it done,and ring space is given back in
+ * ring order once the oldest slots are done.
+ */
+
+#define PCAP_SHM_MAX_INFLIGHT 8192
+
+struct rte_pcap_shm;
+
+struct rte_pcap_shm_slot {
+
+    struct rte_mbuf_ext_shared_info shinfo;
+    /*ring position just after this record*/
+    uint64_t end;
+    uint32_t done;
+};
+
+struct rte_pcap_shm {
+
+    const char *name;
+    int memfd;
+    int evfd;
+
+    struct pcap_shm_ring *ring;
+    size_t map_size;
+
+    /*next record to read,tail lags behind it by the packets in flight*/
+    uint64_t rpos;
+
+    struct rte_pcap_shm_slot *slots;
+    uint32_t slot_head;
+    uint32_t slot_tail;
+
+    uint64_t kicks;
+    uint64_t slot_full;
+    uint64_t errors; /*records running past what was published,the ring was skipped*/
+};
+
+int rte_pcap_shm_open(struct rte_pcap_shm *shm,const char *name,int socket_id);
+
+/*
+ * Returns the next packet and the shared info to attach it with,
+ * NULL if the ring is empty or all slots are in flight.
+ */
+const u_char * rte_pcap_shm_read(struct rte_pcap_shm *shm,struct pcap_pkthdr *pkt_hdr,
+        struct rte_mbuf_ext_shared_info **shinfo);
+
+/*Packet returned by the last read was copied,its slot is done already*/
+static inline void rte_pcap_shm_done(struct rte_mbuf_ext_shared_info *shinfo){
+
+    struct rte_pcap_shm_slot *slot = (struct rte_pcap_shm_slot*)shinfo;
+
+    __atomic_store_n(&slot->done,1,__ATOMIC_RELEASE);
+}
+
+/*Gives the space of done slots back to the producer,in ring order*/
+void rte_pcap_shm_reclaim(struct rte_pcap_shm *shm);
+
+static inline uint32_t rte_pcap_shm_inflight(struct rte_pcap_shm *shm){
+
+    return shm->slot_head-shm->slot_tail;
+}
+
+void rte_pcap_shm_close(struct rte_pcap_shm *shm);
+
+void rte_pcap_shm_dump(struct rte_pcap_shm *shm,FILE *out);
+
+#endif /*_RTE_PCAP_SHM_H_*/
@@ -0,0 +1,161 @@
+#ifndef _RTE_PCAP_SHM_RING_H_
+#define _RTE_PCAP_SHM_RING_H_
+
+/*
+ * Single producer/single consumer ring of pcap framed records living in a
+ * memfd shared between a local capture producer and the pcap vdev.
+ * Kept free of DPDK so the producer side can include it as is.
+ *
+ * Layout of the memfd:
+ *   [struct pcap_shm_ring, PCAP_SHM_HDR_SIZE bytes][data, size bytes]
+ *
+ * head and tail are free running byte positions, a record is a pcap
+ * record header followed by caplen bytes, padded to PCAP_SHM_ALIGN.
+ * Records never wrap: when the end of the data area is too short the
+ * producer writes a pad record and starts over at offset 0.
+ * The consumer moves tail only when it is done with the packet bytes,
+ * so a slow consumer holding packets zero-copy simply fills the ring.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define PCAP_SHM_MAGIC 0x50434d52 /*PCMR*/
+#define PCAP_SHM_VERSION 1
+
+#define PCAP_SHM_HDR_SIZE 4096
+#define PCAP_SHM_ALIGN 16
+#define PCAP_SHM_PAD 0xffffffffu
+#define PCAP_SHM_DEFAULT_SIZE (64*1024*1024)
+
+#define PCAP_SHM_CACHE_LINE 64
+
+struct pcap_shm_rec_hdr {
+
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+struct pcap_shm_ring {
+
+    uint32_t magic;
+    uint32_t version;
+
+    /*bytes of the data area,power of 2*/
+    uint64_t size;
+    uint32_t linktype;
+    uint32_t snaplen;
+
+    /*written by the producer*/
+    uint64_t head __attribute__((aligned(PCAP_SHM_CACHE_LINE)));
+    uint64_t drops;
+
+    /*producer sleeps on the eventfd,the consumer kicks it after release*/
+    uint32_t producer_waiting;
+
+    /*written by the consumer*/
+    uint64_t tail __attribute__((aligned(PCAP_SHM_CACHE_LINE)));
+};
+
+static inline unsigned char * pcap_shm_ring_data(struct pcap_shm_ring *ring){
+
+    return (unsigned char *)ring+PCAP_SHM_HDR_SIZE;
+}
+
+static inline uint64_t pcap_shm_rec_len(uint32_t caplen){
+
+    return ((uint64_t)sizeof(struct pcap_shm_rec_hdr)+caplen+PCAP_SHM_ALIGN-1)&~(uint64_t)(PCAP_SHM_ALIGN-1);
+}
+
+static inline void pcap_shm_ring_init(struct pcap_shm_ring *ring,uint64_t size,uint32_t linktype,uint32_t snaplen){
+
+    memset(ring,0,sizeof(*ring));
+
+    ring->size = size;
+    ring->linktype = linktype;
+    ring->snaplen = snaplen;
+    ring->version = PCAP_SHM_VERSION;
+
+    __atomic_store_n(&ring->magic,PCAP_SHM_MAGIC,__ATOMIC_RELEASE);
+}
+
+/*
+ * Producer side,copies one record in.
+ * Returns 0 on success,-1 if the ring has no room for it right now.
+ */
+static inline int pcap_shm_ring_push(struct pcap_shm_ring *ring,const struct pcap_shm_rec_hdr *hdr,const void *pkt){
+
+    uint64_t head = ring->head;
+    uint64_t tail = __atomic_load_n(&ring->tail,__ATOMIC_ACQUIRE);
+    uint64_t off = head&(ring->size-1);
+    uint64_t contig = ring->size-off;
+    uint64_t need = pcap_shm_rec_len(hdr->caplen);
+    unsigned char *data = pcap_shm_ring_data(ring);
+    struct pcap_shm_rec_hdr *rec;
+
+    if(need>ring->size)
+        return -1;
+
+    if(head+need+(contig<need?contig:0)-tail>ring->size)
+        return -1;
+
+    if(contig<need){
+
+        rec = (struct pcap_shm_rec_hdr*)(data+off);
+        rec->caplen = PCAP_SHM_PAD;
+        head += contig;
+        off = 0;
+    }
+
+    rec = (struct pcap_shm_rec_hdr*)(data+off);
+    *rec = *hdr;
+    memcpy(rec+1,pkt,hdr->caplen);
+
+    __atomic_store_n(&ring->head,head+need,__ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*
+ * Consumer side,returns the record at *pos or NULL if the producer has
+ * not written it yet. A pad record is skipped by moving *pos,the caller
+ * moves *pos past the record with pcap_shm_rec_len() once it took it.
+ */
+static inline const struct pcap_shm_rec_hdr * pcap_shm_ring_peek(struct pcap_shm_ring *ring,uint64_t *pos){
+
+    uint64_t head = __atomic_load_n(&ring->head,__ATOMIC_ACQUIRE);
+    uint64_t off = *pos&(ring->size-1);
+    const struct pcap_shm_rec_hdr *rec;
+
+    if(*pos == head)
+        return NULL;
+
+    rec = (const struct pcap_shm_rec_hdr*)(pcap_shm_ring_data(ring)+off);
+
+    if(rec->caplen == PCAP_SHM_PAD){
+
+        *pos += ring->size-off;
+        if(*pos == head)
+            return NULL;
+
+        rec = (const struct pcap_shm_rec_hdr*)pcap_shm_ring_data(ring);
+    }
+
+    return rec;
+}
+
+/*
+ * Consumer side,gives everything before pos back to the producer.
+ * Returns 1 if the producer is waiting for room and should be kicked.
+ */
+static inline int pcap_shm_ring_release(struct pcap_shm_ring *ring,uint64_t pos){
+
+    /*seq_cst so the tail store is not ordered after the waiting load*/
+    __atomic_store_n(&ring->tail,pos,__ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&ring->producer_waiting,__ATOMIC_SEQ_CST)?1:0;
+}
+
+#endif /*_RTE_PCAP_SHM_RING_H_*/
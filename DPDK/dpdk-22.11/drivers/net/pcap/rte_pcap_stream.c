@@ -0,0 +1,269 @@
+#include "rte_pcap_stream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_malloc.h>
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+#define PCAP_STREAM_FILE_HDR_LEN 24
+#define PCAP_STREAM_REC_HDR_LEN 16
+#define PCAP_STREAM_MAX_CAPLEN (256*1024)
+
+static inline uint32_t rd32(const u_char *p,int swapped){
+
+    uint32_t v;
+
+    memcpy(&v,p,sizeof(v));
+
+    return swapped?__builtin_bswap32(v):v;
+}
+
+static int _bufs_alloc(struct rte_pcap_stream *stream,int socket_id){
+
+    stream->buf_hugepage = 1;
+    stream->buf[0] = rte_malloc_socket("pcap_stream_buf",stream->buf_size,
+            RTE_CACHE_LINE_SIZE,socket_id);
+    stream->buf[1] = rte_malloc_socket("pcap_stream_buf",stream->buf_size,
+            RTE_CACHE_LINE_SIZE,socket_id);
+
+    if(stream->buf[0]&&stream->buf[1])
+        return 0;
+
+    rte_free(stream->buf[0]);
+    rte_free(stream->buf[1]);
+
+    stream->buf_hugepage = 0;
+    stream->buf[0] = malloc(stream->buf_size);
+    stream->buf[1] = malloc(stream->buf_size);
+
+    return stream->buf[0]&&stream->buf[1]?0:-1;
+}
+
+static void _buf_free(struct rte_pcap_stream *stream,void *buf){
+
+    if(buf == NULL)
+        return;
+
+    if(stream->buf_hugepage)
+        rte_free(buf);
+    else
+        free(buf);
+}
+
+int rte_pcap_stream_open(struct rte_pcap_stream *stream,const char *name,int socket_id){
+
+    int flags;
+
+    memset(stream,0,sizeof(*stream));
+
+    stream->name = name;
+    stream->fd = -1;
+    stream->buf_size = PCAP_STREAM_BUF_SIZE;
+
+    if(_bufs_alloc(stream,socket_id))
+        goto fail;
+
+    if(strcmp(name,PCAP_STREAM_STDIN) == 0){
+
+        stream->fd = dup(STDIN_FILENO);
+        if(stream->fd<0)
+            goto fail;
+
+        flags = fcntl(stream->fd,F_GETFL);
+        if(flags<0||fcntl(stream->fd,F_SETFL,flags|O_NONBLOCK)<0)
+            goto fail;
+    }else{
+
+        /*a FIFO opened non-blocking does not wait for its writer*/
+        stream->fd = open(name,O_RDONLY|O_NONBLOCK);
+        if(stream->fd<0)
+            goto fail;
+    }
+
+    return 0;
+
+fail:
+    rte_pcap_stream_close(stream);
+
+    return -1;
+}
+
+void rte_pcap_stream_close(struct rte_pcap_stream *stream){
+
+    if(stream->fd>=0)
+        close(stream->fd);
+
+    _buf_free(stream,stream->buf[0]);
+    _buf_free(stream,stream->buf[1]);
+
+    stream->fd = -1;
+    stream->buf[0] = NULL;
+    stream->buf[1] = NULL;
+    stream->pos = 0;
+    stream->len = 0;
+}
+
+/*
+ * Move the unparsed tail into the other buffer and top it up from the fd,
+ * returns the number of new bytes,0 if nothing is available right now.
+ */
+static size_t _refill(struct rte_pcap_stream *stream){
+
+    unsigned int next = stream->cur^1;
+    size_t tail = stream->len-stream->pos;
+    ssize_t n;
+
+    if(tail == stream->buf_size)
+        return 0;
+
+    n = read(stream->fd,stream->buf[next]+tail,stream->buf_size-tail);
+    stream->reads++;
+
+    if(n<=0){
+
+        if(n<0&&(errno == EAGAIN||errno == EWOULDBLOCK))
+            stream->eagains++;
+        else if(n == 0){
+            /*writer went away,the next one starts with a new file header*/
+            stream->hdr_done = 0;
+
+            /*and it left a record cut short,never to be finished*/
+            if(tail){
+                stream->bad_records++;
+                stream->pos = stream->len;
+            }
+        }
+
+        return 0;
+    }
+
+    if(tail)
+        memcpy(stream->buf[next],stream->buf[stream->cur]+stream->pos,tail);
+
+    stream->cur = next;
+    stream->pos = 0;
+    stream->len = tail+(size_t)n;
+    stream->bytes += (uint64_t)n;
+
+    return (size_t)n;
+}
+
+static int _parse_file_hdr(struct rte_pcap_stream *stream,const u_char *hdr){
+
+    uint32_t magic;
+
+    memcpy(&magic,hdr,sizeof(magic));
+
+    stream->swapped = 0;
+    stream->nsec = 0;
+
+    if(magic == PCAP_MAGIC_USEC)
+        return 0;
+
+    if(magic == PCAP_MAGIC_NSEC){
+        stream->nsec = 1;
+        return 0;
+    }
+
+    magic = __builtin_bswap32(magic);
+    stream->swapped = 1;
+
+    if(magic == PCAP_MAGIC_USEC)
+        return 0;
+
+    if(magic == PCAP_MAGIC_NSEC){
+        stream->nsec = 1;
+        return 0;
+    }
+
+    return -1;
+}
+
+static inline int _need(struct rte_pcap_stream *stream,size_t n){
+
+    while(stream->len-stream->pos<n){
+
+        if(_refill(stream) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+const u_char * rte_pcap_stream_read(struct rte_pcap_stream *stream,struct pcap_pkthdr *pkt_hdr){
+
+    const u_char *rec;
+    uint32_t caplen;
+
+    if(stream->fd<0)
+        return NULL;
+
+    if(!stream->hdr_done){
+
+        if(!_need(stream,PCAP_STREAM_FILE_HDR_LEN))
+            return NULL;
+
+        if(_parse_file_hdr(stream,(const u_char *)stream->buf[stream->cur]+stream->pos)){
+
+            /*not a pcap stream,drop what we have and wait for a new writer*/
+            stream->bad_records++;
+            stream->pos = stream->len;
+            return NULL;
+        }
+
+        stream->pos += PCAP_STREAM_FILE_HDR_LEN;
+        stream->hdr_done = 1;
+        stream->writers++;
+    }
+
+    if(!_need(stream,PCAP_STREAM_REC_HDR_LEN))
+        return NULL;
+
+    rec = (const u_char *)stream->buf[stream->cur]+stream->pos;
+    caplen = rd32(rec+8,stream->swapped);
+
+    if(caplen>PCAP_STREAM_MAX_CAPLEN){
+
+        /*framing is lost,resync on the next writer*/
+        stream->bad_records++;
+        stream->pos = stream->len;
+        stream->hdr_done = 0;
+        return NULL;
+    }
+
+    if(!_need(stream,PCAP_STREAM_REC_HDR_LEN+caplen))
+        return NULL;
+
+    /*the refill may have moved the record to the other buffer*/
+    rec = (const u_char *)stream->buf[stream->cur]+stream->pos;
+
+    pkt_hdr->ts.tv_sec = rd32(rec,stream->swapped);
+    pkt_hdr->ts.tv_usec = rd32(rec+4,stream->swapped);
+    if(stream->nsec)
+        pkt_hdr->ts.tv_usec /= 1000;
+    pkt_hdr->caplen = caplen;
+    pkt_hdr->len = rd32(rec+12,stream->swapped);
+
+    stream->pos += PCAP_STREAM_REC_HDR_LEN+caplen;
+
+    return rec+PCAP_STREAM_REC_HDR_LEN;
+}
+
+void rte_pcap_stream_dump(struct rte_pcap_stream *stream,FILE *out){
+
+    fprintf(out,"stream.name:%s\n",stream->name);
+    fprintf(out,"stream.buf:2x%lu(%s)\n",(unsigned long)stream->buf_size,
+            stream->buf_hugepage?"hugepage":"normal");
+    fprintf(out,"stream.reads:%llu\n",(unsigned long long)stream->reads);
+    fprintf(out,"stream.eagains:%llu\n",(unsigned long long)stream->eagains);
+    fprintf(out,"stream.bytes:%llu\n",(unsigned long long)stream->bytes);
+    fprintf(out,"stream.writers:%llu\n",(unsigned long long)stream->writers);
+    fprintf(out,"stream.bad_records:%llu\n",(unsigned long long)stream->bad_records);
+}
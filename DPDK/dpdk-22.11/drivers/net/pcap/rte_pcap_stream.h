@@ -0,0 +1,57 @@
+#ifndef _RTE_PCAP_STREAM_H_
+#define _RTE_PCAP_STREAM_H_
+
+#include <pcap.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * pcap savefile stream read from a FIFO,a pipe or stdin ("-").
+ * The fd is non-blocking and read in large chunks into two buffers:
+ * a record cut by the end of one buffer is copied to the head of the
+ * other one before the next chunk is read behind it,so the buffer being
+ * parsed is never shifted under the packet handed out last.
+ */
+
+#define PCAP_STREAM_BUF_SIZE (4*1024*1024)
+#define PCAP_STREAM_STDIN "-"
+
+struct rte_pcap_stream {
+
+    const char *name;
+    int fd;
+
+    char *buf[2];
+    size_t buf_size;
+    unsigned int buf_hugepage;
+
+    /*parsing state of the current buffer*/
+    unsigned int cur;
+    size_t pos;
+    size_t len;
+
+    /*file header of the current writer has been parsed*/
+    unsigned int hdr_done;
+    int swapped;
+    int nsec;
+
+    uint64_t reads;
+    uint64_t eagains;
+    uint64_t bytes;
+    uint64_t writers; /*file headers seen,one per writer*/
+    uint64_t bad_records;
+};
+
+int rte_pcap_stream_open(struct rte_pcap_stream *stream,const char *name,int socket_id);
+
+/*
+ * Returns the next complete record or NULL if none is buffered yet,
+ * never blocks.
+ */
+const u_char * rte_pcap_stream_read(struct rte_pcap_stream *stream,struct pcap_pkthdr *pkt_hdr);
+
+void rte_pcap_stream_close(struct rte_pcap_stream *stream);
+
+void rte_pcap_stream_dump(struct rte_pcap_stream *stream,FILE *out);
+
+#endif /*_RTE_PCAP_STREAM_H_*/
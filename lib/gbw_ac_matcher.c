@@ -0,0 +1,691 @@
+/*
+ *
+ *      Filename: gbw_ac_matcher.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: multi pattern matcher,a compiled Aho-Corasick automaton
+ *                behind a Teddy style SIMD prefilter,for DPI
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "gbw_ac_matcher.h"
+#include "gbw_log.h"
+
+#if defined(__x86_64__)||defined(__i386__)
+#include <immintrin.h>
+#define AC_HAVE_X86 1
+#endif
+
+#define AC_NBUCKETS 8
+
+/*the prefilter only pays when at most one byte pair in this many may start a pattern*/
+#define AC_PREFILTER_MAX_DENSITY 8
+
+#define AC_NONE 0xffffffffU
+
+/*trie node while compiling,children on a sibling list*/
+typedef struct {
+
+    uint32_t child;
+    uint32_t sibling;
+    uint32_t fail;
+    uint32_t out;
+    uint32_t n_out;
+    uint32_t id;
+    uint8_t cls;
+} ac_node_t;
+
+typedef struct {
+
+    uint32_t id;
+    uint32_t next;
+} ac_out_t;
+
+typedef struct {
+
+    ac_node_t *nodes;
+    uint32_t n_nodes;
+    uint32_t cap_nodes;
+
+    ac_out_t *outs;
+    uint32_t n_outs;
+    uint32_t cap_outs;
+
+    /*children of the root,by class,it has the widest fan out*/
+    uint32_t root_kids[256];
+} ac_build_t;
+
+static inline uint8_t _fold(const gbw_ac_matcher_t *ac,uint8_t b){
+
+    return (ac->flags&GBW_AC_NOCASE)?(uint8_t)tolower(b):b;
+}
+
+gbw_ac_matcher_t * gbw_ac_matcher_create(gbw_pool_t *mp,int flags){
+
+    gbw_ac_matcher_t *ac = (gbw_ac_matcher_t*)gbw_pcalloc(mp,sizeof(*ac));
+
+    ac->mp = mp;
+    ac->flags = flags;
+    ac->min_len = AC_NONE;
+
+    return ac;
+}
+
+int gbw_ac_matcher_add(gbw_ac_matcher_t *ac,const void *pattern,uint32_t len,uint32_t id){
+
+    gbw_ac_pattern_t *pat;
+    uint8_t *data;
+
+    if(ac->compiled||len == 0){
+        gbw_log(GBW_LOG_ERR,"Cannot add an empty pattern or a pattern to a compiled matcher");
+        return -1;
+    }
+
+    data = (uint8_t*)gbw_palloc(ac->mp,len);
+    memcpy(data,pattern,len);
+
+    pat = (gbw_ac_pattern_t*)gbw_palloc(ac->mp,sizeof(*pat));
+    pat->data = data;
+    pat->len = len;
+    pat->id = id;
+    pat->next = ac->patterns;
+    ac->patterns = pat;
+
+    ac->n_patterns++;
+    if(len>ac->max_len)
+        ac->max_len = len;
+    if(len<ac->min_len)
+        ac->min_len = len;
+
+    return 0;
+}
+
+/*Byte classes,the bytes no pattern holds are told apart by none of them*/
+static void _classes_build(gbw_ac_matcher_t *ac){
+
+    uint8_t used[256];
+    uint8_t folded[256];
+    gbw_ac_pattern_t *pat;
+    uint32_t i,n = 0;
+
+    memset(used,0,sizeof(used));
+
+    for(pat = ac->patterns;pat;pat = pat->next){
+        for(i = 0;i<pat->len;i++)
+            used[_fold(ac,pat->data[i])] = 1;
+    }
+
+    for(i = 0;i<256;i++)
+        n += used[i];
+
+    /*every byte in use,there is no class left for the others*/
+    ac->n_classes = n == 256?256:n+1;
+
+    for(i = 0,n = n == 256?0:1;i<256;i++)
+        folded[i] = used[i]?(uint8_t)n++:0;
+
+    for(i = 0;i<256;i++)
+        ac->cmap[i] = folded[_fold(ac,(uint8_t)i)];
+}
+
+static uint32_t _node_new(ac_build_t *b,uint8_t cls){
+
+    ac_node_t *node;
+
+    if(b->n_nodes == b->cap_nodes){
+
+        b->cap_nodes = b->cap_nodes?b->cap_nodes*2:1024;
+        node = (ac_node_t*)realloc(b->nodes,sizeof(ac_node_t)*b->cap_nodes);
+        if(node == NULL)
+            return AC_NONE;
+
+        b->nodes = node;
+    }
+
+    node = &b->nodes[b->n_nodes];
+    node->child = AC_NONE;
+    node->sibling = AC_NONE;
+    node->fail = 0;
+    node->out = AC_NONE;
+    node->n_out = 0;
+    node->cls = cls;
+
+    return b->n_nodes++;
+}
+
+static inline uint32_t _child(ac_build_t *b,uint32_t n,uint8_t cls){
+
+    uint32_t k;
+
+    if(n == 0)
+        return b->root_kids[cls];
+
+    for(k = b->nodes[n].child;k!=AC_NONE;k = b->nodes[k].sibling){
+        if(b->nodes[k].cls == cls)
+            return k;
+    }
+
+    return AC_NONE;
+}
+
+static int _trie_insert(gbw_ac_matcher_t *ac,ac_build_t *b,gbw_ac_pattern_t *pat){
+
+    ac_out_t *out;
+    uint32_t n = 0,k,i;
+    uint8_t cls;
+
+    for(i = 0;i<pat->len;i++){
+
+        cls = ac->cmap[pat->data[i]];
+        k = _child(b,n,cls);
+
+        if(k == AC_NONE){
+
+            k = _node_new(b,cls);
+            if(k == AC_NONE)
+                return -1;
+
+            if(n == 0){
+                b->root_kids[cls] = k;
+            }else{
+                b->nodes[k].sibling = b->nodes[n].child;
+                b->nodes[n].child = k;
+            }
+        }
+
+        n = k;
+    }
+
+    if(b->n_outs == b->cap_outs){
+
+        b->cap_outs = b->cap_outs?b->cap_outs*2:1024;
+        out = (ac_out_t*)realloc(b->outs,sizeof(ac_out_t)*b->cap_outs);
+        if(out == NULL)
+            return -1;
+
+        b->outs = out;
+    }
+
+    b->outs[b->n_outs].id = pat->id;
+    b->outs[b->n_outs].next = b->nodes[n].out;
+    b->nodes[n].out = b->n_outs++;
+    b->nodes[n].n_out++;
+
+    return 0;
+}
+
+/*Fail links in breadth first order,which also becomes the state numbering*/
+static int _fail_build(ac_build_t *b,uint32_t *order){
+
+    uint32_t head = 1,tail = 1;
+    uint32_t n,k,f,t,c;
+
+    order[0] = 0;
+
+    for(c = 0;c<256;c++){
+
+        k = b->root_kids[c];
+        if(k!=AC_NONE){
+            b->nodes[k].fail = 0;
+            order[tail++] = k;
+        }
+    }
+
+    while(head<tail){
+
+        n = order[head++];
+
+        for(k = b->nodes[n].child;k!=AC_NONE;k = b->nodes[k].sibling){
+
+            f = b->nodes[n].fail;
+            for(;;){
+
+                t = _child(b,f,b->nodes[k].cls);
+                if(t!=AC_NONE||f == 0)
+                    break;
+                f = b->nodes[f].fail;
+            }
+
+            b->nodes[k].fail = t == AC_NONE?0:t;
+            b->nodes[k].n_out += b->nodes[b->nodes[k].fail].n_out;
+            order[tail++] = k;
+        }
+    }
+
+    return tail == b->n_nodes?0:-1;
+}
+
+static inline uint32_t _trans(const gbw_ac_matcher_t *ac,ac_build_t *b,uint32_t k){
+
+    return (b->nodes[k].id<<ac->shift)|(b->nodes[k].n_out?GBW_AC_MATCH_FLAG:0);
+}
+
+static void * _aligned_alloc(gbw_ac_matcher_t *ac,size_t size){
+
+    uintptr_t p = (uintptr_t)gbw_pcalloc(ac->mp,size+63);
+
+    ac->mem_size += size;
+
+    return (void*)((p+63)&~(uintptr_t)63);
+}
+
+static int _tables_build(gbw_ac_matcher_t *ac,ac_build_t *b,const uint32_t *order){
+
+    uint32_t ncls;
+    uint32_t i,s,k,n,f,e,o;
+    uint32_t n_edges = 0;
+    uint32_t *row;
+    gbw_ac_sparse_t *sp;
+
+    ac->n_states = b->n_nodes;
+
+    for(i = 0;i<b->n_nodes;i++)
+        b->nodes[order[i]].id = i;
+
+    /*rows padded to a power of 2,states are shifted row offsets*/
+    for(ac->shift = 0;(1U<<ac->shift)<ac->n_classes;ac->shift++);
+    ncls = 1U<<ac->shift;
+
+    if(((uint64_t)ac->n_states<<ac->shift)>=GBW_AC_MATCH_FLAG)
+        return -1;
+
+    ac->n_dense = GBW_AC_DENSE_BYTES/(ncls*sizeof(uint32_t));
+    if(ac->n_dense == 0)
+        ac->n_dense = 1;
+    if(ac->n_dense>ac->n_states)
+        ac->n_dense = ac->n_states;
+
+    ac->dense = (uint32_t*)_aligned_alloc(ac,(size_t)ac->n_dense*ncls*sizeof(uint32_t));
+
+    /*a fail state is shallower,so numbered before and already filled in*/
+    for(s = 0;s<ac->n_dense;s++){
+
+        n = order[s];
+        row = ac->dense+(size_t)s*ncls;
+
+        if(s)
+            memcpy(row,ac->dense+(size_t)b->nodes[b->nodes[n].fail].id*ncls,ncls*sizeof(uint32_t));
+
+        if(n == 0){
+
+            for(k = 0;k<ncls;k++)
+                row[k] = b->root_kids[k] == AC_NONE?0:_trans(ac,b,b->root_kids[k]);
+        }else{
+
+            for(k = b->nodes[n].child;k!=AC_NONE;k = b->nodes[k].sibling)
+                row[b->nodes[k].cls] = _trans(ac,b,k);
+        }
+    }
+
+    for(s = ac->n_dense;s<ac->n_states;s++){
+        for(k = b->nodes[order[s]].child;k!=AC_NONE;k = b->nodes[k].sibling)
+            n_edges++;
+    }
+
+    if(ac->n_states>ac->n_dense){
+
+        ac->sparse = (gbw_ac_sparse_t*)_aligned_alloc(ac,sizeof(gbw_ac_sparse_t)*(ac->n_states-ac->n_dense));
+        ac->edge_cls = (uint8_t*)_aligned_alloc(ac,n_edges+1);
+        ac->edge_next = (uint32_t*)_aligned_alloc(ac,sizeof(uint32_t)*(n_edges+1));
+    }
+
+    for(s = ac->n_dense,e = 0;s<ac->n_states;s++){
+
+        n = order[s];
+        sp = &ac->sparse[s-ac->n_dense];
+        sp->fail = b->nodes[b->nodes[n].fail].id<<ac->shift;
+        sp->edges = e;
+
+        /*sorted by class,insertion into the few edges of a deep state*/
+        for(k = b->nodes[n].child;k!=AC_NONE;k = b->nodes[k].sibling){
+
+            for(i = e;i>sp->edges&&ac->edge_cls[i-1]>b->nodes[k].cls;i--){
+                ac->edge_cls[i] = ac->edge_cls[i-1];
+                ac->edge_next[i] = ac->edge_next[i-1];
+            }
+
+            ac->edge_cls[i] = b->nodes[k].cls;
+            ac->edge_next[i] = _trans(ac,b,k);
+            e++;
+        }
+
+        sp->n_edges = (uint16_t)(e-sp->edges);
+    }
+
+    /*outputs,a state reports its own patterns then those of its fail state*/
+    ac->out_offs = (uint32_t*)_aligned_alloc(ac,sizeof(uint32_t)*(ac->n_states+1));
+
+    for(s = 0,o = 0;s<ac->n_states;s++){
+        ac->out_offs[s] = o;
+        o += b->nodes[order[s]].n_out;
+    }
+    ac->out_offs[ac->n_states] = o;
+
+    ac->out_ids = (uint32_t*)_aligned_alloc(ac,sizeof(uint32_t)*(o+1));
+
+    for(s = 0;s<ac->n_states;s++){
+
+        n = order[s];
+        o = ac->out_offs[s];
+
+        for(k = b->nodes[n].out;k!=AC_NONE;k = b->outs[k].next)
+            ac->out_ids[o++] = b->outs[k].id;
+
+        if(s){
+            f = b->nodes[b->nodes[n].fail].id;
+            memcpy(ac->out_ids+o,ac->out_ids+ac->out_offs[f],sizeof(uint32_t)*(ac->out_offs[f+1]-ac->out_offs[f]));
+        }
+    }
+
+    return 0;
+}
+
+static inline uint32_t _cand(const gbw_ac_matcher_t *ac,uint8_t a,uint8_t b){
+
+    return ac->masks[0][a&15]&ac->masks[1][a>>4]&ac->masks[2][b&15]&ac->masks[3][b>>4];
+}
+
+/*
+ * First position from i on where a pattern may start,or the last byte
+ * whose follower is not known yet,the automaton takes it from there.
+ */
+static uint32_t _skip_scalar(const gbw_ac_matcher_t *ac,const uint8_t *data,uint32_t i,uint32_t len){
+
+    for(;i+1<len;i++){
+        if(_cand(ac,data[i],data[i+1]))
+            return i;
+    }
+
+    return i;
+}
+
+#ifdef AC_HAVE_X86
+
+__attribute__((target("ssse3")))
+static uint32_t _skip_ssse3(const gbw_ac_matcher_t *ac,const uint8_t *data,uint32_t i,uint32_t len){
+
+    const __m128i nib = _mm_set1_epi8(0x0f);
+    const __m128i lo0 = _mm_loadu_si128((const __m128i*)ac->masks[0]);
+    const __m128i hi0 = _mm_loadu_si128((const __m128i*)ac->masks[1]);
+    const __m128i lo1 = _mm_loadu_si128((const __m128i*)ac->masks[2]);
+    const __m128i hi1 = _mm_loadu_si128((const __m128i*)ac->masks[3]);
+    __m128i v0,v1,r;
+    uint32_t bits;
+
+    for(;i+17<=len;i += 16){
+
+        v0 = _mm_loadu_si128((const __m128i*)(data+i));
+        v1 = _mm_loadu_si128((const __m128i*)(data+i+1));
+
+        r = _mm_and_si128(_mm_shuffle_epi8(lo0,_mm_and_si128(v0,nib)),
+                _mm_shuffle_epi8(hi0,_mm_and_si128(_mm_srli_epi16(v0,4),nib)));
+        r = _mm_and_si128(r,_mm_shuffle_epi8(lo1,_mm_and_si128(v1,nib)));
+        r = _mm_and_si128(r,_mm_shuffle_epi8(hi1,_mm_and_si128(_mm_srli_epi16(v1,4),nib)));
+
+        bits = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(r,_mm_setzero_si128()))&0xffff;
+        if(bits)
+            return i+(uint32_t)__builtin_ctz(bits);
+    }
+
+    return _skip_scalar(ac,data,i,len);
+}
+
+__attribute__((target("avx2")))
+static uint32_t _skip_avx2(const gbw_ac_matcher_t *ac,const uint8_t *data,uint32_t i,uint32_t len){
+
+    const __m256i nib = _mm256_set1_epi8(0x0f);
+    const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ac->masks[0]));
+    const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ac->masks[1]));
+    const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ac->masks[2]));
+    const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ac->masks[3]));
+    __m256i v0,v1,r;
+    uint32_t bits;
+
+    for(;i+33<=len;i += 32){
+
+        v0 = _mm256_loadu_si256((const __m256i*)(data+i));
+        v1 = _mm256_loadu_si256((const __m256i*)(data+i+1));
+
+        r = _mm256_and_si256(_mm256_shuffle_epi8(lo0,_mm256_and_si256(v0,nib)),
+                _mm256_shuffle_epi8(hi0,_mm256_and_si256(_mm256_srli_epi16(v0,4),nib)));
+        r = _mm256_and_si256(r,_mm256_shuffle_epi8(lo1,_mm256_and_si256(v1,nib)));
+        r = _mm256_and_si256(r,_mm256_shuffle_epi8(hi1,_mm256_and_si256(_mm256_srli_epi16(v1,4),nib)));
+
+        bits = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(r,_mm256_setzero_si256()));
+        if(bits)
+            return i+(uint32_t)__builtin_ctz(bits);
+    }
+
+    return _skip_ssse3(ac,data,i,len);
+}
+
+#endif /*AC_HAVE_X86*/
+
+static inline void _mask_set(uint8_t lo[16],uint8_t hi[16],int b,uint8_t bit){
+
+    int i;
+
+    /*-1 stands for any byte,after a one byte pattern*/
+    if(b<0){
+        for(i = 0;i<16;i++){
+            lo[i] |= bit;
+            hi[i] |= bit;
+        }
+        return;
+    }
+
+    lo[b&15] |= bit;
+    hi[b>>4] |= bit;
+}
+
+static int _prefix_cmp(const void *a,const void *b){
+
+    return *(const int*)a-*(const int*)b;
+}
+
+/*
+ * Teddy style buckets over the first two bytes of the patterns,sorted so
+ * that each bucket gets prefixes alike and the nibble masks stay tight.
+ * Off when the pairs let through are too many to skip anything.
+ */
+static void _prefilter_build(gbw_ac_matcher_t *ac){
+
+    gbw_ac_pattern_t *pat;
+    int *prefixes;
+    uint32_t n = 0,u,i,per;
+    uint32_t a,b,cands = 0;
+    int b0,b1;
+    uint8_t bit;
+
+    ac->skip = NULL;
+    memset(ac->masks,0,sizeof(ac->masks));
+
+    prefixes = (int*)malloc(sizeof(int)*ac->n_patterns);
+    if(prefixes == NULL)
+        return;
+
+    for(pat = ac->patterns;pat;pat = pat->next){
+        b0 = _fold(ac,pat->data[0]);
+        b1 = pat->len>1?_fold(ac,pat->data[1]):256;
+        prefixes[n++] = (b0<<9)|b1;
+    }
+
+    qsort(prefixes,n,sizeof(int),_prefix_cmp);
+
+    for(i = 1,u = 1;i<n;i++){
+        if(prefixes[i]!=prefixes[u-1])
+            prefixes[u++] = prefixes[i];
+    }
+
+    per = (u+AC_NBUCKETS-1)/AC_NBUCKETS;
+
+    for(i = 0;i<u;i++){
+
+        bit = (uint8_t)(1<<(i/per));
+        b0 = prefixes[i]>>9;
+        b1 = prefixes[i]&0x1ff;
+        b1 = b1 == 256?-1:b1;
+
+        _mask_set(ac->masks[0],ac->masks[1],b0,bit);
+        if(ac->flags&GBW_AC_NOCASE)
+            _mask_set(ac->masks[0],ac->masks[1],toupper(b0),bit);
+
+        _mask_set(ac->masks[2],ac->masks[3],b1,bit);
+        if(b1>=0&&(ac->flags&GBW_AC_NOCASE))
+            _mask_set(ac->masks[2],ac->masks[3],toupper(b1),bit);
+    }
+
+    free(prefixes);
+
+    for(a = 0;a<256;a++){
+        for(b = 0;b<256;b++){
+            if(_cand(ac,(uint8_t)a,(uint8_t)b))
+                cands++;
+        }
+    }
+
+    if(cands*AC_PREFILTER_MAX_DENSITY>256*256)
+        return;
+
+#ifdef AC_HAVE_X86
+    if(__builtin_cpu_supports("avx2"))
+        ac->skip = _skip_avx2;
+    else if(__builtin_cpu_supports("ssse3"))
+        ac->skip = _skip_ssse3;
+#endif
+}
+
+int gbw_ac_matcher_compile(gbw_ac_matcher_t *ac){
+
+    ac_build_t b;
+    gbw_ac_pattern_t *pat;
+    uint32_t *order = NULL;
+    int rc = -1;
+
+    if(ac->compiled||ac->n_patterns == 0){
+        gbw_log(GBW_LOG_ERR,"Matcher is already compiled or has no pattern");
+        return -1;
+    }
+
+    memset(&b,0,sizeof(b));
+    memset(b.root_kids,0xff,sizeof(b.root_kids));
+
+    _classes_build(ac);
+
+    if(_node_new(&b,0) == AC_NONE)
+        goto out;
+
+    for(pat = ac->patterns;pat;pat = pat->next){
+        if(_trie_insert(ac,&b,pat))
+            goto out;
+    }
+
+    order = (uint32_t*)malloc(sizeof(uint32_t)*b.n_nodes);
+    if(order == NULL||_fail_build(&b,order))
+        goto out;
+
+    if(_tables_build(ac,&b,order))
+        goto out;
+
+    _prefilter_build(ac);
+
+    ac->compiled = 1;
+    rc = 0;
+
+out:
+    if(rc)
+        gbw_log(GBW_LOG_ERR,"No memory to compile a matcher of %u patterns",ac->n_patterns);
+
+    free(order);
+    free(b.nodes);
+    free(b.outs);
+
+    return rc;
+}
+
+static inline uint32_t _sparse_next(const gbw_ac_matcher_t *ac,uint32_t s,uint8_t c){
+
+    const uint32_t dense_end = ac->n_dense<<ac->shift;
+    const gbw_ac_sparse_t *sp;
+    uint32_t k,end;
+
+    while(s>=dense_end){
+
+        sp = &ac->sparse[(s>>ac->shift)-ac->n_dense];
+
+        for(k = sp->edges,end = k+sp->n_edges;k<end&&ac->edge_cls[k]<=c;k++){
+            if(ac->edge_cls[k] == c)
+                return ac->edge_next[k];
+        }
+
+        s = sp->fail;
+    }
+
+    return ac->dense[s+c];
+}
+
+int gbw_ac_matcher_scan_stream(const gbw_ac_matcher_t *ac,gbw_ac_stream_t *st,
+        const uint8_t *data,uint32_t len,gbw_ac_match_fn fn,void *priv){
+
+    const uint32_t *dense = ac->dense;
+    const uint32_t dense_end = ac->n_dense<<ac->shift;
+    uint32_t s = st->state;
+    uint32_t i,k,t,id;
+    uint8_t c;
+
+    for(i = 0;i<len;i++){
+
+        /*at root nothing is half matched,jump to where a pattern may start*/
+        if(s == 0&&ac->skip){
+
+            i = ac->skip(ac,data,i,len);
+            if(i>=len)
+                break;
+        }
+
+        c = ac->cmap[data[i]];
+        t = s<dense_end?dense[s+c]:_sparse_next(ac,s,c);
+        s = t&~GBW_AC_MATCH_FLAG;
+
+        if(t&GBW_AC_MATCH_FLAG){
+
+            id = s>>ac->shift;
+
+            for(k = ac->out_offs[id];k<ac->out_offs[id+1];k++){
+
+                if(fn(priv,ac->out_ids[k],st->offset+i+1)){
+                    st->state = s;
+                    st->offset += i+1;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    st->state = s;
+    st->offset += len;
+
+    return 0;
+}
+
+void gbw_ac_matcher_dump(gbw_ac_matcher_t *ac,FILE *fp){
+
+    const char *skip = "off";
+
+#ifdef AC_HAVE_X86
+    if(ac->skip == _skip_avx2)
+        skip = "avx2";
+    else if(ac->skip == _skip_ssse3)
+        skip = "ssse3";
+#endif
+
+    fprintf(fp,"Dump ac matcher info-------------------------------------------\n");
+    fprintf(fp,"The patterns:%u,min len:%u,max len:%u,nocase:%d\n",ac->n_patterns,
+            ac->n_patterns?ac->min_len:0,ac->max_len,(ac->flags&GBW_AC_NOCASE)?1:0);
+    fprintf(fp,"The states:%u,dense:%u,classes:%u,memory:%lu,prefilter:%s\n",ac->n_states,
+            ac->n_dense,ac->n_classes,(unsigned long)ac->mem_size,skip);
+}
@@ -0,0 +1,150 @@
+/*
+ *
+ *      Filename: gbw_ac_matcher.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: multi pattern matcher,a compiled Aho-Corasick automaton
+ *                behind a Teddy style SIMD prefilter,for DPI
+ *
+ */
+
+#ifndef GBW_AC_MATCHER_H
+#define GBW_AC_MATCHER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_mpool.h"
+
+/*patterns match whatever the case of ASCII letters*/
+#define GBW_AC_NOCASE 0x01
+
+/*bytes of the dense part of the state table,the hot states should stay in L2*/
+#define GBW_AC_DENSE_BYTES (256*1024)
+
+/*set in a transition when the state it leads to reports patterns*/
+#define GBW_AC_MATCH_FLAG 0x80000000U
+
+typedef struct gbw_ac_matcher_t gbw_ac_matcher_t;
+typedef struct gbw_ac_pattern_t gbw_ac_pattern_t;
+typedef struct gbw_ac_sparse_t gbw_ac_sparse_t;
+typedef struct gbw_ac_stream_t gbw_ac_stream_t;
+
+/*
+ * Called for every pattern found,end is the offset right after its last
+ * byte,from the start of the stream. Returning non zero stops the scan.
+ */
+typedef int (*gbw_ac_match_fn)(void *priv,uint32_t id,uint64_t end);
+
+struct gbw_ac_pattern_t {
+
+    gbw_ac_pattern_t *next;
+
+    const uint8_t *data;
+    uint32_t len;
+    uint32_t id;
+};
+
+/*A deep state,its goto edges only,the rest goes through fail*/
+struct gbw_ac_sparse_t {
+
+    uint32_t fail;
+    uint32_t edges;
+    uint16_t n_edges;
+    uint16_t pad;
+};
+
+/*
+ * States are numbered breadth first and stand for their number shifted
+ * by shift,the offset of their row,so a scan step is one add and one load.
+ * The first n_dense ones have a full row of transitions,one per byte
+ * class,with failures already resolved.
+ * Deeper states,rarely reached on real traffic,keep their sorted goto
+ * edges and a fail link that ends in a dense state.
+ */
+struct gbw_ac_matcher_t {
+
+    gbw_pool_t *mp;
+    int flags;
+
+    /*added patterns until compiled*/
+    gbw_ac_pattern_t *patterns;
+    uint32_t n_patterns;
+    uint32_t max_len;
+    uint32_t min_len;
+
+    int compiled;
+
+    /*byte to class,bytes no pattern holds share class 0*/
+    uint8_t cmap[256];
+    uint32_t n_classes;
+
+    uint32_t n_states;
+    uint32_t n_dense;
+    uint32_t shift;
+    uint32_t *dense;
+
+    gbw_ac_sparse_t *sparse;
+    uint8_t *edge_cls;
+    uint32_t *edge_next;
+
+    /*pattern ids each state reports,its own and those of its fail chain*/
+    uint32_t *out_offs;
+    uint32_t *out_ids;
+
+    /*
+     * Prefilter on the first two bytes of the patterns,8 buckets of nibble
+     * masks as in Teddy,used to skip ahead while the automaton is at root.
+     */
+    uint8_t masks[4][16];
+    uint32_t (*skip)(const gbw_ac_matcher_t *ac,const uint8_t *data,uint32_t i,uint32_t len);
+
+    uint64_t mem_size;
+};
+
+/*Where a stream is between two chunks,per flow and direction,state 0 is root*/
+struct gbw_ac_stream_t {
+
+    uint32_t state;
+    uint64_t offset;
+};
+
+static inline void gbw_ac_stream_init(gbw_ac_stream_t *st){
+
+    st->state = 0;
+    st->offset = 0;
+}
+
+extern gbw_ac_matcher_t * gbw_ac_matcher_create(gbw_pool_t *mp,int flags);
+
+/*Copies the pattern,ids need not be unique,returns -1 once compiled*/
+extern int gbw_ac_matcher_add(gbw_ac_matcher_t *ac,const void *pattern,uint32_t len,uint32_t id);
+
+/*
+ * Builds the automaton,the matcher is read only afterwards and may be
+ * shared by all workers. Returns -1 without patterns or memory.
+ */
+extern int gbw_ac_matcher_compile(gbw_ac_matcher_t *ac);
+
+/*
+ * Scans the next chunk of a stream,matches across chunks are found as if
+ * the stream had come in one piece. Returns 1 if fn stopped the scan,
+ * st then stands right after the match so scanning may go on.
+ */
+extern int gbw_ac_matcher_scan_stream(const gbw_ac_matcher_t *ac,gbw_ac_stream_t *st,
+        const uint8_t *data,uint32_t len,gbw_ac_match_fn fn,void *priv);
+
+/*Scans one buffer on its own*/
+static inline int gbw_ac_matcher_scan(const gbw_ac_matcher_t *ac,const uint8_t *data,uint32_t len,
+        gbw_ac_match_fn fn,void *priv){
+
+    gbw_ac_stream_t st;
+
+    gbw_ac_stream_init(&st);
+
+    return gbw_ac_matcher_scan_stream(ac,&st,data,len,fn,priv);
+}
+
+extern void gbw_ac_matcher_dump(gbw_ac_matcher_t *ac,FILE *fp);
+
+#endif /*GBW_AC_MATCHER_H*/
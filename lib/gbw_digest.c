@@ -0,0 +1,278 @@
+/*
+ *
+ *      Filename: gbw_digest.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: MD5 and SHA-256,streaming,for fingerprints such as
+ *                JA3 and JA4 rather than for security
+ *
+ */
+
+#include <string.h>
+
+#include "gbw_digest.h"
+
+#define ROL32(x,n) (((x)<<(n))|((x)>>(32-(n))))
+#define ROR32(x,n) (((x)>>(n))|((x)<<(32-(n))))
+
+/*MD5,RFC 1321*/
+
+static const uint32_t md5_k[64] = {
+    0xd76aa478,0xe8c7b756,0x242070db,0xc1bdceee,0xf57c0faf,0x4787c62a,0xa8304613,0xfd469501,
+    0x698098d8,0x8b44f7af,0xffff5bb1,0x895cd7be,0x6b901122,0xfd987193,0xa679438e,0x49b40821,
+    0xf61e2562,0xc040b340,0x265e5a51,0xe9b6c7aa,0xd62f105d,0x02441453,0xd8a1e681,0xe7d3fbc8,
+    0x21e1cde6,0xc33707d6,0xf4d50d87,0x455a14ed,0xa9e3e905,0xfcefa3f8,0x676f02d9,0x8d2a4c8a,
+    0xfffa3942,0x8771f681,0x6d9d6122,0xfde5380c,0xa4beea44,0x4bdecfa9,0xf6bb4b60,0xbebfbc70,
+    0x289b7ec6,0xeaa127fa,0xd4ef3085,0x04881d05,0xd9d4d039,0xe6db99e5,0x1fa27cf8,0xc4ac5665,
+    0xf4292244,0x432aff97,0xab9423a7,0xfc93a039,0x655b59c3,0x8f0ccc92,0xffeff47d,0x85845dd1,
+    0x6fa87e4f,0xfe2ce6e0,0xa3014314,0x4e0811a1,0xf7537e82,0xbd3af235,0x2ad7d2bb,0xeb86d391
+};
+
+static const uint8_t md5_r[64] = {
+    7,12,17,22,7,12,17,22,7,12,17,22,7,12,17,22,
+    5,9,14,20,5,9,14,20,5,9,14,20,5,9,14,20,
+    4,11,16,23,4,11,16,23,4,11,16,23,4,11,16,23,
+    6,10,15,21,6,10,15,21,6,10,15,21,6,10,15,21
+};
+
+static void _md5_block(gbw_md5_t *ctx,const uint8_t *p){
+
+    uint32_t w[16],a,b,c,d,f,t;
+    unsigned int i,g;
+
+    for(i = 0;i<16;i++)
+        w[i] = (uint32_t)p[i*4]|((uint32_t)p[i*4+1]<<8)|((uint32_t)p[i*4+2]<<16)|((uint32_t)p[i*4+3]<<24);
+
+    a = ctx->state[0];
+    b = ctx->state[1];
+    c = ctx->state[2];
+    d = ctx->state[3];
+
+    for(i = 0;i<64;i++){
+
+        if(i<16){
+            f = (b&c)|(~b&d);
+            g = i;
+        }else if(i<32){
+            f = (d&b)|(~d&c);
+            g = (5*i+1)&15;
+        }else if(i<48){
+            f = b^c^d;
+            g = (3*i+5)&15;
+        }else{
+            f = c^(b|~d);
+            g = (7*i)&15;
+        }
+
+        t = d;
+        d = c;
+        c = b;
+        b = b+ROL32(a+f+md5_k[i]+w[g],md5_r[i]);
+        a = t;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+}
+
+void gbw_md5_init(gbw_md5_t *ctx){
+
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->len = 0;
+}
+
+void gbw_md5_update(gbw_md5_t *ctx,const void *data,size_t len){
+
+    const uint8_t *p = (const uint8_t*)data;
+    size_t used = ctx->len&63,n;
+
+    ctx->len += len;
+
+    if(used){
+
+        n = 64-used;
+        if(n>len)
+            n = len;
+
+        memcpy(ctx->buf+used,p,n);
+        p += n;
+        len -= n;
+
+        if(used+n<64)
+            return;
+
+        _md5_block(ctx,ctx->buf);
+    }
+
+    for(;len>=64;p += 64,len -= 64)
+        _md5_block(ctx,p);
+
+    memcpy(ctx->buf,p,len);
+}
+
+void gbw_md5_final(gbw_md5_t *ctx,uint8_t out[GBW_MD5_LEN]){
+
+    uint64_t bits = ctx->len<<3;
+    size_t used = ctx->len&63;
+    unsigned int i;
+
+    ctx->buf[used++] = 0x80;
+
+    if(used>56){
+        memset(ctx->buf+used,0,64-used);
+        _md5_block(ctx,ctx->buf);
+        used = 0;
+    }
+
+    memset(ctx->buf+used,0,56-used);
+    for(i = 0;i<8;i++)
+        ctx->buf[56+i] = (uint8_t)(bits>>(8*i));
+
+    _md5_block(ctx,ctx->buf);
+
+    for(i = 0;i<16;i++)
+        out[i] = (uint8_t)(ctx->state[i>>2]>>(8*(i&3)));
+}
+
+/*SHA-256,FIPS 180-4*/
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static void _sha256_block(gbw_sha256_t *ctx,const uint8_t *p){
+
+    uint32_t w[64],a,b,c,d,e,f,g,h,t1,t2;
+    unsigned int i;
+
+    for(i = 0;i<16;i++)
+        w[i] = ((uint32_t)p[i*4]<<24)|((uint32_t)p[i*4+1]<<16)|((uint32_t)p[i*4+2]<<8)|p[i*4+3];
+
+    for(;i<64;i++)
+        w[i] = (ROR32(w[i-2],17)^ROR32(w[i-2],19)^(w[i-2]>>10))+w[i-7]+
+            (ROR32(w[i-15],7)^ROR32(w[i-15],18)^(w[i-15]>>3))+w[i-16];
+
+    a = ctx->state[0];
+    b = ctx->state[1];
+    c = ctx->state[2];
+    d = ctx->state[3];
+    e = ctx->state[4];
+    f = ctx->state[5];
+    g = ctx->state[6];
+    h = ctx->state[7];
+
+    for(i = 0;i<64;i++){
+
+        t1 = h+(ROR32(e,6)^ROR32(e,11)^ROR32(e,25))+((e&f)^(~e&g))+sha256_k[i]+w[i];
+        t2 = (ROR32(a,2)^ROR32(a,13)^ROR32(a,22))+((a&b)^(a&c)^(b&c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d+t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1+t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+void gbw_sha256_init(gbw_sha256_t *ctx){
+
+    ctx->state[0] = 0x6a09e667;
+    ctx->state[1] = 0xbb67ae85;
+    ctx->state[2] = 0x3c6ef372;
+    ctx->state[3] = 0xa54ff53a;
+    ctx->state[4] = 0x510e527f;
+    ctx->state[5] = 0x9b05688c;
+    ctx->state[6] = 0x1f83d9ab;
+    ctx->state[7] = 0x5be0cd19;
+    ctx->len = 0;
+}
+
+void gbw_sha256_update(gbw_sha256_t *ctx,const void *data,size_t len){
+
+    const uint8_t *p = (const uint8_t*)data;
+    size_t used = ctx->len&63,n;
+
+    ctx->len += len;
+
+    if(used){
+
+        n = 64-used;
+        if(n>len)
+            n = len;
+
+        memcpy(ctx->buf+used,p,n);
+        p += n;
+        len -= n;
+
+        if(used+n<64)
+            return;
+
+        _sha256_block(ctx,ctx->buf);
+    }
+
+    for(;len>=64;p += 64,len -= 64)
+        _sha256_block(ctx,p);
+
+    memcpy(ctx->buf,p,len);
+}
+
+void gbw_sha256_final(gbw_sha256_t *ctx,uint8_t out[GBW_SHA256_LEN]){
+
+    uint64_t bits = ctx->len<<3;
+    size_t used = ctx->len&63;
+    unsigned int i;
+
+    ctx->buf[used++] = 0x80;
+
+    if(used>56){
+        memset(ctx->buf+used,0,64-used);
+        _sha256_block(ctx,ctx->buf);
+        used = 0;
+    }
+
+    memset(ctx->buf+used,0,56-used);
+    for(i = 0;i<8;i++)
+        ctx->buf[63-i] = (uint8_t)(bits>>(8*i));
+
+    _sha256_block(ctx,ctx->buf);
+
+    for(i = 0;i<32;i++)
+        out[i] = (uint8_t)(ctx->state[i>>2]>>(24-8*(i&3)));
+}
+
+void gbw_digest_hex(char *out,const uint8_t *in,size_t n){
+
+    static const char hex[] = "0123456789abcdef";
+    size_t i;
+
+    for(i = 0;i<n;i++){
+        out[2*i] = hex[in[i]>>4];
+        out[2*i+1] = hex[in[i]&15];
+    }
+
+    out[2*n] = 0;
+}
@@ -0,0 +1,48 @@
+/*
+ *
+ *      Filename: gbw_digest.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: MD5 and SHA-256,streaming,for fingerprints such as
+ *                JA3 and JA4 rather than for security
+ *
+ */
+
+#ifndef GBW_DIGEST_H
+#define GBW_DIGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GBW_MD5_LEN    16
+#define GBW_SHA256_LEN 32
+
+typedef struct gbw_md5_t gbw_md5_t;
+typedef struct gbw_sha256_t gbw_sha256_t;
+
+struct gbw_md5_t {
+
+    uint32_t state[4];
+    uint64_t len;
+    uint8_t buf[64];
+};
+
+struct gbw_sha256_t {
+
+    uint32_t state[8];
+    uint64_t len;
+    uint8_t buf[64];
+};
+
+extern void gbw_md5_init(gbw_md5_t *ctx);
+extern void gbw_md5_update(gbw_md5_t *ctx,const void *data,size_t len);
+extern void gbw_md5_final(gbw_md5_t *ctx,uint8_t out[GBW_MD5_LEN]);
+
+extern void gbw_sha256_init(gbw_sha256_t *ctx);
+extern void gbw_sha256_update(gbw_sha256_t *ctx,const void *data,size_t len);
+extern void gbw_sha256_final(gbw_sha256_t *ctx,uint8_t out[GBW_SHA256_LEN]);
+
+/*lowercase hex of n bytes into out,which gets 2*n chars and a NUL*/
+extern void gbw_digest_hex(char *out,const uint8_t *in,size_t n);
+
+#endif /*GBW_DIGEST_H*/
@@ -0,0 +1,249 @@
+/*
+ *
+ *      Filename: gbw_dns_parser.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: DNS message decoder,names are decoded into a caller's
+ *                scratch buffer,nothing is allocated
+ *
+ */
+
+#include <string.h>
+
+#include "gbw_dns_parser.h"
+
+#define _rd16(p) ((uint16_t)(((p)[0]<<8)|(p)[1]))
+#define _rd32(p) (((uint32_t)(p)[0]<<24)|((uint32_t)(p)[1]<<16)|((uint32_t)(p)[2]<<8)|(p)[3])
+
+#define _RR_FIXED_LEN 10
+
+/*
+ * Decodes the name at off into the scratch buffer,following compression
+ * pointers. Each pointer has to go back before the previous jump,so a
+ * name can't loop. Bytes that would make the dotted form ambiguous or
+ * unprintable come out as '?'.
+ * Returns the offset right after the name in the message,0 if malformed.
+ */
+static uint32_t _name(const uint8_t *data,uint32_t len,uint32_t off,gbw_dns_scratch_t *sc,
+        const char **name,uint16_t *name_len){
+
+    char *out = sc->buf+sc->used;
+    uint32_t pos = off,next = 0,limit = off,n = 0,i;
+    uint8_t c,b;
+
+    if(sc->used+256>GBW_DNS_SCRATCH_SIZE)
+        return 0;
+
+    for(;;){
+
+        if(pos>=len)
+            return 0;
+
+        c = data[pos];
+
+        if(c == 0){
+            pos++;
+            break;
+        }
+
+        if((c&0xc0) == 0xc0){
+
+            uint32_t ptr;
+
+            if(pos+1>=len)
+                return 0;
+
+            ptr = ((uint32_t)(c&0x3f)<<8)|data[pos+1];
+            if(ptr>=limit)
+                return 0;
+
+            limit = ptr;
+
+            if(next == 0)
+                next = pos+2;
+
+            pos = ptr;
+            continue;
+        }
+
+        /*the extended label types never made it*/
+        if(c&0xc0)
+            return 0;
+
+        if(pos+1+c>len||n+c+(n?1:0)>255)
+            return 0;
+
+        if(n)
+            out[n++] = '.';
+
+        for(i = 1;i<=c;i++){
+
+            b = data[pos+i];
+            out[n++] = (b>0x20&&b<0x7f&&b!='.')?(char)b:'?';
+        }
+
+        pos += 1+c;
+    }
+
+    if(n == 0)
+        out[n++] = '.';
+
+    out[n] = 0;
+    sc->used += n+1;
+
+    *name = out;
+    *name_len = (uint16_t)n;
+
+    return next?next:pos;
+}
+
+/*Steps over a name without decoding it,0 if malformed*/
+static inline uint32_t _skip_name(const uint8_t *data,uint32_t len,uint32_t off){
+
+    uint8_t c;
+
+    while(off<len){
+
+        c = data[off];
+
+        if(c == 0)
+            return off+1;
+
+        if((c&0xc0) == 0xc0)
+            return off+2<=len?off+2:0;
+
+        if(c&0xc0)
+            return 0;
+
+        off += 1+c;
+    }
+
+    return 0;
+}
+
+static void _rr_name(const uint8_t *data,uint32_t len,uint32_t off,uint16_t skip,
+        gbw_dns_scratch_t *sc,gbw_dns_rr_t *rr){
+
+    if(rr->rdlen<=skip||_name(data,len,off+skip,sc,&rr->name,&rr->name_len) == 0){
+        rr->name = NULL;
+        rr->name_len = 0;
+    }
+}
+
+int gbw_dns_parse(gbw_dns_msg_t *msg,gbw_dns_scratch_t *sc,const uint8_t *data,uint32_t len){
+
+    gbw_dns_rr_t *rr;
+    uint32_t off,i,n_rrs,ttl;
+    uint16_t type,rdlen;
+
+    if(len<GBW_DNS_HEADER_LEN)
+        return -1;
+
+    sc->used = 0;
+
+    msg->id = _rd16(data);
+    msg->flags = _rd16(data+2);
+    msg->qdcount = _rd16(data+4);
+    msg->ancount = _rd16(data+6);
+    msg->nscount = _rd16(data+8);
+    msg->arcount = _rd16(data+10);
+
+    msg->rcode = GBW_DNS_RCODE(msg->flags);
+    msg->n_answers = 0;
+    msg->edns = 0;
+    msg->edns_version = 0;
+    msg->edns_do = 0;
+    msg->edns_size = 0;
+
+    msg->qname = "";
+    msg->qname_len = 0;
+    msg->qtype = 0;
+    msg->qclass = 0;
+
+    off = GBW_DNS_HEADER_LEN;
+
+    for(i = 0;i<msg->qdcount;i++){
+
+        if(i == 0)
+            off = _name(data,len,off,sc,&msg->qname,&msg->qname_len);
+        else
+            off = _skip_name(data,len,off);
+
+        if(off == 0||off+4>len){
+
+            if(i == 0)
+                return -1;
+            return 0;
+        }
+
+        if(i == 0){
+            msg->qtype = _rd16(data+off);
+            msg->qclass = _rd16(data+off+2);
+        }
+
+        off += 4;
+    }
+
+    /*answers,authority then additional,only the owner of an OPT matters*/
+    n_rrs = (uint32_t)msg->ancount+msg->nscount+msg->arcount;
+
+    for(i = 0;i<n_rrs;i++){
+
+        off = _skip_name(data,len,off);
+        if(off == 0||off+_RR_FIXED_LEN>len)
+            return 0;
+
+        type = _rd16(data+off);
+        ttl = _rd32(data+off+4);
+        rdlen = _rd16(data+off+8);
+        off += _RR_FIXED_LEN;
+
+        if(off+rdlen>len)
+            return 0;
+
+        if(i<msg->ancount&&msg->n_answers<GBW_DNS_MAX_ANSWERS){
+
+            rr = &msg->answers[msg->n_answers++];
+            rr->type = type;
+            rr->rclass = _rd16(data+off-8);
+            rr->ttl = ttl;
+            rr->rdata = data+off;
+            rr->rdlen = rdlen;
+            rr->name = NULL;
+            rr->name_len = 0;
+
+            switch(type){
+
+            case GBW_DNS_TYPE_CNAME:
+            case GBW_DNS_TYPE_NS:
+            case GBW_DNS_TYPE_PTR:
+                _rr_name(data,len,off,0,sc,rr);
+                break;
+
+            case GBW_DNS_TYPE_MX:
+                _rr_name(data,len,off,2,sc,rr);
+                break;
+
+            case GBW_DNS_TYPE_SRV:
+                _rr_name(data,len,off,6,sc,rr);
+                break;
+
+            default:
+                break;
+            }
+
+        }else if(type == GBW_DNS_TYPE_OPT&&i>=(uint32_t)msg->ancount+msg->nscount&&!msg->edns){
+
+            /*class is the UDP payload size,ttl the extended rcode,version and flags*/
+            msg->edns = 1;
+            msg->edns_size = _rd16(data+off-8);
+            msg->edns_version = (uint8_t)(ttl>>16);
+            msg->edns_do = (ttl>>15)&1;
+            msg->rcode |= (uint16_t)((ttl>>24)<<4);
+        }
+
+        off += rdlen;
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ *
+ *      Filename: gbw_dns_parser.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: DNS message decoder,names are decoded into a caller's
+ *                scratch buffer,nothing is allocated
+ *
+ */
+
+#ifndef GBW_DNS_PARSER_H
+#define GBW_DNS_PARSER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define GBW_DNS_HEADER_LEN 12
+
+/*answers decoded from a message,the others are only counted*/
+#define GBW_DNS_MAX_ANSWERS 8
+
+/*
+ * Room for the decoded names of one message: the question and the
+ * answers,up to 255 bytes each as RFC 1035 limits them.
+ */
+#define GBW_DNS_SCRATCH_SIZE ((GBW_DNS_MAX_ANSWERS+1)*256)
+
+#define GBW_DNS_TYPE_A     1
+#define GBW_DNS_TYPE_NS    2
+#define GBW_DNS_TYPE_CNAME 5
+#define GBW_DNS_TYPE_SOA   6
+#define GBW_DNS_TYPE_PTR   12
+#define GBW_DNS_TYPE_MX    15
+#define GBW_DNS_TYPE_TXT   16
+#define GBW_DNS_TYPE_AAAA  28
+#define GBW_DNS_TYPE_SRV   33
+#define GBW_DNS_TYPE_OPT   41
+
+#define GBW_DNS_QR(flags)     (((flags)>>15)&1)
+#define GBW_DNS_OPCODE(flags) (((flags)>>11)&0xf)
+#define GBW_DNS_TC(flags)     (((flags)>>9)&1)
+#define GBW_DNS_RCODE(flags)  ((flags)&0xf)
+
+typedef struct gbw_dns_scratch_t gbw_dns_scratch_t;
+typedef struct gbw_dns_rr_t gbw_dns_rr_t;
+typedef struct gbw_dns_msg_t gbw_dns_msg_t;
+
+/*Per worker,reused by every message,names stay valid until the next parse*/
+struct gbw_dns_scratch_t {
+
+    uint32_t used;
+    char buf[GBW_DNS_SCRATCH_SIZE];
+};
+
+/*
+ * An answer record. Names in rdata,of CNAME,NS,PTR,MX and SRV,are decoded
+ * into name,other rdata is left in the message for the caller.
+ */
+struct gbw_dns_rr_t {
+
+    uint16_t type;
+    uint16_t rclass;
+    uint32_t ttl;
+
+    const uint8_t *rdata;
+    uint16_t rdlen;
+
+    uint16_t name_len;
+    const char *name;
+};
+
+struct gbw_dns_msg_t {
+
+    uint16_t id;
+    uint16_t flags;
+    uint16_t qdcount;
+    uint16_t ancount;
+    uint16_t nscount;
+    uint16_t arcount;
+
+    /*first question,dotted,"." for the root*/
+    const char *qname;
+    uint16_t qname_len;
+    uint16_t qtype;
+    uint16_t qclass;
+
+    uint16_t n_answers;
+    gbw_dns_rr_t answers[GBW_DNS_MAX_ANSWERS];
+
+    /*rcode with the EDNS extended bits*/
+    uint16_t rcode;
+
+    /*an OPT record was found*/
+    uint8_t edns;
+    uint8_t edns_version;
+    uint8_t edns_do;
+    uint16_t edns_size;
+};
+
+/*
+ * Decodes the header,the first question,the first GBW_DNS_MAX_ANSWERS
+ * answers and the EDNS OPT record of a message,without the TCP length.
+ * Returns -1 on a header or question that doesn't fit the data; later
+ * sections cut short are kept up to where they break.
+ */
+extern int gbw_dns_parse(gbw_dns_msg_t *msg,gbw_dns_scratch_t *sc,const uint8_t *data,uint32_t len);
+
+#endif /*GBW_DNS_PARSER_H*/
@@ -0,0 +1,319 @@
+/*
+ *
+ *      Filename: gbw_flow_table.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: single writer flow table keyed on the 5-tuple,
+ *                open addressing over buckets of 8 signatures
+ *
+ */
+
+#include <stdlib.h>
+#include "gbw_flow_table.h"
+#include "gbw_util.h"
+#include "gbw_log.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*signature 0 marks a free slot*/
+#define FLOW_SIG(hash) ((uint16_t)((hash)>>16)?(uint16_t)((hash)>>16):1)
+
+#define FLOW_BUCKET(ft,i) (&(ft)->buckets[(i)&(ft)->bucket_mask])
+
+/*
+ * One bit per slot matching sig,at bit 2*slot.
+ * SSE2 compares all 8 signatures of the bucket in one instruction.
+ */
+static inline uint32_t _sig_match(const gbw_flow_bucket_t *b,uint16_t sig){
+
+#if defined(__SSE2__)
+    __m128i v = _mm_load_si128((const __m128i*)b->sigs);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v,_mm_set1_epi16((short)sig)))&0x5555;
+#else
+    uint32_t m = 0;
+    int i;
+
+    for(i = 0;i<GBW_FLOW_BUCKET_ENTRIES;i++)
+        m |= (uint32_t)(b->sigs[i] == sig)<<(i*2);
+
+    return m;
+#endif
+}
+
+static inline gbw_flow_entry_t * _bucket_find(gbw_flow_table_t *ft,uint32_t idx,
+        const gbw_flow_key_t *key,uint32_t hash,uint16_t sig){
+
+    gbw_flow_bucket_t *b;
+    gbw_flow_entry_t *entry;
+    uint32_t i,m;
+
+    for(i = 0;i<=ft->bucket_mask;i++){
+
+        b = FLOW_BUCKET(ft,idx+i);
+
+        for(m = _sig_match(b,sig);m;m &= m-1){
+
+            entry = b->entries[__builtin_ctz(m)>>1];
+            if(entry->hash == hash&&gbw_flow_key_equal(&entry->key,key))
+                return entry;
+        }
+
+        if(b->overflow == 0)
+            break;
+    }
+
+    return NULL;
+}
+
+gbw_flow_table_t * gbw_flow_table_create(gbw_pool_t *mp,size_t max_entries,size_t priv_size,int hugepage){
+
+    gbw_flow_table_t *ft;
+    size_t nb_buckets = 2;
+    size_t entry_size;
+
+    if(max_entries == 0){
+        gbw_log(GBW_LOG_ERR,"The flow table needs at least one entry");
+        return NULL;
+    }
+
+    /*keep the load under 80%*/
+    while(nb_buckets*GBW_FLOW_BUCKET_ENTRIES*4<max_entries*5)
+        nb_buckets <<= 1;
+
+    if(nb_buckets>(size_t)UINT32_MAX+1){
+        gbw_log(GBW_LOG_ERR,"Too many flow table entries:%lu",(unsigned long)max_entries);
+        return NULL;
+    }
+
+    ft = (gbw_flow_table_t*)gbw_pcalloc(mp,sizeof(*ft));
+    if(ft == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for a flow table");
+        return NULL;
+    }
+
+    ft->max_entries = max_entries;
+    ft->priv_size = priv_size;
+    ft->bucket_mask = (uint32_t)(nb_buckets-1);
+    ft->buckets_size = nb_buckets*sizeof(gbw_flow_bucket_t);
+
+    entry_size = (sizeof(gbw_flow_entry_t)+priv_size+7)&~(size_t)7;
+
+    if(hugepage){
+
+        ft->buckets = (gbw_flow_bucket_t*)gbw_hugepage_alloc(ft->buckets_size,&ft->buckets_huge);
+        ft->entry_pool = gbw_object_pool_create_hugepage(mp,max_entries,entry_size,NULL,NULL);
+        ft->hugepage = 1;
+    }else{
+
+        if(posix_memalign((void**)&ft->buckets,64,ft->buckets_size))
+            ft->buckets = NULL;
+        else
+            memset(ft->buckets,0,ft->buckets_size);
+
+        ft->entry_pool = gbw_object_pool_create(mp,max_entries,entry_size,NULL,NULL);
+    }
+
+    if(ft->buckets == NULL||ft->entry_pool == NULL){
+
+        gbw_log(GBW_LOG_ERR,"No memory for a flow table of %lu entries",(unsigned long)max_entries);
+        gbw_flow_table_destroy(ft);
+        return NULL;
+    }
+
+    return ft;
+}
+
+void gbw_flow_table_destroy(gbw_flow_table_t *ft){
+
+    if(ft->entry_pool){
+        gbw_object_pool_destroy(ft->entry_pool);
+        ft->entry_pool = NULL;
+    }
+
+    if(ft->buckets){
+
+        if(ft->hugepage)
+            gbw_hugepage_free(ft->buckets,ft->buckets_size);
+        else
+            free(ft->buckets);
+
+        ft->buckets = NULL;
+    }
+}
+
+gbw_flow_entry_t * gbw_flow_table_lookup(gbw_flow_table_t *ft,const gbw_flow_key_t *key,uint32_t hash){
+
+    return _bucket_find(ft,hash&ft->bucket_mask,key,hash,FLOW_SIG(hash));
+}
+
+uint32_t gbw_flow_table_lookup_burst(gbw_flow_table_t *ft,const gbw_flow_key_t *keys,
+        const uint32_t *hashes,uint32_t n,gbw_flow_entry_t **entries){
+
+    gbw_flow_bucket_t *bs[GBW_FLOW_BURST_MAX];
+    uint32_t ms[GBW_FLOW_BURST_MAX];
+    gbw_flow_entry_t *entry;
+    uint32_t i,m,hits = 0;
+
+    if(n>GBW_FLOW_BURST_MAX)
+        n = GBW_FLOW_BURST_MAX;
+
+    /*both bucket lines of the whole burst*/
+    for(i = 0;i<n;i++){
+
+        bs[i] = FLOW_BUCKET(ft,hashes[i]);
+        __builtin_prefetch(bs[i]->sigs);
+        __builtin_prefetch(bs[i]->entries);
+    }
+
+    /*first candidate entry of each key*/
+    for(i = 0;i<n;i++){
+
+        ms[i] = _sig_match(bs[i],FLOW_SIG(hashes[i]));
+        entries[i] = NULL;
+
+        if(ms[i]){
+            entry = bs[i]->entries[__builtin_ctz(ms[i])>>1];
+            __builtin_prefetch(entry);
+            entries[i] = entry;
+        }
+    }
+
+    for(i = 0;i<n;i++){
+
+        entry = entries[i];
+        if(entry&&entry->hash == hashes[i]&&gbw_flow_key_equal(&entry->key,&keys[i])){
+            hits++;
+            continue;
+        }
+
+        entries[i] = NULL;
+
+        /*signature clashes in the home bucket or keys pushed past it*/
+        m = ms[i]&(ms[i]-1);
+        if(m||bs[i]->overflow){
+
+            entries[i] = _bucket_find(ft,hashes[i]&ft->bucket_mask,&keys[i],hashes[i],FLOW_SIG(hashes[i]));
+            if(entries[i])
+                hits++;
+        }
+    }
+
+    return hits;
+}
+
+gbw_flow_entry_t * gbw_flow_table_add(gbw_flow_table_t *ft,const gbw_flow_key_t *key,uint32_t hash){
+
+    gbw_flow_bucket_t *b = NULL;
+    gbw_flow_entry_t *entry;
+    uint32_t idx = hash&ft->bucket_mask;
+    uint32_t i,j,m = 0;
+
+    if(ft->n_entries>=ft->max_entries){
+        ft->n_full++;
+        return NULL;
+    }
+
+    for(i = 0;i<=ft->bucket_mask;i++){
+
+        b = FLOW_BUCKET(ft,idx+i);
+        m = _sig_match(b,0);
+        if(m)
+            break;
+    }
+
+    if(m == 0){
+        ft->n_full++;
+        return NULL;
+    }
+
+    entry = (gbw_flow_entry_t*)gbw_object_pool_get(ft->entry_pool);
+    if(entry == NULL){
+        ft->n_full++;
+        return NULL;
+    }
+
+    memset(entry,0,sizeof(*entry)+ft->priv_size);
+    entry->key = *key;
+    entry->hash = hash;
+    entry->bucket = (idx+i)&ft->bucket_mask;
+
+    j = __builtin_ctz(m)>>1;
+    b->sigs[j] = FLOW_SIG(hash);
+    b->entries[j] = entry;
+
+    if(i){
+
+        for(j = 0;j<i;j++)
+            FLOW_BUCKET(ft,idx+j)->overflow++;
+
+        ft->n_overflows++;
+    }
+
+    ft->n_entries++;
+    ft->n_adds++;
+
+    return entry;
+}
+
+void gbw_flow_table_del(gbw_flow_table_t *ft,gbw_flow_entry_t *entry){
+
+    gbw_flow_bucket_t *b = &ft->buckets[entry->bucket];
+    uint32_t i;
+
+    for(i = 0;i<GBW_FLOW_BUCKET_ENTRIES;i++){
+
+        if(b->entries[i] == entry){
+
+            b->sigs[i] = 0;
+            b->entries[i] = NULL;
+            break;
+        }
+    }
+
+    if(i == GBW_FLOW_BUCKET_ENTRIES){
+        gbw_log(GBW_LOG_ERR,"Delete a flow entry that is not in the table");
+        return;
+    }
+
+    for(i = entry->hash&ft->bucket_mask;i!=entry->bucket;i = (i+1)&ft->bucket_mask)
+        ft->buckets[i].overflow--;
+
+    gbw_object_pool_put(ft->entry_pool,entry);
+
+    ft->n_entries--;
+    ft->n_dels++;
+}
+
+void gbw_flow_table_walk(gbw_flow_table_t *ft,void (*fn)(gbw_flow_entry_t *entry,void *priv),void *priv){
+
+    gbw_flow_bucket_t *b;
+    uint32_t i;
+    int j;
+
+    for(i = 0;i<=ft->bucket_mask;i++){
+
+        b = &ft->buckets[i];
+
+        for(j = 0;j<GBW_FLOW_BUCKET_ENTRIES;j++){
+
+            if(b->sigs[j])
+                fn(b->entries[j],priv);
+        }
+    }
+}
+
+void gbw_flow_table_dump(gbw_flow_table_t *ft,FILE *fp){
+
+    fprintf(fp,"Dump flow table info-------------------------------------------\n");
+
+    fprintf(fp,"The buckets:%lu,size:%luk%s\n",(unsigned long)ft->bucket_mask+1,
+            (unsigned long)(ft->buckets_size/1024),ft->buckets_huge?" in hugepages":"");
+
+    fprintf(fp,"The entries:%lu/%lu,adds:%lu,dels:%lu,overflows:%lu,full:%lu\n",
+            (unsigned long)ft->n_entries,(unsigned long)ft->max_entries,
+            (unsigned long)ft->n_adds,(unsigned long)ft->n_dels,
+            (unsigned long)ft->n_overflows,(unsigned long)ft->n_full);
+}
@@ -0,0 +1,183 @@
+/*
+ *
+ *      Filename: gbw_flow_table.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: single writer flow table keyed on the 5-tuple,
+ *                open addressing over buckets of 8 signatures
+ *
+ */
+
+#ifndef GBW_FLOW_TABLE_H
+#define GBW_FLOW_TABLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "gbw_mpool.h"
+#include "gbw_jhash.h"
+#include "gbw_object_pool.h"
+
+#define GBW_FLOW_BUCKET_ENTRIES 8
+
+/*longest burst gbw_flow_table_lookup_burst takes at once*/
+#define GBW_FLOW_BURST_MAX 64
+
+typedef struct gbw_flow_key_t gbw_flow_key_t;
+typedef struct gbw_flow_entry_t gbw_flow_entry_t;
+typedef struct gbw_flow_bucket_t gbw_flow_bucket_t;
+typedef struct gbw_flow_table_t gbw_flow_table_t;
+
+/*
+ * 5-tuple,both directions of a flow share the same key:
+ * the lower address/port pair always comes first.
+ * IPv4 addresses use the first word only,the rest stays zero.
+ */
+struct gbw_flow_key_t {
+
+    uint32_t addr_lo[4];
+    uint32_t addr_hi[4];
+    uint16_t port_lo;
+    uint16_t port_hi;
+    uint8_t proto;
+    uint8_t ip_version;
+    uint16_t zone;
+
+}__attribute__((aligned(8)));
+
+struct gbw_flow_entry_t {
+
+    gbw_flow_key_t key;
+    uint32_t hash;
+
+    /*bucket the entry sits in,for a delete without a lookup*/
+    uint32_t bucket;
+
+    /*user data,priv_size bytes*/
+    uint64_t data[];
+};
+
+/*
+ * Two cache lines: lookups scan the signatures in the first one and only
+ * touch the entry pointer of a matching slot in the second.
+ * overflow counts entries that passed over this full bucket from an
+ * earlier one,a lookup stops at the first bucket where it is zero.
+ */
+struct gbw_flow_bucket_t {
+
+    uint16_t sigs[GBW_FLOW_BUCKET_ENTRIES];
+    uint32_t overflow;
+    uint32_t pad[11];
+
+    gbw_flow_entry_t *entries[GBW_FLOW_BUCKET_ENTRIES];
+
+}__attribute__((aligned(64)));
+
+struct gbw_flow_table_t {
+
+    gbw_object_pool_t *entry_pool;
+
+    gbw_flow_bucket_t *buckets;
+    size_t buckets_size;
+    uint32_t bucket_mask;
+
+    size_t max_entries;
+    size_t priv_size;
+
+    size_t n_entries;
+
+    uint64_t n_adds;
+    uint64_t n_dels;
+    uint64_t n_full;
+    uint64_t n_overflows;
+
+    int hugepage;
+    int buckets_huge;
+};
+
+/*
+ * Builds the symmetric key,returns 1 if src/dst were swapped,that is
+ * the packet goes from the hi to the lo end of the key.
+ * Addresses are 4 bytes for ip_version 4 and 16 for 6,in network order.
+ */
+static inline int gbw_flow_key_make(gbw_flow_key_t *key,uint8_t ip_version,
+        const void *saddr,const void *daddr,uint16_t sport,uint16_t dport,uint8_t proto,uint16_t zone){
+
+    size_t alen = ip_version == 4?4:16;
+    int cmp = memcmp(saddr,daddr,alen);
+    int swap = cmp>0||(cmp == 0&&sport>dport);
+
+    memset(key,0,sizeof(*key));
+
+    memcpy(key->addr_lo,swap?daddr:saddr,alen);
+    memcpy(key->addr_hi,swap?saddr:daddr,alen);
+    key->port_lo = swap?dport:sport;
+    key->port_hi = swap?sport:dport;
+    key->proto = proto;
+    key->ip_version = ip_version;
+    key->zone = zone;
+
+    return swap;
+}
+
+static inline uint32_t gbw_flow_key_hash(const gbw_flow_key_t *key){
+
+    return gbw_jhash2((const uint32_t*)key,sizeof(*key)/4,JHASH_INITVAL);
+}
+
+static inline int gbw_flow_key_equal(const gbw_flow_key_t *a,const gbw_flow_key_t *b){
+
+    const uint64_t *x = (const uint64_t*)a;
+    const uint64_t *y = (const uint64_t*)b;
+
+    return ((x[0]^y[0])|(x[1]^y[1])|(x[2]^y[2])|(x[3]^y[3])|(x[4]^y[4])) == 0;
+}
+
+static inline void * gbw_flow_entry_data(gbw_flow_entry_t *entry){
+
+    return (void*)entry->data;
+}
+
+/*Back from the user data to its entry*/
+static inline gbw_flow_entry_t * gbw_flow_entry_of(void *data){
+
+    return (gbw_flow_entry_t*)((char*)data-offsetof(gbw_flow_entry_t,data));
+}
+
+/*
+ * The table is for one thread,usually one worker lcore fed by the
+ * symmetric distributor,so there are no locks and no atomics.
+ * With hugepage set buckets and entries come from 2M hugepages when
+ * reserved,and no page is touched before the owning thread uses it,so
+ * the table lands on that thread's NUMA node wherever it was created.
+ */
+extern gbw_flow_table_t * gbw_flow_table_create(gbw_pool_t *mp,size_t max_entries,size_t priv_size,int hugepage);
+
+extern void gbw_flow_table_destroy(gbw_flow_table_t *ft);
+
+extern gbw_flow_entry_t * gbw_flow_table_lookup(gbw_flow_table_t *ft,const gbw_flow_key_t *key,uint32_t hash);
+
+/*
+ * Looks up n keys at once,n up to GBW_FLOW_BURST_MAX,prefetching the
+ * buckets of the whole burst first and the candidate entries next.
+ * entries[i] is NULL for a miss,returns the number of hits.
+ */
+extern uint32_t gbw_flow_table_lookup_burst(gbw_flow_table_t *ft,const gbw_flow_key_t *keys,
+        const uint32_t *hashes,uint32_t n,gbw_flow_entry_t **entries);
+
+/*
+ * Inserts a key known to be missing,returns NULL when the table holds
+ * max_entries or no bucket is free,the new entry's data is zeroed.
+ */
+extern gbw_flow_entry_t * gbw_flow_table_add(gbw_flow_table_t *ft,const gbw_flow_key_t *key,uint32_t hash);
+
+extern void gbw_flow_table_del(gbw_flow_table_t *ft,gbw_flow_entry_t *entry);
+
+/*Calls fn on every entry,fn may delete the entry it is given*/
+extern void gbw_flow_table_walk(gbw_flow_table_t *ft,void (*fn)(gbw_flow_entry_t *entry,void *priv),void *priv);
+
+extern void gbw_flow_table_dump(gbw_flow_table_t *ft,FILE *fp);
+
+#endif /*GBW_FLOW_TABLE_H*/
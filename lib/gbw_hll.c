@@ -0,0 +1,361 @@
+/*
+ *
+ *      Filename: gbw_hll.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: HyperLogLog distinct counters,sparse while few registers
+ *                are set then dense,mergeable and serialized through
+ *                gbw_data_output_t
+ *
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "gbw_hll.h"
+#include "gbw_log.h"
+
+#define HLL_SERIAL_HDR 3
+
+#define SPARSE_IDX(e)  ((e)>>8)
+#define SPARSE_RANK(e) ((uint8_t)(e))
+
+static inline uint32_t _get32(const uint8_t *p){
+
+    return (uint32_t)p[0]<<24|(uint32_t)p[1]<<16|(uint32_t)p[2]<<8|p[3];
+}
+
+gbw_hll_t * gbw_hll_create(gbw_pool_t *mp,uint8_t p){
+
+    gbw_hll_t *hll;
+    uint32_t sparse_size;
+
+    if(p<GBW_HLL_MIN_PRECISION||p>GBW_HLL_MAX_PRECISION){
+        gbw_log(GBW_LOG_ERR,"HyperLogLog precision:%u not in %u-%u",p,
+                GBW_HLL_MIN_PRECISION,GBW_HLL_MAX_PRECISION);
+        return NULL;
+    }
+
+    hll = (gbw_hll_t*)gbw_pcalloc(mp,sizeof(*hll));
+    if(hll == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for a HyperLogLog");
+        return NULL;
+    }
+
+    hll->p = p;
+    hll->m = 1U<<p;
+
+    if(posix_memalign((void**)&hll->registers,64,hll->m)){
+        gbw_log(GBW_LOG_ERR,"No memory for %u HyperLogLog registers",hll->m);
+        return NULL;
+    }
+
+    /*
+     * Half the bytes of the registers,filled 3/4 at most: spilling
+     * before the table costs more to walk than the registers would.
+     */
+    if(p>=GBW_HLL_SPARSE_MIN_PRECISION){
+
+        sparse_size = hll->m/8;
+
+        if(posix_memalign((void**)&hll->sparse,64,sparse_size*sizeof(uint32_t))){
+            gbw_log(GBW_LOG_ERR,"No memory for a sparse HyperLogLog of %u registers",hll->m);
+            gbw_hll_destroy(hll);
+            return NULL;
+        }
+
+        hll->sparse_mask = sparse_size-1;
+        hll->sparse_max = sparse_size/4*3;
+        memset(hll->sparse,0,sparse_size*sizeof(uint32_t));
+    }
+
+    memset(hll->registers,0,hll->m);
+    hll->dense = hll->sparse == NULL;
+
+    return hll;
+}
+
+void gbw_hll_destroy(gbw_hll_t *hll){
+
+    free(hll->registers);
+    free(hll->sparse);
+
+    hll->registers = NULL;
+    hll->sparse = NULL;
+}
+
+void gbw_hll_clear(gbw_hll_t *hll){
+
+    /*a sparse one never touched its registers*/
+    if(hll->dense||hll->sparse == NULL)
+        memset(hll->registers,0,hll->m);
+
+    if(hll->sparse){
+        if(hll->sparse_n)
+            memset(hll->sparse,0,((size_t)hll->sparse_mask+1)*sizeof(uint32_t));
+        hll->dense = 0;
+    }else{
+        hll->dense = 1;
+    }
+
+    hll->sparse_n = 0;
+}
+
+static void _spill(gbw_hll_t *hll){
+
+    uint32_t i,e;
+
+    for(i = 0;i<=hll->sparse_mask;i++){
+
+        e = hll->sparse[i];
+        if(e&&hll->registers[SPARSE_IDX(e)]<SPARSE_RANK(e))
+            hll->registers[SPARSE_IDX(e)] = SPARSE_RANK(e);
+    }
+
+    hll->dense = 1;
+}
+
+void gbw_hll_sparse_add(gbw_hll_t *hll,uint32_t idx,uint8_t rank){
+
+    uint32_t i = idx&hll->sparse_mask;
+    uint32_t e;
+
+    while((e = hll->sparse[i])!=0){
+
+        if(SPARSE_IDX(e) == idx){
+            if(SPARSE_RANK(e)<rank)
+                hll->sparse[i] = idx<<8|rank;
+            return;
+        }
+
+        i = (i+1)&hll->sparse_mask;
+    }
+
+    if(hll->sparse_n == hll->sparse_max){
+        _spill(hll);
+        if(hll->registers[idx]<rank)
+            hll->registers[idx] = rank;
+        return;
+    }
+
+    hll->sparse[i] = idx<<8|rank;
+    hll->sparse_n++;
+}
+
+/*
+ * Ertl's improved estimator,the register histogram stands in for the
+ * linear counting and bias tables of the original,even across the small
+ * range where those two meet.
+ */
+static double _sigma(double x){
+
+    double y = 1,z = x,prev;
+
+    if(x == 1)
+        return INFINITY;
+
+    do{
+        x *= x;
+        prev = z;
+        z += x*y;
+        y += y;
+    }while(z!=prev);
+
+    return z;
+}
+
+static double _tau(double x){
+
+    double y = 1,z,prev;
+
+    if(x == 0||x == 1)
+        return 0;
+
+    z = 1-x;
+
+    do{
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= (1-x)*(1-x)*y;
+    }while(z!=prev);
+
+    return z/3;
+}
+
+uint64_t gbw_hll_count(const gbw_hll_t *hll){
+
+    uint32_t hist[64+2] = {0};
+    uint32_t q = 64-hll->p;
+    uint32_t i,e;
+    double m = hll->m,z;
+    int k;
+
+    if(hll->dense){
+
+        for(i = 0;i<hll->m;i++)
+            hist[hll->registers[i]]++;
+    }else{
+
+        hist[0] = hll->m-hll->sparse_n;
+
+        for(i = 0;i<=hll->sparse_mask&&hll->sparse_n;i++){
+            e = hll->sparse[i];
+            if(e)
+                hist[SPARSE_RANK(e)]++;
+        }
+    }
+
+    if(hist[0] == hll->m)
+        return 0;
+
+    z = m*_tau(1-hist[q+1]/m);
+
+    for(k = (int)q;k>=1;k--)
+        z = 0.5*(z+hist[k]);
+
+    z += m*_sigma(hist[0]/m);
+
+    return (uint64_t)(m*m/(2*M_LN2*z)+0.5);
+}
+
+/*max of two runs of registers,a vector at a time*/
+static void _registers_max(uint8_t *dst,const uint8_t *src,uint32_t m){
+
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    for(;i+32<=m;i += 32)
+        _mm256_store_si256((__m256i*)(dst+i),_mm256_max_epu8(_mm256_load_si256((const __m256i*)(dst+i)),
+                    _mm256_load_si256((const __m256i*)(src+i))));
+#endif
+
+#if defined(__SSE2__)
+    for(;i+16<=m;i += 16)
+        _mm_store_si128((__m128i*)(dst+i),_mm_max_epu8(_mm_load_si128((const __m128i*)(dst+i)),
+                    _mm_load_si128((const __m128i*)(src+i))));
+#endif
+
+    for(;i<m;i++)
+        if(dst[i]<src[i])
+            dst[i] = src[i];
+}
+
+int gbw_hll_merge(gbw_hll_t *dst,const gbw_hll_t *src){
+
+    uint32_t i,e;
+
+    if(dst->p!=src->p)
+        return -1;
+
+    if(src->dense){
+
+        if(!dst->dense)
+            _spill(dst);
+
+        _registers_max(dst->registers,src->registers,dst->m);
+        return 0;
+    }
+
+    for(i = 0;i<=src->sparse_mask&&src->sparse_n;i++){
+
+        e = src->sparse[i];
+        if(e == 0)
+            continue;
+
+        if(dst->dense){
+            if(dst->registers[SPARSE_IDX(e)]<SPARSE_RANK(e))
+                dst->registers[SPARSE_IDX(e)] = SPARSE_RANK(e);
+        }else{
+            gbw_hll_sparse_add(dst,SPARSE_IDX(e),SPARSE_RANK(e));
+        }
+    }
+
+    return 0;
+}
+
+ssize_t gbw_hll_serialize(const gbw_hll_t *hll,gbw_data_output_t *dout){
+
+    size_t len = HLL_SERIAL_HDR+(hll->dense?hll->m:4+(size_t)hll->sparse_n*4);
+    uint32_t i;
+
+    if(GBW_DOUT_FULL(dout,len)&&gbw_dout_incr(dout,len))
+        return -1;
+
+    gbw_dout_uint8_write(dout,GBW_HLL_SERIAL_VERSION);
+    gbw_dout_uint8_write(dout,hll->p);
+    gbw_dout_uint8_write(dout,hll->dense?GBW_HLL_SERIAL_DENSE:GBW_HLL_SERIAL_SPARSE);
+
+    if(hll->dense){
+        dout_write(dout,(unsigned char*)hll->registers,hll->m);
+        return (ssize_t)len;
+    }
+
+    gbw_dout_uint32_write(dout,hll->sparse_n);
+
+    for(i = 0;i<=hll->sparse_mask&&hll->sparse_n;i++)
+        if(hll->sparse[i])
+            gbw_dout_uint32_write(dout,hll->sparse[i]);
+
+    return (ssize_t)len;
+}
+
+int gbw_hll_merge_serialized(gbw_hll_t *hll,const void *data,size_t len){
+
+    const uint8_t *p = (const uint8_t*)data;
+    uint32_t i,n,e,idx;
+    uint8_t rank;
+
+    if(len<HLL_SERIAL_HDR||p[0]!=GBW_HLL_SERIAL_VERSION||p[1]!=hll->p)
+        return -1;
+
+    if(p[2] == GBW_HLL_SERIAL_DENSE){
+
+        if(len!=HLL_SERIAL_HDR+hll->m)
+            return -1;
+
+        if(!hll->dense)
+            _spill(hll);
+
+        /*unaligned,no vectors*/
+        for(i = 0;i<hll->m;i++)
+            if(hll->registers[i]<p[HLL_SERIAL_HDR+i])
+                hll->registers[i] = p[HLL_SERIAL_HDR+i];
+
+        return 0;
+    }
+
+    if(p[2]!=GBW_HLL_SERIAL_SPARSE||len<HLL_SERIAL_HDR+4)
+        return -1;
+
+    n = _get32(p+HLL_SERIAL_HDR);
+    if(len!=HLL_SERIAL_HDR+4+(size_t)n*4)
+        return -1;
+
+    for(i = 0;i<n;i++){
+
+        e = _get32(p+HLL_SERIAL_HDR+4+(size_t)i*4);
+        idx = SPARSE_IDX(e);
+        rank = SPARSE_RANK(e);
+
+        if(idx>=hll->m||rank == 0||rank>64-hll->p+1)
+            return -1;
+
+        if(hll->dense){
+            if(hll->registers[idx]<rank)
+                hll->registers[idx] = rank;
+        }else{
+            gbw_hll_sparse_add(hll,idx,rank);
+        }
+    }
+
+    return 0;
+}
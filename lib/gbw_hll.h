@@ -0,0 +1,102 @@
+/*
+ *
+ *      Filename: gbw_hll.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: HyperLogLog distinct counters,sparse while few registers
+ *                are set then dense,mergeable and serialized through
+ *                gbw_data_output_t
+ *
+ */
+
+#ifndef GBW_HLL_H
+#define GBW_HLL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "gbw_mpool.h"
+#include "gbw_data_output.h"
+
+#define GBW_HLL_MIN_PRECISION 4
+#define GBW_HLL_MAX_PRECISION 16
+
+/*below this precision registers are dense from the start*/
+#define GBW_HLL_SPARSE_MIN_PRECISION 8
+
+#define GBW_HLL_SERIAL_VERSION 1
+#define GBW_HLL_SERIAL_SPARSE  0
+#define GBW_HLL_SERIAL_DENSE   1
+
+typedef struct gbw_hll_t gbw_hll_t;
+
+/*
+ * 2^p registers,the standard error is 1.04/sqrt(2^p): 0.81% at the
+ * default 14 for 16KB.
+ */
+struct gbw_hll_t {
+
+    uint8_t p;
+    uint8_t dense;
+    uint32_t m;
+
+    /*
+     * While sparse,the set registers sit in an open addressing table on
+     * their index as idx<<8|rank,0 for a free slot. Past sparse_max of
+     * them the table is spilled into the registers for good.
+     */
+    uint32_t *sparse;
+    uint32_t sparse_mask;
+    uint32_t sparse_n;
+    uint32_t sparse_max;
+
+    /*m bytes,cache line aligned*/
+    uint8_t *registers;
+};
+
+/*p is GBW_HLL_MIN_PRECISION-GBW_HLL_MAX_PRECISION*/
+extern gbw_hll_t * gbw_hll_create(gbw_pool_t *mp,uint8_t p);
+
+extern void gbw_hll_destroy(gbw_hll_t *hll);
+
+/*Empties it,back to sparse*/
+extern void gbw_hll_clear(gbw_hll_t *hll);
+
+extern void gbw_hll_sparse_add(gbw_hll_t *hll,uint32_t idx,uint8_t rank);
+
+/*
+ * hash must be a good 64 bits hash of the item: the top p bits pick the
+ * register,the rank is 1 more than the zeros leading the rest.
+ */
+static inline void gbw_hll_add(gbw_hll_t *hll,uint64_t hash){
+
+    uint32_t idx = (uint32_t)(hash>>(64-hll->p));
+    uint8_t rank = (uint8_t)(__builtin_clzll(hash<<hll->p|(1ULL<<(hll->p-1)))+1);
+
+    if(hll->dense){
+        if(hll->registers[idx]<rank)
+            hll->registers[idx] = rank;
+        return;
+    }
+
+    gbw_hll_sparse_add(hll,idx,rank);
+}
+
+extern uint64_t gbw_hll_count(const gbw_hll_t *hll);
+
+/*Register wise max of dst and src,both of the same precision,or fails*/
+extern int gbw_hll_merge(gbw_hll_t *dst,const gbw_hll_t *src);
+
+/*
+ * Appends it as: version,p,encoding as uint8,then the 2^p registers
+ * when dense,or when sparse the uint32 count of set registers and each
+ * as uint32 idx<<8|rank,in no order. Integers are big endian.
+ * Returns the bytes written or -1.
+ */
+extern ssize_t gbw_hll_serialize(const gbw_hll_t *hll,gbw_data_output_t *dout);
+
+/*Merges a serialized one of the same precision into hll*/
+extern int gbw_hll_merge_serialized(gbw_hll_t *hll,const void *data,size_t len);
+
+#endif /*GBW_HLL_H*/
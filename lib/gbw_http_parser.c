@@ -0,0 +1,590 @@
+/*
+ *
+ *      Filename: gbw_http_parser.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: incremental HTTP/1.x parser,one per stream direction,
+ *                resumes across chunks and reports spans,not copies
+ *
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "gbw_http_parser.h"
+
+#define _ST_STOP        -1
+#define _ST_START        0
+#define _ST_HEADERS      1
+#define _ST_BODY         2
+#define _ST_CHUNK_SIZE   3
+#define _ST_CHUNK_DATA   4
+#define _ST_CHUNK_CRLF   5
+#define _ST_TRAILERS     6
+#define _ST_BODY_EOF     7
+
+/*uri_state*/
+#define _URI_NONE   0
+#define _URI_DONE   1
+#define _URI_FAILED 2
+
+#define _is_space(c) ((c)==' '||(c)=='\t')
+
+static void _stop(gbw_http_parser_t *p,int error){
+
+    p->state = _ST_STOP;
+    if(error)
+        p->errors++;
+}
+
+void gbw_http_parser_init(gbw_http_parser_t *p,gbw_pool_t *mp,int type,
+        const gbw_http_callbacks_t *cbs,void *priv){
+
+    memset(p,0,sizeof(*p));
+
+    p->type = type;
+    p->state = _ST_START;
+    p->cbs = cbs;
+    p->priv = priv;
+    p->mp = mp;
+}
+
+void gbw_http_parser_fin(gbw_http_parser_t *p){
+
+    if(p->uri_mp){
+        gbw_pool_destroy(p->uri_mp);
+        p->uri_mp = NULL;
+    }
+
+    /*the line buffer goes with mp*/
+    p->line = NULL;
+    p->line_len = 0;
+    p->state = _ST_STOP;
+}
+
+void gbw_http_parser_expect(gbw_http_parser_t *p,int is_head){
+
+    /*more than 32 requests in flight,the oldest ones are forgotten*/
+    if(p->head_n == 32){
+        p->head_queue >>= 1;
+        p->head_n--;
+    }
+
+    if(is_head)
+        p->head_queue |= 1U<<p->head_n;
+
+    p->head_n++;
+}
+
+static int _expect_pop(gbw_http_parser_t *p){
+
+    int is_head;
+
+    if(p->head_n == 0)
+        return 0;
+
+    is_head = p->head_queue&1;
+    p->head_queue >>= 1;
+    p->head_n--;
+
+    return is_head;
+}
+
+const gbw_uri_t * gbw_http_parser_uri(gbw_http_parser_t *p){
+
+    char *target;
+
+    if(p->uri_state == _URI_DONE)
+        return &p->uri;
+
+    if(p->uri_state == _URI_FAILED||p->target.data == NULL)
+        return NULL;
+
+    if(p->uri_mp == NULL){
+
+        p->uri_mp = gbw_pool_create(GBW_HTTP_URI_POOL_SIZE);
+        if(p->uri_mp == NULL)
+            return NULL;
+    }
+
+    /*gbw_uri_parse wants a C string,the target is a span*/
+    target = gbw_pstrndup(p->uri_mp,(const char*)p->target.data,p->target.len);
+    if(target == NULL||gbw_uri_parse(p->uri_mp,target,&p->uri)){
+        p->uri_state = _URI_FAILED;
+        return NULL;
+    }
+
+    p->uri_state = _URI_DONE;
+    return &p->uri;
+}
+
+static void _message_begin(gbw_http_parser_t *p){
+
+    p->content_length = 0;
+    p->body_left = 0;
+    p->body_len = 0;
+    p->status = 0;
+    p->has_length = 0;
+    p->chunked = 0;
+    p->no_body = 0;
+
+    if(p->uri_state != _URI_NONE){
+
+        memset(&p->uri,0,sizeof(p->uri));
+        p->uri_state = _URI_NONE;
+        gbw_pool_reset(p->uri_mp);
+    }
+}
+
+static void _message_done(gbw_http_parser_t *p){
+
+    const gbw_http_callbacks_t *cbs = p->cbs;
+
+    p->messages++;
+    p->state = _ST_START;
+
+    if(cbs->on_message_done&&cbs->on_message_done(p)){
+        _stop(p,0);
+        return;
+    }
+
+    /*the connection now speaks something else*/
+    if(p->type == GBW_HTTP_RESPONSE&&p->status == 101)
+        _stop(p,0);
+}
+
+/*splits "a b c" at the first two spaces,c may hold more spaces*/
+static int _split3(const uint8_t *line,uint32_t len,gbw_str_t *a,gbw_str_t *b,gbw_str_t *c){
+
+    const uint8_t *sp1,*sp2,*end = line+len;
+
+    sp1 = memchr(line,' ',len);
+    if(sp1 == NULL||sp1 == line)
+        return -1;
+
+    a->data = (unsigned char*)line;
+    a->len = sp1-line;
+
+    sp2 = memchr(sp1+1,' ',end-sp1-1);
+    if(sp2 == NULL){
+        /*"HTTP/1.1 200" without a reason*/
+        sp2 = end;
+    }
+
+    b->data = (unsigned char*)sp1+1;
+    b->len = sp2-sp1-1;
+
+    if(sp2 == end){
+        c->data = (unsigned char*)end;
+        c->len = 0;
+    }else{
+        c->data = (unsigned char*)sp2+1;
+        c->len = end-sp2-1;
+    }
+
+    return 0;
+}
+
+static int _is_version(const gbw_str_t *v){
+
+    return v->len == 8&&memcmp(v->data,"HTTP/",5) == 0&&
+        v->data[5]>='0'&&v->data[5]<='9'&&v->data[6]=='.'&&
+        v->data[7]>='0'&&v->data[7]<='9';
+}
+
+static void _start_line(gbw_http_parser_t *p,const uint8_t *line,uint32_t len){
+
+    const gbw_http_callbacks_t *cbs = p->cbs;
+    gbw_str_t a,b,c;
+    int rc = 0;
+    uint32_t i;
+
+    /*blank lines between messages are tolerated*/
+    if(len == 0)
+        return;
+
+    _message_begin(p);
+
+    if(_split3(line,len,&a,&b,&c)){
+        _stop(p,1);
+        return;
+    }
+
+    if(p->type == GBW_HTTP_REQUEST){
+
+        if(b.len == 0||!_is_version(&c)){
+            _stop(p,1);
+            return;
+        }
+
+        if(cbs->on_request){
+            p->target = b;
+            rc = cbs->on_request(p,&a,&b,&c);
+            p->target.data = NULL;
+            p->target.len = 0;
+        }
+
+    }else{
+
+        if(!_is_version(&a)||b.len != 3){
+            _stop(p,1);
+            return;
+        }
+
+        for(i = 0;i<3;i++){
+
+            if(b.data[i]<'0'||b.data[i]>'9'){
+                _stop(p,1);
+                return;
+            }
+            p->status = p->status*10+(b.data[i]-'0');
+        }
+
+        /*an interim response comes before the final one to the same request*/
+        if(p->status>=200||p->status == 101){
+            if(_expect_pop(p))
+                p->no_body = 1;
+        }
+
+        if(p->status<200||p->status == 204||p->status == 304)
+            p->no_body = 1;
+
+        if(cbs->on_response)
+            rc = cbs->on_response(p,&a,p->status,&c);
+    }
+
+    if(rc){
+        _stop(p,0);
+        return;
+    }
+
+    p->state = _ST_HEADERS;
+}
+
+static int _parse_length(const uint8_t *s,uint32_t len,uint64_t *val){
+
+    uint64_t v = 0;
+    uint32_t i;
+
+    if(len == 0||len>18)
+        return -1;
+
+    for(i = 0;i<len;i++){
+
+        if(s[i]<'0'||s[i]>'9')
+            return -1;
+        v = v*10+(s[i]-'0');
+    }
+
+    *val = v;
+    return 0;
+}
+
+/*is the last coding of a Transfer-Encoding value chunked*/
+static int _is_chunked(const uint8_t *s,uint32_t len){
+
+    while(len&&(_is_space(s[len-1])||s[len-1]==','))
+        len--;
+
+    return len>=7&&strncasecmp((const char*)s+len-7,"chunked",7) == 0&&
+        (len == 7||s[len-8]==','||_is_space(s[len-8]));
+}
+
+static void _header_line(gbw_http_parser_t *p,const uint8_t *line,uint32_t len){
+
+    const gbw_http_callbacks_t *cbs = p->cbs;
+    const uint8_t *colon;
+    gbw_str_t name,value;
+
+    /*obsolete line folding,the continuation is dropped*/
+    if(_is_space(line[0]))
+        return;
+
+    colon = memchr(line,':',len);
+    if(colon == NULL||colon == line){
+        _stop(p,1);
+        return;
+    }
+
+    name.data = (unsigned char*)line;
+    name.len = colon-line;
+    while(name.len&&_is_space(name.data[name.len-1]))
+        name.len--;
+
+    value.data = (unsigned char*)colon+1;
+    value.len = len-(colon-line)-1;
+    while(value.len&&_is_space(value.data[0])){
+        value.data++;
+        value.len--;
+    }
+    while(value.len&&_is_space(value.data[value.len-1]))
+        value.len--;
+
+    /*framing,headers of the trailer have no say*/
+    if(p->state == _ST_HEADERS){
+
+        if(name.len == 14&&strncasecmp((const char*)name.data,"Content-Length",14) == 0){
+
+            if(_parse_length(value.data,value.len,&p->content_length)){
+                _stop(p,1);
+                return;
+            }
+            p->has_length = 1;
+
+        }else if(name.len == 17&&strncasecmp((const char*)name.data,"Transfer-Encoding",17) == 0){
+
+            p->chunked = _is_chunked(value.data,value.len);
+        }
+    }
+
+    if(cbs->on_header&&cbs->on_header(p,&name,&value))
+        _stop(p,0);
+}
+
+static void _headers_done(gbw_http_parser_t *p){
+
+    const gbw_http_callbacks_t *cbs = p->cbs;
+
+    if(cbs->on_headers_done&&cbs->on_headers_done(p)){
+        _stop(p,0);
+        return;
+    }
+
+    if(p->no_body){
+        _message_done(p);
+        return;
+    }
+
+    /*chunked wins over a length,as RFC 7230 3.3.3 says*/
+    if(p->chunked){
+        p->state = _ST_CHUNK_SIZE;
+        return;
+    }
+
+    if(p->has_length){
+
+        if(p->content_length == 0){
+            _message_done(p);
+            return;
+        }
+
+        p->body_left = p->content_length;
+        p->state = _ST_BODY;
+        return;
+    }
+
+    /*a request without framing has no body,a response runs to the close*/
+    if(p->type == GBW_HTTP_REQUEST)
+        _message_done(p);
+    else
+        p->state = _ST_BODY_EOF;
+}
+
+static void _chunk_size(gbw_http_parser_t *p,const uint8_t *line,uint32_t len){
+
+    uint64_t size = 0;
+    uint32_t i;
+    int c;
+
+    for(i = 0;i<len;i++){
+
+        c = line[i];
+
+        if(c>='0'&&c<='9')
+            c -= '0';
+        else if(c>='a'&&c<='f')
+            c -= 'a'-10;
+        else if(c>='A'&&c<='F')
+            c -= 'A'-10;
+        else
+            break;
+
+        if(i == 15){
+            _stop(p,1);
+            return;
+        }
+
+        size = (size<<4)|c;
+    }
+
+    /*chunk extensions after ';' are ignored*/
+    if(i == 0||(i<len&&line[i]!=';'&&!_is_space(line[i]))){
+        _stop(p,1);
+        return;
+    }
+
+    if(size == 0){
+        p->state = _ST_TRAILERS;
+        return;
+    }
+
+    p->body_left = size;
+    p->state = _ST_CHUNK_DATA;
+}
+
+static void _line(gbw_http_parser_t *p,const uint8_t *line,uint32_t len){
+
+    if(len&&line[len-1]=='\r')
+        len--;
+
+    switch(p->state){
+
+    case _ST_START:
+        _start_line(p,line,len);
+        break;
+
+    case _ST_HEADERS:
+        if(len == 0)
+            _headers_done(p);
+        else
+            _header_line(p,line,len);
+        break;
+
+    case _ST_CHUNK_SIZE:
+        _chunk_size(p,line,len);
+        break;
+
+    case _ST_CHUNK_CRLF:
+        if(len)
+            _stop(p,1);
+        else
+            p->state = _ST_CHUNK_SIZE;
+        break;
+
+    case _ST_TRAILERS:
+        if(len == 0)
+            _message_done(p);
+        else
+            _header_line(p,line,len);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*
+ * Takes the next line out of data,in place when it is whole there,
+ * else through the line buffer. Returns the bytes consumed.
+ */
+static uint32_t _take_line(gbw_http_parser_t *p,const uint8_t *data,uint32_t len){
+
+    const uint8_t *nl;
+    uint32_t n;
+
+    nl = memchr(data,'\n',len);
+    n = nl?(uint32_t)(nl-data):len;
+
+    if(p->line_len == 0&&nl){
+        _line(p,data,n);
+        return n+1;
+    }
+
+    if(p->line_len+n>GBW_HTTP_MAX_LINE){
+        _stop(p,1);
+        return len;
+    }
+
+    if(p->line == NULL){
+
+        p->line = (uint8_t*)gbw_palloc(p->mp,GBW_HTTP_MAX_LINE);
+        if(p->line == NULL){
+            _stop(p,1);
+            return len;
+        }
+    }
+
+    memcpy(p->line+p->line_len,data,n);
+    p->line_len += n;
+
+    if(nl == NULL)
+        return len;
+
+    n++;
+    _line(p,p->line,p->line_len);
+    p->line_len = 0;
+
+    return n;
+}
+
+static uint32_t _take_body(gbw_http_parser_t *p,const uint8_t *data,uint32_t len){
+
+    const gbw_http_callbacks_t *cbs = p->cbs;
+    uint32_t n = len;
+
+    if(p->state != _ST_BODY_EOF&&p->body_left<n)
+        n = (uint32_t)p->body_left;
+
+    p->body_len += n;
+
+    if(cbs->on_body&&cbs->on_body(p,data,n)){
+        _stop(p,0);
+        return len;
+    }
+
+    if(p->state == _ST_BODY_EOF)
+        return n;
+
+    p->body_left -= n;
+    if(p->body_left == 0){
+
+        if(p->state == _ST_CHUNK_DATA)
+            p->state = _ST_CHUNK_CRLF;
+        else
+            _message_done(p);
+    }
+
+    return n;
+}
+
+int gbw_http_parser_execute(gbw_http_parser_t *p,const uint8_t *data,uint32_t len){
+
+    uint32_t pos = 0;
+
+    while(pos<len&&p->state>=0){
+
+        if(p->state == _ST_BODY||p->state == _ST_CHUNK_DATA||p->state == _ST_BODY_EOF)
+            pos += _take_body(p,data+pos,len-pos);
+        else
+            pos += _take_line(p,data+pos,len-pos);
+    }
+
+    return p->state<0?-1:0;
+}
+
+int gbw_http_parser_gap(gbw_http_parser_t *p,uint32_t len){
+
+    if(p->state<0)
+        return -1;
+
+    if(p->state == _ST_BODY_EOF){
+        p->body_len += len;
+        return 0;
+    }
+
+    if((p->state == _ST_BODY||p->state == _ST_CHUNK_DATA)&&p->body_left>=len){
+
+        p->body_left -= len;
+        p->body_len += len;
+
+        if(p->body_left == 0){
+
+            if(p->state == _ST_CHUNK_DATA)
+                p->state = _ST_CHUNK_CRLF;
+            else
+                _message_done(p);
+        }
+
+        return 0;
+    }
+
+    /*the gap reaches into headers or chunk framing,no way to resync*/
+    _stop(p,1);
+    return -1;
+}
+
+void gbw_http_parser_finish(gbw_http_parser_t *p){
+
+    if(p->state == _ST_BODY_EOF)
+        _message_done(p);
+}
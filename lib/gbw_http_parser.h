@@ -0,0 +1,129 @@
+/*
+ *
+ *      Filename: gbw_http_parser.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: incremental HTTP/1.x parser,one per stream direction,
+ *                resumes across chunks and reports spans,not copies
+ *
+ */
+
+#ifndef GBW_HTTP_PARSER_H
+#define GBW_HTTP_PARSER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_mpool.h"
+#include "gbw_string.h"
+#include "gbw_uri.h"
+
+#define GBW_HTTP_REQUEST  0
+#define GBW_HTTP_RESPONSE 1
+
+/*longest start or header line,only lines cut by a chunk end are copied*/
+#define GBW_HTTP_MAX_LINE 8192
+
+/*pool of the parsed URI of a message,reset for each one*/
+#define GBW_HTTP_URI_POOL_SIZE 1024
+
+typedef struct gbw_http_parser_t gbw_http_parser_t;
+typedef struct gbw_http_callbacks_t gbw_http_callbacks_t;
+
+/*
+ * Any callback may be NULL. Spans point into the chunk being parsed or
+ * into the parser's line buffer,they are only valid during the callback.
+ * A non zero return stops the parser for good,for consumers done with
+ * a stream.
+ */
+struct gbw_http_callbacks_t {
+
+    int (*on_request)(gbw_http_parser_t *p,const gbw_str_t *method,const gbw_str_t *target,const gbw_str_t *version);
+    int (*on_response)(gbw_http_parser_t *p,const gbw_str_t *version,int status,const gbw_str_t *reason);
+
+    /*trailers of a chunked body come this way too*/
+    int (*on_header)(gbw_http_parser_t *p,const gbw_str_t *name,const gbw_str_t *value);
+    int (*on_headers_done)(gbw_http_parser_t *p);
+
+    /*body bytes,chunked encoding removed*/
+    int (*on_body)(gbw_http_parser_t *p,const uint8_t *data,uint32_t len);
+    int (*on_message_done)(gbw_http_parser_t *p);
+};
+
+struct gbw_http_parser_t {
+
+    int type;
+    int state;
+
+    const gbw_http_callbacks_t *cbs;
+    void *priv;
+
+    /*line buffer,taken from mp the first time a line is cut*/
+    gbw_pool_t *mp;
+    uint8_t *line;
+    uint32_t line_len;
+
+    /*framing of the current message*/
+    uint64_t content_length;
+    uint64_t body_left;
+    uint64_t body_len;
+    int status;
+    uint8_t has_length;
+    uint8_t chunked;
+    uint8_t no_body;
+
+    /*responses still due to HEAD requests,one bit each,oldest lowest*/
+    uint32_t head_queue;
+    uint8_t head_n;
+
+    /*request target while on_request runs,and its URI once asked for*/
+    gbw_str_t target;
+    gbw_pool_t *uri_mp;
+    gbw_uri_t uri;
+    int uri_state;
+
+    uint64_t messages;
+    uint64_t errors;
+};
+
+/*mp holds the line buffer,priv is for the callbacks*/
+extern void gbw_http_parser_init(gbw_http_parser_t *p,gbw_pool_t *mp,int type,
+        const gbw_http_callbacks_t *cbs,void *priv);
+
+extern void gbw_http_parser_fin(gbw_http_parser_t *p);
+
+/*
+ * Parses the next chunk of the stream,returns -1 once the parser is
+ * stopped by a malformed message,a callback or a protocol switch.
+ */
+extern int gbw_http_parser_execute(gbw_http_parser_t *p,const uint8_t *data,uint32_t len);
+
+/*
+ * len bytes of the stream were lost,bodies of known length resync past
+ * them,anything else stops the parser.
+ */
+extern int gbw_http_parser_gap(gbw_http_parser_t *p,uint32_t len);
+
+/*The stream ended,completes a response whose body ran until the close*/
+extern void gbw_http_parser_finish(gbw_http_parser_t *p);
+
+/*
+ * Tells a response parser about the next pipelined request,responses to
+ * HEAD carry no body whatever their headers say.
+ */
+extern void gbw_http_parser_expect(gbw_http_parser_t *p,int is_head);
+
+/*
+ * URI parts of the request target,parsed with gbw_uri_parse the first
+ * time they are asked for in a message,from on_request on.
+ * NULL if the target does not parse or on_request has returned without
+ * asking.
+ */
+extern const gbw_uri_t * gbw_http_parser_uri(gbw_http_parser_t *p);
+
+static inline int gbw_http_parser_stopped(const gbw_http_parser_t *p){
+
+    return p->state<0;
+}
+
+#endif /*GBW_HTTP_PARSER_H*/
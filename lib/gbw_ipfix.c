@@ -0,0 +1,306 @@
+/*
+ *
+ *      Filename: gbw_ipfix.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: IPFIX and NetFlow v9 encoder,records are laid out by a
+ *                field table and packed many to a message in a
+ *                gbw_data_output_t,templates resent as UDP needs
+ *
+ */
+
+#include <string.h>
+
+#include "gbw_ipfix.h"
+
+#define IPFIX_HEADER_LEN 16
+#define V9_HEADER_LEN    20
+#define SET_HEADER_LEN   4
+
+/*set ids of the template sets*/
+#define IPFIX_TEMPLATE_SET 2
+#define V9_TEMPLATE_SET    0
+
+/*a set is padded to 4 bytes*/
+#define SET_PAD_MAX 3
+
+static inline void _put16(uint8_t *p,uint16_t v){
+
+    p[0] = (uint8_t)(v>>8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void _put32(uint8_t *p,uint32_t v){
+
+    p[0] = (uint8_t)(v>>24);
+    p[1] = (uint8_t)(v>>16);
+    p[2] = (uint8_t)(v>>8);
+    p[3] = (uint8_t)v;
+}
+
+static inline void _put64(uint8_t *p,uint64_t v){
+
+    _put32(p,(uint32_t)(v>>32));
+    _put32(p+4,(uint32_t)v);
+}
+
+static inline size_t _header_len(const gbw_ipfix_exporter_t *ex){
+
+    return ex->version == GBW_IPFIX_VERSION?IPFIX_HEADER_LEN:V9_HEADER_LEN;
+}
+
+static size_t _templates_len(const gbw_ipfix_exporter_t *ex){
+
+    size_t len = SET_HEADER_LEN;
+    unsigned int i;
+
+    for(i = 0;i<ex->n_templates;i++)
+        len += 4+4*ex->templates[i]->n_fields;
+
+    return len;
+}
+
+int gbw_ipfix_exporter_init(gbw_ipfix_exporter_t *ex,int version,uint32_t domain_id,size_t mtu,
+        uint64_t refresh_ms,uint64_t now_ms,gbw_ipfix_send_fn send,void *priv){
+
+    memset(ex,0,sizeof(*ex));
+
+    if(version!=GBW_IPFIX_VERSION&&version!=GBW_NETFLOW_V9_VERSION)
+        return -1;
+
+    if(mtu<V9_HEADER_LEN+SET_HEADER_LEN||mtu>GBW_IPFIX_MAX_MTU)
+        return -1;
+
+    if(gbw_dout_init(&ex->dout))
+        return -1;
+
+    ex->version = version;
+    ex->domain_id = domain_id;
+    ex->mtu = mtu;
+    ex->refresh_ms = refresh_ms;
+    ex->start_ms = now_ms;
+    ex->send = send;
+    ex->priv = priv;
+
+    return 0;
+}
+
+void gbw_ipfix_exporter_fin(gbw_ipfix_exporter_t *ex){
+
+    free(ex->dout.base);
+    ex->dout.base = ex->dout.pos = ex->dout.end = NULL;
+}
+
+int gbw_ipfix_template_add(gbw_ipfix_exporter_t *ex,gbw_ipfix_template_t *tmpl){
+
+    size_t len = 0;
+    uint16_t i;
+    const gbw_ipfix_field_t *f;
+
+    if(ex->n_templates>=GBW_IPFIX_MAX_TEMPLATES||tmpl->id<GBW_IPFIX_MIN_TEMPLATE_ID||
+            tmpl->n_fields == 0||tmpl->n_fields>GBW_IPFIX_MAX_FIELDS)
+        return -1;
+
+    for(i = 0;i<tmpl->n_fields;i++){
+
+        f = &tmpl->fields[i];
+        if(f->len == 0||(!f->raw&&f->len!=1&&f->len!=2&&f->len!=4&&f->len!=8))
+            return -1;
+
+        len += f->len;
+    }
+
+    tmpl->rec_len = (uint16_t)len;
+    ex->templates[ex->n_templates++] = tmpl;
+
+    /*the first message carries all templates and a record of each*/
+    if(_header_len(ex)+_templates_len(ex)+SET_HEADER_LEN+len+SET_PAD_MAX>ex->mtu){
+        ex->n_templates--;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void _set_open(gbw_ipfix_exporter_t *ex,uint16_t id){
+
+    ex->set_off = GBW_DOUT_CONTENT_SIZE(&ex->dout);
+
+    gbw_dout_uint16_write(&ex->dout,id);
+    gbw_dout_uint16_write(&ex->dout,0);
+}
+
+static void _set_close(gbw_ipfix_exporter_t *ex){
+
+    uint8_t *base = (uint8_t*)GBW_DOUT_CONTENT(&ex->dout);
+
+    while((GBW_DOUT_CONTENT_SIZE(&ex->dout)-ex->set_off)&3)
+        gbw_dout_uint8_write(&ex->dout,0);
+
+    _put16(base+ex->set_off+2,(uint16_t)(GBW_DOUT_CONTENT_SIZE(&ex->dout)-ex->set_off));
+    ex->set_tmpl = NULL;
+}
+
+static void _templates_write(gbw_ipfix_exporter_t *ex,uint64_t now_ms){
+
+    const gbw_ipfix_template_t *tmpl;
+    unsigned int i;
+    uint16_t j;
+
+    _set_open(ex,ex->version == GBW_IPFIX_VERSION?IPFIX_TEMPLATE_SET:V9_TEMPLATE_SET);
+
+    for(i = 0;i<ex->n_templates;i++){
+
+        tmpl = ex->templates[i];
+
+        gbw_dout_uint16_write(&ex->dout,tmpl->id);
+        gbw_dout_uint16_write(&ex->dout,tmpl->n_fields);
+
+        for(j = 0;j<tmpl->n_fields;j++){
+            gbw_dout_uint16_write(&ex->dout,tmpl->fields[j].id);
+            gbw_dout_uint16_write(&ex->dout,tmpl->fields[j].len);
+        }
+    }
+
+    _set_close(ex);
+
+    ex->msg_records += ex->n_templates;
+    ex->templates_at = now_ms;
+    ex->templates_sent = 1;
+}
+
+static void _msg_begin(gbw_ipfix_exporter_t *ex,uint64_t now_ms){
+
+    size_t hlen = _header_len(ex);
+
+    GBW_DOUT_RESET(&ex->dout);
+    memset(ex->dout.pos,0,hlen);
+    GBW_DOUT_POS_UPDATE(&ex->dout,hlen);
+
+    ex->set_tmpl = NULL;
+    ex->msg_records = 0;
+    ex->msg_data_records = 0;
+    ex->msg_ms = now_ms;
+
+    /*UDP collectors that started late learn the templates on the refresh*/
+    if(!ex->templates_sent||now_ms-ex->templates_at>=ex->refresh_ms)
+        _templates_write(ex,now_ms);
+}
+
+int gbw_ipfix_flush(gbw_ipfix_exporter_t *ex,uint64_t now_ms){
+
+    uint8_t *base = (uint8_t*)GBW_DOUT_CONTENT(&ex->dout);
+    size_t len = GBW_DOUT_CONTENT_SIZE(&ex->dout);
+    int rc;
+
+    if(len == 0)
+        return 0;
+
+    if(ex->set_tmpl)
+        _set_close(ex);
+
+    len = GBW_DOUT_CONTENT_SIZE(&ex->dout);
+
+    _put16(base,(uint16_t)ex->version);
+
+    if(ex->version == GBW_IPFIX_VERSION){
+
+        _put16(base+2,(uint16_t)len);
+        _put32(base+4,(uint32_t)(now_ms/1000));
+        _put32(base+8,ex->seq);
+        _put32(base+12,ex->domain_id);
+
+        ex->seq += ex->msg_data_records;
+    }else{
+
+        _put16(base+2,(uint16_t)ex->msg_records);
+        _put32(base+4,(uint32_t)(now_ms-ex->start_ms));
+        _put32(base+8,(uint32_t)(now_ms/1000));
+        _put32(base+12,ex->seq);
+        _put32(base+16,ex->domain_id);
+
+        ex->seq++;
+    }
+
+    rc = ex->send(base,len,ex->priv);
+    if(rc)
+        ex->send_errors++;
+
+    ex->messages++;
+    ex->records += ex->msg_data_records;
+    ex->bytes += len;
+
+    GBW_DOUT_RESET(&ex->dout);
+    ex->msg_records = 0;
+    ex->msg_data_records = 0;
+
+    return rc;
+}
+
+/*The table walk,values go out big endian*/
+static inline void _record_encode(uint8_t *p,const gbw_ipfix_template_t *tmpl,const uint8_t *rec){
+
+    const gbw_ipfix_field_t *f = tmpl->fields;
+    const gbw_ipfix_field_t *end = f+tmpl->n_fields;
+    uint16_t v16;
+    uint32_t v32;
+    uint64_t v64;
+
+    for(;f<end;p += f->len,f++){
+
+        if(f->raw){
+            memcpy(p,rec+f->off,f->len);
+            continue;
+        }
+
+        switch(f->len){
+        case 1:
+            *p = rec[f->off];
+            break;
+        case 2:
+            memcpy(&v16,rec+f->off,2);
+            _put16(p,v16);
+            break;
+        case 4:
+            memcpy(&v32,rec+f->off,4);
+            _put32(p,v32);
+            break;
+        default:
+            memcpy(&v64,rec+f->off,8);
+            _put64(p,v64);
+            break;
+        }
+    }
+}
+
+int gbw_ipfix_record_add(gbw_ipfix_exporter_t *ex,const gbw_ipfix_template_t *tmpl,const void *rec,uint64_t now_ms){
+
+    size_t need = tmpl->rec_len+SET_PAD_MAX;
+    int rc = 0;
+
+    if(ex->set_tmpl!=tmpl)
+        need += SET_HEADER_LEN+SET_PAD_MAX;
+
+    if(GBW_DOUT_CONTENT_SIZE(&ex->dout)&&GBW_DOUT_CONTENT_SIZE(&ex->dout)+need>ex->mtu)
+        rc = gbw_ipfix_flush(ex,now_ms);
+
+    if(GBW_DOUT_CONTENT_SIZE(&ex->dout) == 0)
+        _msg_begin(ex,now_ms);
+
+    if(ex->set_tmpl!=tmpl){
+
+        if(ex->set_tmpl)
+            _set_close(ex);
+
+        _set_open(ex,tmpl->id);
+        ex->set_tmpl = tmpl;
+    }
+
+    _record_encode((uint8_t*)ex->dout.pos,tmpl,(const uint8_t*)rec);
+    GBW_DOUT_POS_UPDATE(&ex->dout,tmpl->rec_len);
+
+    ex->msg_records++;
+    ex->msg_data_records++;
+
+    return rc;
+}
@@ -0,0 +1,158 @@
+/*
+ *
+ *      Filename: gbw_ipfix.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: IPFIX and NetFlow v9 encoder,records are laid out by a
+ *                field table and packed many to a message in a
+ *                gbw_data_output_t,templates resent as UDP needs
+ *
+ */
+
+#ifndef GBW_IPFIX_H
+#define GBW_IPFIX_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_data_output.h"
+
+#define GBW_IPFIX_VERSION      10
+#define GBW_NETFLOW_V9_VERSION 9
+
+#define GBW_IPFIX_MAX_FIELDS    32
+#define GBW_IPFIX_MAX_TEMPLATES 8
+
+/*template ids below are reserved for sets of their own*/
+#define GBW_IPFIX_MIN_TEMPLATE_ID 256
+
+/*a message never outgrows the output buffer*/
+#define GBW_IPFIX_MAX_MTU (DOUT_SIZE_DEFAULT-DOUT_SIZE_EXT)
+
+/*
+ * IPFIX information elements,the NetFlow v9 field types have the same
+ * numbers where both exist.
+ */
+#define GBW_IPFIX_IE_OCTET_DELTA_COUNT   1
+#define GBW_IPFIX_IE_PACKET_DELTA_COUNT  2
+#define GBW_IPFIX_IE_PROTOCOL            4
+#define GBW_IPFIX_IE_TCP_FLAGS           6
+#define GBW_IPFIX_IE_SRC_PORT            7
+#define GBW_IPFIX_IE_SRC_IPV4            8
+#define GBW_IPFIX_IE_DST_PORT            11
+#define GBW_IPFIX_IE_DST_IPV4            12
+#define GBW_IPFIX_IE_LAST_SWITCHED       21
+#define GBW_IPFIX_IE_FIRST_SWITCHED      22
+#define GBW_IPFIX_IE_SRC_IPV6            27
+#define GBW_IPFIX_IE_DST_IPV6            28
+#define GBW_IPFIX_IE_IP_VERSION          60
+#define GBW_IPFIX_IE_FLOW_END_REASON     136
+#define GBW_IPFIX_IE_FLOW_START_MS       152
+#define GBW_IPFIX_IE_FLOW_END_MS         153
+
+/*flowEndReason*/
+#define GBW_IPFIX_END_IDLE   1
+#define GBW_IPFIX_END_ACTIVE 2
+#define GBW_IPFIX_END_FLOW   3
+#define GBW_IPFIX_END_FORCED 4
+
+typedef struct gbw_ipfix_field_t gbw_ipfix_field_t;
+typedef struct gbw_ipfix_template_t gbw_ipfix_template_t;
+typedef struct gbw_ipfix_exporter_t gbw_ipfix_exporter_t;
+
+/*
+ * Where a field's value sits in the caller's record struct. raw bytes go
+ * out as they are,addresses in network order say. Other fields are host
+ * order unsigned integers of len 1,2,4 or 8 bytes.
+ */
+struct gbw_ipfix_field_t {
+
+    uint16_t id;
+    uint16_t len;
+    uint16_t off;
+    uint16_t raw;
+};
+
+struct gbw_ipfix_template_t {
+
+    uint16_t id;
+    uint16_t n_fields;
+
+    /*set by gbw_ipfix_template_add*/
+    uint16_t rec_len;
+
+    gbw_ipfix_field_t fields[GBW_IPFIX_MAX_FIELDS];
+};
+
+/*Sends one whole message,returns 0 or -1*/
+typedef int (*gbw_ipfix_send_fn)(const void *msg,size_t len,void *priv);
+
+struct gbw_ipfix_exporter_t {
+
+    int version;
+    uint32_t domain_id;
+    size_t mtu;
+
+    gbw_ipfix_send_fn send;
+    void *priv;
+
+    unsigned int n_templates;
+    const gbw_ipfix_template_t *templates[GBW_IPFIX_MAX_TEMPLATES];
+
+    /*msecs between two sends of the templates,and the last one*/
+    uint64_t refresh_ms;
+    uint64_t templates_at;
+    uint8_t templates_sent;
+
+    /*NetFlow v9 uptime counts from here*/
+    uint64_t start_ms;
+
+    /*
+     * IPFIX counts the data records before the message,NetFlow v9 the
+     * messages.
+     */
+    uint32_t seq;
+
+    /*message being built,the open set and the records it counts*/
+    gbw_data_output_t dout;
+    size_t set_off;
+    const gbw_ipfix_template_t *set_tmpl;
+    uint32_t msg_records;
+    uint32_t msg_data_records;
+    uint64_t msg_ms;
+
+    uint64_t messages;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t send_errors;
+};
+
+/*
+ * version is GBW_IPFIX_VERSION or GBW_NETFLOW_V9_VERSION,mtu the largest
+ * message,refresh_ms how often templates are sent again. now_ms,as for
+ * every call taking one,is the wall clock in msecs.
+ */
+extern int gbw_ipfix_exporter_init(gbw_ipfix_exporter_t *ex,int version,uint32_t domain_id,size_t mtu,
+        uint64_t refresh_ms,uint64_t now_ms,gbw_ipfix_send_fn send,void *priv);
+
+extern void gbw_ipfix_exporter_fin(gbw_ipfix_exporter_t *ex);
+
+/*tmpl must outlive the exporter,fails if a field or the record doesn't fit*/
+extern int gbw_ipfix_template_add(gbw_ipfix_exporter_t *ex,gbw_ipfix_template_t *tmpl);
+
+/*
+ * Appends a record laid out by tmpl,rec points to the caller's struct.
+ * A message that can't take it is sent first.
+ */
+extern int gbw_ipfix_record_add(gbw_ipfix_exporter_t *ex,const gbw_ipfix_template_t *tmpl,const void *rec,uint64_t now_ms);
+
+/*Sends the message being built,if any*/
+extern int gbw_ipfix_flush(gbw_ipfix_exporter_t *ex,uint64_t now_ms);
+
+/*msecs the message being built has waited,0 if there is none*/
+static inline uint64_t gbw_ipfix_pending_ms(const gbw_ipfix_exporter_t *ex,uint64_t now_ms){
+
+    return ex->msg_records&&now_ms>ex->msg_ms?now_ms-ex->msg_ms:0;
+}
+
+#endif /*GBW_IPFIX_H*/
@@ -91,6 +91,21 @@ void gbw_mpool_agent_free(gbw_mpool_agent_t *mpa,gbw_pool_t *mp){
     mpa->frees = (mpa->frees+1)%ULONG_MAX;
 }
 
+void gbw_mpool_agent_clear(gbw_mpool_agent_t *mpa){
+
+    gbw_pool_t *mp;
+
+    while(!list_empty(&mpa->cache_list)){
+
+        mp = list_first_entry(&mpa->cache_list,gbw_pool_t,node);
+
+        list_del(&mp->node);
+        gbw_pool_destroy(mp);
+    }
+
+    mpa->cur_cache_n = 0;
+}
+
 void gbw_mpool_agent_log(gbw_mpool_agent_t *mpa){
 
 
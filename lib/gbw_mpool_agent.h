@@ -55,6 +55,9 @@ extern gbw_pool_t *gbw_mpool_agent_alloc(gbw_mpool_agent_t *mpa);
 
 extern void gbw_mpool_agent_free(gbw_mpool_agent_t *mpa,gbw_pool_t *mp);
 
+/*destroys the cached pools,pools handed out are not tracked*/
+extern void gbw_mpool_agent_clear(gbw_mpool_agent_t *mpa);
+
 extern void gbw_mpool_agent_log(gbw_mpool_agent_t *mpa);
 
 
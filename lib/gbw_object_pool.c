@@ -10,6 +10,7 @@
 
 #include "gbw_object_pool.h"
 #include "gbw_log.h"
+#include "gbw_util.h"
 
 static inline int _new_memory(gbw_object_pool_t *omp){
 
@@ -21,7 +22,11 @@ static inline int _new_memory(gbw_object_pool_t *omp){
 	void *pos;
 	void *end;
 
-	addr = malloc(OBJECT_MEM_SIZE);
+	if(omp->hugepage)
+		addr = gbw_hugepage_alloc(omp->mem_size,NULL);
+	else
+		addr = malloc(omp->mem_size);
+
 	if(addr == NULL){
 	
 		return -1;
@@ -30,7 +35,7 @@ static inline int _new_memory(gbw_object_pool_t *omp){
 	objm = (gbw_object_mem_t*)addr;
 
 	pos = (void*)(objm+1);
-	end = addr+OBJECT_MEM_SIZE;
+	end = addr+omp->mem_size;
 
 	/*alloc object item and add to free list*/
 	r_item_size = omp->object_size+sizeof(gbw_object_item_t);
@@ -56,12 +61,14 @@ static inline int _new_memory(gbw_object_pool_t *omp){
 	return 0;
 }
 
-gbw_object_pool_t * gbw_object_pool_create(gbw_pool_t *mp,size_t object_limits,
+static gbw_object_pool_t * _object_pool_create(gbw_pool_t *mp,size_t object_limits,
 	size_t object_size,
 	void *priv_data,
-	void (*obj_init)(void *obj,void *priv_data)){
+	void (*obj_init)(void *obj,void *priv_data),
+	size_t mem_size,
+	int hugepage){
 
-	if(object_size>=OBJECT_MEM_SIZE){
+	if(object_size>=mem_size){
 	
 		gbw_log(GBW_LOG_ERR,"The object size is too large:%lu",object_size);
 		return NULL;
@@ -77,6 +84,8 @@ gbw_object_pool_t * gbw_object_pool_create(gbw_pool_t *mp,size_t object_limits,
 	objp->obj_init = obj_init;
 	objp->object_limits = object_limits;
 	objp->object_size = object_size;
+	objp->mem_size = mem_size;
+	objp->hugepage = hugepage;
 	objp->n_objects = 0;
 	objp->n_mms = 0;
 
@@ -86,6 +95,22 @@ gbw_object_pool_t * gbw_object_pool_create(gbw_pool_t *mp,size_t object_limits,
 	return objp;
 }
 
+gbw_object_pool_t * gbw_object_pool_create(gbw_pool_t *mp,size_t object_limits,
+	size_t object_size,
+	void *priv_data,
+	void (*obj_init)(void *obj,void *priv_data)){
+
+	return _object_pool_create(mp,object_limits,object_size,priv_data,obj_init,OBJECT_MEM_SIZE,0);
+}
+
+gbw_object_pool_t * gbw_object_pool_create_hugepage(gbw_pool_t *mp,size_t object_limits,
+	size_t object_size,
+	void *priv_data,
+	void (*obj_init)(void *obj,void *priv_data)){
+
+	return _object_pool_create(mp,object_limits,object_size,priv_data,obj_init,GBW_HUGEPAGE_SIZE,1);
+}
+
 
 void gbw_object_pool_destroy(gbw_object_pool_t *omp){
 
@@ -97,7 +122,10 @@ void gbw_object_pool_destroy(gbw_object_pool_t *omp){
 		prev = objm;
 		objm = objm->next;
 
-		free(prev);
+		if(omp->hugepage)
+			gbw_hugepage_free(prev,omp->mem_size);
+		else
+			free(prev);
 	}
 
 }
@@ -171,8 +199,8 @@ void gbw_object_pool_dump(gbw_object_pool_t *omp,FILE *fp){
 	fprintf(fp,"The total number object has been alloced:%lu,size:%lu\n",(unsigned long)omp->n_objects,
 		ROBJ_SIZE(omp,omp->n_objects));
 
-	fprintf(fp,"The total number memory has been alloced:%lu,size:%luk\n",(unsigned long)omp->n_mms,
-		(unsigned long)64*omp->n_mms);
+	fprintf(fp,"The total number memory has been alloced:%lu,size:%luk%s\n",(unsigned long)omp->n_mms,
+		(unsigned long)(omp->mem_size/1024*omp->n_mms),omp->hugepage?" in hugepages":"");
 
 
 	fprintf(fp,"The total number object in free list:%lu,size:%lu\n",(unsigned long)omp->n_frees,
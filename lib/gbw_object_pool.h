@@ -33,6 +33,10 @@ struct gbw_object_pool_t {
 	size_t object_limits;
 	size_t object_size;
 
+	/*bytes carved into objects at a time,from hugepages if hugepage is set*/
+	size_t mem_size;
+	int hugepage;
+
 	size_t n_objects;
 
 	size_t n_mms;
@@ -58,6 +62,16 @@ extern gbw_object_pool_t * gbw_object_pool_create(gbw_pool_t *mp,size_t object_l
 	void *priv_data,
 	void (*obj_init)(void *obj,void *priv_data));
 
+/*
+ * Same as gbw_object_pool_create,but objects are carved from 2M chunks
+ * of hugepage memory,falling back to plain pages when none are reserved.
+ * Fits pools of millions of small objects that are walked at line rate.
+ */
+extern gbw_object_pool_t * gbw_object_pool_create_hugepage(gbw_pool_t *mp,size_t object_limits,
+	size_t object_size,
+	void *priv_data,
+	void (*obj_init)(void *obj,void *priv_data));
+
 extern void gbw_object_pool_destroy(gbw_object_pool_t *omp);
 
 extern void * gbw_object_pool_get(gbw_object_pool_t *omp);
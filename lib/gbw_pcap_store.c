@@ -0,0 +1,690 @@
+/*
+ *
+ *      Filename: gbw_pcap_store.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: packet store on disk,pcap segments written through an
+ *                aligned buffer,each with an index of time ranges and
+ *                Bloom filters of addresses and 5-tuples to query it by
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gbw_pcap_store.h"
+#include "gbw_sketch.h"
+#include "gbw_log.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+
+#define ETHER_HDR_LEN 14
+#define ETHER_TYPE_VLAN 0x8100
+#define ETHER_TYPE_QINQ 0x88a8
+#define ETHER_TYPE_IPV4 0x0800
+#define ETHER_TYPE_IPV6 0x86dd
+
+#define IPV6_MAX_EXT_HDRS 8
+
+/*Keys,the same for the writer and the queries*/
+
+static inline uint64_t _addr_key(const uint8_t *addr,uint8_t len){
+
+    uint64_t w[2] = {0,0};
+
+    memcpy(w,addr,len>sizeof(w)?sizeof(w):len);
+
+    return gbw_sketch_mix64(w[0]^gbw_sketch_mix64(w[1]^len));
+}
+
+/*either way round gives the same key*/
+static inline uint64_t _flow_key(uint8_t proto,uint8_t len,const uint8_t *a,uint16_t aport,
+        const uint8_t *b,uint16_t bport){
+
+    return gbw_sketch_mix64(gbw_sketch_mix64(_addr_key(a,len)^aport)+
+            gbw_sketch_mix64(_addr_key(b,len)^bport)+proto);
+}
+
+static inline void _bloom_add(uint64_t *bloom,uint32_t bits,uint32_t k,uint64_t h){
+
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h>>32)|1;
+    uint32_t i,bit;
+
+    for(i = 0;i<k;i++){
+        bit = (h1+i*h2)&(bits-1);
+        bloom[bit>>6] |= 1ULL<<(bit&63);
+    }
+}
+
+static inline int _bloom_has(const uint64_t *bloom,uint32_t bits,uint32_t k,uint64_t h){
+
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h>>32)|1;
+    uint32_t i,bit;
+
+    for(i = 0;i<k;i++){
+        bit = (h1+i*h2)&(bits-1);
+        if((bloom[bit>>6]&(1ULL<<(bit&63))) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+static inline uint16_t _rd16(const uint8_t *p){
+
+    return (uint16_t)(p[0]<<8|p[1]);
+}
+
+/*Version 2.4,usec timestamps*/
+void gbw_pcap_store_file_hdr(void *buf,uint32_t snaplen){
+
+    uint32_t hdr[6];
+
+    hdr[0] = PCAP_MAGIC_USEC;
+    ((uint16_t*)hdr)[2] = 2;
+    ((uint16_t*)hdr)[3] = 4;
+    hdr[2] = 0;
+    hdr[3] = 0;
+    hdr[4] = snaplen;
+    hdr[5] = GBW_PCAP_STORE_LINKTYPE;
+
+    memcpy(buf,hdr,sizeof(hdr));
+}
+
+int gbw_pcap_store_file_hdr_write(FILE *fp,uint32_t snaplen){
+
+    uint8_t hdr[GBW_PCAP_STORE_FILE_HDR];
+
+    gbw_pcap_store_file_hdr(hdr,snaplen);
+
+    return fwrite(hdr,sizeof(hdr),1,fp) == 1?0:-1;
+}
+
+int gbw_pcap_store_tuple_parse(const uint8_t *data,uint32_t caplen,gbw_pcap_store_tuple_t *tuple){
+
+    uint32_t off = ETHER_HDR_LEN,l4_off;
+    uint16_t type;
+    uint8_t nh;
+    int ports = 1,i;
+
+    if(caplen<ETHER_HDR_LEN)
+        return -1;
+
+    type = _rd16(data+12);
+
+    while((type == ETHER_TYPE_VLAN||type == ETHER_TYPE_QINQ)&&off+4<=caplen){
+        type = _rd16(data+off+2);
+        off += 4;
+    }
+
+    if(type == ETHER_TYPE_IPV4){
+
+        if(off+20>caplen||(data[off]>>4)!=4)
+            return -1;
+
+        tuple->addr_len = 4;
+        tuple->proto = data[off+9];
+        memcpy(tuple->src,data+off+12,4);
+        memcpy(tuple->dst,data+off+16,4);
+
+        /*later fragments have no ports*/
+        ports = (_rd16(data+off+6)&0x1fff) == 0;
+        l4_off = off+(data[off]&0x0f)*4;
+
+    }else if(type == ETHER_TYPE_IPV6){
+
+        if(off+40>caplen||(data[off]>>4)!=6)
+            return -1;
+
+        tuple->addr_len = 16;
+        memcpy(tuple->src,data+off+8,16);
+        memcpy(tuple->dst,data+off+24,16);
+
+        nh = data[off+6];
+        l4_off = off+40;
+
+        for(i = 0;i<IPV6_MAX_EXT_HDRS&&l4_off+8<=caplen;i++){
+
+            if(nh == 0||nh == 43||nh == 60){
+                nh = data[l4_off];
+                l4_off += ((uint32_t)data[l4_off+1]+1)*8;
+            }else if(nh == 44){
+                ports = (_rd16(data+l4_off+2)&0xfff8) == 0;
+                nh = data[l4_off];
+                l4_off += 8;
+            }else if(nh == 51){
+                nh = data[l4_off];
+                l4_off += ((uint32_t)data[l4_off+1]+2)*4;
+            }else{
+                break;
+            }
+        }
+
+        tuple->proto = nh;
+
+    }else{
+        return -1;
+    }
+
+    tuple->sport = tuple->dport = 0;
+
+    if(ports&&l4_off+4<=caplen&&(tuple->proto == 6||tuple->proto == 17||tuple->proto == 132)){
+        tuple->sport = _rd16(data+l4_off);
+        tuple->dport = _rd16(data+l4_off+2);
+    }
+
+    return 0;
+}
+
+/*Writer*/
+
+static inline uint32_t _bloom_words(uint32_t bits){
+
+    return bits/64;
+}
+
+static inline uint64_t * _block_bloom(const gbw_pcap_store_index_t *idx,uint32_t i){
+
+    return idx->block_blooms+(size_t)i*_bloom_words(idx->hdr.block_bloom_bits);
+}
+
+static void _index_reset(gbw_pcap_store_index_t *idx){
+
+    memset(&idx->hdr,0,sizeof(idx->hdr));
+
+    idx->hdr.magic = GBW_PCAP_STORE_MAGIC;
+    idx->hdr.version = GBW_PCAP_STORE_VERSION;
+    idx->hdr.hdr_len = sizeof(idx->hdr);
+    idx->hdr.block_size = GBW_PCAP_STORE_BLOCK_SIZE;
+    idx->hdr.seg_bloom_bits = GBW_PCAP_STORE_SEG_BLOOM_BITS;
+    idx->hdr.block_bloom_bits = GBW_PCAP_STORE_BLOCK_BLOOM_BITS;
+    idx->hdr.bloom_hashes = GBW_PCAP_STORE_BLOOM_HASHES;
+    idx->hdr.linktype = GBW_PCAP_STORE_LINKTYPE;
+
+    memset(idx->seg_bloom,0,GBW_PCAP_STORE_SEG_BLOOM_BITS/8);
+}
+
+gbw_pcap_store_t * gbw_pcap_store_create(gbw_pool_t *mp,const char *dir,const char *name,
+        uint64_t segment_size,uint32_t segment_secs,size_t buf_size,uint32_t snaplen){
+
+    gbw_pcap_store_t *st;
+    gbw_pcap_store_index_t *idx;
+
+    if(buf_size == 0||buf_size%GBW_PCAP_STORE_ALIGN){
+        gbw_log(GBW_LOG_ERR,"Packet store buffer size:%lu not a multiple of %u",
+                (unsigned long)buf_size,GBW_PCAP_STORE_ALIGN);
+        return NULL;
+    }
+
+    st = (gbw_pcap_store_t*)gbw_pcalloc(mp,sizeof(*st));
+
+    st->dir = dir;
+    st->name = name;
+    st->segment_size = segment_size;
+    st->segment_usecs = (uint64_t)segment_secs*1000000;
+    st->snaplen = snaplen;
+    st->buf_size = buf_size;
+    st->fd = -1;
+
+    idx = &st->idx;
+
+    /*a block may end past its size by a record,a segment by none*/
+    idx->max_blocks = (uint32_t)(segment_size/GBW_PCAP_STORE_BLOCK_SIZE)+2;
+    idx->blocks = (gbw_pcap_store_block_t*)calloc(idx->max_blocks,sizeof(*idx->blocks));
+    idx->seg_bloom = (uint64_t*)malloc(GBW_PCAP_STORE_SEG_BLOOM_BITS/8);
+    idx->block_blooms = (uint64_t*)malloc((size_t)idx->max_blocks*GBW_PCAP_STORE_BLOCK_BLOOM_BITS/8);
+
+    if(idx->blocks == NULL||idx->seg_bloom == NULL||idx->block_blooms == NULL||
+            posix_memalign((void**)&st->buf,GBW_PCAP_STORE_ALIGN,buf_size)){
+
+        gbw_log(GBW_LOG_ERR,"No memory for the packet store:%s",name);
+        gbw_pcap_store_index_free(idx);
+        return NULL;
+    }
+
+    _index_reset(idx);
+
+    return st;
+}
+
+static int _seg_open(gbw_pcap_store_t *st,uint64_t ts){
+
+    char part[sizeof(st->path)+8];
+    int n;
+
+    n = snprintf(st->path,sizeof(st->path),"%s/%s_%lu_%u.pcap",st->dir,st->name,
+            (unsigned long)(ts/1000000),st->seq++);
+    if(n<0||(size_t)n>=sizeof(st->path)){
+        gbw_log(GBW_LOG_ERR,"Packet store path too long:%s/%s",st->dir,st->name);
+        return -1;
+    }
+
+    snprintf(part,sizeof(part),"%s.part",st->path);
+
+    /*tmpfs and some others have no direct I/O*/
+    st->direct = 1;
+    st->fd = open(part,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC|O_DIRECT,0644);
+
+    if(st->fd<0&&errno == EINVAL){
+        st->direct = 0;
+        st->fd = open(part,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+    }
+
+    if(st->fd<0){
+        gbw_log(GBW_LOG_ERR,"Cannot open packet store segment:%s:%s",part,strerror(errno));
+        return -1;
+    }
+
+    gbw_pcap_store_file_hdr(st->buf,st->snaplen);
+
+    st->buf_len = GBW_PCAP_STORE_FILE_HDR;
+    st->file_off = 0;
+    st->started = ts;
+    st->segments++;
+
+    _index_reset(&st->idx);
+
+    return 0;
+}
+
+static int _write_all(int fd,const uint8_t *data,size_t len){
+
+    ssize_t n;
+
+    while(len){
+
+        n = write(fd,data,len);
+        if(n<0){
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        data += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/*A segment that failed to write is not kept,its index would lie*/
+static void _seg_abort(gbw_pcap_store_t *st){
+
+    char part[sizeof(st->path)+8];
+
+    gbw_log(GBW_LOG_ERR,"Cannot write packet store segment:%s:%s",st->path,strerror(errno));
+
+    if(st->fd>=0)
+        close(st->fd);
+
+    st->fd = -1;
+    st->errors++;
+
+    snprintf(part,sizeof(part),"%s.part",st->path);
+    unlink(part);
+}
+
+static int _buf_put(gbw_pcap_store_t *st,const void *data,size_t len){
+
+    const uint8_t *p = (const uint8_t*)data;
+    size_t n;
+
+    while(len){
+
+        n = st->buf_size-st->buf_len;
+        if(n>len)
+            n = len;
+
+        memcpy(st->buf+st->buf_len,p,n);
+        st->buf_len += n;
+        p += n;
+        len -= n;
+
+        if(st->buf_len == st->buf_size){
+
+            if(_write_all(st->fd,st->buf,st->buf_size))
+                return -1;
+
+            st->file_off += st->buf_size;
+            st->buf_len = 0;
+        }
+    }
+
+    return 0;
+}
+
+static void _index_add(gbw_pcap_store_index_t *idx,uint64_t offset,uint64_t ts,
+        const uint8_t *data,uint32_t caplen,uint32_t rec_len){
+
+    gbw_pcap_store_block_t *block;
+    gbw_pcap_store_tuple_t t;
+    uint64_t *bloom;
+    uint64_t keys[3];
+    int i;
+
+    if(idx->hdr.nb_blocks == 0||(idx->blocks[idx->hdr.nb_blocks-1].len>=GBW_PCAP_STORE_BLOCK_SIZE&&
+                idx->hdr.nb_blocks<idx->max_blocks)){
+
+        block = &idx->blocks[idx->hdr.nb_blocks++];
+        block->offset = offset;
+        block->len = 0;
+        block->ts_min = block->ts_max = ts;
+        block->pkts = 0;
+
+        memset(_block_bloom(idx,idx->hdr.nb_blocks-1),0,GBW_PCAP_STORE_BLOCK_BLOOM_BITS/8);
+    }
+
+    block = &idx->blocks[idx->hdr.nb_blocks-1];
+
+    if(ts<block->ts_min)
+        block->ts_min = ts;
+    if(ts>block->ts_max)
+        block->ts_max = ts;
+
+    block->len += rec_len;
+    block->pkts++;
+
+    if(idx->hdr.pkts == 0||ts<idx->hdr.ts_min)
+        idx->hdr.ts_min = ts;
+    if(ts>idx->hdr.ts_max)
+        idx->hdr.ts_max = ts;
+
+    idx->hdr.pkts++;
+    idx->hdr.bytes += rec_len;
+
+    if(gbw_pcap_store_tuple_parse(data,caplen,&t))
+        return;
+
+    keys[0] = _addr_key(t.src,t.addr_len);
+    keys[1] = _addr_key(t.dst,t.addr_len);
+    keys[2] = _flow_key(t.proto,t.addr_len,t.src,t.sport,t.dst,t.dport);
+
+    bloom = _block_bloom(idx,idx->hdr.nb_blocks-1);
+
+    for(i = 0;i<3;i++){
+        _bloom_add(idx->seg_bloom,idx->hdr.seg_bloom_bits,idx->hdr.bloom_hashes,keys[i]);
+        _bloom_add(bloom,idx->hdr.block_bloom_bits,idx->hdr.bloom_hashes,keys[i]);
+    }
+}
+
+int gbw_pcap_store_add(gbw_pcap_store_t *st,uint64_t ts,const void *data,uint32_t caplen,uint32_t len){
+
+    uint32_t hdr[4];
+    uint64_t rec_len;
+
+    if(caplen>st->snaplen)
+        caplen = st->snaplen;
+
+    rec_len = GBW_PCAP_STORE_REC_HDR+caplen;
+
+    if(st->fd>=0&&st->idx.hdr.pkts&&(st->file_off+st->buf_len+rec_len>st->segment_size||
+                (st->segment_usecs&&ts>=st->started+st->segment_usecs)))
+        gbw_pcap_store_close(st);
+
+    if(st->fd<0&&_seg_open(st,ts)){
+        st->errors++;
+        return -1;
+    }
+
+    _index_add(&st->idx,st->file_off+st->buf_len,ts,(const uint8_t*)data,caplen,(uint32_t)rec_len);
+
+    hdr[0] = (uint32_t)(ts/1000000);
+    hdr[1] = (uint32_t)(ts%1000000);
+    hdr[2] = caplen;
+    hdr[3] = len;
+
+    if(_buf_put(st,hdr,sizeof(hdr))||_buf_put(st,data,caplen)){
+        _seg_abort(st);
+        return -1;
+    }
+
+    st->pkts++;
+    st->bytes += rec_len;
+
+    return 0;
+}
+
+static void _index_fname(char *buf,size_t size,const char *path){
+
+    snprintf(buf,size,"%s.%s",path,GBW_PCAP_STORE_EXTNAME);
+}
+
+static int _index_write(const gbw_pcap_store_index_t *idx,const char *path){
+
+    char fname[sizeof(((gbw_pcap_store_t*)0)->path)+8];
+    char tmp[sizeof(fname)+8];
+    size_t nb = idx->hdr.nb_blocks;
+    FILE *fp;
+    int rc = 0;
+
+    _index_fname(fname,sizeof(fname),path);
+    snprintf(tmp,sizeof(tmp),"%s.tmp",fname);
+
+    fp = fopen(tmp,"wb");
+    if(fp == NULL)
+        return -1;
+
+    if(fwrite(&idx->hdr,sizeof(idx->hdr),1,fp)!=1||
+            (nb&&fwrite(idx->blocks,sizeof(*idx->blocks),nb,fp)!=nb)||
+            fwrite(idx->seg_bloom,idx->hdr.seg_bloom_bits/8,1,fp)!=1||
+            (nb&&fwrite(idx->block_blooms,idx->hdr.block_bloom_bits/8,nb,fp)!=nb))
+        rc = -1;
+
+    if(fclose(fp))
+        rc = -1;
+
+    if(rc == 0&&rename(tmp,fname))
+        rc = -1;
+
+    if(rc)
+        unlink(tmp);
+
+    return rc;
+}
+
+/*
+ * The tail is less than a buffer and may end anywhere,direct I/O is
+ * turned off for it. The index goes first,a segment is never seen
+ * without one unless it could not be written.
+ */
+int gbw_pcap_store_close(gbw_pcap_store_t *st){
+
+    char part[sizeof(st->path)+8];
+    int flags;
+
+    if(st->fd<0)
+        return 0;
+
+    if(st->buf_len){
+
+        if(st->direct&&(flags = fcntl(st->fd,F_GETFL))!=-1)
+            fcntl(st->fd,F_SETFL,flags&~O_DIRECT);
+
+        if(_write_all(st->fd,st->buf,st->buf_len)){
+            _seg_abort(st);
+            return -1;
+        }
+
+        st->file_off += st->buf_len;
+        st->buf_len = 0;
+    }
+
+    if(close(st->fd)){
+        st->fd = -1;
+        _seg_abort(st);
+        return -1;
+    }
+
+    st->fd = -1;
+
+    if(_index_write(&st->idx,st->path)){
+        gbw_log(GBW_LOG_ERR,"Cannot write the index of packet store segment:%s",st->path);
+        st->errors++;
+    }
+
+    snprintf(part,sizeof(part),"%s.part",st->path);
+    if(rename(part,st->path)){
+        gbw_log(GBW_LOG_ERR,"Cannot rename packet store segment:%s:%s",part,strerror(errno));
+        st->errors++;
+        return -1;
+    }
+
+    return 0;
+}
+
+void gbw_pcap_store_destroy(gbw_pcap_store_t *st){
+
+    gbw_pcap_store_close(st);
+    gbw_pcap_store_index_free(&st->idx);
+
+    free(st->buf);
+    st->buf = NULL;
+}
+
+/*Reader*/
+
+void gbw_pcap_store_index_free(gbw_pcap_store_index_t *idx){
+
+    free(idx->blocks);
+    free(idx->seg_bloom);
+    free(idx->block_blooms);
+
+    idx->blocks = NULL;
+    idx->seg_bloom = NULL;
+    idx->block_blooms = NULL;
+    idx->max_blocks = 0;
+}
+
+static inline int _bloom_bits_ok(uint32_t bits){
+
+    return bits>=64&&(bits&(bits-1)) == 0;
+}
+
+int gbw_pcap_store_index_load(gbw_pcap_store_index_t *idx,const char *path){
+
+    char fname[1024];
+    gbw_pcap_store_index_hdr_t hdr;
+    size_t nb;
+    FILE *fp;
+
+    memset(idx,0,sizeof(*idx));
+
+    _index_fname(fname,sizeof(fname),path);
+
+    fp = fopen(fname,"rb");
+    if(fp == NULL)
+        return -1;
+
+    if(fread(&hdr,sizeof(hdr),1,fp)!=1||hdr.magic!=GBW_PCAP_STORE_MAGIC||
+            hdr.version!=GBW_PCAP_STORE_VERSION||hdr.hdr_len!=sizeof(hdr)||
+            !_bloom_bits_ok(hdr.seg_bloom_bits)||!_bloom_bits_ok(hdr.block_bloom_bits)||
+            hdr.bloom_hashes == 0||hdr.linktype!=GBW_PCAP_STORE_LINKTYPE)
+        goto fail;
+
+    idx->hdr = hdr;
+    nb = hdr.nb_blocks;
+
+    idx->blocks = (gbw_pcap_store_block_t*)malloc((nb?nb:1)*sizeof(*idx->blocks));
+    idx->seg_bloom = (uint64_t*)malloc(hdr.seg_bloom_bits/8);
+    idx->block_blooms = (uint64_t*)malloc((nb?nb:1)*(hdr.block_bloom_bits/8));
+
+    if(idx->blocks == NULL||idx->seg_bloom == NULL||idx->block_blooms == NULL)
+        goto fail;
+
+    idx->max_blocks = hdr.nb_blocks;
+
+    if((nb&&fread(idx->blocks,sizeof(*idx->blocks),nb,fp)!=nb)||
+            fread(idx->seg_bloom,hdr.seg_bloom_bits/8,1,fp)!=1||
+            (nb&&fread(idx->block_blooms,hdr.block_bloom_bits/8,nb,fp)!=nb))
+        goto fail;
+
+    fclose(fp);
+
+    return 0;
+
+fail:
+    fclose(fp);
+    gbw_pcap_store_index_free(idx);
+
+    return -1;
+}
+
+static inline int _end_full(const gbw_pcap_store_query_t *q,int i){
+
+    return q->ends[i].addr_len&&q->ends[i].port;
+}
+
+/*
+ * A whole 5-tuple is looked up as such,otherwise each address on its
+ * own. Ports alone are in no filter.
+ */
+static int _bloom_query(const gbw_pcap_store_query_t *q,const uint64_t *bloom,uint32_t bits,uint32_t k){
+
+    int i;
+
+    if((q->proto == 6||q->proto == 17||q->proto == 132)&&_end_full(q,0)&&_end_full(q,1)&&
+            q->ends[0].addr_len == q->ends[1].addr_len)
+        return _bloom_has(bloom,bits,k,_flow_key(q->proto,q->ends[0].addr_len,q->ends[0].addr,q->ends[0].port,
+                    q->ends[1].addr,q->ends[1].port));
+
+    for(i = 0;i<2;i++){
+        if(q->ends[i].addr_len&&!_bloom_has(bloom,bits,k,_addr_key(q->ends[i].addr,q->ends[i].addr_len)))
+            return 0;
+    }
+
+    return 1;
+}
+
+static inline int _time_query(const gbw_pcap_store_query_t *q,uint64_t ts_min,uint64_t ts_max){
+
+    return (q->ts_from == 0||ts_max>=q->ts_from)&&(q->ts_to == 0||ts_min<=q->ts_to);
+}
+
+int gbw_pcap_store_query_segment(const gbw_pcap_store_index_t *idx,const gbw_pcap_store_query_t *q){
+
+    if(idx->hdr.pkts == 0||!_time_query(q,idx->hdr.ts_min,idx->hdr.ts_max))
+        return 0;
+
+    return _bloom_query(q,idx->seg_bloom,idx->hdr.seg_bloom_bits,idx->hdr.bloom_hashes);
+}
+
+int gbw_pcap_store_query_block(const gbw_pcap_store_index_t *idx,const gbw_pcap_store_query_t *q,uint32_t i){
+
+    const gbw_pcap_store_block_t *block = &idx->blocks[i];
+
+    if(!_time_query(q,block->ts_min,block->ts_max))
+        return 0;
+
+    return _bloom_query(q,_block_bloom(idx,i),idx->hdr.block_bloom_bits,idx->hdr.bloom_hashes);
+}
+
+static inline int _end_match(const gbw_pcap_store_query_t *q,int i,const gbw_pcap_store_tuple_t *t,
+        const uint8_t *addr,uint16_t port){
+
+    if(q->ends[i].addr_len&&(q->ends[i].addr_len!=t->addr_len||memcmp(q->ends[i].addr,addr,t->addr_len)))
+        return 0;
+
+    return q->ends[i].port == 0||q->ends[i].port == port;
+}
+
+int gbw_pcap_store_query_match(const gbw_pcap_store_query_t *q,uint64_t ts,const gbw_pcap_store_tuple_t *tuple){
+
+    if(!_time_query(q,ts,ts))
+        return 0;
+
+    if(q->proto == 0&&q->ends[0].addr_len == 0&&q->ends[0].port == 0&&
+            q->ends[1].addr_len == 0&&q->ends[1].port == 0)
+        return 1;
+
+    if(tuple == NULL||(q->proto&&q->proto!=tuple->proto))
+        return 0;
+
+    return (_end_match(q,0,tuple,tuple->src,tuple->sport)&&_end_match(q,1,tuple,tuple->dst,tuple->dport))||
+        (_end_match(q,0,tuple,tuple->dst,tuple->dport)&&_end_match(q,1,tuple,tuple->src,tuple->sport));
+}
@@ -0,0 +1,209 @@
+/*
+ *
+ *      Filename: gbw_pcap_store.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: packet store on disk,pcap segments written through an
+ *                aligned buffer,each with an index of time ranges and
+ *                Bloom filters of addresses and 5-tuples to query it by
+ *
+ */
+
+#ifndef GBW_PCAP_STORE_H
+#define GBW_PCAP_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_mpool.h"
+
+/*
+ * A segment is a pcap file,usec timestamps,ethernet,named
+ * <name>_<secs of its first packet>_<seq>.pcap and written as .part until
+ * closed. Its index is written next to it as <segment>.idx first:
+ *
+ *   gbw_pcap_store_index_hdr_t
+ *   gbw_pcap_store_block_t[nb_blocks]
+ *   uint64_t[seg_bloom_bits/64]                the whole segment
+ *   uint64_t[block_bloom_bits/64][nb_blocks]   each block
+ *
+ * A block is the records of about GBW_PCAP_STORE_BLOCK_SIZE bytes in a
+ * row. The Bloom filters hold the addresses and the 5-tuple,either way
+ * round,of the outermost IP header of each packet. Fields are in host
+ * byte order.
+ */
+#define GBW_PCAP_STORE_MAGIC 0x58445347 /*GSDX*/
+#define GBW_PCAP_STORE_VERSION 1
+#define GBW_PCAP_STORE_EXTNAME "idx"
+
+#define GBW_PCAP_STORE_FILE_HDR 24
+#define GBW_PCAP_STORE_REC_HDR 16
+#define GBW_PCAP_STORE_LINKTYPE 1
+
+/*O_DIRECT wants buffers,sizes and offsets aligned on this*/
+#define GBW_PCAP_STORE_ALIGN 4096
+
+#define GBW_PCAP_STORE_BLOCK_SIZE (1024*1024)
+#define GBW_PCAP_STORE_SEG_BLOOM_BITS (1U<<20)
+#define GBW_PCAP_STORE_BLOCK_BLOOM_BITS (1U<<14)
+#define GBW_PCAP_STORE_BLOOM_HASHES 3
+
+typedef struct gbw_pcap_store_index_hdr_t gbw_pcap_store_index_hdr_t;
+typedef struct gbw_pcap_store_block_t gbw_pcap_store_block_t;
+typedef struct gbw_pcap_store_index_t gbw_pcap_store_index_t;
+typedef struct gbw_pcap_store_t gbw_pcap_store_t;
+typedef struct gbw_pcap_store_tuple_t gbw_pcap_store_tuple_t;
+typedef struct gbw_pcap_store_query_t gbw_pcap_store_query_t;
+
+struct gbw_pcap_store_index_hdr_t {
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_len;
+
+    uint32_t block_size;
+    uint32_t nb_blocks;
+
+    uint64_t pkts;
+    uint64_t bytes;
+
+    /*usec*/
+    uint64_t ts_min;
+    uint64_t ts_max;
+
+    uint32_t seg_bloom_bits;
+    uint32_t block_bloom_bits;
+    uint32_t bloom_hashes;
+    uint32_t linktype;
+};
+
+struct gbw_pcap_store_block_t {
+
+    /*file offset of its first record*/
+    uint64_t offset;
+    uint64_t len;
+
+    uint64_t ts_min;
+    uint64_t ts_max;
+
+    uint64_t pkts;
+};
+
+struct gbw_pcap_store_index_t {
+
+    gbw_pcap_store_index_hdr_t hdr;
+
+    gbw_pcap_store_block_t *blocks;
+    uint32_t max_blocks;
+
+    uint64_t *seg_bloom;
+    uint64_t *block_blooms;
+};
+
+/*One per stream of packets,only ever used from one thread*/
+struct gbw_pcap_store_t {
+
+    const char *dir;
+    const char *name;
+
+    uint64_t segment_size;
+    uint64_t segment_usecs;
+    uint32_t snaplen;
+
+    int fd;
+    int direct;
+    uint32_t seq;
+    char path[256];
+
+    /*the segment from its first packet*/
+    uint64_t started;
+
+    /*
+     * The segment past what is on disk,file_off is always aligned: only
+     * whole buffers are written until it is closed.
+     */
+    uint8_t *buf;
+    size_t buf_size;
+    size_t buf_len;
+    uint64_t file_off;
+
+    gbw_pcap_store_index_t idx;
+
+    uint64_t segments;
+    uint64_t pkts;
+    uint64_t bytes;
+    uint64_t errors;
+};
+
+/*Addresses in network order,ports only for tcp,udp and sctp*/
+struct gbw_pcap_store_tuple_t {
+
+    uint8_t addr_len;
+    uint8_t proto;
+
+    uint16_t sport;
+    uint16_t dport;
+
+    uint8_t src[16];
+    uint8_t dst[16];
+};
+
+/*
+ * Packets between the two ends,either way round,each end an address,a
+ * port or both. An end with neither,or proto 0,matches anything.
+ */
+struct gbw_pcap_store_query_t {
+
+    /*usec,0 means open*/
+    uint64_t ts_from;
+    uint64_t ts_to;
+
+    uint8_t proto;
+
+    struct {
+        uint8_t addr_len;
+        uint8_t addr[16];
+        uint16_t port;
+    }ends[2];
+};
+
+/*
+ * Segments of at most segment_size bytes and segment_secs secs,written
+ * in buf_size bytes,a multiple of GBW_PCAP_STORE_ALIGN. Nothing is
+ * opened before the first packet.
+ */
+extern gbw_pcap_store_t * gbw_pcap_store_create(gbw_pool_t *mp,const char *dir,const char *name,
+        uint64_t segment_size,uint32_t segment_secs,size_t buf_size,uint32_t snaplen);
+
+/*Closes the segment being written*/
+extern void gbw_pcap_store_destroy(gbw_pcap_store_t *st);
+
+/*Appends a packet,ts in usec,returns -1 when it is lost*/
+extern int gbw_pcap_store_add(gbw_pcap_store_t *st,uint64_t ts,const void *data,uint32_t caplen,uint32_t len);
+
+/*Writes out and indexes the segment being written,the next packet opens another*/
+extern int gbw_pcap_store_close(gbw_pcap_store_t *st);
+
+/*Fills buf with the GBW_PCAP_STORE_FILE_HDR bytes of a pcap file header*/
+extern void gbw_pcap_store_file_hdr(void *buf,uint32_t snaplen);
+
+/*Writes a pcap file header to fp,-1 on failure*/
+extern int gbw_pcap_store_file_hdr_write(FILE *fp,uint32_t snaplen);
+
+/*Of the outermost IP header behind ethernet and VLAN tags,-1 for non IP*/
+extern int gbw_pcap_store_tuple_parse(const uint8_t *data,uint32_t caplen,gbw_pcap_store_tuple_t *tuple);
+
+/*Index of the segment at path,-1 if it has none or a broken one*/
+extern int gbw_pcap_store_index_load(gbw_pcap_store_index_t *idx,const char *path);
+
+extern void gbw_pcap_store_index_free(gbw_pcap_store_index_t *idx);
+
+/*Whether the segment,or its block i,may hold packets of the query*/
+extern int gbw_pcap_store_query_segment(const gbw_pcap_store_index_t *idx,const gbw_pcap_store_query_t *q);
+
+extern int gbw_pcap_store_query_block(const gbw_pcap_store_index_t *idx,const gbw_pcap_store_query_t *q,uint32_t i);
+
+/*Whether a packet matches,tuple is NULL for non IP ones*/
+extern int gbw_pcap_store_query_match(const gbw_pcap_store_query_t *q,uint64_t ts,const gbw_pcap_store_tuple_t *tuple);
+
+#endif /*GBW_PCAP_STORE_H*/
@@ -0,0 +1,419 @@
+/*
+ *
+ *      Filename: gbw_sketch.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: Count-Min and Space-Saving sketches,fixed memory counts
+ *                of as many distinct keys as there are
+ *
+ */
+
+#include <stdlib.h>
+
+#include "gbw_sketch.h"
+#include "gbw_log.h"
+
+static inline uint32_t _pow2_roundup(uint32_t v){
+
+    uint32_t p = 1;
+
+    while(p<v)
+        p <<= 1;
+
+    return p;
+}
+
+static void *_aligned_zalloc(size_t size){
+
+    void *p;
+
+    if(posix_memalign(&p,64,size))
+        return NULL;
+
+    memset(p,0,size);
+
+    return p;
+}
+
+gbw_sketch_cms_t * gbw_sketch_cms_create(gbw_pool_t *mp,uint32_t depth,uint32_t width){
+
+    gbw_sketch_cms_t *cms;
+
+    if(depth == 0||depth>GBW_SKETCH_MAX_DEPTH||width == 0||width>(1U<<30)){
+        gbw_log(GBW_LOG_ERR,"Bad Count-Min sketch size,depth:%u width:%u",depth,width);
+        return NULL;
+    }
+
+    cms = (gbw_sketch_cms_t*)gbw_pcalloc(mp,sizeof(*cms));
+    if(cms == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for a Count-Min sketch");
+        return NULL;
+    }
+
+    cms->depth = depth;
+    cms->width = _pow2_roundup(width);
+    cms->mask = cms->width-1;
+
+    cms->counters = (uint64_t*)_aligned_zalloc((size_t)cms->depth*cms->width*sizeof(uint64_t));
+    if(cms->counters == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for a Count-Min sketch of %u*%u counters",cms->depth,cms->width);
+        return NULL;
+    }
+
+    return cms;
+}
+
+void gbw_sketch_cms_destroy(gbw_sketch_cms_t *cms){
+
+    free(cms->counters);
+    cms->counters = NULL;
+}
+
+int gbw_sketch_cms_merge(gbw_sketch_cms_t *dst,const gbw_sketch_cms_t *src){
+
+    size_t i,n = (size_t)dst->depth*dst->width;
+
+    if(dst->depth!=src->depth||dst->width!=src->width)
+        return -1;
+
+    for(i = 0;i<n;i++)
+        dst->counters[i] += src->counters[i];
+
+    dst->total += src->total;
+
+    return 0;
+}
+
+void gbw_sketch_cms_clear(gbw_sketch_cms_t *cms){
+
+    memset(cms->counters,0,(size_t)cms->depth*cms->width*sizeof(uint64_t));
+    cms->total = 0;
+}
+
+gbw_sketch_ss_t * gbw_sketch_ss_create(gbw_pool_t *mp,uint32_t capacity){
+
+    gbw_sketch_ss_t *ss;
+    uint32_t index_size;
+
+    if(capacity == 0||capacity>(1U<<24)){
+        gbw_log(GBW_LOG_ERR,"Bad Space-Saving capacity:%u",capacity);
+        return NULL;
+    }
+
+    /*the index stays at most half full*/
+    index_size = _pow2_roundup(capacity*2);
+
+    ss = (gbw_sketch_ss_t*)gbw_pcalloc(mp,sizeof(*ss));
+    if(ss == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for a Space-Saving sketch");
+        return NULL;
+    }
+
+    ss->capacity = capacity;
+    ss->index_mask = index_size-1;
+
+    ss->entries = (gbw_sketch_ss_entry_t*)_aligned_zalloc((size_t)capacity*sizeof(gbw_sketch_ss_entry_t));
+    ss->heap = (uint32_t*)_aligned_zalloc((size_t)capacity*sizeof(uint32_t));
+    ss->index = (uint32_t*)_aligned_zalloc((size_t)index_size*sizeof(uint32_t));
+
+    if(ss->entries == NULL||ss->heap == NULL||ss->index == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for a Space-Saving sketch of %u counters",capacity);
+        gbw_sketch_ss_destroy(ss);
+        return NULL;
+    }
+
+    return ss;
+}
+
+void gbw_sketch_ss_destroy(gbw_sketch_ss_t *ss){
+
+    free(ss->entries);
+    free(ss->heap);
+    free(ss->index);
+
+    ss->entries = NULL;
+    ss->heap = NULL;
+    ss->index = NULL;
+}
+
+void gbw_sketch_ss_clear(gbw_sketch_ss_t *ss){
+
+    memset(ss->index,0,((size_t)ss->index_mask+1)*sizeof(uint32_t));
+    ss->n = 0;
+    ss->total = 0;
+}
+
+static inline uint32_t * _index_find(gbw_sketch_ss_t *ss,const gbw_sketch_key_t *key,uint32_t hash){
+
+    uint32_t i = hash&ss->index_mask;
+    uint32_t id;
+
+    while((id = ss->index[i])!=0){
+
+        if(ss->entries[id-1].hash == hash&&gbw_sketch_key_equal(&ss->entries[id-1].key,key))
+            return &ss->index[i];
+
+        i = (i+1)&ss->index_mask;
+    }
+
+    /*the free slot it would go in*/
+    return &ss->index[i];
+}
+
+/*Backward shift,no tombstones to slow lookups down*/
+static void _index_del(gbw_sketch_ss_t *ss,uint32_t *slot){
+
+    uint32_t i = (uint32_t)(slot-ss->index);
+    uint32_t j = i,home;
+
+    for(;;){
+
+        ss->index[i] = 0;
+
+        for(;;){
+
+            j = (j+1)&ss->index_mask;
+            if(ss->index[j] == 0)
+                return;
+
+            /*stays unless its home is cyclically outside (i,j]*/
+            home = ss->entries[ss->index[j]-1].hash&ss->index_mask;
+            if(((j-home)&ss->index_mask)>=((j-i)&ss->index_mask))
+                break;
+        }
+
+        ss->index[i] = ss->index[j];
+        i = j;
+    }
+}
+
+static inline void _heap_set(gbw_sketch_ss_t *ss,uint32_t pos,uint32_t id){
+
+    ss->heap[pos] = id;
+    ss->entries[id].heap_pos = pos;
+}
+
+/*Counts only grow,an entry only ever moves down*/
+static void _heap_down(gbw_sketch_ss_t *ss,uint32_t pos){
+
+    uint32_t id = ss->heap[pos];
+    uint64_t count = ss->entries[id].count;
+    uint32_t child;
+
+    for(;;){
+
+        child = 2*pos+1;
+        if(child>=ss->n)
+            break;
+
+        if(child+1<ss->n&&ss->entries[ss->heap[child+1]].count<ss->entries[ss->heap[child]].count)
+            child++;
+
+        if(ss->entries[ss->heap[child]].count>=count)
+            break;
+
+        _heap_set(ss,pos,ss->heap[child]);
+        pos = child;
+    }
+
+    _heap_set(ss,pos,id);
+}
+
+static void _heap_up(gbw_sketch_ss_t *ss,uint32_t pos){
+
+    uint32_t id = ss->heap[pos];
+    uint64_t count = ss->entries[id].count;
+    uint32_t parent;
+
+    while(pos>0){
+
+        parent = (pos-1)/2;
+        if(ss->entries[ss->heap[parent]].count<=count)
+            break;
+
+        _heap_set(ss,pos,ss->heap[parent]);
+        pos = parent;
+    }
+
+    _heap_set(ss,pos,id);
+}
+
+static void _ss_add(gbw_sketch_ss_t *ss,const gbw_sketch_key_t *key,uint32_t hash,uint64_t w,uint64_t err){
+
+    uint32_t *slot = _index_find(ss,key,hash);
+    gbw_sketch_ss_entry_t *e;
+    uint32_t id;
+
+    ss->total += w;
+
+    if(*slot){
+
+        e = &ss->entries[*slot-1];
+        e->count += w;
+        e->err += err;
+        _heap_down(ss,e->heap_pos);
+        return;
+    }
+
+    if(ss->n<ss->capacity){
+
+        id = ss->n++;
+        e = &ss->entries[id];
+        e->key = *key;
+        e->hash = hash;
+        e->count = w;
+        e->err = err;
+        *slot = id+1;
+
+        _heap_set(ss,ss->n-1,id);
+        _heap_up(ss,ss->n-1);
+        return;
+    }
+
+    /*the new key takes the least count over,that is its error*/
+    id = ss->heap[0];
+    e = &ss->entries[id];
+
+    _index_del(ss,_index_find(ss,&e->key,e->hash));
+
+    e->key = *key;
+    e->hash = hash;
+    e->err = e->count+err;
+    e->count += w;
+
+    /*the deletion may have moved the slot*/
+    *_index_find(ss,key,hash) = id+1;
+
+    _heap_down(ss,0);
+}
+
+void gbw_sketch_ss_update(gbw_sketch_ss_t *ss,const gbw_sketch_key_t *key,uint64_t hash,uint64_t w){
+
+    _ss_add(ss,key,(uint32_t)hash,w,0);
+}
+
+/*What a key not monitored may have counted at most,0 while nothing was evicted*/
+static inline uint64_t _ss_floor(const gbw_sketch_ss_t *ss){
+
+    return ss->n == ss->capacity?ss->entries[ss->heap[0]].count:0;
+}
+
+/*
+ * Mergeable Space-Saving: a key missing on one side may have counted up
+ * to that side's floor there,so it is added to both its count and error.
+ * The union is then cut back to the capacity largest counts.
+ */
+void gbw_sketch_ss_merge(gbw_sketch_ss_t *dst,const gbw_sketch_ss_t *src){
+
+    /*src is only looked up*/
+    gbw_sketch_ss_t *s = (gbw_sketch_ss_t*)src;
+    const gbw_sketch_ss_entry_t *se;
+    gbw_sketch_ss_entry_t *e;
+    uint64_t src_floor = _ss_floor(src);
+    uint64_t dst_floor = _ss_floor(dst);
+    uint64_t count;
+    uint32_t i,id,*slot;
+
+    if(src_floor){
+
+        for(i = 0;i<dst->n;i++){
+
+            e = &dst->entries[i];
+            if(*_index_find(s,&e->key,e->hash))
+                continue;
+
+            e->count += src_floor;
+            e->err += src_floor;
+        }
+
+        /*counts grew by different amounts,heapify again*/
+        for(i = dst->n/2;i>0;i--)
+            _heap_down(dst,i-1);
+    }
+
+    /*keys on both sides first,so none is evicted before it is added up*/
+    for(i = 0;i<src->n;i++){
+
+        se = &src->entries[i];
+        slot = _index_find(dst,&se->key,se->hash);
+        if(*slot == 0)
+            continue;
+
+        e = &dst->entries[*slot-1];
+        e->count += se->count;
+        e->err += se->err;
+        _heap_down(dst,e->heap_pos);
+    }
+
+    for(i = 0;i<src->n;i++){
+
+        se = &src->entries[i];
+        slot = _index_find(dst,&se->key,se->hash);
+
+        /*added up above,one evicted since has no more than the min*/
+        if(*slot)
+            continue;
+
+        count = se->count+dst_floor;
+
+        if(dst->n<dst->capacity){
+
+            id = dst->n++;
+            e = &dst->entries[id];
+            e->key = se->key;
+            e->hash = se->hash;
+            e->count = count;
+            e->err = se->err+dst_floor;
+            *slot = id+1;
+
+            _heap_set(dst,dst->n-1,id);
+            _heap_up(dst,dst->n-1);
+            continue;
+        }
+
+        /*out of the capacity largest counts*/
+        id = dst->heap[0];
+        e = &dst->entries[id];
+        if(count<=e->count)
+            continue;
+
+        _index_del(dst,_index_find(dst,&e->key,e->hash));
+
+        e->key = se->key;
+        e->hash = se->hash;
+        e->count = count;
+        e->err = se->err+dst_floor;
+
+        *_index_find(dst,&e->key,e->hash) = id+1;
+
+        _heap_down(dst,0);
+    }
+
+    dst->total += src->total;
+}
+
+uint32_t gbw_sketch_ss_top(const gbw_sketch_ss_t *ss,gbw_sketch_ss_entry_t *out,uint32_t max){
+
+    uint32_t i,j,n = 0;
+    const gbw_sketch_ss_entry_t *e;
+
+    if(max == 0)
+        return 0;
+
+    /*insertion into out,max is small next to the capacity*/
+    for(i = 0;i<ss->n;i++){
+
+        e = &ss->entries[i];
+
+        if(n == max&&e->count<=out[n-1].count)
+            continue;
+
+        j = n<max?n++:n-1;
+        for(;j>0&&out[j-1].count<e->count;j--)
+            out[j] = out[j-1];
+
+        out[j] = *e;
+    }
+
+    return n;
+}
@@ -0,0 +1,175 @@
+/*
+ *
+ *      Filename: gbw_sketch.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: Count-Min and Space-Saving sketches,fixed memory counts
+ *                of as many distinct keys as there are
+ *
+ */
+
+#ifndef GBW_SKETCH_H
+#define GBW_SKETCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gbw_mpool.h"
+
+#define GBW_SKETCH_MAX_DEPTH 8
+
+typedef struct gbw_sketch_key_t gbw_sketch_key_t;
+typedef struct gbw_sketch_cms_t gbw_sketch_cms_t;
+typedef struct gbw_sketch_ss_entry_t gbw_sketch_ss_entry_t;
+typedef struct gbw_sketch_ss_t gbw_sketch_ss_t;
+
+/*16 bytes,an IPv6 address say,shorter keys leave the rest zero*/
+struct gbw_sketch_key_t {
+
+    uint64_t w[2];
+};
+
+/*
+ * depth rows of width counters,a key adds to one counter of each row
+ * and is estimated by the least of them: never under the true count,
+ * over it by at most total*e/width with probability 1-e^-depth.
+ */
+struct gbw_sketch_cms_t {
+
+    uint32_t depth;
+    uint32_t width;
+    uint32_t mask;
+
+    uint64_t total;
+
+    /*depth rows one after another,cache line aligned*/
+    uint64_t *counters;
+};
+
+/*
+ * A monitored key. count is never under its true count,count-err never
+ * over it.
+ */
+struct gbw_sketch_ss_entry_t {
+
+    gbw_sketch_key_t key;
+    uint64_t count;
+    uint64_t err;
+
+    uint32_t hash;
+    uint32_t heap_pos;
+};
+
+/*
+ * Space-Saving: capacity keys are monitored,a new key takes over the
+ * smallest count when all are taken. Any key counting more than
+ * total/capacity is among them.
+ */
+struct gbw_sketch_ss_t {
+
+    uint32_t capacity;
+    uint32_t n;
+
+    uint64_t total;
+
+    gbw_sketch_ss_entry_t *entries;
+
+    /*entry ids as a min heap on count*/
+    uint32_t *heap;
+
+    /*open addressing on the key hash,entry id+1,0 for a free slot*/
+    uint32_t *index;
+    uint32_t index_mask;
+};
+
+static inline void gbw_sketch_key_set(gbw_sketch_key_t *key,const void *data,size_t len){
+
+    key->w[0] = key->w[1] = 0;
+    memcpy(key->w,data,len>sizeof(key->w)?sizeof(key->w):len);
+}
+
+static inline int gbw_sketch_key_equal(const gbw_sketch_key_t *a,const gbw_sketch_key_t *b){
+
+    return a->w[0] == b->w[0]&&a->w[1] == b->w[1];
+}
+
+/*Finalizer of MurmurHash3,every input bit flips half the output ones*/
+static inline uint64_t gbw_sketch_mix64(uint64_t h){
+
+    h ^= h>>33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h>>33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h>>33;
+
+    return h;
+}
+
+/*One hash serves both sketches,the Count-Min rows derive theirs from it*/
+static inline uint64_t gbw_sketch_key_hash(const gbw_sketch_key_t *key){
+
+    return gbw_sketch_mix64(key->w[0]^gbw_sketch_mix64(key->w[1]^0x9e3779b97f4a7c15ULL));
+}
+
+/*width is rounded up to a power of 2,depth is 1-GBW_SKETCH_MAX_DEPTH*/
+extern gbw_sketch_cms_t * gbw_sketch_cms_create(gbw_pool_t *mp,uint32_t depth,uint32_t width);
+
+extern void gbw_sketch_cms_destroy(gbw_sketch_cms_t *cms);
+
+/*row i takes the counter at h1+i*h2,both halves of the key hash*/
+static inline void gbw_sketch_cms_update(gbw_sketch_cms_t *cms,uint64_t hash,uint64_t w){
+
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash>>32)|1;
+    uint64_t *row = cms->counters;
+    uint32_t i;
+
+    for(i = 0;i<cms->depth;i++,row += cms->width)
+        row[(h1+i*h2)&cms->mask] += w;
+
+    cms->total += w;
+}
+
+static inline uint64_t gbw_sketch_cms_estimate(const gbw_sketch_cms_t *cms,uint64_t hash){
+
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash>>32)|1;
+    const uint64_t *row = cms->counters;
+    uint64_t v,est = UINT64_MAX;
+    uint32_t i;
+
+    for(i = 0;i<cms->depth;i++,row += cms->width){
+        v = row[(h1+i*h2)&cms->mask];
+        if(v<est)
+            est = v;
+    }
+
+    return est;
+}
+
+/*Adds src into dst,both of the same depth and width,or fails*/
+extern int gbw_sketch_cms_merge(gbw_sketch_cms_t *dst,const gbw_sketch_cms_t *src);
+
+extern void gbw_sketch_cms_clear(gbw_sketch_cms_t *cms);
+
+extern gbw_sketch_ss_t * gbw_sketch_ss_create(gbw_pool_t *mp,uint32_t capacity);
+
+extern void gbw_sketch_ss_destroy(gbw_sketch_ss_t *ss);
+
+/*hash is gbw_sketch_key_hash(key)*/
+extern void gbw_sketch_ss_update(gbw_sketch_ss_t *ss,const gbw_sketch_key_t *key,uint64_t hash,uint64_t w);
+
+/*
+ * Adds src to dst,a key one side lacks counting that side's least count
+ * in both count and error,and keeps the capacity largest,so the bounds
+ * still hold for the union of the streams.
+ */
+extern void gbw_sketch_ss_merge(gbw_sketch_ss_t *dst,const gbw_sketch_ss_t *src);
+
+extern void gbw_sketch_ss_clear(gbw_sketch_ss_t *ss);
+
+/*Copies the max largest counts to out,largest first,returns how many*/
+extern uint32_t gbw_sketch_ss_top(const gbw_sketch_ss_t *ss,gbw_sketch_ss_entry_t *out,uint32_t max);
+
+#endif /*GBW_SKETCH_H*/
@@ -0,0 +1,228 @@
+/*
+ *
+ *      Filename: gbw_timer_wheel.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: hierarchical timer wheel on intrusive gbw_list lists,
+ *                for flow aging and session timeouts
+ *
+ */
+
+#include "gbw_timer_wheel.h"
+#include "gbw_log.h"
+
+#define TW_L0_MASK (GBW_TW_L0_SIZE-1)
+#define TW_LN_MASK (GBW_TW_LN_SIZE-1)
+
+#define TW_LEVEL_SHIFT(l) (GBW_TW_L0_BITS+(l)*GBW_TW_LN_BITS)
+
+/*furthest tick the wheel holds,later timers wait in the last slot*/
+#define TW_MAX_DELTA (((uint64_t)1<<TW_LEVEL_SHIFT(GBW_TW_LEVELS-1))-1)
+
+gbw_timer_wheel_t * gbw_timer_wheel_create(gbw_pool_t *mp,uint64_t tick_unit,
+        void (*expire)(gbw_timer_t *timer,void *priv),void *priv){
+
+    gbw_timer_wheel_t *tw;
+    int i,l;
+
+    if(tick_unit == 0||expire == NULL){
+        gbw_log(GBW_LOG_ERR,"A timer wheel needs a tick unit and an expire callback");
+        return NULL;
+    }
+
+    tw = (gbw_timer_wheel_t*)gbw_pcalloc(mp,sizeof(*tw));
+
+    tw->tick_unit = tick_unit;
+    tw->expire = expire;
+    tw->priv = priv;
+
+    INIT_LIST_HEAD(&tw->expired);
+
+    for(i = 0;i<GBW_TW_L0_SIZE;i++)
+        INIT_LIST_HEAD(&tw->level0[i]);
+
+    for(l = 0;l<GBW_TW_LEVELS-1;l++){
+        for(i = 0;i<GBW_TW_LN_SIZE;i++)
+            INIT_LIST_HEAD(&tw->levels[l][i]);
+    }
+
+    return tw;
+}
+
+/*
+ * Slot of a timer relative to the next tick to run: level 0 holds the
+ * next 256 ticks one per slot,each upper level 64 times coarser slots.
+ */
+static inline void _timer_place(gbw_timer_wheel_t *tw,gbw_timer_t *timer){
+
+    uint64_t expires = timer->expires;
+    uint64_t delta;
+    struct list_head *head = NULL;
+    int l;
+
+    if(expires<tw->tick)
+        expires = tw->tick;
+
+    delta = expires-tw->tick;
+
+    if(delta<GBW_TW_L0_SIZE){
+
+        head = &tw->level0[expires&TW_L0_MASK];
+    }else{
+
+        if(delta>TW_MAX_DELTA)
+            expires = tw->tick+TW_MAX_DELTA;
+
+        for(l = 0;l<GBW_TW_LEVELS-1;l++){
+
+            if(l == GBW_TW_LEVELS-2||delta<((uint64_t)1<<TW_LEVEL_SHIFT(l+1))){
+                head = &tw->levels[l][(expires>>TW_LEVEL_SHIFT(l))&TW_LN_MASK];
+                break;
+            }
+        }
+    }
+
+    list_add_tail(&timer->node,head);
+}
+
+/*
+ * Level 0 wrapped,moves the upper level slots that are now within reach
+ * one level down,a level is only looked at when the one below wrapped.
+ */
+static void _cascade(gbw_timer_wheel_t *tw){
+
+    struct list_head tmp;
+    gbw_timer_t *timer,*n;
+    uint64_t idx;
+    int l;
+
+    for(l = 0;l<GBW_TW_LEVELS-1;l++){
+
+        idx = (tw->tick>>TW_LEVEL_SHIFT(l))&TW_LN_MASK;
+
+        INIT_LIST_HEAD(&tmp);
+        list_splice_init(&tw->levels[l][idx],&tmp);
+
+        list_for_each_entry_safe(timer,n,&tmp,node){
+
+            list_del(&timer->node);
+            _timer_place(tw,timer);
+            tw->n_cascaded++;
+        }
+
+        if(idx)
+            break;
+    }
+}
+
+void gbw_timer_wheel_add(gbw_timer_wheel_t *tw,gbw_timer_t *timer,uint64_t when){
+
+    /*never early,a timer fires on the first tick at or after when*/
+    uint64_t expires = (when+tw->tick_unit-1)/tw->tick_unit;
+
+    /*not started by the caller,the best guess of now is when*/
+    gbw_timer_wheel_start(tw,when);
+
+    if(gbw_timer_pending(timer))
+        list_del(&timer->node);
+    else
+        tw->n_timers++;
+
+    timer->expires = expires;
+    _timer_place(tw,timer);
+}
+
+static inline uint32_t _run_expired(gbw_timer_wheel_t *tw,uint32_t budget,uint32_t n){
+
+    gbw_timer_t *timer;
+
+    while(!list_empty(&tw->expired)){
+
+        if(budget&&n>=budget)
+            break;
+
+        timer = list_first_entry(&tw->expired,gbw_timer_t,node);
+        list_del_init(&timer->node);
+
+        tw->n_timers--;
+        tw->n_expired++;
+        n++;
+
+        tw->expire(timer,tw->priv);
+    }
+
+    return n;
+}
+
+uint32_t gbw_timer_wheel_advance(gbw_timer_wheel_t *tw,uint64_t now,uint32_t budget){
+
+    uint64_t target = now/tw->tick_unit;
+    uint32_t n = 0;
+    uint64_t idx;
+
+    gbw_timer_wheel_start(tw,now);
+
+    for(;;){
+
+        n = _run_expired(tw,budget,n);
+        if(!list_empty(&tw->expired))
+            break;
+
+        if(tw->tick>target)
+            break;
+
+        /*nothing armed,jump straight to now*/
+        if(tw->n_timers == 0){
+            tw->tick = target+1;
+            break;
+        }
+
+        idx = tw->tick&TW_L0_MASK;
+        if(idx == 0)
+            _cascade(tw);
+
+        list_splice_tail_init(&tw->level0[idx],&tw->expired);
+        tw->tick++;
+    }
+
+    return n;
+}
+
+void gbw_timer_wheel_flush(gbw_timer_wheel_t *tw){
+
+    struct list_head all;
+    gbw_timer_t *timer;
+    int i,l;
+
+    INIT_LIST_HEAD(&all);
+
+    list_splice_tail_init(&tw->expired,&all);
+
+    for(i = 0;i<GBW_TW_L0_SIZE;i++)
+        list_splice_tail_init(&tw->level0[i],&all);
+
+    for(l = 0;l<GBW_TW_LEVELS-1;l++){
+        for(i = 0;i<GBW_TW_LN_SIZE;i++)
+            list_splice_tail_init(&tw->levels[l][i],&all);
+    }
+
+    /*timers re-armed by expire go back on the wheel and stay there*/
+    while(!list_empty(&all)){
+
+        timer = list_first_entry(&all,gbw_timer_t,node);
+        list_del_init(&timer->node);
+
+        tw->n_timers--;
+        tw->n_expired++;
+
+        tw->expire(timer,tw->priv);
+    }
+}
+
+void gbw_timer_wheel_dump(gbw_timer_wheel_t *tw,FILE *fp){
+
+    fprintf(fp,"Dump timer wheel info-------------------------------------------\n");
+    fprintf(fp,"The tick unit:%lu,current tick:%lu\n",(unsigned long)tw->tick_unit,(unsigned long)tw->tick);
+    fprintf(fp,"The timers pending:%lu,expired:%lu,cascaded:%lu\n",(unsigned long)tw->n_timers,
+            (unsigned long)tw->n_expired,(unsigned long)tw->n_cascaded);
+}
@@ -0,0 +1,124 @@
+/*
+ *
+ *      Filename: gbw_timer_wheel.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: hierarchical timer wheel on intrusive gbw_list lists,
+ *                for flow aging and session timeouts
+ *
+ */
+
+#ifndef GBW_TIMER_WHEEL_H
+#define GBW_TIMER_WHEEL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_mpool.h"
+#include "gbw_list.h"
+
+/*256 slots in level 0,64 in each of the upper levels*/
+#define GBW_TW_LEVELS 4
+#define GBW_TW_L0_BITS 8
+#define GBW_TW_LN_BITS 6
+#define GBW_TW_L0_SIZE (1<<GBW_TW_L0_BITS)
+#define GBW_TW_LN_SIZE (1<<GBW_TW_LN_BITS)
+
+typedef struct gbw_timer_t gbw_timer_t;
+typedef struct gbw_timer_wheel_t gbw_timer_wheel_t;
+
+/*Embedded in the object it times,found back with container_of*/
+struct gbw_timer_t {
+
+    struct list_head node;
+
+    /*tick the timer fires on*/
+    uint64_t expires;
+};
+
+struct gbw_timer_wheel_t {
+
+    /*time units per tick,time itself is whatever the caller counts in*/
+    uint64_t tick_unit;
+
+    /*next tick to run,valid once started*/
+    uint64_t tick;
+    int started;
+
+    void (*expire)(gbw_timer_t *timer,void *priv);
+    void *priv;
+
+    /*timers due but not run yet,because the last advance ran out of budget*/
+    struct list_head expired;
+
+    struct list_head level0[GBW_TW_L0_SIZE];
+    struct list_head levels[GBW_TW_LEVELS-1][GBW_TW_LN_SIZE];
+
+    uint64_t n_timers;
+    uint64_t n_expired;
+    uint64_t n_cascaded;
+};
+
+static inline void gbw_timer_init(gbw_timer_t *timer){
+
+    INIT_LIST_HEAD(&timer->node);
+    timer->expires = 0;
+}
+
+static inline int gbw_timer_pending(const gbw_timer_t *timer){
+
+    return !list_empty(&timer->node);
+}
+
+/*
+ * expire runs from gbw_timer_wheel_advance for every timer due,with the
+ * timer already off the wheel,it may re-arm it or free the object.
+ * The wheel starts at the time given to gbw_timer_wheel_start or to the
+ * first advance,so a wheel on packet time can be created before the
+ * first packet is seen.
+ */
+extern gbw_timer_wheel_t * gbw_timer_wheel_create(gbw_pool_t *mp,uint64_t tick_unit,
+        void (*expire)(gbw_timer_t *timer,void *priv),void *priv);
+
+/*
+ * Starts the wheel at time now,once,later calls do nothing. Timers added
+ * before are due from their own time on,so start it at the current time
+ * before the first add: a timer later added for an earlier time than one
+ * already armed is then still on time.
+ */
+static inline void gbw_timer_wheel_start(gbw_timer_wheel_t *tw,uint64_t now){
+
+    if(!tw->started){
+        tw->tick = now/tw->tick_unit;
+        tw->started = 1;
+    }
+}
+
+/*
+ * Arms the timer to fire at time when,or re-arms it if already pending,
+ * in O(1). A time in the past fires on the next advance.
+ */
+extern void gbw_timer_wheel_add(gbw_timer_wheel_t *tw,gbw_timer_t *timer,uint64_t when);
+
+static inline void gbw_timer_wheel_del(gbw_timer_wheel_t *tw,gbw_timer_t *timer){
+
+    if(gbw_timer_pending(timer)){
+
+        list_del_init(&timer->node);
+        tw->n_timers--;
+    }
+}
+
+/*
+ * Runs the ticks up to time now and the timers they hold,but no more
+ * than budget timers per call,0 for no limit,the rest are left for the
+ * next call. Returns the number of timers run.
+ */
+extern uint32_t gbw_timer_wheel_advance(gbw_timer_wheel_t *tw,uint64_t now,uint32_t budget);
+
+/*Runs every pending timer whatever its time,for shutdown*/
+extern void gbw_timer_wheel_flush(gbw_timer_wheel_t *tw);
+
+extern void gbw_timer_wheel_dump(gbw_timer_wheel_t *tw,FILE *fp);
+
+#endif /*GBW_TIMER_WHEEL_H*/
@@ -0,0 +1,636 @@
+/*
+ *
+ *      Filename: gbw_tls_parser.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: TLS hello parser,one per stream direction,finds the
+ *                ClientHello or ServerHello across records and chunks
+ *                and fingerprints it with JA3 and JA4
+ *
+ */
+
+#include <string.h>
+
+#include "gbw_tls_parser.h"
+#include "gbw_digest.h"
+
+#define _rd16(p) ((uint16_t)(((p)[0]<<8)|(p)[1]))
+#define _rd24(p) (((uint32_t)(p)[0]<<16)|((uint32_t)(p)[1]<<8)|(p)[2])
+
+#define TLS_RECORD_HANDSHAKE 22
+#define TLS_RECORD_HEADER_LEN 5
+#define TLS_MSG_HEADER_LEN 4
+
+/*a record holds at most 2^14 bytes,plus what compression or a cipher adds*/
+#define TLS_MAX_RECORD (16384+2048)
+
+static const char _hex[] = "0123456789abcdef";
+
+/*JA3 takes decimal values,fed to MD5 one by one*/
+static inline void _md5_dec(gbw_md5_t *md5,uint16_t v,int sep){
+
+    char b[6];
+    int n = 0,i = 6;
+
+    if(sep)
+        gbw_md5_update(md5,"-",1);
+
+    do{
+        b[--i] = (char)('0'+v%10);
+        v /= 10;
+        n++;
+    }while(v);
+
+    gbw_md5_update(md5,b+i,n);
+}
+
+/*JA4 takes 4 digit hex values,comma separated*/
+static void _sha256_hex_list(gbw_sha256_t *sha,const uint16_t *v,uint16_t n){
+
+    char b[5];
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        b[0] = ',';
+        b[1] = _hex[v[i]>>12];
+        b[2] = _hex[(v[i]>>8)&15];
+        b[3] = _hex[(v[i]>>4)&15];
+        b[4] = _hex[v[i]&15];
+
+        gbw_sha256_update(sha,i?b:b+1,i?5:4);
+    }
+}
+
+static void _sha256_trunc(gbw_sha256_t *sha,char *out){
+
+    uint8_t d[GBW_SHA256_LEN];
+
+    gbw_sha256_final(sha,d);
+    gbw_digest_hex(out,d,6);
+}
+
+static void _sort16(uint16_t *v,uint16_t n){
+
+    uint16_t i,j,x;
+
+    for(i = 1;i<n;i++){
+
+        x = v[i];
+        for(j = i;j>0&&v[j-1]>x;j--)
+            v[j] = v[j-1];
+        v[j] = x;
+    }
+}
+
+static const char * _ja4_version(uint16_t v){
+
+    switch(v){
+    case 0x0304: return "13";
+    case 0x0303: return "12";
+    case 0x0302: return "11";
+    case 0x0301: return "10";
+    case 0x0300: return "s3";
+    case 0x0002: return "s2";
+    case 0xfeff: return "d1";
+    case 0xfefd: return "d2";
+    case 0xfefc: return "d3";
+    default: return "00";
+    }
+}
+
+static inline int _is_alnum(char c){
+
+    return (c>='0'&&c<='9')||(c>='a'&&c<='z')||(c>='A'&&c<='Z');
+}
+
+/*first and last chars of the first ALPN,of its hex form if they aren't alphanumeric*/
+static void _ja4_alpn(const gbw_tls_hello_t *h,char *out){
+
+    char f,l;
+
+    if(h->alpn_len == 0){
+        out[0] = out[1] = '0';
+        return;
+    }
+
+    f = h->alpn[0];
+    l = h->alpn[h->alpn_len-1];
+
+    if(_is_alnum(f)&&_is_alnum(l)){
+        out[0] = f;
+        out[1] = l;
+    }else{
+        out[0] = _hex[(uint8_t)f>>4];
+        out[1] = _hex[(uint8_t)l&15];
+    }
+}
+
+static inline void _ja4_count(char *out,uint32_t n){
+
+    if(n>99)
+        n = 99;
+
+    out[0] = (char)('0'+n/10);
+    out[1] = (char)('0'+n%10);
+}
+
+static void _ja4_client(gbw_tls_hello_t *h,uint32_t n_ciphers,uint32_t n_exts){
+
+    uint16_t v[GBW_TLS_MAX_EXTS>GBW_TLS_MAX_CIPHERS?GBW_TLS_MAX_EXTS:GBW_TLS_MAX_CIPHERS];
+    gbw_sha256_t sha;
+    char *o = h->ja4;
+    uint16_t i,n;
+
+    o[0] = 't';
+    memcpy(o+1,_ja4_version(h->version),2);
+    o[3] = h->has_sni?'d':'i';
+    _ja4_count(o+4,n_ciphers);
+    _ja4_count(o+6,n_exts);
+    _ja4_alpn(h,o+8);
+    o[10] = '_';
+
+    if(h->n_ciphers){
+
+        memcpy(v,h->ciphers,h->n_ciphers*sizeof(uint16_t));
+        _sort16(v,h->n_ciphers);
+
+        gbw_sha256_init(&sha);
+        _sha256_hex_list(&sha,v,h->n_ciphers);
+        _sha256_trunc(&sha,o+11);
+    }else{
+        memset(o+11,'0',12);
+    }
+
+    o[23] = '_';
+
+    /*SNI and ALPN are in the first part already*/
+    for(i = 0,n = 0;i<h->n_exts;i++){
+
+        if(h->exts[i]!=GBW_TLS_EXT_SNI&&h->exts[i]!=GBW_TLS_EXT_ALPN)
+            v[n++] = h->exts[i];
+    }
+
+    if(n||h->n_sig_algs){
+
+        _sort16(v,n);
+
+        gbw_sha256_init(&sha);
+        _sha256_hex_list(&sha,v,n);
+
+        if(h->n_sig_algs){
+            gbw_sha256_update(&sha,"_",1);
+            _sha256_hex_list(&sha,h->sig_algs,h->n_sig_algs);
+        }
+
+        _sha256_trunc(&sha,o+24);
+    }else{
+        memset(o+24,'0',12);
+    }
+
+    o[36] = 0;
+}
+
+static void _ja4_server(gbw_tls_hello_t *h,uint32_t n_exts){
+
+    gbw_sha256_t sha;
+    char *o = h->ja4;
+    uint16_t c = h->ciphers[0];
+
+    o[0] = 't';
+    memcpy(o+1,_ja4_version(h->version),2);
+    _ja4_count(o+3,n_exts);
+    _ja4_alpn(h,o+5);
+    o[7] = '_';
+    o[8] = _hex[c>>12];
+    o[9] = _hex[(c>>8)&15];
+    o[10] = _hex[(c>>4)&15];
+    o[11] = _hex[c&15];
+    o[12] = '_';
+
+    if(h->n_exts){
+
+        gbw_sha256_init(&sha);
+        _sha256_hex_list(&sha,h->exts,h->n_exts);
+        _sha256_trunc(&sha,o+13);
+    }else{
+        memset(o+13,'0',12);
+    }
+
+    o[25] = 0;
+}
+
+/*u16 list of an extension,2 bytes of length first,GREASE dropped*/
+static void _ext_list16(const uint8_t *d,uint32_t len,uint16_t *out,uint16_t *n,uint16_t max,uint8_t *truncated){
+
+    uint32_t l,i;
+    uint16_t v;
+
+    if(len<2)
+        return;
+
+    l = _rd16(d);
+    if(l+2>len)
+        l = len-2;
+
+    for(i = 2;i+1<l+2;i += 2){
+
+        v = _rd16(d+i);
+        if(GBW_TLS_IS_GREASE(v))
+            continue;
+
+        if(*n<max)
+            out[(*n)++] = v;
+        else
+            *truncated = 1;
+    }
+}
+
+static void _ext_sni(gbw_tls_hello_t *h,const uint8_t *d,uint32_t len){
+
+    uint32_t l;
+
+    h->has_sni = 1;
+
+    /*list length,name type,name length*/
+    if(len<5||d[2]!=0)
+        return;
+
+    l = _rd16(d+3);
+    if(l+5>len)
+        return;
+    if(l>255)
+        l = 255;
+
+    memcpy(h->sni,d+5,l);
+    h->sni[l] = 0;
+    h->sni_len = (uint8_t)l;
+}
+
+static void _ext_alpn(gbw_tls_hello_t *h,const uint8_t *d,uint32_t len){
+
+    uint32_t l,i;
+
+    if(len<2)
+        return;
+
+    l = _rd16(d);
+    if(l+2>len)
+        return;
+
+    for(i = 2;i<l+2&&i+1+d[i]<=l+2;i += 1+d[i]){
+
+        if(h->n_alpn == 0){
+            memcpy(h->alpn,d+i+1,d[i]);
+            h->alpn[d[i]] = 0;
+            h->alpn_len = d[i];
+        }
+
+        if(h->n_alpn<255)
+            h->n_alpn++;
+    }
+}
+
+static void _ext_versions(gbw_tls_hello_t *h,const uint8_t *d,uint32_t len){
+
+    uint32_t l,i;
+    uint16_t v;
+
+    if(h->type == GBW_TLS_SERVER_HELLO){
+
+        if(len>=2)
+            h->version = _rd16(d);
+        return;
+    }
+
+    if(len<1)
+        return;
+
+    l = d[0];
+    if(l+1>len)
+        l = len-1;
+
+    for(i = 1;i+1<l+1;i += 2){
+
+        v = _rd16(d+i);
+        if(!GBW_TLS_IS_GREASE(v)&&v>h->version)
+            h->version = v;
+    }
+}
+
+int gbw_tls_hello_parse(gbw_tls_hello_t *h,const uint8_t *msg,uint32_t len){
+
+    const uint8_t *p,*end,*ext_end,*ed;
+    uint32_t n_ciphers = 0,n_exts = 0,l,i;
+    uint16_t v,el;
+    uint8_t d[GBW_MD5_LEN];
+    gbw_md5_t md5;
+    int client;
+
+    if(len<TLS_MSG_HEADER_LEN)
+        return -1;
+
+    if(msg[0]!=GBW_TLS_CLIENT_HELLO&&msg[0]!=GBW_TLS_SERVER_HELLO)
+        return -1;
+
+    l = _rd24(msg+1);
+    if(l+TLS_MSG_HEADER_LEN>len)
+        return -1;
+
+    p = msg+TLS_MSG_HEADER_LEN;
+    end = p+l;
+
+    client = msg[0] == GBW_TLS_CLIENT_HELLO;
+
+    h->type = msg[0];
+    h->n_ciphers = h->n_exts = h->n_groups = h->n_sig_algs = 0;
+    h->n_point_fmts = 0;
+    h->has_sni = h->sni_len = 0;
+    h->n_alpn = h->alpn_len = 0;
+    h->sni[0] = h->alpn[0] = 0;
+    h->truncated = 0;
+    h->version = 0;
+
+    /*version,random and session id*/
+    if(end-p<35)
+        return -1;
+
+    h->legacy_version = _rd16(p);
+    p += 34;
+
+    l = *p++;
+    if(l>32||(uint32_t)(end-p)<l)
+        return -1;
+    p += l;
+
+    gbw_md5_init(&md5);
+    _md5_dec(&md5,h->legacy_version,0);
+    gbw_md5_update(&md5,",",1);
+
+    if(client){
+
+        if(end-p<2)
+            return -1;
+
+        l = _rd16(p);
+        p += 2;
+        if((l&1)||(uint32_t)(end-p)<l)
+            return -1;
+
+        for(i = 0;i<l;i += 2){
+
+            v = _rd16(p+i);
+            if(GBW_TLS_IS_GREASE(v))
+                continue;
+
+            _md5_dec(&md5,v,n_ciphers++ != 0);
+
+            if(h->n_ciphers<GBW_TLS_MAX_CIPHERS)
+                h->ciphers[h->n_ciphers++] = v;
+            else
+                h->truncated = 1;
+        }
+
+        p += l;
+
+        /*compression methods*/
+        if(end-p<1||(uint32_t)(end-p-1)<p[0])
+            return -1;
+        p += 1+p[0];
+
+    }else{
+
+        if(end-p<3)
+            return -1;
+
+        h->ciphers[0] = _rd16(p);
+        h->n_ciphers = 1;
+        _md5_dec(&md5,h->ciphers[0],0);
+        p += 3;
+    }
+
+    gbw_md5_update(&md5,",",1);
+
+    ext_end = p;
+    if(end-p>=2){
+
+        l = _rd16(p);
+        p += 2;
+        if((uint32_t)(end-p)<l)
+            return -1;
+        ext_end = p+l;
+    }
+
+    while(ext_end-p>=4){
+
+        v = _rd16(p);
+        el = _rd16(p+2);
+        p += 4;
+
+        if(ext_end-p<el)
+            return -1;
+
+        ed = p;
+        p += el;
+
+        if(GBW_TLS_IS_GREASE(v))
+            continue;
+
+        _md5_dec(&md5,v,n_exts++ != 0);
+
+        if(h->n_exts<GBW_TLS_MAX_EXTS)
+            h->exts[h->n_exts++] = v;
+        else
+            h->truncated = 1;
+
+        switch(v){
+
+        case GBW_TLS_EXT_SNI:
+            if(client)
+                _ext_sni(h,ed,el);
+            break;
+
+        case GBW_TLS_EXT_ALPN:
+            _ext_alpn(h,ed,el);
+            break;
+
+        case GBW_TLS_EXT_SUPPORTED_GROUPS:
+            _ext_list16(ed,el,h->groups,&h->n_groups,GBW_TLS_MAX_GROUPS,&h->truncated);
+            break;
+
+        case GBW_TLS_EXT_SIG_ALGS:
+            _ext_list16(ed,el,h->sig_algs,&h->n_sig_algs,GBW_TLS_MAX_SIG_ALGS,&h->truncated);
+            break;
+
+        case GBW_TLS_EXT_EC_POINT_FORMATS:
+            if(el>=1){
+                for(i = 0;i<ed[0]&&i+1<el;i++){
+                    if(h->n_point_fmts<GBW_TLS_MAX_POINT_FMTS)
+                        h->point_fmts[h->n_point_fmts++] = ed[1+i];
+                    else
+                        h->truncated = 1;
+                }
+            }
+            break;
+
+        case GBW_TLS_EXT_SUPPORTED_VERSIONS:
+            _ext_versions(h,ed,el);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    /*JA3 goes on with the curves and point formats,JA3S stops at the extensions*/
+    if(client){
+
+        gbw_md5_update(&md5,",",1);
+        for(i = 0;i<h->n_groups;i++)
+            _md5_dec(&md5,h->groups[i],i != 0);
+
+        gbw_md5_update(&md5,",",1);
+        for(i = 0;i<h->n_point_fmts;i++)
+            _md5_dec(&md5,h->point_fmts[i],i != 0);
+    }
+
+    gbw_md5_final(&md5,d);
+    gbw_digest_hex(h->ja3,d,GBW_MD5_LEN);
+
+    if(h->version == 0)
+        h->version = h->legacy_version;
+
+    if(client)
+        _ja4_client(h,n_ciphers,n_exts);
+    else
+        _ja4_server(h,n_exts);
+
+    return 0;
+}
+
+void gbw_tls_parser_init(gbw_tls_parser_t *p,gbw_pool_t *mp){
+
+    memset(p,0,sizeof(*p));
+
+    p->state = GBW_TLS_MORE;
+    p->mp = mp;
+}
+
+static inline int _finish(gbw_tls_parser_t *p,int rc){
+
+    p->state = rc;
+    return rc;
+}
+
+static int _hello(gbw_tls_parser_t *p,const uint8_t *msg,uint32_t len,gbw_tls_hello_t *hello){
+
+    return _finish(p,gbw_tls_hello_parse(hello,msg,len)?GBW_TLS_FAILED:GBW_TLS_HELLO);
+}
+
+/*
+ * Bytes of a handshake record. The hello is parsed in place when a piece
+ * holds it whole,else it is gathered in msg.
+ */
+static int _handshake(gbw_tls_parser_t *p,const uint8_t *data,uint32_t len,gbw_tls_hello_t *hello){
+
+    uint32_t n;
+
+    if(p->msg_have == 0&&len>=TLS_MSG_HEADER_LEN){
+
+        if(data[0]!=GBW_TLS_CLIENT_HELLO&&data[0]!=GBW_TLS_SERVER_HELLO)
+            return _finish(p,GBW_TLS_FAILED);
+
+        n = _rd24(data+1)+TLS_MSG_HEADER_LEN;
+        if(n<=len)
+            return _hello(p,data,n,hello);
+    }
+
+    while(len){
+
+        if(p->msg_have<TLS_MSG_HEADER_LEN){
+
+            p->msg_hdr[p->msg_have++] = *data++;
+            len--;
+
+            if(p->msg_have<TLS_MSG_HEADER_LEN)
+                continue;
+
+            if(p->msg_hdr[0]!=GBW_TLS_CLIENT_HELLO&&p->msg_hdr[0]!=GBW_TLS_SERVER_HELLO)
+                return _finish(p,GBW_TLS_FAILED);
+
+            p->msg_len = _rd24(p->msg_hdr+1)+TLS_MSG_HEADER_LEN;
+            if(p->msg_len>GBW_TLS_MAX_HELLO)
+                return _finish(p,GBW_TLS_FAILED);
+
+            p->msg = (uint8_t*)gbw_palloc(p->mp,p->msg_len);
+            if(p->msg == NULL)
+                return _finish(p,GBW_TLS_FAILED);
+
+            memcpy(p->msg,p->msg_hdr,TLS_MSG_HEADER_LEN);
+            continue;
+        }
+
+        n = p->msg_len-p->msg_have;
+        if(n>len)
+            n = len;
+
+        memcpy(p->msg+p->msg_have,data,n);
+        p->msg_have += n;
+        data += n;
+        len -= n;
+
+        if(p->msg_have == p->msg_len)
+            return _hello(p,p->msg,p->msg_len,hello);
+    }
+
+    /*a hello with an empty body*/
+    if(p->msg_have == TLS_MSG_HEADER_LEN&&p->msg_len == TLS_MSG_HEADER_LEN)
+        return _hello(p,p->msg,p->msg_len,hello);
+
+    return GBW_TLS_MORE;
+}
+
+int gbw_tls_parser_execute(gbw_tls_parser_t *p,const uint8_t *data,uint32_t len,gbw_tls_hello_t *hello){
+
+    uint32_t n;
+    int rc;
+
+    if(p->state!=GBW_TLS_MORE)
+        return GBW_TLS_MORE;
+
+    while(len){
+
+        if(p->rec_left == 0){
+
+            p->rec_hdr[p->rec_have++] = *data++;
+            len--;
+
+            if(p->rec_have<TLS_RECORD_HEADER_LEN)
+                continue;
+
+            p->rec_have = 0;
+
+            /*anything but a handshake record of TLS 1.x before the hello*/
+            if(p->rec_hdr[0]!=TLS_RECORD_HANDSHAKE||p->rec_hdr[1]!=3)
+                return _finish(p,GBW_TLS_FAILED);
+
+            p->rec_left = _rd16(p->rec_hdr+3);
+            if(p->rec_left == 0||p->rec_left>TLS_MAX_RECORD)
+                return _finish(p,GBW_TLS_FAILED);
+
+            continue;
+        }
+
+        n = p->rec_left<len?p->rec_left:len;
+
+        rc = _handshake(p,data,n,hello);
+        if(rc!=GBW_TLS_MORE)
+            return rc;
+
+        p->rec_left -= n;
+        data += n;
+        len -= n;
+    }
+
+    return GBW_TLS_MORE;
+}
@@ -0,0 +1,135 @@
+/*
+ *
+ *      Filename: gbw_tls_parser.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: TLS hello parser,one per stream direction,finds the
+ *                ClientHello or ServerHello across records and chunks
+ *                and fingerprints it with JA3 and JA4
+ *
+ */
+
+#ifndef GBW_TLS_PARSER_H
+#define GBW_TLS_PARSER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_mpool.h"
+
+#define GBW_TLS_CLIENT_HELLO 1
+#define GBW_TLS_SERVER_HELLO 2
+
+/*largest hello gathered when records or chunks cut it,bigger ones are given up*/
+#define GBW_TLS_MAX_HELLO 16384
+
+/*lists kept of a hello,JA4 counts what doesn't fit but can't hash it*/
+#define GBW_TLS_MAX_CIPHERS    128
+#define GBW_TLS_MAX_EXTS       64
+#define GBW_TLS_MAX_GROUPS     32
+#define GBW_TLS_MAX_SIG_ALGS   32
+#define GBW_TLS_MAX_POINT_FMTS 8
+
+#define GBW_TLS_JA3_LEN 32
+#define GBW_TLS_JA4_LEN 36
+
+#define GBW_TLS_EXT_SNI                 0
+#define GBW_TLS_EXT_SUPPORTED_GROUPS    10
+#define GBW_TLS_EXT_EC_POINT_FORMATS    11
+#define GBW_TLS_EXT_SIG_ALGS            13
+#define GBW_TLS_EXT_ALPN                16
+#define GBW_TLS_EXT_SUPPORTED_VERSIONS  43
+
+/*what gbw_tls_parser_execute makes of a chunk*/
+#define GBW_TLS_MORE   0
+#define GBW_TLS_HELLO  1
+#define GBW_TLS_FAILED -1
+
+/*the reserved values of RFC 8701,left out of every list*/
+#define GBW_TLS_IS_GREASE(v) (((v)&0x0f0f) == 0x0a0a&&((v)>>8) == ((v)&0xff))
+
+typedef struct gbw_tls_hello_t gbw_tls_hello_t;
+typedef struct gbw_tls_parser_t gbw_tls_parser_t;
+
+/*
+ * A parsed hello,GREASE values dropped. For a ServerHello ciphers holds
+ * the chosen suite,alpn the chosen protocol,and ja3/ja4 are JA3S/JA4S.
+ */
+struct gbw_tls_hello_t {
+
+    int type;
+
+    uint16_t legacy_version;
+
+    /*highest offered,or chosen,in supported_versions,else legacy_version*/
+    uint16_t version;
+
+    uint16_t n_ciphers;
+    uint16_t ciphers[GBW_TLS_MAX_CIPHERS];
+
+    /*in the order sent*/
+    uint16_t n_exts;
+    uint16_t exts[GBW_TLS_MAX_EXTS];
+
+    uint16_t n_groups;
+    uint16_t groups[GBW_TLS_MAX_GROUPS];
+
+    uint16_t n_sig_algs;
+    uint16_t sig_algs[GBW_TLS_MAX_SIG_ALGS];
+
+    uint8_t n_point_fmts;
+    uint8_t point_fmts[GBW_TLS_MAX_POINT_FMTS];
+
+    /*first host_name of SNI and first ALPN protocol,NUL terminated*/
+    uint8_t has_sni;
+    uint8_t sni_len;
+    char sni[256];
+
+    uint8_t n_alpn;
+    uint8_t alpn_len;
+    char alpn[256];
+
+    /*a list was longer than its array*/
+    uint8_t truncated;
+
+    char ja3[GBW_TLS_JA3_LEN+1];
+    char ja4[GBW_TLS_JA4_LEN+1];
+};
+
+struct gbw_tls_parser_t {
+
+    int state;
+
+    /*record header being gathered,then the bytes left in the record*/
+    uint8_t rec_hdr[5];
+    uint8_t rec_have;
+    uint32_t rec_left;
+
+    /*handshake message gathered when records or chunks cut it*/
+    gbw_pool_t *mp;
+    uint8_t *msg;
+    uint8_t msg_hdr[4];
+    uint32_t msg_have;
+    uint32_t msg_len;
+};
+
+/*mp holds the buffer of a hello cut in pieces*/
+extern void gbw_tls_parser_init(gbw_tls_parser_t *p,gbw_pool_t *mp);
+
+/*
+ * Parses the next chunk of a stream until its first handshake message,
+ * which has to be a hello. Returns GBW_TLS_HELLO once hello is filled,
+ * GBW_TLS_FAILED if the stream isn't TLS or the hello is malformed,
+ * GBW_TLS_MORE while more bytes are needed and once the parser is done.
+ */
+extern int gbw_tls_parser_execute(gbw_tls_parser_t *p,const uint8_t *data,uint32_t len,gbw_tls_hello_t *hello);
+
+static inline int gbw_tls_parser_done(const gbw_tls_parser_t *p){
+
+    return p->state!=GBW_TLS_MORE;
+}
+
+/*Parses one whole hello handshake message,header included*/
+extern int gbw_tls_hello_parse(gbw_tls_hello_t *hello,const uint8_t *msg,uint32_t len);
+
+#endif /*GBW_TLS_PARSER_H*/
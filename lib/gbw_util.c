@@ -12,6 +12,7 @@
 #include "gbw_errno.h"
 #include "gbw_string.h"
 #include "gbw_time.h"
+#include <sys/mman.h>
 
 /* Base64 tables used in decodeBase64Ext */
 static const char b64_pad = '=';
@@ -2077,3 +2078,40 @@ unsigned char* gbw_encode_base64_malloc(const unsigned char *input,int input_len
 	return dst;
 }
 
+#define HUGEPAGE_ALIGN(size) (((size)+GBW_HUGEPAGE_SIZE-1)&~(GBW_HUGEPAGE_SIZE-1))
+
+void * gbw_hugepage_alloc(size_t size,int *is_huge){
+
+	void *addr;
+
+	size = HUGEPAGE_ALIGN(size);
+
+#ifdef MAP_HUGETLB
+	addr = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+	if(addr!=MAP_FAILED){
+
+		if(is_huge)
+			*is_huge = 1;
+		return addr;
+	}
+#endif
+
+	addr = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if(addr == MAP_FAILED)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	madvise(addr,size,MADV_HUGEPAGE);
+#endif
+
+	if(is_huge)
+		*is_huge = 0;
+
+	return addr;
+}
+
+void gbw_hugepage_free(void *addr,size_t size){
+
+	if(addr)
+		munmap(addr,HUGEPAGE_ALIGN(size));
+}
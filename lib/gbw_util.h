@@ -120,6 +120,17 @@ extern int gbw_read_line(char *buff, int size, FILE *fp);
 
 extern int gbw_dir_make_r(const char *orig_path);
 
+#define GBW_HUGEPAGE_SIZE (2UL*1024*1024)
+
+/*
+ * Anonymous zeroed memory rounded up to GBW_HUGEPAGE_SIZE,from 2M hugepages
+ * when some are reserved,otherwise from plain pages with THP advised.
+ * Pages are not touched,so they land on the NUMA node of the first writer.
+ */
+extern void * gbw_hugepage_alloc(size_t size,int *is_huge);
+
+extern void gbw_hugepage_free(void *addr,size_t size);
+
 static inline int gbw_port_equal(uint16_t src_port,uint16_t dst_port,uint16_t v){
 
     return src_port == v || dst_port == v;
@@ -0,0 +1,370 @@
+/*
+ *
+ *      Filename: gbw_probe_capture.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: packet capture to disk,workers copy the packets selected
+ *                into batches a writer lcore appends to indexed pcap
+ *                segments,one stream of them per worker
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+#include <rte_mbuf_dyn.h>
+
+#include "gbw_probe_capture.h"
+#include "gbw_probe_decode.h"
+#include "gbw_string.h"
+#include "gbw_log.h"
+
+#define CAPTURE_WRITER_BURST 32
+
+/*Writer*/
+
+static void _batch_write(gbw_probe_capture_t *cap,gbw_probe_capture_batch_t *b){
+
+    gbw_pcap_store_t *st = cap->stores[b->worker];
+    uint32_t hdr[4];
+    uint32_t off = 0;
+
+    while(off+GBW_PCAP_STORE_REC_HDR<=b->len){
+
+        memcpy(hdr,b->data+off,sizeof(hdr));
+        off += GBW_PCAP_STORE_REC_HDR;
+
+        if(gbw_pcap_store_add(st,(uint64_t)hdr[0]*1000000+hdr[1],b->data+off,hdr[2],hdr[3]))
+            cap->lost_pkts++;
+
+        off += hdr[2];
+    }
+
+    cap->last_add[b->worker] = rte_get_timer_cycles();
+    cap->batches++;
+}
+
+static unsigned int _writer_drain(gbw_probe_capture_t *cap){
+
+    gbw_probe_capture_batch_t *batches[CAPTURE_WRITER_BURST];
+    unsigned int n,i,total = 0;
+
+    while((n = rte_ring_sc_dequeue_burst(cap->ring,(void**)batches,CAPTURE_WRITER_BURST,NULL))!=0){
+
+        for(i = 0;i<n;i++){
+
+            _batch_write(cap,batches[i]);
+
+            batches[i]->len = 0;
+            __atomic_store_n(&batches[i]->busy,0,__ATOMIC_RELEASE);
+        }
+
+        total += n;
+    }
+
+    return total;
+}
+
+static void _writer_idle(gbw_probe_capture_t *cap){
+
+    uint64_t now = rte_get_timer_cycles();
+    gbw_pcap_store_t *st;
+    unsigned int i;
+
+    if(now<cap->next_idle_check)
+        return;
+
+    cap->next_idle_check = now+rte_get_timer_hz();
+
+    for(i = 0;i<GBW_PROBE_MAX_WORKERS;i++){
+
+        st = cap->stores[i];
+        if(st&&st->fd>=0&&now-cap->last_add[i]>cap->idle_cycles)
+            gbw_pcap_store_close(st);
+    }
+}
+
+static int _writer_loop(void *arg){
+
+    gbw_probe_capture_t *cap = (gbw_probe_capture_t*)arg;
+    gbw_probe_engine_t *engine = cap->engine;
+
+    gbw_log(GBW_LOG_INFO,"capture writer runs to %s",engine->pcfg->capture_dir);
+
+    while(!engine->quit){
+
+        if(_writer_drain(cap) == 0){
+            _writer_idle(cap);
+            rte_pause();
+        }
+    }
+
+    return 0;
+}
+
+/*Batching,worker side*/
+
+static inline int _batch_busy(const gbw_probe_capture_batch_t *b){
+
+    return __atomic_load_n(&b->busy,__ATOMIC_ACQUIRE)!=0;
+}
+
+static void _batch_handoff(gbw_probe_capture_ctx_t *ctx){
+
+    gbw_probe_capture_batch_t *b = &ctx->batches[ctx->cur];
+
+    if(b->len == 0)
+        return;
+
+    b->busy = 1;
+
+    /*can't be full,it has room for every batch*/
+    if(rte_ring_mp_enqueue(ctx->cap->ring,b)){
+        b->len = 0;
+        b->busy = 0;
+        return;
+    }
+
+    ctx->batches_sent++;
+    ctx->cur = (ctx->cur+1)%GBW_PROBE_CAPTURE_BATCHES;
+}
+
+static inline int _selected(const gbw_probe_capture_t *cap,struct rte_mbuf *m){
+
+    gbw_probe_pkt_t *pkt;
+
+    if(cap->ports == NULL)
+        return 1;
+
+    pkt = gbw_probe_pkt(m);
+    if(!(pkt->flags&GBW_PKT_F_L4))
+        return 0;
+
+    return (cap->ports[pkt->sport>>6]>>(pkt->sport&63)&1)||(cap->ports[pkt->dport>>6]>>(pkt->dport&63)&1);
+}
+
+static void _pkt_copy(gbw_probe_capture_ctx_t *ctx,struct rte_mbuf *m,uint64_t ts){
+
+    gbw_probe_capture_batch_t *b = &ctx->batches[ctx->cur];
+    uint32_t len = rte_pktmbuf_pkt_len(m);
+    uint32_t caplen = len>ctx->cap->snaplen?ctx->cap->snaplen:len;
+    uint32_t hdr[4];
+    uint8_t *dst;
+    const void *p;
+
+    if(_batch_busy(b))
+        goto drop;
+
+    if(b->len+GBW_PCAP_STORE_REC_HDR+caplen>ctx->cap->batch_size){
+
+        _batch_handoff(ctx);
+
+        b = &ctx->batches[ctx->cur];
+        if(_batch_busy(b))
+            goto drop;
+    }
+
+    hdr[0] = (uint32_t)(ts/1000000);
+    hdr[1] = (uint32_t)(ts%1000000);
+    hdr[2] = caplen;
+    hdr[3] = len;
+
+    dst = b->data+b->len;
+    memcpy(dst,hdr,sizeof(hdr));
+    dst += GBW_PCAP_STORE_REC_HDR;
+
+    /*chained mbufs are gathered right into the batch*/
+    p = rte_pktmbuf_read(m,0,caplen,dst);
+    if(p!=dst)
+        memcpy(dst,p,caplen);
+
+    b->len += GBW_PCAP_STORE_REC_HDR+caplen;
+
+    ctx->pkts++;
+    ctx->bytes += len;
+
+    return;
+
+drop:
+    ctx->dropped++;
+}
+
+static uint16_t _capture_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_capture_ctx_t *ctx = (gbw_probe_capture_ctx_t*)_ctx;
+    uint64_t now = 0;
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        if(_selected(ctx->cap,pkts[i]))
+            _pkt_copy(ctx,pkts[i],gbw_probe_pkt_time(ctx->ts_offset,ctx->ts_flag,pkts[i],&now));
+    }
+
+    return n;
+}
+
+static void _ctx_free(gbw_probe_capture_ctx_t *ctx){
+
+    unsigned int i;
+
+    for(i = 0;i<GBW_PROBE_CAPTURE_BATCHES;i++)
+        rte_free(ctx->batches[i].data);
+
+    rte_free(ctx);
+}
+
+static void *_capture_init(gbw_probe_worker_t *worker,void *priv){
+
+    gbw_probe_capture_t *cap = (gbw_probe_capture_t*)priv;
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_capture_ctx_t *ctx;
+    unsigned int i;
+
+    ctx = (gbw_probe_capture_ctx_t*)rte_zmalloc_socket("gbw_probe_capture",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the capture stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->cap = cap;
+
+    for(i = 0;i<GBW_PROBE_CAPTURE_BATCHES;i++){
+
+        ctx->batches[i].worker = worker->id;
+        ctx->batches[i].data = (uint8_t*)rte_malloc_socket("gbw_probe_capture_batch",cap->batch_size,
+                RTE_CACHE_LINE_SIZE,worker->socket_id);
+        if(ctx->batches[i].data == NULL){
+            gbw_log(GBW_LOG_ERR,"No memory for the capture batches of worker:%u",worker->id);
+            _ctx_free(ctx);
+            return NULL;
+        }
+    }
+
+    cap->stores[worker->id] = gbw_pcap_store_create(worker->engine->mp,pcfg->capture_dir,
+            gbw_psprintf(worker->engine->mp,"w%u",worker->id),(uint64_t)pcfg->capture_segment_size*1024*1024,
+            pcfg->capture_segment_secs,GBW_PROBE_CAPTURE_BUF_SIZE,cap->snaplen);
+    if(cap->stores[worker->id] == NULL){
+        _ctx_free(ctx);
+        return NULL;
+    }
+
+    if(rte_mbuf_dyn_rx_timestamp_register(&ctx->ts_offset,&ctx->ts_flag))
+        ctx->ts_offset = -1;
+
+    ctx->flush_cycles = rte_get_timer_hz()/1000*GBW_PROBE_CAPTURE_FLUSH_MS;
+    ctx->last_flush = rte_get_timer_cycles();
+
+    cap->nb_workers_left++;
+
+    return ctx;
+}
+
+static void _capture_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles){
+
+    gbw_probe_capture_ctx_t *ctx = (gbw_probe_capture_ctx_t*)_ctx;
+
+    if(cycles-ctx->last_flush<ctx->flush_cycles)
+        return;
+
+    ctx->last_flush = cycles;
+    _batch_handoff(ctx);
+}
+
+/*All lcores are back,the writer too,what is left is written from here*/
+static void _capture_fin(gbw_probe_worker_t *worker,void *_ctx){
+
+    gbw_probe_capture_ctx_t *ctx = (gbw_probe_capture_ctx_t*)_ctx;
+    gbw_probe_capture_t *cap = ctx->cap;
+
+    _writer_drain(cap);
+    _batch_handoff(ctx);
+    _writer_drain(cap);
+
+    gbw_pcap_store_destroy(cap->stores[worker->id]);
+    cap->stores[worker->id] = NULL;
+
+    if(--cap->nb_workers_left == 0){
+        rte_ring_free(cap->ring);
+        cap->ring = NULL;
+    }
+
+    _ctx_free(ctx);
+}
+
+static void _capture_dump(gbw_probe_worker_t *worker,void *_ctx,FILE *out){
+
+    gbw_probe_capture_ctx_t *ctx = (gbw_probe_capture_ctx_t*)_ctx;
+    gbw_probe_capture_t *cap = ctx->cap;
+    gbw_pcap_store_t *st = cap->stores[worker->id];
+
+    fprintf(out,"    capture pkts:%lu bytes:%lu batches:%lu dropped:%lu\n",
+            (unsigned long)ctx->pkts,(unsigned long)ctx->bytes,
+            (unsigned long)ctx->batches_sent,(unsigned long)ctx->dropped);
+
+    if(st)
+        fprintf(out,"    capture store segments:%lu pkts:%lu bytes:%lu errors:%lu\n",
+                (unsigned long)st->segments,(unsigned long)st->pkts,
+                (unsigned long)st->bytes,(unsigned long)st->errors);
+
+    if(worker->id == 0)
+        fprintf(out,"    capture writer batches:%lu lost_pkts:%lu\n",
+                (unsigned long)cap->batches,(unsigned long)cap->lost_pkts);
+}
+
+static const gbw_probe_stage_t _capture_stage = {
+    .name = "capture",
+    .init = _capture_init,
+    .process = _capture_process,
+    .fin = _capture_fin,
+    .timer = _capture_timer,
+    .dump = _capture_dump,
+    .priv = NULL,
+};
+
+gbw_probe_capture_t * gbw_probe_capture_create(gbw_probe_engine_t *engine){
+
+    gbw_probe_config_t *pcfg = engine->pcfg;
+    gbw_probe_capture_t *cap;
+    gbw_probe_stage_t stage;
+    unsigned int size = 1;
+
+    if(pcfg->capture_dir == NULL)
+        return NULL;
+
+    cap = (gbw_probe_capture_t*)gbw_pcalloc(engine->mp,sizeof(*cap));
+    if(cap == NULL)
+        return NULL;
+
+    cap->engine = engine;
+    cap->batch_size = (size_t)pcfg->capture_batch_size*1024;
+    cap->snaplen = pcfg->capture_snaplen;
+    cap->ports = pcfg->capture_ports;
+
+    /*a segment that gets nothing is closed after its time,or a minute*/
+    cap->idle_cycles = rte_get_timer_hz()*(pcfg->capture_segment_secs?pcfg->capture_segment_secs:60);
+
+    /*every batch of every worker fits,a ring holds one less than its size*/
+    while(size<=(unsigned int)engine->nb_workers*GBW_PROBE_CAPTURE_BATCHES)
+        size <<= 1;
+
+    cap->ring = rte_ring_create("gbw_capture_ring",size,engine->socket_id,RING_F_SC_DEQ);
+    if(cap->ring == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot create the capture ring");
+        return NULL;
+    }
+
+    stage = _capture_stage;
+    stage.priv = cap;
+
+    if(gbw_probe_service_register(engine,"capture",_writer_loop,cap)||
+            gbw_probe_stage_register(engine,&stage)){
+        rte_ring_free(cap->ring);
+        return NULL;
+    }
+
+    return cap;
+}
@@ -0,0 +1,104 @@
+/*
+ *
+ *      Filename: gbw_probe_capture.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: packet capture to disk,workers copy the packets selected
+ *                into batches a writer lcore appends to indexed pcap
+ *                segments,one stream of them per worker
+ *
+ */
+
+#ifndef GBW_PROBE_CAPTURE_H
+#define GBW_PROBE_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <rte_ring.h>
+
+#include "gbw_pcap_store.h"
+#include "gbw_probe_engine.h"
+
+/*batches of a worker,filled one after another while the writer has the others*/
+#define GBW_PROBE_CAPTURE_BATCHES 4
+
+/*the writer's buffer of each worker's segments,a multiple of GBW_PCAP_STORE_ALIGN*/
+#define GBW_PROBE_CAPTURE_BUF_SIZE (4*1024*1024)
+
+/*ms a batch waits at most before it is handed over*/
+#define GBW_PROBE_CAPTURE_FLUSH_MS 100
+
+typedef struct gbw_probe_capture_batch_t gbw_probe_capture_batch_t;
+typedef struct gbw_probe_capture_t gbw_probe_capture_t;
+typedef struct gbw_probe_capture_ctx_t gbw_probe_capture_ctx_t;
+
+/*pcap records,the header in host order then the packet bytes*/
+struct gbw_probe_capture_batch_t {
+
+    /*set by the worker handing it over,cleared by the writer once written*/
+    volatile uint32_t busy;
+
+    uint16_t worker;
+    uint32_t len;
+    uint8_t *data;
+};
+
+/*Shared by all workers,the stores are only touched by the writer*/
+struct gbw_probe_capture_t {
+
+    gbw_probe_engine_t *engine;
+
+    /*full batches of all workers,multi producer single consumer*/
+    struct rte_ring *ring;
+    size_t batch_size;
+    uint32_t snaplen;
+
+    /*bit per port,a packet with either port set is kept,NULL keeps all*/
+    const uint64_t *ports;
+
+    gbw_pcap_store_t *stores[GBW_PROBE_MAX_WORKERS];
+
+    /*
+     * Timer cycles of the last packet of each store,a segment that got
+     * none for idle_cycles is closed so queries see it.
+     */
+    uint64_t last_add[GBW_PROBE_MAX_WORKERS];
+    uint64_t idle_cycles;
+    uint64_t next_idle_check;
+
+    uint16_t nb_workers_left;
+
+    uint64_t batches;
+    uint64_t lost_pkts;
+};
+
+struct gbw_probe_capture_ctx_t {
+
+    gbw_probe_capture_t *cap;
+
+    gbw_probe_capture_batch_t batches[GBW_PROBE_CAPTURE_BATCHES];
+    unsigned int cur;
+
+    /*rx timestamp dynfield of the pcap port,-1 if none*/
+    int ts_offset;
+    uint64_t ts_flag;
+
+    uint64_t flush_cycles;
+    uint64_t last_flush;
+
+    uint64_t pkts;
+    uint64_t bytes;
+    uint64_t batches_sent;
+    uint64_t dropped;
+};
+
+/*
+ * Creates the capture out of the Capture* config,takes a service lcore
+ * for its writer and registers the capture stage,right after decode so
+ * packets are kept as they came in. Returns NULL when no CaptureDir is
+ * set or on failure.
+ */
+extern gbw_probe_capture_t * gbw_probe_capture_create(gbw_probe_engine_t *engine);
+
+#endif /*GBW_PROBE_CAPTURE_H*/
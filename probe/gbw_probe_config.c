@@ -0,0 +1,1006 @@
+/*
+ *
+ *      Filename: gbw_probe_config.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: probe engine configuration,read with gbw_config
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <rte_kvargs.h>
+
+#include "gbw_probe_config.h"
+#include "gbw_config.h"
+#include "gbw_string.h"
+#include "gbw_log.h"
+
+#define PROBE_UINT_SLOT(field) ((void*)offsetof(gbw_probe_config_t,field))
+#define PROBE_STR_SLOT(field)  ((void*)offsetof(gbw_probe_config_t,field))
+
+static const char *cmd_eal_args(cmd_parms *cmd,void *_dcfg,int argc,char *const argv[]){
+
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)_dcfg;
+    int i;
+
+    if(argc<1||argc>GBW_PROBE_EAL_MAX_ARGS-1)
+        return "EALArgs takes 1 to 63 arguments";
+
+    /*argv[0] stays the program name*/
+    for(i = 0;i<argc;i++)
+        pcfg->eal_argv[i+1] = gbw_pstrdup(cmd->pool,argv[i]);
+
+    pcfg->eal_argc = argc+1;
+    pcfg->eal_argv[pcfg->eal_argc] = NULL;
+
+    return NULL;
+}
+
+static const char *cmd_log_file(cmd_parms *cmd,void *_dcfg,const char *p1){
+
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)_dcfg;
+
+    pcfg->log_file = gbw_pstrdup(cmd->pool,p1);
+
+    return NULL;
+}
+
+static const char *cmd_str_slot(cmd_parms *cmd,void *_dcfg,const char *p1){
+
+    const char **slot = (const char**)((char*)_dcfg+(size_t)cmd->info);
+
+    *slot = gbw_pstrdup(cmd->pool,p1);
+
+    return NULL;
+}
+
+static const char *cmd_uint_slot(cmd_parms *cmd,void *_dcfg,const char *p1){
+
+    char *end;
+    unsigned long v;
+    uint32_t *slot = (uint32_t*)((char*)_dcfg+(size_t)cmd->info);
+
+    v = strtoul(p1,&end,10);
+    if(*p1 == '\0'||*end!='\0'||v>UINT32_MAX)
+        return gbw_pstrcat(cmd->pool,cmd->cmd->name," takes a number",NULL);
+
+    *slot = (uint32_t)v;
+
+    return NULL;
+}
+
+static const char *cmd_flow_clock(cmd_parms *cmd,void *_dcfg,const char *p1){
+
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)_dcfg;
+
+    (void)cmd;
+
+    if(strcasecmp(p1,"wall") == 0)
+        pcfg->flow_clock = GBW_PROBE_CLOCK_WALL;
+    else if(strcasecmp(p1,"packet") == 0)
+        pcfg->flow_clock = GBW_PROBE_CLOCK_PACKET;
+    else
+        return "FlowClock takes wall or packet";
+
+    return NULL;
+}
+
+static const char *cmd_tcp_overlap(cmd_parms *cmd,void *_dcfg,const char *p1){
+
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)_dcfg;
+
+    (void)cmd;
+
+    if(strcasecmp(p1,"first") == 0)
+        pcfg->tcp_overlap = 0;
+    else if(strcasecmp(p1,"last") == 0)
+        pcfg->tcp_overlap = 1;
+    else
+        return "TcpOverlapPolicy takes first or last";
+
+    return NULL;
+}
+
+static const char *cmd_capture_port(cmd_parms *cmd,void *_dcfg,const char *p1){
+
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)_dcfg;
+    char *end;
+    unsigned long v;
+
+    v = strtoul(p1,&end,10);
+    if(*p1 == '\0'||*end!='\0'||v>65535)
+        return "CapturePorts takes port numbers";
+
+    if(pcfg->capture_ports == NULL)
+        pcfg->capture_ports = (uint64_t*)gbw_pcalloc(cmd->pool,65536/8);
+
+    pcfg->capture_ports[v>>6] |= 1ULL<<(v&63);
+
+    return NULL;
+}
+
+/*an end of a RecordFlow rule,its address and port each any or a value*/
+static int _record_end_parse(const char *addr,const char *port,gbw_pcap_store_query_t *q,int i){
+
+    char *end;
+    unsigned long v;
+
+    if(strcasecmp(addr,"any")){
+
+        if(inet_pton(AF_INET,addr,q->ends[i].addr) == 1)
+            q->ends[i].addr_len = 4;
+        else if(inet_pton(AF_INET6,addr,q->ends[i].addr) == 1)
+            q->ends[i].addr_len = 16;
+        else
+            return -1;
+    }
+
+    if(strcasecmp(port,"any")){
+
+        v = strtoul(port,&end,10);
+        if(*port == '\0'||*end!='\0'||v == 0||v>65535)
+            return -1;
+
+        q->ends[i].port = (uint16_t)v;
+    }
+
+    return 0;
+}
+
+static const char *cmd_record_flow(cmd_parms *cmd,void *_dcfg,int argc,char *const argv[]){
+
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)_dcfg;
+    gbw_pcap_store_query_t *q;
+    struct protoent *pe;
+    char *end;
+    unsigned long v;
+
+    (void)cmd;
+
+    if(argc!=3&&argc!=5)
+        return "RecordFlow takes a protocol and one or two ends,each an address and a port";
+
+    if(pcfg->nb_record_rules == GBW_PROBE_RECORD_MAX_RULES)
+        return "Too many RecordFlow rules";
+
+    q = &pcfg->record_rules[pcfg->nb_record_rules];
+    memset(q,0,sizeof(*q));
+
+    if(strcasecmp(argv[0],"any")){
+
+        v = strtoul(argv[0],&end,10);
+        if(*end == '\0'&&v>0&&v<256)
+            q->proto = (uint8_t)v;
+        else if((pe = getprotobyname(argv[0]))!=NULL)
+            q->proto = (uint8_t)pe->p_proto;
+        else
+            return "RecordFlow takes tcp,udp,sctp,any or a protocol number";
+    }
+
+    if(_record_end_parse(argv[1],argv[2],q,0)||(argc == 5&&_record_end_parse(argv[3],argv[4],q,1)))
+        return "RecordFlow takes an IPv4 or IPv6 address or any,and a port or any";
+
+    pcfg->nb_record_rules++;
+
+    return NULL;
+}
+
+static const command_rec probe_directives[] = {
+
+    GBW_INIT_TAKE_ARGV(
+            "EALArgs",
+            cmd_eal_args,
+            NULL,
+            0,
+            "DPDK EAL arguments,e.g. -l 0-7 -n 4 --vdev net_pcap0,rx_pcap=/data"
+            ),
+
+    GBW_INIT_TAKE1(
+            "LogFile",
+            cmd_log_file,
+            NULL,
+            0,
+            "set the log file path"
+            ),
+
+    GBW_INIT_TAKE1(
+            "LogLevel",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(log_level),
+            0,
+            "set the log level,1(emerg) to 8(debug)"
+            ),
+
+    GBW_INIT_TAKE1(
+            "PortID",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(port_id),
+            0,
+            "set the dpdk port to capture on"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RxQueues",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(nb_rx_queues),
+            0,
+            "set the number of rx queues,one rx lcore each"
+            ),
+
+    GBW_INIT_TAKE1(
+            "Workers",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(nb_workers),
+            0,
+            "set the number of worker lcores"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RxDesc",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(rx_desc),
+            0,
+            "set the number of rx descriptors per queue"
+            ),
+
+    GBW_INIT_TAKE1(
+            "BurstSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(burst_size),
+            0,
+            "set the number of mbufs handled per burst"
+            ),
+
+    GBW_INIT_TAKE1(
+            "MbufNum",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(mbuf_num),
+            0,
+            "set the number of mbufs in the packet pool"
+            ),
+
+    GBW_INIT_TAKE1(
+            "MbufCache",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(mbuf_cache),
+            0,
+            "set the per lcore mbuf cache size"
+            ),
+
+    GBW_INIT_TAKE1(
+            "WorkerRingSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(worker_ring_size),
+            0,
+            "set the size of each worker input ring"
+            ),
+
+    GBW_INIT_TAKE1(
+            "StatsInterval",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(stats_interval),
+            0,
+            "set the seconds between two stats dumps"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowTableSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(flow_max),
+            0,
+            "set the number of flows each worker can track"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowHugepage",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(flow_hugepage),
+            0,
+            "set to 1 to keep the flow tables in hugepages"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowIdleTimeout",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(flow_idle_timeout),
+            0,
+            "set the seconds an idle flow is kept"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowCloseTimeout",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(flow_close_timeout),
+            0,
+            "set the seconds a flow is kept after a TCP FIN or RST"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowCutoffBytes",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(flow_cutoff_bytes),
+            0,
+            "set the bytes of a flow after which its packets are only counted,0 for no cutoff"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowCutoffPackets",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(flow_cutoff_pkts),
+            0,
+            "set the packets of a flow after which its packets are only counted,0 for no cutoff"
+            ),
+
+    GBW_INIT_TAKE1(
+            "FlowClock",
+            cmd_flow_clock,
+            NULL,
+            0,
+            "age flows on wall clock time or on packet capture time"
+            ),
+
+    GBW_INIT_TAKE1(
+            "TcpOverlapPolicy",
+            cmd_tcp_overlap,
+            NULL,
+            0,
+            "keep the first or the last copy of overlapping tcp bytes"
+            ),
+
+    GBW_INIT_TAKE1(
+            "TcpFlowMemCap",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(tcp_flow_cap),
+            0,
+            "set the bytes one tcp flow may hold out of order"
+            ),
+
+    GBW_INIT_TAKE1(
+            "TcpMemCap",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(tcp_mem_cap),
+            0,
+            "set the MB all tcp flows may hold out of order"
+            ),
+
+    GBW_INIT_TAKE1(
+            "TcpPoolSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(tcp_pool_size),
+            0,
+            "set the size of the per flow reassembly pools"
+            ),
+
+    GBW_INIT_TAKE1(
+            "TcpPoolCache",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(tcp_pool_cache),
+            0,
+            "set the number of free reassembly pools each worker caches"
+            ),
+
+    GBW_INIT_TAKE1(
+            "DefragMaxDatagrams",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(defrag_max),
+            0,
+            "set the number of fragmented datagrams each worker may hold"
+            ),
+
+    GBW_INIT_TAKE1(
+            "DefragTimeout",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(defrag_timeout),
+            0,
+            "set the msecs a fragmented datagram may wait for its fragments"
+            ),
+
+    GBW_INIT_TAKE1(
+            "ProtoMaxPackets",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(proto_max_pkts),
+            0,
+            "set the payload packets of a flow inspected to find its protocol"
+            ),
+
+    GBW_INIT_TAKE1(
+            "DnsFlushSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(dns_flush_size),
+            0,
+            "set the KB of dns records a worker packs before flushing them"
+            ),
+
+    GBW_INIT_TAKE1(
+            "DnsFlushInterval",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(dns_flush_interval),
+            0,
+            "set the most msecs dns records wait before being flushed"
+            ),
+
+    GBW_INIT_TAKE1(
+            "ExportDir",
+            cmd_str_slot,
+            PROBE_STR_SLOT(export_dir),
+            0,
+            "set the directory records are exported to,in rotated files"
+            ),
+
+    GBW_INIT_TAKE1(
+            "ExportUnixSocket",
+            cmd_str_slot,
+            PROBE_STR_SLOT(export_unix),
+            0,
+            "set the unix stream socket records are exported to"
+            ),
+
+    GBW_INIT_TAKE1(
+            "ExportFileSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(export_file_size),
+            0,
+            "set the MB an export file grows to before it is rotated"
+            ),
+
+    GBW_INIT_TAKE1(
+            "ExportBatchSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(export_batch_size),
+            0,
+            "set the KB of records a worker batches before handing them to the writer"
+            ),
+
+    GBW_INIT_TAKE1(
+            "ExportFlushInterval",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(export_flush_interval),
+            0,
+            "set the most msecs exported records wait in a batch"
+            ),
+
+    GBW_INIT_TAKE1(
+            "IpfixCollector",
+            cmd_str_slot,
+            PROBE_STR_SLOT(ipfix_collector),
+            0,
+            "set the UDP collector flow records are sent to,as host:port"
+            ),
+
+    GBW_INIT_TAKE1(
+            "IpfixVersion",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(ipfix_version),
+            0,
+            "set 10 for IPFIX or 9 for NetFlow v9"
+            ),
+
+    GBW_INIT_TAKE1(
+            "IpfixDomainId",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(ipfix_domain_id),
+            0,
+            "set the observation domain of the first worker,the next ones count up"
+            ),
+
+    GBW_INIT_TAKE1(
+            "IpfixMTU",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(ipfix_mtu),
+            0,
+            "set the largest IPFIX message in bytes"
+            ),
+
+    GBW_INIT_TAKE1(
+            "IpfixActiveTimeout",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(ipfix_active_timeout),
+            0,
+            "set the secs after which a live flow is reported"
+            ),
+
+    GBW_INIT_TAKE1(
+            "IpfixTemplateRefresh",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(ipfix_template_refresh),
+            0,
+            "set the secs between two sends of the templates"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchInterval",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(sketch_interval),
+            0,
+            "set the secs between two top-K reports,0 for no sketches"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchTopK",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(sketch_top_k),
+            0,
+            "set how many top talkers,ports and protocols are reported"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchCounters",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(sketch_counters),
+            0,
+            "set how many keys each Space-Saving sketch monitors"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchDepth",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(sketch_depth),
+            0,
+            "set the rows of the Count-Min sketches"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchWidth",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(sketch_width),
+            0,
+            "set the counters per row of the Count-Min sketches"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchHllPrecision",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(sketch_hll_precision),
+            0,
+            "set the precision of the distinct counters,2^n registers"
+            ),
+
+    GBW_INIT_TAKE1(
+            "SketchReportFile",
+            cmd_str_slot,
+            PROBE_STR_SLOT(sketch_report_file),
+            0,
+            "set the file rewritten with every top-K report"
+            ),
+
+    GBW_INIT_TAKE1(
+            "CaptureDir",
+            cmd_str_slot,
+            PROBE_STR_SLOT(capture_dir),
+            0,
+            "set the directory packets are captured to,none for no capture"
+            ),
+
+    GBW_INIT_TAKE1(
+            "CaptureSegmentSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(capture_segment_size),
+            0,
+            "set the MB of a capture segment"
+            ),
+
+    GBW_INIT_TAKE1(
+            "CaptureSegmentTime",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(capture_segment_secs),
+            0,
+            "set the secs of packets a capture segment holds at most,0 for no limit"
+            ),
+
+    GBW_INIT_TAKE1(
+            "CaptureSnaplen",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(capture_snaplen),
+            0,
+            "set the bytes captured of a packet at most"
+            ),
+
+    GBW_INIT_TAKE1(
+            "CaptureBatchSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(capture_batch_size),
+            0,
+            "set the KB of packets a worker batches for the capture writer"
+            ),
+
+    GBW_INIT_ITERATE(
+            "CapturePorts",
+            cmd_capture_port,
+            NULL,
+            0,
+            "capture only tcp/udp packets from or to these ports"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RetroSize",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(retro_size),
+            0,
+            "set the MB of the retrospective packet ring of each worker,0 for none"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RetroSeconds",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(retro_secs),
+            0,
+            "set the secs of packets a retrospective dump goes back"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RetroDir",
+            cmd_str_slot,
+            PROBE_STR_SLOT(retro_dir),
+            0,
+            "set the directory retrospective dumps are written to"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RecordDir",
+            cmd_str_slot,
+            PROBE_STR_SLOT(record_dir),
+            0,
+            "set the directory the pcap files of recorded flows go to,none for no recording"
+            ),
+
+    GBW_INIT_TAKE1(
+            "RecordMaxFiles",
+            cmd_uint_slot,
+            PROBE_UINT_SLOT(record_max_files),
+            0,
+            "set the pcap files of recorded flows held open at most"
+            ),
+
+    GBW_INIT_TAKE_ARGV(
+            "RecordFlow",
+            cmd_record_flow,
+            NULL,
+            0,
+            "record the flows between two ends,e.g. tcp 10.0.0.1 any any 443"
+            ),
+
+    {NULL}
+};
+
+static void _config_init(gbw_probe_config_t *pcfg,gbw_pool_t *mp){
+
+    pcfg->mp = mp;
+
+    pcfg->eal_argc = 1;
+    pcfg->eal_argv[0] = "GBWProbe";
+    pcfg->eal_argv[1] = NULL;
+
+    pcfg->log_file = "/var/log/GBWProbe.log";
+    pcfg->log_level = GBW_LOG_NOTICE;
+
+    pcfg->port_id = 0;
+    pcfg->nb_rx_queues = 1;
+    pcfg->nb_workers = 1;
+
+    pcfg->rx_desc = 1024;
+    pcfg->burst_size = 32;
+
+    pcfg->mbuf_num = 65535;
+    pcfg->mbuf_cache = 256;
+
+    pcfg->worker_ring_size = 4096;
+    pcfg->stats_interval = 10;
+
+    pcfg->flow_max = 1<<20;
+    pcfg->flow_hugepage = 1;
+
+    pcfg->flow_idle_timeout = 60;
+    pcfg->flow_close_timeout = 10;
+    pcfg->flow_cutoff_bytes = 0;
+    pcfg->flow_cutoff_pkts = 0;
+    pcfg->flow_clock = GBW_PROBE_CLOCK_WALL;
+
+    pcfg->tcp_overlap = 0;
+    pcfg->tcp_flow_cap = 1024*1024;
+    pcfg->tcp_mem_cap = 1024;
+    pcfg->tcp_pool_size = 4096;
+    pcfg->tcp_pool_cache = 4096;
+
+    pcfg->defrag_max = 1024;
+    pcfg->defrag_timeout = 2000;
+
+    pcfg->proto_max_pkts = 8;
+
+    pcfg->dns_flush_size = 64;
+    pcfg->dns_flush_interval = 1000;
+
+    pcfg->export_dir = NULL;
+    pcfg->export_unix = NULL;
+    pcfg->export_file_size = 256;
+    pcfg->export_batch_size = 256;
+    pcfg->export_flush_interval = 1000;
+
+    pcfg->ipfix_collector = NULL;
+    pcfg->ipfix_version = 10;
+    pcfg->ipfix_domain_id = 1;
+    pcfg->ipfix_mtu = 1400;
+    pcfg->ipfix_active_timeout = 60;
+    pcfg->ipfix_template_refresh = 60;
+
+    pcfg->sketch_interval = 0;
+    pcfg->sketch_top_k = 20;
+    pcfg->sketch_counters = 1024;
+    pcfg->sketch_depth = 4;
+    pcfg->sketch_width = 8192;
+    pcfg->sketch_hll_precision = 14;
+    pcfg->sketch_report_file = NULL;
+
+    pcfg->capture_dir = NULL;
+    pcfg->capture_segment_size = 1024;
+    pcfg->capture_segment_secs = 300;
+    pcfg->capture_snaplen = 65535;
+    pcfg->capture_batch_size = 1024;
+    pcfg->capture_ports = NULL;
+
+    pcfg->retro_size = 0;
+    pcfg->retro_secs = 30;
+    pcfg->retro_dir = "/tmp";
+
+    pcfg->record_dir = NULL;
+    pcfg->record_max_files = 64;
+    pcfg->nb_record_rules = 0;
+}
+
+/*
+ * Queues of a pcap vdev in the EAL args reading one file split,out of
+ * its devargs as --vdev=<name>,<key>=<value>,... or --vdev <name>,...
+ * 0 when there is none.
+ */
+static uint32_t _eal_rx_split(gbw_probe_config_t *pcfg){
+
+    struct rte_kvargs *kv;
+    const char *dev,*args,*v;
+    char *end;
+    unsigned long n;
+    uint32_t split = 0;
+    int i;
+
+    for(i = 1;i<pcfg->eal_argc;i++){
+
+        if(strncmp(pcfg->eal_argv[i],"--vdev=",sizeof("--vdev=")-1) == 0)
+            dev = pcfg->eal_argv[i]+sizeof("--vdev=")-1;
+        else if(strcmp(pcfg->eal_argv[i],"--vdev") == 0&&i+1<pcfg->eal_argc)
+            dev = pcfg->eal_argv[++i];
+        else
+            continue;
+
+        /*the pcap driver,by its name or alias*/
+        if(strncmp(dev,"net_pcap",sizeof("net_pcap")-1)&&strncmp(dev,"eth_pcap",sizeof("eth_pcap")-1))
+            continue;
+
+        args = strchr(dev,',');
+        if(args == NULL)
+            continue;
+
+        kv = rte_kvargs_parse(args+1,NULL);
+        if(kv == NULL)
+            continue;
+
+        v = rte_kvargs_get(kv,"rx_split");
+        if(v){
+
+            n = strtoul(v,&end,10);
+            if(*end == 0&&n>1&&n>split)
+                split = (uint32_t)n;
+        }
+
+        rte_kvargs_free(kv);
+    }
+
+    return split;
+}
+
+gbw_probe_config_t * gbw_probe_config_load(gbw_pool_t *mp,const char *cfname){
+
+    const char *msg;
+    gbw_probe_config_t *pcfg = (gbw_probe_config_t*)gbw_pcalloc(mp,sizeof(*pcfg));
+
+    _config_init(pcfg,mp);
+
+    msg = gbw_process_command_config(probe_directives,(void*)pcfg,mp,mp,cfname);
+
+    if(msg!=NULL){
+
+        gbw_log(GBW_LOG_ERR,"Load probe config file:%s failed:%s",cfname,msg);
+        return NULL;
+    }
+
+    pcfg->rx_split = _eal_rx_split(pcfg);
+
+    /*the queues of a split file are at different times,the packet clock would jump between them*/
+    if(pcfg->flow_clock == GBW_PROBE_CLOCK_PACKET&&pcfg->rx_split){
+
+        gbw_log(GBW_LOG_ERR,"FlowClock packet can't be used with a pcap vdev in rx_split mode");
+        return NULL;
+    }
+
+    if(pcfg->tcp_flow_cap<64*1024||pcfg->tcp_mem_cap == 0){
+
+        gbw_log(GBW_LOG_ERR,"TcpFlowMemCap must be at least 65536 and TcpMemCap at least 1");
+        return NULL;
+    }
+
+    if(pcfg->defrag_max == 0||pcfg->defrag_timeout == 0){
+
+        gbw_log(GBW_LOG_ERR,"DefragMaxDatagrams and DefragTimeout must be at least 1");
+        return NULL;
+    }
+
+    if(pcfg->proto_max_pkts == 0||pcfg->proto_max_pkts>255){
+
+        gbw_log(GBW_LOG_ERR,"ProtoMaxPackets must be in 1-255");
+        return NULL;
+    }
+
+    if(pcfg->dns_flush_size == 0||pcfg->dns_flush_interval == 0){
+
+        gbw_log(GBW_LOG_ERR,"DnsFlushSize and DnsFlushInterval must be at least 1");
+        return NULL;
+    }
+
+    if(pcfg->export_dir&&pcfg->export_unix){
+
+        gbw_log(GBW_LOG_ERR,"ExportDir and ExportUnixSocket can't be both set");
+        return NULL;
+    }
+
+    /*a dns flush is handed over whole*/
+    if(pcfg->export_file_size == 0||pcfg->export_flush_interval == 0||
+            pcfg->export_batch_size<=pcfg->dns_flush_size){
+
+        gbw_log(GBW_LOG_ERR,"ExportFileSize and ExportFlushInterval must be at least 1,ExportBatchSize more than DnsFlushSize");
+        return NULL;
+    }
+
+    if((pcfg->ipfix_version!=9&&pcfg->ipfix_version!=10)||pcfg->ipfix_mtu<512||pcfg->ipfix_mtu>65000||
+            pcfg->ipfix_active_timeout == 0||pcfg->ipfix_template_refresh == 0){
+
+        gbw_log(GBW_LOG_ERR,"IpfixVersion must be 9 or 10,IpfixMTU in 512-65000,IpfixActiveTimeout and IpfixTemplateRefresh at least 1");
+        return NULL;
+    }
+
+    if(pcfg->sketch_top_k == 0||pcfg->sketch_top_k>pcfg->sketch_counters||pcfg->sketch_counters>1<<20||
+            pcfg->sketch_depth == 0||pcfg->sketch_depth>8||pcfg->sketch_width<64||pcfg->sketch_width>1<<24||
+            pcfg->sketch_hll_precision<4||pcfg->sketch_hll_precision>16){
+
+        gbw_log(GBW_LOG_ERR,"SketchTopK must be in 1-SketchCounters,SketchCounters at most 1048576,SketchDepth in 1-8,SketchWidth in 64-16777216,SketchHllPrecision in 4-16");
+        return NULL;
+    }
+
+    /*a batch holds a packet of snaplen and its header*/
+    if(pcfg->capture_segment_size == 0||pcfg->capture_snaplen<64||pcfg->capture_snaplen>65535||
+            (uint64_t)pcfg->capture_batch_size*1024<pcfg->capture_snaplen+16){
+
+        gbw_log(GBW_LOG_ERR,"CaptureSegmentSize must be at least 1,CaptureSnaplen in 64-65535,CaptureBatchSize at least 65 KB");
+        return NULL;
+    }
+
+    if(pcfg->retro_secs == 0||pcfg->retro_size>1024*1024){
+
+        gbw_log(GBW_LOG_ERR,"RetroSeconds must be at least 1,RetroSize at most 1048576");
+        return NULL;
+    }
+
+    if(pcfg->record_max_files == 0){
+
+        gbw_log(GBW_LOG_ERR,"RecordMaxFiles must be at least 1");
+        return NULL;
+    }
+
+    if(pcfg->nb_record_rules&&pcfg->record_dir == NULL){
+
+        gbw_log(GBW_LOG_ERR,"RecordFlow needs a RecordDir to write the flows to");
+        return NULL;
+    }
+
+    if(pcfg->nb_rx_queues == 0||pcfg->nb_workers == 0||pcfg->burst_size == 0||pcfg->flow_max == 0){
+
+        gbw_log(GBW_LOG_ERR,"RxQueues,Workers,BurstSize and FlowTableSize must be at least 1");
+        return NULL;
+    }
+
+    return pcfg;
+}
+
+void gbw_probe_config_dump(gbw_probe_config_t *pcfg,FILE *out){
+
+    const gbw_pcap_store_query_t *q;
+    char addr[INET6_ADDRSTRLEN];
+    int i,e;
+
+    fprintf(out,"Dump probe config:\n");
+    fprintf(out,"EALArgs:");
+    for(i = 1;i<pcfg->eal_argc;i++)
+        fprintf(out," %s",pcfg->eal_argv[i]);
+    fprintf(out,"\n");
+
+    fprintf(out,"LogFile:%s\n",pcfg->log_file);
+    fprintf(out,"LogLevel:%u\n",pcfg->log_level);
+    fprintf(out,"PortID:%u\n",pcfg->port_id);
+    fprintf(out,"RxQueues:%u\n",pcfg->nb_rx_queues);
+    fprintf(out,"Workers:%u\n",pcfg->nb_workers);
+    fprintf(out,"RxDesc:%u\n",pcfg->rx_desc);
+    fprintf(out,"BurstSize:%u\n",pcfg->burst_size);
+    fprintf(out,"MbufNum:%u\n",pcfg->mbuf_num);
+    fprintf(out,"MbufCache:%u\n",pcfg->mbuf_cache);
+    fprintf(out,"WorkerRingSize:%u\n",pcfg->worker_ring_size);
+    fprintf(out,"StatsInterval:%u\n",pcfg->stats_interval);
+    fprintf(out,"FlowTableSize:%u\n",pcfg->flow_max);
+    fprintf(out,"FlowHugepage:%u\n",pcfg->flow_hugepage);
+    fprintf(out,"FlowIdleTimeout:%u\n",pcfg->flow_idle_timeout);
+    fprintf(out,"FlowCloseTimeout:%u\n",pcfg->flow_close_timeout);
+    fprintf(out,"FlowCutoffBytes:%u\n",pcfg->flow_cutoff_bytes);
+    fprintf(out,"FlowCutoffPackets:%u\n",pcfg->flow_cutoff_pkts);
+    fprintf(out,"FlowClock:%s\n",pcfg->flow_clock == GBW_PROBE_CLOCK_PACKET?"packet":"wall");
+    fprintf(out,"TcpOverlapPolicy:%s\n",pcfg->tcp_overlap?"last":"first");
+    fprintf(out,"TcpFlowMemCap:%u\n",pcfg->tcp_flow_cap);
+    fprintf(out,"TcpMemCap:%u\n",pcfg->tcp_mem_cap);
+    fprintf(out,"TcpPoolSize:%u\n",pcfg->tcp_pool_size);
+    fprintf(out,"TcpPoolCache:%u\n",pcfg->tcp_pool_cache);
+    fprintf(out,"DefragMaxDatagrams:%u\n",pcfg->defrag_max);
+    fprintf(out,"DefragTimeout:%u\n",pcfg->defrag_timeout);
+    fprintf(out,"ProtoMaxPackets:%u\n",pcfg->proto_max_pkts);
+    fprintf(out,"DnsFlushSize:%u\n",pcfg->dns_flush_size);
+    fprintf(out,"DnsFlushInterval:%u\n",pcfg->dns_flush_interval);
+    fprintf(out,"ExportDir:%s\n",pcfg->export_dir?pcfg->export_dir:"");
+    fprintf(out,"ExportUnixSocket:%s\n",pcfg->export_unix?pcfg->export_unix:"");
+    fprintf(out,"ExportFileSize:%u\n",pcfg->export_file_size);
+    fprintf(out,"ExportBatchSize:%u\n",pcfg->export_batch_size);
+    fprintf(out,"ExportFlushInterval:%u\n",pcfg->export_flush_interval);
+    fprintf(out,"IpfixCollector:%s\n",pcfg->ipfix_collector?pcfg->ipfix_collector:"");
+    fprintf(out,"IpfixVersion:%u\n",pcfg->ipfix_version);
+    fprintf(out,"IpfixDomainId:%u\n",pcfg->ipfix_domain_id);
+    fprintf(out,"IpfixMTU:%u\n",pcfg->ipfix_mtu);
+    fprintf(out,"IpfixActiveTimeout:%u\n",pcfg->ipfix_active_timeout);
+    fprintf(out,"IpfixTemplateRefresh:%u\n",pcfg->ipfix_template_refresh);
+    fprintf(out,"SketchInterval:%u\n",pcfg->sketch_interval);
+    fprintf(out,"SketchTopK:%u\n",pcfg->sketch_top_k);
+    fprintf(out,"SketchCounters:%u\n",pcfg->sketch_counters);
+    fprintf(out,"SketchDepth:%u\n",pcfg->sketch_depth);
+    fprintf(out,"SketchWidth:%u\n",pcfg->sketch_width);
+    fprintf(out,"SketchHllPrecision:%u\n",pcfg->sketch_hll_precision);
+    fprintf(out,"SketchReportFile:%s\n",pcfg->sketch_report_file?pcfg->sketch_report_file:"");
+    fprintf(out,"CaptureDir:%s\n",pcfg->capture_dir?pcfg->capture_dir:"");
+    fprintf(out,"CaptureSegmentSize:%u\n",pcfg->capture_segment_size);
+    fprintf(out,"CaptureSegmentTime:%u\n",pcfg->capture_segment_secs);
+    fprintf(out,"CaptureSnaplen:%u\n",pcfg->capture_snaplen);
+    fprintf(out,"CaptureBatchSize:%u\n",pcfg->capture_batch_size);
+    fprintf(out,"CapturePorts:");
+    for(i = 0;pcfg->capture_ports&&i<65536;i++)
+        if(pcfg->capture_ports[i>>6]>>(i&63)&1)
+            fprintf(out," %d",i);
+    fprintf(out,"\n");
+    fprintf(out,"RetroSize:%u\n",pcfg->retro_size);
+    fprintf(out,"RetroSeconds:%u\n",pcfg->retro_secs);
+    fprintf(out,"RetroDir:%s\n",pcfg->retro_dir?pcfg->retro_dir:"");
+    fprintf(out,"RecordDir:%s\n",pcfg->record_dir?pcfg->record_dir:"");
+    fprintf(out,"RecordMaxFiles:%u\n",pcfg->record_max_files);
+
+    for(i = 0;i<(int)pcfg->nb_record_rules;i++){
+
+        q = &pcfg->record_rules[i];
+        fprintf(out,"RecordFlow:%u",q->proto);
+
+        for(e = 0;e<2;e++){
+
+            if(q->ends[e].addr_len)
+                inet_ntop(q->ends[e].addr_len == 4?AF_INET:AF_INET6,q->ends[e].addr,addr,sizeof(addr));
+            else
+                strcpy(addr,"any");
+
+            fprintf(out," %s %u",addr,q->ends[e].port);
+        }
+
+        fprintf(out,"\n");
+    }
+}
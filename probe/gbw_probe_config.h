@@ -0,0 +1,173 @@
+/*
+ *
+ *      Filename: gbw_probe_config.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: probe engine configuration,read with gbw_config
+ *
+ */
+
+#ifndef GBW_PROBE_CONFIG_H
+#define GBW_PROBE_CONFIG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "gbw_mpool.h"
+#include "gbw_pcap_store.h"
+
+#define GBW_PROBE_EAL_MAX_ARGS 64
+
+/*RecordFlow lines at most*/
+#define GBW_PROBE_RECORD_MAX_RULES 16
+
+/*what flow timeouts are measured against*/
+#define GBW_PROBE_CLOCK_WALL   0
+#define GBW_PROBE_CLOCK_PACKET 1
+
+typedef struct gbw_probe_config_t gbw_probe_config_t;
+
+struct gbw_probe_config_t {
+
+    gbw_pool_t *mp;
+
+    /*argv handed to rte_eal_init,argv[0] is the program name*/
+    int eal_argc;
+    char *eal_argv[GBW_PROBE_EAL_MAX_ARGS+1];
+
+    /*rx_split of a pcap vdev in the EAL args,0 when none reads a file split*/
+    uint32_t rx_split;
+
+    const char *log_file;
+    uint32_t log_level;
+
+    uint32_t port_id;
+    uint32_t nb_rx_queues;
+    uint32_t nb_workers;
+
+    uint32_t rx_desc;
+    uint32_t burst_size;
+
+    uint32_t mbuf_num;
+    uint32_t mbuf_cache;
+
+    /*per worker ring between rx and worker lcores,power of 2*/
+    uint32_t worker_ring_size;
+
+    /*seconds between two stats dumps,0 disables them*/
+    uint32_t stats_interval;
+
+    /*flows tracked per worker,and whether to keep them in hugepages*/
+    uint32_t flow_max;
+    uint32_t flow_hugepage;
+
+    /*seconds a flow may stay silent,or after a FIN/RST*/
+    uint32_t flow_idle_timeout;
+    uint32_t flow_close_timeout;
+
+    /*bytes and packets of both directions after which a flow is only
+     *counted,0 for no cutoff*/
+    uint32_t flow_cutoff_bytes;
+    uint32_t flow_cutoff_pkts;
+
+    /*GBW_PROBE_CLOCK_WALL,or GBW_PROBE_CLOCK_PACKET to age flows on
+     *capture timestamps when replaying pcap files*/
+    uint32_t flow_clock;
+
+    /*GBW_TCP_OVERLAP_FIRST or GBW_TCP_OVERLAP_LAST*/
+    uint32_t tcp_overlap;
+
+    /*bytes one flow may hold out of order,MB a whole probe may hold*/
+    uint32_t tcp_flow_cap;
+    uint32_t tcp_mem_cap;
+
+    /*per flow pools of the reassembly,and how many each worker caches*/
+    uint32_t tcp_pool_size;
+    uint32_t tcp_pool_cache;
+
+    /*datagrams each worker may reassemble at once,msecs one may take*/
+    uint32_t defrag_max;
+    uint32_t defrag_timeout;
+
+    /*payload packets of a flow looked at to find its protocol*/
+    uint32_t proto_max_pkts;
+
+    /*KB of DNS records a worker packs before flushing them,msecs at most between flushes*/
+    uint32_t dns_flush_size;
+    uint32_t dns_flush_interval;
+
+    /*records are exported to files in export_dir,rotated every
+     *export_file_size MB,or to the unix socket export_unix,NULL for none*/
+    const char *export_dir;
+    const char *export_unix;
+    uint32_t export_file_size;
+
+    /*KB of records a worker batches for the writer,msecs at most a batch waits*/
+    uint32_t export_batch_size;
+    uint32_t export_flush_interval;
+
+    /*IPFIX/NetFlow v9 collector as host:port,NULL for none*/
+    const char *ipfix_collector;
+    uint32_t ipfix_version;
+    uint32_t ipfix_domain_id;
+    uint32_t ipfix_mtu;
+
+    /*secs a live flow is reported after,secs between template resends*/
+    uint32_t ipfix_active_timeout;
+    uint32_t ipfix_template_refresh;
+
+    /*secs between two top-K reports of the sketches,0 for none*/
+    uint32_t sketch_interval;
+    uint32_t sketch_top_k;
+
+    /*keys each Space-Saving sketch monitors,Count-Min rows and counters per row*/
+    uint32_t sketch_counters;
+    uint32_t sketch_depth;
+    uint32_t sketch_width;
+
+    /*registers of the distinct counters are 2^sketch_hll_precision bytes*/
+    uint32_t sketch_hll_precision;
+
+    /*rewritten with the last top-K report,NULL for none*/
+    const char *sketch_report_file;
+
+    /*packet store directory,NULL for no capture*/
+    const char *capture_dir;
+
+    /*MB and secs a segment is closed after,0 secs for no time limit*/
+    uint32_t capture_segment_size;
+    uint32_t capture_segment_secs;
+
+    /*bytes kept of a packet,KB a worker batches for the writer*/
+    uint32_t capture_snaplen;
+    uint32_t capture_batch_size;
+
+    /*bit per tcp/udp port of the packets kept,NULL keeps all*/
+    uint64_t *capture_ports;
+
+    /*MB of the retrospective ring of each worker,0 for none*/
+    uint32_t retro_size;
+
+    /*secs back a triggered dump goes,dumps are written to retro_dir*/
+    uint32_t retro_secs;
+    const char *retro_dir;
+
+    /*directory flows flagged for recording are written to,NULL for none*/
+    const char *record_dir;
+
+    /*pcap files of recorded flows held open at most*/
+    uint32_t record_max_files;
+
+    /*flows recorded from their first packet on,ts left open*/
+    uint32_t nb_record_rules;
+    gbw_pcap_store_query_t record_rules[GBW_PROBE_RECORD_MAX_RULES];
+};
+
+/*
+ * Loads cfname over the defaults,returns NULL and logs the syntax error
+ * if the file can't be parsed.
+ */
+extern gbw_probe_config_t * gbw_probe_config_load(gbw_pool_t *mp,const char *cfname);
+
+extern void gbw_probe_config_dump(gbw_probe_config_t *pcfg,FILE *out);
+
+#endif /*GBW_PROBE_CONFIG_H*/
@@ -0,0 +1,713 @@
+/*
+ *
+ *      Filename: gbw_probe_decode.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: first worker stage,decodes L2-L4 once per packet into
+ *                a compact mbuf dynfield so later stages never re-parse
+ *
+ */
+
+#include <string.h>
+#include <rte_malloc.h>
+#include <rte_ether.h>
+#include <rte_prefetch.h>
+#include <rte_errno.h>
+#include <rte_vect.h>
+
+#include "gbw_probe_decode.h"
+#include "gbw_log.h"
+
+#define DECODE_PREFETCH_AHEAD 4
+#define DECODE_MAX_VLANS 2
+#define DECODE_MAX_LABELS 8
+#define DECODE_MAX_IPV6_EXTS 8
+#define DECODE_MAX_TUNNELS 2
+
+#define ETHER_TYPE_MPLS_UC 0x8847
+#define ETHER_TYPE_MPLS_MC 0x8848
+#define ETHER_TYPE_TEB 0x6558
+
+#define VXLAN_PORT 4789
+#define GTPU_PORT 2152
+
+#define IPV4_MF 0x2000
+#define IPV4_OFFSET_MASK 0x1fff
+
+#define PROTO_HOPOPTS 0
+#define PROTO_ICMP 1
+#define PROTO_IPIP 4
+#define PROTO_TCP 6
+#define PROTO_UDP 17
+#define PROTO_IPV6 41
+#define PROTO_ROUTING 43
+#define PROTO_FRAGMENT 44
+#define PROTO_GRE 47
+#define PROTO_AH 51
+#define PROTO_ICMPV6 58
+#define PROTO_DSTOPTS 60
+#define PROTO_SCTP 132
+
+#define GRE_F_CSUM 0x8000
+#define GRE_F_KEY 0x2000
+#define GRE_F_SEQ 0x1000
+#define GRE_VERSION 0x0007
+
+#define GTP_F_VERSION 0xe0
+#define GTP_F_PT 0x10
+#define GTP_F_OPT 0x07
+#define GTP_F_EXT 0x04
+#define GTP_TPDU 0xff
+
+/*classes of the outer ethertype,the common ones skip the L2 walk*/
+#define DECODE_CLS_OTHER 0
+#define DECODE_CLS_IPV4 1
+#define DECODE_CLS_IPV6 2
+
+#define rd16(p) ((uint16_t)(((uint16_t)(p)[0]<<8)|(p)[1]))
+#define rd32(p) (((uint32_t)(p)[0]<<24)|((uint32_t)(p)[1]<<16)|((uint32_t)(p)[2]<<8)|(p)[3])
+
+int gbw_probe_pkt_dynfield_offset = -1;
+
+static const struct rte_mbuf_dynfield pkt_dynfield_desc = {
+    .name = "gbw_probe_dynfield_pkt",
+    .size = sizeof(gbw_probe_pkt_t),
+    .align = __alignof__(gbw_probe_pkt_t),
+};
+
+/*
+ * Ethertypes of a burst,8 compared at once with SSE2,packets too short
+ * for an ethernet header get class OTHER and are sorted out later.
+ */
+static inline void _classify(struct rte_mbuf **pkts,uint16_t n,uint8_t *cls){
+
+    uint16_t i,j;
+    uint16_t et[8] __attribute__((aligned(16)));
+
+#if defined(RTE_ARCH_X86)||defined(__SSE2__)
+    const __m128i v4 = _mm_set1_epi16((short)RTE_BE16(RTE_ETHER_TYPE_IPV4));
+    const __m128i v6 = _mm_set1_epi16((short)RTE_BE16(RTE_ETHER_TYPE_IPV6));
+    __m128i v;
+    uint32_t m4,m6;
+
+    for(i = 0;i<n;i += 8){
+
+        for(j = 0;j<8;j++){
+
+            struct rte_mbuf *m = pkts[i+j<n?i+j:i];
+
+            et[j] = rte_pktmbuf_data_len(m)>=sizeof(struct rte_ether_hdr)?
+                rte_pktmbuf_mtod(m,const struct rte_ether_hdr*)->ether_type:0;
+        }
+
+        v = _mm_load_si128((const __m128i*)et);
+        m4 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v,v4));
+        m6 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v,v6));
+
+        for(j = 0;j<8&&i+j<n;j++)
+            cls[i+j] = (m4>>(j*2))&1?DECODE_CLS_IPV4:((m6>>(j*2))&1?DECODE_CLS_IPV6:DECODE_CLS_OTHER);
+    }
+#else
+    for(i = 0;i<n;i++){
+
+        et[0] = rte_pktmbuf_data_len(pkts[i])>=sizeof(struct rte_ether_hdr)?
+            rte_pktmbuf_mtod(pkts[i],const struct rte_ether_hdr*)->ether_type:0;
+
+        cls[i] = et[0] == RTE_BE16(RTE_ETHER_TYPE_IPV4)?DECODE_CLS_IPV4:
+            (et[0] == RTE_BE16(RTE_ETHER_TYPE_IPV6)?DECODE_CLS_IPV6:DECODE_CLS_OTHER);
+    }
+    (void)j;
+#endif
+}
+
+/*VLAN tags and MPLS labels,returns the ethertype found behind them*/
+static inline uint16_t _decode_l2(gbw_probe_decode_ctx_t *ctx,gbw_probe_pkt_t *pkt,
+        const uint8_t *base,uint32_t len,uint32_t *off,uint16_t etype){
+
+    int i;
+
+    for(i = 0;i<DECODE_MAX_VLANS&&(etype == RTE_ETHER_TYPE_VLAN||etype == RTE_ETHER_TYPE_QINQ);i++){
+
+        if(*off+4>len){
+            pkt->flags |= GBW_PKT_F_TRUNC;
+            return 0;
+        }
+
+        if(!(pkt->flags&GBW_PKT_F_VLAN)){
+            pkt->flags |= GBW_PKT_F_VLAN;
+            pkt->vlan_id = rd16(base+*off)&0x0fff;
+            ctx->vlan++;
+        }
+
+        etype = rd16(base+*off+2);
+        *off += 4;
+    }
+
+    if(etype == ETHER_TYPE_MPLS_UC||etype == ETHER_TYPE_MPLS_MC){
+
+        pkt->flags |= GBW_PKT_F_MPLS;
+        ctx->mpls++;
+
+        for(i = 0;i<DECODE_MAX_LABELS;i++){
+
+            if(*off+4>len){
+                pkt->flags |= GBW_PKT_F_TRUNC;
+                return 0;
+            }
+
+            *off += 4;
+
+            /*bottom of stack*/
+            if(base[*off-2]&0x01)
+                break;
+        }
+
+        if(*off>=len)
+            return 0;
+
+        /*no payload type in MPLS,guess it from the IP version*/
+        switch(base[*off]>>4){
+        case 4:
+            return RTE_ETHER_TYPE_IPV4;
+        case 6:
+            return RTE_ETHER_TYPE_IPV6;
+        default:
+            return 0;
+        }
+    }
+
+    return etype;
+}
+
+/*Returns the l4 protocol,*off moves to the l4 header*/
+static inline int _decode_ipv4(gbw_probe_pkt_t *pkt,const uint8_t *base,uint32_t len,uint32_t *off,uint32_t *l3_end){
+
+    const uint8_t *ip = base+*off;
+    uint32_t hlen,tlen;
+    uint16_t frag;
+
+    if(*off+20>len){
+        pkt->flags |= GBW_PKT_F_TRUNC;
+        return -1;
+    }
+
+    hlen = (uint32_t)(ip[0]&0x0f)<<2;
+    tlen = rd16(ip+2);
+
+    if((ip[0]>>4)!=4||hlen<20||tlen<hlen){
+        pkt->flags |= GBW_PKT_F_BAD;
+        return -1;
+    }
+
+    pkt->l3_type = GBW_PKT_L3_IPV4;
+    pkt->l3_off = (uint16_t)*off;
+
+    frag = rd16(ip+6);
+    if(frag&(IPV4_MF|IPV4_OFFSET_MASK)){
+
+        pkt->flags |= GBW_PKT_F_FRAG;
+        if(frag&IPV4_OFFSET_MASK)
+            pkt->flags |= GBW_PKT_F_FRAG_NEXT;
+    }
+
+    /*ethernet padding is not payload*/
+    *l3_end = *off+tlen<len?*off+tlen:len;
+    *off += hlen;
+
+    return ip[9];
+}
+
+static inline int _decode_ipv6(gbw_probe_pkt_t *pkt,const uint8_t *base,uint32_t len,uint32_t *off,uint32_t *l3_end){
+
+    const uint8_t *ip = base+*off;
+    uint32_t plen;
+    uint8_t proto;
+    int i;
+
+    if(*off+40>len){
+        pkt->flags |= GBW_PKT_F_TRUNC;
+        return -1;
+    }
+
+    if((ip[0]>>4)!=6){
+        pkt->flags |= GBW_PKT_F_BAD;
+        return -1;
+    }
+
+    pkt->l3_type = GBW_PKT_L3_IPV6;
+    pkt->l3_off = (uint16_t)*off;
+
+    plen = rd16(ip+4);
+    proto = ip[6];
+
+    *l3_end = *off+40+plen<len?*off+40+plen:len;
+    *off += 40;
+
+    for(i = 0;i<DECODE_MAX_IPV6_EXTS;i++){
+
+        switch(proto){
+        case PROTO_HOPOPTS:
+        case PROTO_ROUTING:
+        case PROTO_DSTOPTS:
+            if(*off+8>len)
+                goto trunc;
+            proto = base[*off];
+            *off += ((uint32_t)base[*off+1]+1)<<3;
+            break;
+
+        case PROTO_AH:
+            if(*off+8>len)
+                goto trunc;
+            proto = base[*off];
+            *off += ((uint32_t)base[*off+1]+2)<<2;
+            break;
+
+        case PROTO_FRAGMENT:
+            if(*off+8>len)
+                goto trunc;
+            pkt->flags |= GBW_PKT_F_FRAG;
+            if(rd16(base+*off+2)&0xfff8)
+                pkt->flags |= GBW_PKT_F_FRAG_NEXT;
+            proto = base[*off];
+            *off += 8;
+            break;
+
+        default:
+            return proto;
+        }
+    }
+
+    return proto;
+
+trunc:
+    pkt->flags |= GBW_PKT_F_TRUNC;
+    return -1;
+}
+
+/*
+ * GRE header,returns the ethertype of the payload or 0,
+ * only version 0 carries a plain payload.
+ */
+static inline uint16_t _decode_gre(gbw_probe_pkt_t *pkt,const uint8_t *base,uint32_t len,uint32_t *off){
+
+    const uint8_t *gre = base+*off;
+    uint16_t flags;
+    uint32_t hlen = 4;
+
+    if(*off+4>len){
+        pkt->flags |= GBW_PKT_F_TRUNC;
+        return 0;
+    }
+
+    flags = rd16(gre);
+    if(flags&GRE_VERSION)
+        return 0;
+
+    if(flags&GRE_F_CSUM)
+        hlen += 4;
+
+    if(flags&GRE_F_KEY){
+
+        if(*off+hlen+4>len){
+            pkt->flags |= GBW_PKT_F_TRUNC;
+            return 0;
+        }
+
+        pkt->tunnel_id = rd32(gre+hlen);
+        hlen += 4;
+    }
+
+    if(flags&GRE_F_SEQ)
+        hlen += 4;
+
+    *off += hlen;
+
+    return rd16(gre+2);
+}
+
+/*GTP-U G-PDU,returns the ethertype of the inner IP packet or 0*/
+static inline uint16_t _decode_gtpu(gbw_probe_pkt_t *pkt,const uint8_t *base,uint32_t len,uint32_t *off){
+
+    const uint8_t *gtp = base+*off;
+    uint32_t hlen = 8;
+    uint8_t next;
+
+    if(*off+8>len){
+        pkt->flags |= GBW_PKT_F_TRUNC;
+        return 0;
+    }
+
+    /*version 1,GTP not GTP',T-PDU*/
+    if((gtp[0]&GTP_F_VERSION)!=0x20||!(gtp[0]&GTP_F_PT)||gtp[1]!=GTP_TPDU)
+        return 0;
+
+    pkt->tunnel_id = rd32(gtp+4);
+
+    if(gtp[0]&GTP_F_OPT){
+
+        hlen += 4;
+        if(*off+hlen>len)
+            goto trunc;
+
+        next = (gtp[0]&GTP_F_EXT)?gtp[hlen-1]:0;
+
+        /*extension headers,length in 4 byte units*/
+        while(next){
+
+            if(*off+hlen+1>len||base[*off+hlen] == 0)
+                goto trunc;
+
+            hlen += (uint32_t)base[*off+hlen]<<2;
+            if(*off+hlen>len)
+                goto trunc;
+
+            next = base[*off+hlen-1];
+        }
+    }
+
+    *off += hlen;
+
+    if(*off>=len)
+        return 0;
+
+    switch(base[*off]>>4){
+    case 4:
+        return RTE_ETHER_TYPE_IPV4;
+    case 6:
+        return RTE_ETHER_TYPE_IPV6;
+    default:
+        return 0;
+    }
+
+trunc:
+    pkt->flags |= GBW_PKT_F_TRUNC;
+    return 0;
+}
+
+static inline void _tunnel_enter(gbw_probe_pkt_t *pkt,uint8_t tunnel){
+
+    if(pkt->tunnel == GBW_PKT_TUN_NONE)
+        pkt->outer_l3_off = pkt->l3_off;
+
+    pkt->tunnel = tunnel;
+
+    /*the inner packet has its own l4 and fragments*/
+    pkt->flags &= (uint8_t)~(GBW_PKT_F_L4|GBW_PKT_F_FRAG|GBW_PKT_F_FRAG_NEXT);
+    pkt->sport = 0;
+    pkt->dport = 0;
+}
+
+static inline void _decode(gbw_probe_decode_ctx_t *ctx,struct rte_mbuf *m,uint8_t cls){
+
+    gbw_probe_pkt_t *pkt = gbw_probe_pkt(m);
+    const uint8_t *base = rte_pktmbuf_mtod(m,const uint8_t*);
+    uint32_t len = rte_pktmbuf_data_len(m);
+    uint32_t off = sizeof(struct rte_ether_hdr);
+    uint32_t l3_end = len;
+    uint16_t etype;
+    uint32_t tlen;
+    int proto;
+    int depth = 0;
+
+    memset(pkt,0,sizeof(*pkt));
+
+    if(len<sizeof(struct rte_ether_hdr)){
+        pkt->flags |= GBW_PKT_F_TRUNC;
+        ctx->trunc++;
+        return;
+    }
+
+    /*plain IPv4/IPv6 on untagged ethernet skip the L2 walk*/
+    if(cls == DECODE_CLS_IPV4){
+        etype = RTE_ETHER_TYPE_IPV4;
+        goto l3;
+    }
+
+    if(cls == DECODE_CLS_IPV6){
+        etype = RTE_ETHER_TYPE_IPV6;
+        goto l3;
+    }
+
+    etype = rd16(base+12);
+
+l2:
+    etype = _decode_l2(ctx,pkt,base,len,&off,etype);
+
+l3:
+    switch(etype){
+    case RTE_ETHER_TYPE_IPV4:
+        proto = _decode_ipv4(pkt,base,len,&off,&l3_end);
+        break;
+    case RTE_ETHER_TYPE_IPV6:
+        proto = _decode_ipv6(pkt,base,len,&off,&l3_end);
+        break;
+    case RTE_ETHER_TYPE_ARP:
+        pkt->l3_type = GBW_PKT_L3_ARP;
+        pkt->l3_off = (uint16_t)off;
+        goto done;
+    default:
+        goto done;
+    }
+
+    if(proto<0)
+        goto done;
+
+    pkt->proto = (uint8_t)proto;
+    pkt->l4_off = (uint16_t)off;
+    pkt->payload_off = (uint16_t)off;
+
+    if(pkt->flags&GBW_PKT_F_FRAG_NEXT)
+        goto done;
+
+    switch(proto){
+    case PROTO_TCP:
+        if(off+20>l3_end)
+            goto trunc;
+
+        tlen = (uint32_t)(base[off+12]>>4)<<2;
+        if(tlen<20){
+            pkt->flags |= GBW_PKT_F_BAD;
+            goto done;
+        }
+
+        pkt->sport = rd16(base+off);
+        pkt->dport = rd16(base+off+2);
+        pkt->flags |= GBW_PKT_F_L4;
+        pkt->payload_off = (uint16_t)(off+tlen);
+        break;
+
+    case PROTO_UDP:
+        if(off+8>l3_end)
+            goto trunc;
+
+        pkt->sport = rd16(base+off);
+        pkt->dport = rd16(base+off+2);
+        pkt->flags |= GBW_PKT_F_L4;
+        pkt->payload_off = (uint16_t)(off+8);
+
+        if(depth>=DECODE_MAX_TUNNELS||(pkt->flags&GBW_PKT_F_FRAG))
+            break;
+
+        if(pkt->dport == VXLAN_PORT){
+
+            off += 8;
+            if(off+8+sizeof(struct rte_ether_hdr)>len||!(base[off]&0x08))
+                break;
+
+            _tunnel_enter(pkt,GBW_PKT_TUN_VXLAN);
+            pkt->tunnel_id = rd32(base+off+4)>>8;
+            off += 8;
+            etype = rd16(base+off+12);
+            off += sizeof(struct rte_ether_hdr);
+            l3_end = len;
+            depth++;
+            goto l2;
+        }
+
+        if(pkt->dport == GTPU_PORT||pkt->sport == GTPU_PORT){
+
+            uint32_t goff = off+8;
+
+            etype = _decode_gtpu(pkt,base,len,&goff);
+            if(etype == 0)
+                break;
+
+            _tunnel_enter(pkt,GBW_PKT_TUN_GTPU);
+            off = goff;
+            l3_end = len;
+            depth++;
+            goto l3;
+        }
+        break;
+
+    case PROTO_SCTP:
+        if(off+12>l3_end)
+            goto trunc;
+
+        pkt->sport = rd16(base+off);
+        pkt->dport = rd16(base+off+2);
+        pkt->flags |= GBW_PKT_F_L4;
+        pkt->payload_off = (uint16_t)(off+12);
+        break;
+
+    case PROTO_ICMP:
+    case PROTO_ICMPV6:
+        if(off+4>l3_end)
+            goto trunc;
+
+        /*type and code stand in for the ports*/
+        pkt->sport = base[off];
+        pkt->dport = base[off+1];
+        pkt->flags |= GBW_PKT_F_L4;
+        pkt->payload_off = (uint16_t)(off+4);
+        break;
+
+    case PROTO_GRE:
+        if(depth>=DECODE_MAX_TUNNELS||(pkt->flags&GBW_PKT_F_FRAG))
+            break;
+
+        {
+            uint32_t goff = off;
+            uint32_t key;
+
+            etype = _decode_gre(pkt,base,len,&goff);
+            if(etype == 0)
+                break;
+
+            key = pkt->tunnel_id;
+            _tunnel_enter(pkt,GBW_PKT_TUN_GRE);
+            pkt->tunnel_id = key;
+            off = goff;
+            l3_end = len;
+            depth++;
+
+            if(etype == ETHER_TYPE_TEB){
+
+                if(off+sizeof(struct rte_ether_hdr)>len)
+                    goto trunc;
+
+                etype = rd16(base+off+12);
+                off += sizeof(struct rte_ether_hdr);
+                goto l2;
+            }
+
+            goto l3;
+        }
+
+    case PROTO_IPIP:
+    case PROTO_IPV6:
+        if(depth>=DECODE_MAX_TUNNELS||(pkt->flags&GBW_PKT_F_FRAG))
+            break;
+
+        _tunnel_enter(pkt,GBW_PKT_TUN_IPIP);
+        etype = proto == PROTO_IPIP?RTE_ETHER_TYPE_IPV4:RTE_ETHER_TYPE_IPV6;
+        l3_end = len;
+        depth++;
+        goto l3;
+
+    default:
+        break;
+    }
+
+    goto done;
+
+trunc:
+    pkt->flags |= GBW_PKT_F_TRUNC;
+
+done:
+    if(pkt->payload_off>l3_end)
+        pkt->payload_off = (uint16_t)l3_end;
+    if(pkt->l3_type == GBW_PKT_L3_IPV4||pkt->l3_type == GBW_PKT_L3_IPV6)
+        pkt->payload_len = (uint16_t)(l3_end-pkt->payload_off);
+
+    switch(pkt->l3_type){
+    case GBW_PKT_L3_IPV4:
+        ctx->ipv4++;
+        break;
+    case GBW_PKT_L3_IPV6:
+        ctx->ipv6++;
+        break;
+    case GBW_PKT_L3_ARP:
+        ctx->arp++;
+        break;
+    default:
+        ctx->other++;
+        break;
+    }
+
+    if(pkt->flags&GBW_PKT_F_L4){
+
+        if(pkt->proto == PROTO_TCP)
+            ctx->tcp++;
+        else if(pkt->proto == PROTO_UDP)
+            ctx->udp++;
+        else if(pkt->proto == PROTO_ICMP||pkt->proto == PROTO_ICMPV6)
+            ctx->icmp++;
+    }
+
+    if(pkt->flags&GBW_PKT_F_FRAG)
+        ctx->frags++;
+    if(pkt->tunnel)
+        ctx->tunnels[pkt->tunnel]++;
+    if(pkt->flags&GBW_PKT_F_TRUNC)
+        ctx->trunc++;
+    if(pkt->flags&GBW_PKT_F_BAD)
+        ctx->bad++;
+}
+
+void gbw_probe_decode(gbw_probe_decode_ctx_t *ctx,struct rte_mbuf *m){
+
+    _decode(ctx,m,DECODE_CLS_OTHER);
+}
+
+static uint16_t _decode_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_decode_ctx_t *ctx = (gbw_probe_decode_ctx_t*)_ctx;
+    uint8_t cls[GBW_PROBE_MAX_BURST];
+    uint16_t i;
+
+    /*packet data and the mbuf line holding the dynfield*/
+    for(i = 0;i<n&&i<DECODE_PREFETCH_AHEAD;i++){
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[i],void*));
+        rte_prefetch0(RTE_PTR_ADD(pkts[i],RTE_CACHE_LINE_SIZE));
+    }
+
+    _classify(pkts,n,cls);
+
+    for(i = 0;i<n;i++){
+
+        if(i+DECODE_PREFETCH_AHEAD<n){
+            rte_prefetch0(rte_pktmbuf_mtod(pkts[i+DECODE_PREFETCH_AHEAD],void*));
+            rte_prefetch0(RTE_PTR_ADD(pkts[i+DECODE_PREFETCH_AHEAD],RTE_CACHE_LINE_SIZE));
+        }
+
+        _decode(ctx,pkts[i],cls[i]);
+    }
+
+    return n;
+}
+
+static void *_decode_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    if(gbw_probe_pkt_dynfield_offset<0){
+
+        gbw_probe_pkt_dynfield_offset = rte_mbuf_dynfield_register(&pkt_dynfield_desc);
+        if(gbw_probe_pkt_dynfield_offset<0){
+            gbw_log(GBW_LOG_ERR,"Cannot register the decoded packet dynfield:%s",rte_strerror(rte_errno));
+            return NULL;
+        }
+    }
+
+    return rte_zmalloc_socket("gbw_probe_decode",sizeof(gbw_probe_decode_ctx_t),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+}
+
+static void _decode_fin(gbw_probe_worker_t *worker __rte_unused,void *ctx){
+
+    rte_free(ctx);
+}
+
+static void _decode_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_decode_ctx_t *ctx = (gbw_probe_decode_ctx_t*)_ctx;
+
+    fprintf(out,"    decode ipv4:%lu ipv6:%lu arp:%lu other:%lu tcp:%lu udp:%lu icmp:%lu\n",
+            (unsigned long)ctx->ipv4,(unsigned long)ctx->ipv6,(unsigned long)ctx->arp,
+            (unsigned long)ctx->other,(unsigned long)ctx->tcp,(unsigned long)ctx->udp,
+            (unsigned long)ctx->icmp);
+    fprintf(out,"    decode vlan:%lu mpls:%lu frags:%lu gre:%lu vxlan:%lu gtpu:%lu ipip:%lu trunc:%lu bad:%lu\n",
+            (unsigned long)ctx->vlan,(unsigned long)ctx->mpls,(unsigned long)ctx->frags,
+            (unsigned long)ctx->tunnels[GBW_PKT_TUN_GRE],(unsigned long)ctx->tunnels[GBW_PKT_TUN_VXLAN],
+            (unsigned long)ctx->tunnels[GBW_PKT_TUN_GTPU],(unsigned long)ctx->tunnels[GBW_PKT_TUN_IPIP],
+            (unsigned long)ctx->trunc,(unsigned long)ctx->bad);
+}
+
+const gbw_probe_stage_t gbw_probe_decode_stage = {
+    .name = "decode",
+    .init = _decode_init,
+    .process = _decode_process,
+    .fin = _decode_fin,
+    .dump = _decode_dump,
+    .priv = NULL,
+};
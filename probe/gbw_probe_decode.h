@@ -0,0 +1,131 @@
+/*
+ *
+ *      Filename: gbw_probe_decode.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: first worker stage,decodes L2-L4 once per packet into
+ *                a compact mbuf dynfield so later stages never re-parse
+ *
+ */
+
+#ifndef GBW_PROBE_DECODE_H
+#define GBW_PROBE_DECODE_H
+
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+
+#include "gbw_probe_engine.h"
+
+#define GBW_PKT_L3_NONE 0
+#define GBW_PKT_L3_IPV4 1
+#define GBW_PKT_L3_IPV6 2
+#define GBW_PKT_L3_ARP  3
+
+#define GBW_PKT_TUN_NONE  0
+#define GBW_PKT_TUN_GRE   1
+#define GBW_PKT_TUN_VXLAN 2
+#define GBW_PKT_TUN_GTPU  3
+#define GBW_PKT_TUN_IPIP  4
+
+#define GBW_PKT_F_VLAN      0x01
+#define GBW_PKT_F_MPLS      0x02
+/*l3 is a fragment,l4 fields are only set on the first one*/
+#define GBW_PKT_F_FRAG      0x04
+#define GBW_PKT_F_FRAG_NEXT 0x08
+/*sport/dport are valid:tcp,udp,sctp ports or icmp type/code*/
+#define GBW_PKT_F_L4        0x10
+/*a header is cut by the capture length*/
+#define GBW_PKT_F_TRUNC     0x20
+/*a header has impossible lengths or versions*/
+#define GBW_PKT_F_BAD       0x40
+/*reassembled from fragments,see gbw_probe_defrag.h*/
+#define GBW_PKT_F_DEFRAG    0x80
+
+/*
+ * Decoded packet,kept in an mbuf dynfield.
+ * Offsets are from the start of the mbuf data and describe the innermost
+ * decoded layers,the outer ones of a tunnel are found at outer_l3_off.
+ * Addresses are not copied,they are read in place through l3_off with
+ * the accessors below,so the field stays small enough for the dynfield
+ * area next to the pcap timestamp.
+ */
+typedef struct gbw_probe_pkt_t gbw_probe_pkt_t;
+
+struct gbw_probe_pkt_t {
+
+    uint16_t l3_off;
+    uint16_t l4_off;
+    uint16_t payload_off;
+    uint16_t payload_len;
+    uint16_t outer_l3_off;
+    uint16_t vlan_id;
+
+    /*host byte order*/
+    uint16_t sport;
+    uint16_t dport;
+
+    /*GRE key,VXLAN VNI or GTP-U TEID*/
+    uint32_t tunnel_id;
+
+    uint8_t l3_type;
+    uint8_t proto;
+    uint8_t tunnel;
+    uint8_t flags;
+};
+
+extern int gbw_probe_pkt_dynfield_offset;
+
+static inline gbw_probe_pkt_t * gbw_probe_pkt(struct rte_mbuf *m){
+
+    return RTE_MBUF_DYNFIELD(m,gbw_probe_pkt_dynfield_offset,gbw_probe_pkt_t*);
+}
+
+static inline const uint8_t * gbw_probe_pkt_l3(struct rte_mbuf *m,const gbw_probe_pkt_t *pkt){
+
+    return rte_pktmbuf_mtod_offset(m,const uint8_t*,pkt->l3_off);
+}
+
+/*4 bytes for ipv4,16 for ipv6,in network order*/
+static inline const uint8_t * gbw_probe_pkt_src_addr(struct rte_mbuf *m,const gbw_probe_pkt_t *pkt){
+
+    return gbw_probe_pkt_l3(m,pkt)+(pkt->l3_type == GBW_PKT_L3_IPV4?12:8);
+}
+
+static inline const uint8_t * gbw_probe_pkt_dst_addr(struct rte_mbuf *m,const gbw_probe_pkt_t *pkt){
+
+    return gbw_probe_pkt_l3(m,pkt)+(pkt->l3_type == GBW_PKT_L3_IPV4?16:24);
+}
+
+static inline const uint8_t * gbw_probe_pkt_payload(struct rte_mbuf *m,const gbw_probe_pkt_t *pkt){
+
+    return rte_pktmbuf_mtod_offset(m,const uint8_t*,pkt->payload_off);
+}
+
+typedef struct gbw_probe_decode_ctx_t gbw_probe_decode_ctx_t;
+
+struct gbw_probe_decode_ctx_t {
+
+    uint64_t ipv4;
+    uint64_t ipv6;
+    uint64_t arp;
+    uint64_t other;
+
+    uint64_t tcp;
+    uint64_t udp;
+    uint64_t icmp;
+
+    uint64_t vlan;
+    uint64_t mpls;
+    uint64_t frags;
+    uint64_t tunnels[GBW_PKT_TUN_IPIP+1];
+
+    uint64_t trunc;
+    uint64_t bad;
+};
+
+/*Decodes one packet,the stage runs it on whole bursts*/
+extern void gbw_probe_decode(gbw_probe_decode_ctx_t *ctx,struct rte_mbuf *m);
+
+extern const gbw_probe_stage_t gbw_probe_decode_stage;
+
+#endif /*GBW_PROBE_DECODE_H*/
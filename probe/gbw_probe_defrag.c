@@ -0,0 +1,249 @@
+/*
+ *
+ *      Filename: gbw_probe_defrag.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: IPv4/IPv6 fragment reassembly stage,runs between the
+ *                decode and the flow stages
+ *
+ */
+
+#include <string.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+#include <rte_ip.h>
+
+#include "gbw_probe_defrag.h"
+#include "gbw_log.h"
+
+/*rte_ip_frag buckets are searched linearly,a power of 2 entries each*/
+#define DEFRAG_BUCKET_ENTRIES 16
+#define DEFRAG_PREFETCH_OFFSET 3
+
+/*mbufs one reassembly call may put on the death row*/
+#define DEFRAG_DR_MAX_ADD (RTE_LIBRTE_IP_FRAG_MAX_FRAG+1)
+
+static inline void _dr_free(gbw_probe_defrag_ctx_t *ctx){
+
+    if(ctx->dr.cnt){
+
+        ctx->freed += ctx->dr.cnt;
+        rte_ip_frag_free_death_row(&ctx->dr,DEFRAG_PREFETCH_OFFSET);
+    }
+}
+
+/*
+ * Fills in what rte_ip_frag reads from the mbuf,returns -1 for fragments
+ * it cannot take: headers past the l2_len range or,for IPv6,a fragment
+ * header behind other extension headers.
+ */
+static inline int _frag_prepare(gbw_probe_defrag_ctx_t *ctx,struct rte_mbuf *m,gbw_probe_pkt_t *pkt,
+        struct rte_ipv6_fragment_ext **frag_hdr){
+
+    uint8_t *l3 = rte_pktmbuf_mtod_offset(m,uint8_t*,pkt->l3_off);
+    uint32_t tlen;
+
+    if(pkt->l3_off>=(1<<RTE_MBUF_L2_LEN_BITS))
+        return -1;
+
+    m->l2_len = pkt->l3_off;
+
+    if(pkt->l3_type == GBW_PKT_L3_IPV4){
+
+        m->l3_len = (uint64_t)(l3[0]&0x0f)<<2;
+        tlen = rte_be_to_cpu_16(((struct rte_ipv4_hdr*)l3)->total_length);
+        ctx->ipv4++;
+    }else{
+
+        *frag_hdr = rte_ipv6_frag_get_ipv6_fragment_header((struct rte_ipv6_hdr*)l3);
+        if(*frag_hdr == NULL)
+            return -1;
+
+        m->l3_len = sizeof(struct rte_ipv6_hdr)+sizeof(struct rte_ipv6_fragment_ext);
+        tlen = sizeof(struct rte_ipv6_hdr)+rte_be_to_cpu_16(((struct rte_ipv6_hdr*)l3)->payload_len);
+        ctx->ipv6++;
+    }
+
+    /*ethernet padding would be chained in as payload*/
+    if(rte_pktmbuf_pkt_len(m)>pkt->l3_off+tlen)
+        rte_pktmbuf_trim(m,(uint16_t)(rte_pktmbuf_pkt_len(m)-pkt->l3_off-tlen));
+
+    return 0;
+}
+
+/*Decodes a reassembled datagram again,its dynfield still holds the first fragment*/
+static inline void _reassembled(gbw_probe_defrag_ctx_t *ctx,struct rte_mbuf *m){
+
+    gbw_probe_pkt_t *pkt = gbw_probe_pkt(m);
+
+    ctx->reassembled++;
+
+    if(m->nb_segs>1&&rte_pktmbuf_linearize(m))
+        ctx->chained++;
+
+    gbw_probe_decode(&ctx->redecode,m);
+
+    /*decode stops at the first segment,the datagram goes on in the chain*/
+    pkt->flags |= GBW_PKT_F_DEFRAG;
+    if(pkt->l3_type!=GBW_PKT_L3_NONE&&rte_pktmbuf_pkt_len(m)>pkt->payload_off)
+        pkt->payload_len = (uint16_t)(rte_pktmbuf_pkt_len(m)-pkt->payload_off);
+}
+
+static uint16_t _defrag_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_defrag_ctx_t *ctx = (gbw_probe_defrag_ctx_t*)_ctx;
+    struct rte_ipv6_fragment_ext *frag_hdr = NULL;
+    gbw_probe_pkt_t *pkt;
+    struct rte_mbuf *m,*mo;
+    uint64_t tms = 0;
+    uint16_t i,j;
+
+    for(i = 0,j = 0;i<n;i++){
+
+        m = pkts[i];
+        pkt = gbw_probe_pkt(m);
+
+        if(!(pkt->flags&GBW_PKT_F_FRAG)){
+            pkts[j++] = m;
+            continue;
+        }
+
+        ctx->frags++;
+
+        /*
+         * an external buffer is the producer's shm ring,given back in ring
+         * order only: the table may hold a fragment for DefragTimeout and
+         * stall the ring behind it,so it keeps a copy instead
+         */
+        if(RTE_MBUF_HAS_EXTBUF(m)){
+
+            mo = rte_pktmbuf_copy(m,m->pool,0,UINT32_MAX);
+            if(mo == NULL){
+                ctx->no_copy++;
+                pkts[j++] = m;
+                continue;
+            }
+
+            rte_pktmbuf_free(m);
+            m = mo;
+            pkt = gbw_probe_pkt(m);
+            ctx->copied++;
+        }
+
+        if(_frag_prepare(ctx,m,pkt,&frag_hdr)){
+            ctx->unsupported++;
+            pkts[j++] = m;
+            continue;
+        }
+
+        if(tms == 0)
+            tms = rte_rdtsc();
+
+        if(ctx->dr.cnt+DEFRAG_DR_MAX_ADD>RTE_DIM(ctx->dr.row))
+            _dr_free(ctx);
+
+        if(pkt->l3_type == GBW_PKT_L3_IPV4)
+            mo = rte_ipv4_frag_reassemble_packet(ctx->tbl,&ctx->dr,m,tms,
+                    rte_pktmbuf_mtod_offset(m,struct rte_ipv4_hdr*,pkt->l3_off));
+        else
+            mo = rte_ipv6_frag_reassemble_packet(ctx->tbl,&ctx->dr,m,tms,
+                    rte_pktmbuf_mtod_offset(m,struct rte_ipv6_hdr*,pkt->l3_off),frag_hdr);
+
+        /*held until the datagram is complete,or dropped on the death row*/
+        if(mo == NULL)
+            continue;
+
+        _reassembled(ctx,mo);
+        pkts[j++] = mo;
+    }
+
+    _dr_free(ctx);
+
+    return j;
+}
+
+/*datagrams whose fragments stopped coming are only found on lookups,sweep them*/
+static void _defrag_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles __rte_unused){
+
+    gbw_probe_defrag_ctx_t *ctx = (gbw_probe_defrag_ctx_t*)_ctx;
+
+    rte_ip_frag_table_del_expired_entries(ctx->tbl,&ctx->dr,rte_rdtsc());
+    _dr_free(ctx);
+}
+
+static void *_defrag_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_defrag_ctx_t *ctx;
+    uint32_t max = pcfg->defrag_max;
+    uint32_t limit;
+
+    if(gbw_probe_stage_ctx(worker,"decode") == NULL){
+        gbw_log(GBW_LOG_ERR,"The defrag stage needs the decode stage registered before it");
+        return NULL;
+    }
+
+    /*fragments waiting in all workers may pin half of the packet pool at most*/
+    limit = pcfg->mbuf_num/2/RTE_LIBRTE_IP_FRAG_MAX_FRAG/worker->engine->nb_workers;
+    if(limit<DEFRAG_BUCKET_ENTRIES)
+        limit = DEFRAG_BUCKET_ENTRIES;
+
+    if(max>limit){
+        gbw_log(GBW_LOG_NOTICE,"DefragMaxDatagrams:%u would pin too many mbufs,worker:%u uses %u",
+                max,worker->id,limit);
+        max = limit;
+    }
+
+    ctx = (gbw_probe_defrag_ctx_t*)rte_zmalloc_socket("gbw_probe_defrag",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the defrag stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->max_cycles = (rte_get_tsc_hz()+999)/1000*pcfg->defrag_timeout;
+
+    ctx->tbl = rte_ip_frag_table_create((max+DEFRAG_BUCKET_ENTRIES-1)/DEFRAG_BUCKET_ENTRIES,
+            DEFRAG_BUCKET_ENTRIES,max,ctx->max_cycles,worker->socket_id);
+    if(ctx->tbl == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot create the fragment table of worker:%u",worker->id);
+        rte_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void _defrag_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_defrag_ctx_t *ctx = (gbw_probe_defrag_ctx_t*)_ctx;
+
+    _dr_free(ctx);
+
+    /*frees the mbufs of the datagrams still waiting*/
+    rte_ip_frag_table_destroy(ctx->tbl);
+    rte_free(ctx);
+}
+
+static void _defrag_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_defrag_ctx_t *ctx = (gbw_probe_defrag_ctx_t*)_ctx;
+
+    fprintf(out,"    defrag frags:%lu ipv4:%lu ipv6:%lu reassembled:%lu chained:%lu freed:%lu unsupported:%lu copied:%lu no_copy:%lu\n",
+            (unsigned long)ctx->frags,(unsigned long)ctx->ipv4,(unsigned long)ctx->ipv6,
+            (unsigned long)ctx->reassembled,(unsigned long)ctx->chained,(unsigned long)ctx->freed,
+            (unsigned long)ctx->unsupported,(unsigned long)ctx->copied,(unsigned long)ctx->no_copy);
+
+    rte_ip_frag_table_statistics_dump(out,ctx->tbl);
+}
+
+const gbw_probe_stage_t gbw_probe_defrag_stage = {
+    .name = "defrag",
+    .init = _defrag_init,
+    .process = _defrag_process,
+    .fin = _defrag_fin,
+    .timer = _defrag_timer,
+    .dump = _defrag_dump,
+    .priv = NULL,
+};
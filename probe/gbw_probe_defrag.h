@@ -0,0 +1,57 @@
+/*
+ *
+ *      Filename: gbw_probe_defrag.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: IPv4/IPv6 fragment reassembly stage,runs between the
+ *                decode and the flow stages
+ *
+ */
+
+#ifndef GBW_PROBE_DEFRAG_H
+#define GBW_PROBE_DEFRAG_H
+
+#include <rte_mbuf.h>
+#include <rte_ip_frag.h>
+
+#include "gbw_probe_engine.h"
+#include "gbw_probe_decode.h"
+
+typedef struct gbw_probe_defrag_ctx_t gbw_probe_defrag_ctx_t;
+
+/*
+ * Fragments are held in a fixed size rte_ip_frag table keyed by
+ * (src,dst,id,proto),so however many an attacker sends no more than
+ * max_entries datagrams of RTE_LIBRTE_IP_FRAG_MAX_FRAG mbufs each are
+ * pinned,the rest and the timed out ones go to the death row and are
+ * freed in bulk.
+ * A reassembled datagram leaves the stage in place of its last fragment,
+ * decoded again and flagged GBW_PKT_F_DEFRAG. It is a chain of mbufs when
+ * it does not fit in the first one,its payload past the first segment is
+ * read with rte_pktmbuf_read.
+ */
+struct gbw_probe_defrag_ctx_t {
+
+    struct rte_ip_frag_tbl *tbl;
+    struct rte_ip_frag_death_row dr;
+
+    /*tsc cycles a datagram may wait for its fragments*/
+    uint64_t max_cycles;
+
+    /*decode stats of the reassembled datagrams*/
+    gbw_probe_decode_ctx_t redecode;
+
+    uint64_t frags;
+    uint64_t ipv4;
+    uint64_t ipv6;
+    uint64_t reassembled;
+    uint64_t chained;
+    uint64_t freed;
+    uint64_t unsupported;
+    uint64_t copied;
+    uint64_t no_copy;
+};
+
+extern const gbw_probe_stage_t gbw_probe_defrag_stage;
+
+#endif /*GBW_PROBE_DEFRAG_H*/
@@ -0,0 +1,117 @@
+/*
+ *
+ *      Filename: gbw_probe_dist.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: software flow distribution from rx lcores to workers,
+ *                both directions of a flow go to the same worker
+ *
+ */
+
+#include <string.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_prefetch.h>
+
+#include "gbw_probe_dist.h"
+#include "gbw_jhash.h"
+
+#define DIST_PREFETCH_AHEAD 8
+#define DIST_MAX_VLANS 2
+
+static inline uint32_t _fold_ipv6(const uint8_t *addr){
+
+    uint32_t w[4];
+
+    memcpy(w,addr,sizeof(w));
+
+    return w[0]^w[1]^w[2]^w[3];
+}
+
+uint32_t gbw_probe_dist_hash(const struct rte_mbuf *m){
+
+    const uint8_t *p = rte_pktmbuf_mtod(m,const uint8_t*);
+    const uint8_t *end = p+rte_pktmbuf_data_len(m);
+    const struct rte_ipv4_hdr *ip4;
+    const struct rte_ipv6_hdr *ip6;
+    uint16_t etype;
+    int i;
+
+    if(p+sizeof(struct rte_ether_hdr)>end)
+        return 0;
+
+    etype = ((const struct rte_ether_hdr*)p)->ether_type;
+    p += sizeof(struct rte_ether_hdr);
+
+    for(i = 0;i<DIST_MAX_VLANS&&(etype == RTE_BE16(RTE_ETHER_TYPE_VLAN)||
+                etype == RTE_BE16(RTE_ETHER_TYPE_QINQ));i++){
+
+        if(p+sizeof(struct rte_vlan_hdr)>end)
+            return 0;
+
+        etype = ((const struct rte_vlan_hdr*)p)->eth_proto;
+        p += sizeof(struct rte_vlan_hdr);
+    }
+
+    if(etype == RTE_BE16(RTE_ETHER_TYPE_IPV4)){
+
+        ip4 = (const struct rte_ipv4_hdr*)p;
+        if(p+sizeof(*ip4)>end)
+            return 0;
+
+        return gbw_jhash_2words_sort(ip4->src_addr,ip4->dst_addr,0);
+    }
+
+    if(etype == RTE_BE16(RTE_ETHER_TYPE_IPV6)){
+
+        ip6 = (const struct rte_ipv6_hdr*)p;
+        if(p+sizeof(*ip6)>end)
+            return 0;
+
+        return gbw_jhash_2words_sort(_fold_ipv6(ip6->src_addr),_fold_ipv6(ip6->dst_addr),0);
+    }
+
+    return 0;
+}
+
+void gbw_probe_dist_burst(gbw_probe_rx_t *rx,struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_engine_t *engine = rx->engine;
+    uint16_t nb_workers = engine->nb_workers;
+    uint16_t counts[GBW_PROBE_MAX_WORKERS];
+    struct rte_mbuf **out;
+    struct rte_mbuf *m;
+    unsigned int sent;
+    uint16_t i,w;
+
+    memset(counts,0,sizeof(uint16_t)*nb_workers);
+
+    for(i = 0;i<n&&i<DIST_PREFETCH_AHEAD;i++)
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[i],void*));
+
+    for(i = 0;i<n;i++){
+
+        if(i+DIST_PREFETCH_AHEAD<n)
+            rte_prefetch0(rte_pktmbuf_mtod(pkts[i+DIST_PREFETCH_AHEAD],void*));
+
+        m = pkts[i];
+        m->hash.rss = gbw_probe_dist_hash(m);
+
+        w = (uint16_t)(((uint64_t)m->hash.rss*nb_workers)>>32);
+        rx->dist_bufs[w*GBW_PROBE_MAX_BURST+counts[w]++] = m;
+    }
+
+    for(w = 0;w<nb_workers;w++){
+
+        if(counts[w] == 0)
+            continue;
+
+        out = &rx->dist_bufs[w*GBW_PROBE_MAX_BURST];
+
+        sent = rte_ring_sp_enqueue_burst(engine->workers[w].rings[rx->queue_id],(void**)out,counts[w],NULL);
+        if(unlikely(sent<counts[w])){
+            rx->rx_drops += counts[w]-sent;
+            rte_pktmbuf_free_bulk(&out[sent],counts[w]-sent);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ *
+ *      Filename: gbw_probe_dist.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: software flow distribution from rx lcores to workers,
+ *                both directions of a flow go to the same worker
+ *
+ */
+
+#ifndef GBW_PROBE_DIST_H
+#define GBW_PROBE_DIST_H
+
+#include "gbw_probe_engine.h"
+
+/*
+ * Symmetric hash of the outer address pair,like the RSS of the port: the
+ * addresses are put in a fixed order before hashing,so swapping source
+ * and destination gives the same value. Ports are left out so fragments
+ * and the tunnels that vary their outer ports stay with the rest of their
+ * flow,non IP packets hash to 0.
+ */
+extern uint32_t gbw_probe_dist_hash(const struct rte_mbuf *m);
+
+/*
+ * Hashes a burst,keeps the hash in mbuf->hash.rss for the workers and
+ * enqueues the packets to the SPSC ring between this rx lcore and
+ * the worker of each hash,one enqueue per worker and burst.
+ */
+extern void gbw_probe_dist_burst(gbw_probe_rx_t *rx,struct rte_mbuf **pkts,uint16_t n);
+
+#endif /*GBW_PROBE_DIST_H*/
@@ -0,0 +1,494 @@
+/*
+ *
+ *      Filename: gbw_probe_dns.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: DNS stage,pairs the queries and responses of DNS flows,
+ *                over UDP and TCP,and logs them as msgpack records
+ *
+ */
+
+#include <string.h>
+#include <netinet/in.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+
+#include "gbw_probe_dns.h"
+#include "gbw_probe_decode.h"
+#include "gbw_probe_proto.h"
+#include "gbw_probe_export.h"
+#include "gbw_log.h"
+
+/*a length prefix and the largest message it can announce*/
+#define DNS_TCP_MSG_MAX (2+65535)
+
+static void _dns_flush(gbw_probe_dns_ctx_t *ctx){
+
+    msgpack_sbuffer *sb = &ctx->store->pk_buf;
+    unsigned int i;
+
+    if(sb->size == 0)
+        return;
+
+    if(ctx->nb_sinks == 0)
+        ctx->dropped += sb->size;
+
+    for(i = 0;i<ctx->nb_sinks;i++)
+        ctx->sink_fns[i](sb->data,sb->size,ctx->sink_privs[i]);
+
+    ctx->flushes++;
+    gbw_msgpack_store_reset(ctx->store);
+}
+
+static void _pack_answers(gbw_msgpack_store_t *st,const gbw_dns_msg_t *msg){
+
+    const gbw_dns_rr_t *rr;
+    uint16_t i;
+
+    gbw_msgpack_store_array_start(st,"an",msg->n_answers);
+
+    for(i = 0;i<msg->n_answers;i++){
+
+        rr = &msg->answers[i];
+
+        gbw_msgpack_store_array_start(st,NULL,3);
+        gbw_msgpack_store_write_uint16(st,NULL,rr->type);
+        gbw_msgpack_store_write_uint32(st,NULL,rr->ttl);
+
+        if(rr->name){
+            msgpack_pack_str(&st->pk,rr->name_len);
+            msgpack_pack_str_body(&st->pk,rr->name,rr->name_len);
+        }else if((rr->type == GBW_DNS_TYPE_A&&rr->rdlen == 4)||(rr->type == GBW_DNS_TYPE_AAAA&&rr->rdlen == 16)){
+            gbw_msgpack_store_write_bin(st,(void*)rr->rdata,rr->rdlen);
+        }else{
+            msgpack_pack_nil(&st->pk);
+        }
+    }
+}
+
+/*
+ * One record per transaction,a map with short keys. txn is the query,
+ * msg the response,either may be missing but not both.
+ */
+static void _dns_record(gbw_probe_dns_ctx_t *ctx,gbw_probe_flow_t *flow,int status,
+        const gbw_probe_dns_txn_t *txn,const gbw_dns_msg_t *msg,int resp_dir){
+
+    gbw_msgpack_store_t *st = ctx->store;
+    size_t n = 10;
+
+    if(msg)
+        n += msg->edns?5:3;
+    if(txn&&msg)
+        n++;
+
+    gbw_msgpack_store_map_start(st,NULL,n);
+
+    gbw_msgpack_store_write_kv(st,"t","dns");
+    gbw_msgpack_store_write_uint8(st,"st",(uint8_t)status);
+    gbw_msgpack_store_write_uint64(st,"ts",txn?txn->ts:flow->last_seen);
+    /*client is the end that sent the query*/
+    gbw_probe_export_pack_ends(st,flow,txn?txn->dir:!resp_dir);
+
+    if(msg){
+
+        gbw_msgpack_store_write_uint16(st,"id",msg->id);
+        gbw_msgpack_store_write_str_wlen(st,"qn",msg->qname,msg->qname_len);
+        gbw_msgpack_store_write_uint16(st,"qt",msg->qtype);
+        gbw_msgpack_store_write_uint16(st,"rc",msg->rcode);
+        gbw_msgpack_store_write_uint16(st,"fl",msg->flags);
+        _pack_answers(st,msg);
+
+        if(msg->edns){
+            gbw_msgpack_store_write_uint16(st,"eds",msg->edns_size);
+            gbw_msgpack_store_write_uint8(st,"edo",msg->edns_do);
+        }
+
+        if(txn)
+            gbw_msgpack_store_write_uint64(st,"rtt",flow->last_seen>txn->ts?flow->last_seen-txn->ts:0);
+    }else{
+
+        gbw_msgpack_store_write_uint16(st,"id",txn->id);
+        gbw_msgpack_store_write_str_wlen(st,"qn",txn->qname,txn->qname_len);
+        gbw_msgpack_store_write_uint16(st,"qt",txn->qtype);
+    }
+
+    ctx->records++;
+
+    if(st->pk_buf.size>=ctx->flush_size)
+        _dns_flush(ctx);
+}
+
+static void _dns_query(gbw_probe_dns_ctx_t *ctx,gbw_probe_flow_t *flow,gbw_probe_dns_flow_t *df,
+        const gbw_dns_msg_t *msg,int dir){
+
+    gbw_probe_dns_txn_t *txn = NULL,*t;
+    unsigned int i;
+
+    ctx->queries++;
+
+    for(i = 0;i<GBW_PROBE_DNS_TXNS;i++){
+
+        t = &df->txns[i];
+
+        if(!t->used){
+            if(txn == NULL||txn->used)
+                txn = t;
+            continue;
+        }
+
+        /*sent again,the first one times the response*/
+        if(t->id == msg->id&&t->qtype == msg->qtype&&t->dir == dir){
+            ctx->retrans++;
+            return;
+        }
+
+        if(txn == NULL||(txn->used&&t->ts<txn->ts))
+            txn = t;
+    }
+
+    if(txn->used){
+        ctx->unanswered++;
+        _dns_record(ctx,flow,GBW_DNS_REC_UNANSWERED,txn,NULL,0);
+    }
+
+    txn->used = 1;
+    txn->ts = flow->last_seen;
+    txn->id = msg->id;
+    txn->qtype = msg->qtype;
+    txn->dir = (uint8_t)dir;
+    txn->qname_len = msg->qname_len>GBW_PROBE_DNS_QNAME_KEEP?GBW_PROBE_DNS_QNAME_KEEP:(uint8_t)msg->qname_len;
+    memcpy(txn->qname,msg->qname,txn->qname_len);
+    txn->qname[txn->qname_len] = 0;
+}
+
+static void _dns_response(gbw_probe_dns_ctx_t *ctx,gbw_probe_flow_t *flow,gbw_probe_dns_flow_t *df,
+        const gbw_dns_msg_t *msg,int dir){
+
+    gbw_probe_dns_txn_t *txn;
+    unsigned int i;
+
+    ctx->responses++;
+
+    for(i = 0;i<GBW_PROBE_DNS_TXNS;i++){
+
+        txn = &df->txns[i];
+
+        if(txn->used&&txn->id == msg->id&&txn->dir!=dir&&txn->qtype == msg->qtype){
+
+            ctx->answered++;
+            _dns_record(ctx,flow,GBW_DNS_REC_ANSWERED,txn,msg,dir);
+            txn->used = 0;
+            return;
+        }
+    }
+
+    ctx->orphans++;
+    _dns_record(ctx,flow,GBW_DNS_REC_ORPHAN,NULL,msg,dir);
+}
+
+static void _dns_message(gbw_probe_dns_ctx_t *ctx,gbw_probe_flow_t *flow,int dir,
+        const uint8_t *data,uint32_t len){
+
+    gbw_dns_msg_t *msg = &ctx->msg;
+    gbw_probe_dns_flow_t *df;
+
+    ctx->msgs++;
+
+    if(gbw_dns_parse(msg,&ctx->sc,data,len)){
+        ctx->malformed++;
+        return;
+    }
+
+    df = (gbw_probe_dns_flow_t*)flow->dns;
+    if(df == NULL){
+
+        df = (gbw_probe_dns_flow_t*)gbw_object_pool_get(ctx->flows);
+        if(df == NULL){
+            ctx->no_mem++;
+            return;
+        }
+
+        memset(df,0,sizeof(*df));
+        flow->dns = df;
+    }
+
+    if(GBW_DNS_QR(msg->flags))
+        _dns_response(ctx,flow,df,msg,dir);
+    else
+        _dns_query(ctx,flow,df,msg,dir);
+}
+
+/*queries left unanswered go out when their flow ends*/
+static void _dns_flow_end(gbw_probe_flow_t *flow,void *priv){
+
+    gbw_probe_dns_ctx_t *ctx = (gbw_probe_dns_ctx_t*)priv;
+    gbw_probe_dns_flow_t *df = (gbw_probe_dns_flow_t*)flow->dns;
+    unsigned int i;
+
+    if(df == NULL)
+        return;
+
+    for(i = 0;i<GBW_PROBE_DNS_TXNS;i++){
+
+        if(df->txns[i].used){
+            ctx->unanswered++;
+            _dns_record(ctx,flow,GBW_DNS_REC_UNANSWERED,&df->txns[i],NULL,0);
+        }
+    }
+
+    gbw_object_pool_put(ctx->flows,df);
+    flow->dns = NULL;
+}
+
+static void _dns_tcp_data(gbw_probe_tcp_session_t *tsess,void **user,void *priv,int dir,
+        const uint8_t *data,uint32_t len){
+
+    gbw_probe_dns_ctx_t *ctx = (gbw_probe_dns_ctx_t*)priv;
+    gbw_probe_dns_tcp_t *dt = (gbw_probe_dns_tcp_t*)*user;
+    uint32_t mlen,n;
+    uint8_t *buf;
+
+    if(dt == NULL){
+
+        if(tsess->flow->app_proto!=GBW_PROTO_DNS){
+
+            if(tsess->flow->proto_done)
+                gbw_probe_tcp_detach(tsess,user);
+            return;
+        }
+
+        dt = (gbw_probe_dns_tcp_t*)gbw_pcalloc(tsess->mp,sizeof(*dt));
+        if(dt == NULL){
+            ctx->no_mem++;
+            return;
+        }
+
+        *user = dt;
+    }
+
+    if(dt->lost[dir])
+        return;
+
+    while(len){
+
+        /*whole messages are parsed in place*/
+        if(dt->have[dir] == 0&&len>=2){
+
+            mlen = ((uint32_t)data[0]<<8)|data[1];
+            if(len>=2+mlen){
+
+                ctx->tcp_msgs++;
+                _dns_message(ctx,tsess->flow,dir,data+2,mlen);
+                data += 2+mlen;
+                len -= 2+mlen;
+                continue;
+            }
+        }
+
+        buf = dt->buf[dir];
+        if(buf == NULL){
+
+            buf = (uint8_t*)gbw_palloc(tsess->mp,DNS_TCP_MSG_MAX);
+            if(buf == NULL){
+                ctx->no_mem++;
+                dt->lost[dir] = 1;
+                return;
+            }
+            dt->buf[dir] = buf;
+        }
+
+        if(dt->have[dir]<2)
+            mlen = 2-dt->have[dir];
+        else
+            mlen = 2+(((uint32_t)buf[0]<<8)|buf[1])-dt->have[dir];
+
+        n = len<mlen?len:mlen;
+        memcpy(buf+dt->have[dir],data,n);
+        dt->have[dir] += n;
+        data += n;
+        len -= n;
+
+        if(dt->have[dir]>=2&&dt->have[dir] == 2+(((uint32_t)buf[0]<<8)|buf[1])){
+
+            ctx->tcp_msgs++;
+            _dns_message(ctx,tsess->flow,dir,buf+2,dt->have[dir]-2);
+            dt->have[dir] = 0;
+        }
+    }
+}
+
+/*no way to find the next length prefix after lost bytes*/
+static void _dns_tcp_gap(gbw_probe_tcp_session_t *tsess __rte_unused,void **user,void *priv __rte_unused,
+        int dir,uint32_t len __rte_unused){
+
+    gbw_probe_dns_tcp_t *dt = (gbw_probe_dns_tcp_t*)*user;
+
+    if(dt)
+        dt->lost[dir] = 1;
+}
+
+static void _dns_tcp_close(gbw_probe_tcp_session_t *tsess __rte_unused,void **user,void *priv __rte_unused){
+
+    /*the buffers go back with the tcp session pool*/
+    *user = NULL;
+}
+
+static const gbw_probe_tcp_ops_t _dns_tcp_ops = {
+    .name = "dns",
+    .data = _dns_tcp_data,
+    .gap = _dns_tcp_gap,
+    .close = _dns_tcp_close,
+};
+
+int gbw_probe_dns_listen(gbw_probe_dns_ctx_t *ctx,gbw_probe_dns_sink_fn fn,void *priv){
+
+    if(ctx->nb_sinks>=GBW_PROBE_DNS_MAX_SINKS){
+        gbw_log(GBW_LOG_ERR,"Too many dns record sinks");
+        return -1;
+    }
+
+    ctx->sink_fns[ctx->nb_sinks] = fn;
+    ctx->sink_privs[ctx->nb_sinks] = priv;
+    ctx->nb_sinks++;
+
+    return 0;
+}
+
+static uint16_t _dns_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_dns_ctx_t *ctx = (gbw_probe_dns_ctx_t*)_ctx;
+    gbw_probe_pkt_flow_t *pf;
+    gbw_probe_flow_t *flow;
+    gbw_probe_pkt_t *pkt;
+    struct rte_mbuf *m;
+    const uint8_t *data;
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        m = pkts[i];
+        pkt = gbw_probe_pkt(m);
+
+        /*DNS over TCP comes through the tcp stage*/
+        if(pkt->proto!=IPPROTO_UDP||!(pkt->flags&GBW_PKT_F_L4)||pkt->payload_len == 0)
+            continue;
+
+        pf = gbw_probe_pkt_flow(m);
+        if(pf->entry == NULL)
+            continue;
+
+        flow = gbw_probe_flow(pf->entry);
+        if(flow->app_proto!=GBW_PROTO_DNS)
+            continue;
+
+        /*a reassembled datagram too big for one mbuf is gathered*/
+        data = (const uint8_t*)rte_pktmbuf_read(m,pkt->payload_off,pkt->payload_len,ctx->gather);
+        if(data == NULL)
+            continue;
+
+        if(m->nb_segs>1)
+            ctx->chained++;
+
+        _dns_message(ctx,flow,pf->dir,data,pkt->payload_len);
+    }
+
+    return n;
+}
+
+static void _dns_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles){
+
+    gbw_probe_dns_ctx_t *ctx = (gbw_probe_dns_ctx_t*)_ctx;
+
+    if(cycles-ctx->last_flush<ctx->flush_cycles)
+        return;
+
+    ctx->last_flush = cycles;
+    _dns_flush(ctx);
+}
+
+static void *_dns_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_flow_ctx_t *flow_ctx;
+    gbw_probe_tcp_ctx_t *tcp_ctx;
+    gbw_probe_dns_ctx_t *ctx;
+
+    flow_ctx = (gbw_probe_flow_ctx_t*)gbw_probe_stage_ctx(worker,"flow");
+    tcp_ctx = (gbw_probe_tcp_ctx_t*)gbw_probe_stage_ctx(worker,"tcp");
+    if(flow_ctx == NULL||tcp_ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"The dns stage needs the flow and tcp stages registered before it");
+        return NULL;
+    }
+
+    ctx = (gbw_probe_dns_ctx_t*)rte_zmalloc_socket("gbw_probe_dns",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the dns stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->flows = gbw_object_pool_create(worker->engine->mp,pcfg->flow_max,sizeof(gbw_probe_dns_flow_t),NULL,NULL);
+    ctx->store = gbw_msgpack_store_create(worker->engine->mp);
+    if(ctx->flows == NULL||ctx->store == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the dns stage of worker:%u",worker->id);
+        goto fail;
+    }
+
+    ctx->flush_size = (size_t)pcfg->dns_flush_size*1024;
+    ctx->flush_cycles = rte_get_timer_hz()/1000*pcfg->dns_flush_interval;
+    ctx->last_flush = rte_get_timer_cycles();
+
+    if(gbw_probe_flow_end_listen(flow_ctx,_dns_flow_end,ctx)||gbw_probe_tcp_listen(tcp_ctx,&_dns_tcp_ops,ctx))
+        goto fail;
+
+    return ctx;
+
+fail:
+    if(ctx->store)
+        gbw_msgpack_store_destroy(ctx->store);
+    if(ctx->flows)
+        gbw_object_pool_destroy(ctx->flows);
+    rte_free(ctx);
+    return NULL;
+}
+
+/*
+ * The flow stage ran its fin first and ended every flow,the unanswered
+ * queries are in the store.
+ */
+static void _dns_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_dns_ctx_t *ctx = (gbw_probe_dns_ctx_t*)_ctx;
+
+    _dns_flush(ctx);
+
+    gbw_msgpack_store_destroy(ctx->store);
+    gbw_object_pool_destroy(ctx->flows);
+    rte_free(ctx);
+}
+
+static void _dns_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_dns_ctx_t *ctx = (gbw_probe_dns_ctx_t*)_ctx;
+
+    fprintf(out,"    dns msgs:%lu tcp_msgs:%lu malformed:%lu queries:%lu retrans:%lu responses:%lu answered:%lu unanswered:%lu orphans:%lu no_mem:%lu chained:%lu\n",
+            (unsigned long)ctx->msgs,(unsigned long)ctx->tcp_msgs,(unsigned long)ctx->malformed,
+            (unsigned long)ctx->queries,(unsigned long)ctx->retrans,(unsigned long)ctx->responses,
+            (unsigned long)ctx->answered,(unsigned long)ctx->unanswered,(unsigned long)ctx->orphans,
+            (unsigned long)ctx->no_mem,(unsigned long)ctx->chained);
+
+    fprintf(out,"    dns records:%lu flushes:%lu dropped:%lu pending:%lu\n",
+            (unsigned long)ctx->records,(unsigned long)ctx->flushes,(unsigned long)ctx->dropped,
+            (unsigned long)ctx->store->pk_buf.size);
+}
+
+const gbw_probe_stage_t gbw_probe_dns_stage = {
+    .name = "dns",
+    .init = _dns_init,
+    .process = _dns_process,
+    .fin = _dns_fin,
+    .timer = _dns_timer,
+    .dump = _dns_dump,
+    .priv = NULL,
+};
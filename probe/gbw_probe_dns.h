@@ -0,0 +1,124 @@
+/*
+ *
+ *      Filename: gbw_probe_dns.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: DNS stage,pairs the queries and responses of DNS flows,
+ *                over UDP and TCP,and logs them as msgpack records
+ *
+ */
+
+#ifndef GBW_PROBE_DNS_H
+#define GBW_PROBE_DNS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_object_pool.h"
+#include "gbw_msgpack_store.h"
+#include "gbw_dns_parser.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+#include "gbw_probe_tcp.h"
+
+/*queries of a flow waiting for their responses,the oldest gives way*/
+#define GBW_PROBE_DNS_TXNS 4
+
+/*bytes of a query name kept,for queries never answered*/
+#define GBW_PROBE_DNS_QNAME_KEEP 63
+
+/*most record sinks,see gbw_probe_dns_listen*/
+#define GBW_PROBE_DNS_MAX_SINKS 4
+
+/*a reassembled datagram left as a chain is gathered here,payload_len is 16 bits*/
+#define GBW_PROBE_DNS_GATHER_SIZE 65536
+
+/*what a record stands for,its "st" field*/
+#define GBW_DNS_REC_ANSWERED   0
+#define GBW_DNS_REC_UNANSWERED 1
+#define GBW_DNS_REC_ORPHAN     2
+
+typedef struct gbw_probe_dns_txn_t gbw_probe_dns_txn_t;
+typedef struct gbw_probe_dns_flow_t gbw_probe_dns_flow_t;
+typedef struct gbw_probe_dns_tcp_t gbw_probe_dns_tcp_t;
+typedef struct gbw_probe_dns_ctx_t gbw_probe_dns_ctx_t;
+
+struct gbw_probe_dns_txn_t {
+
+    uint64_t ts;
+    uint16_t id;
+    uint16_t qtype;
+    uint8_t used;
+    uint8_t dir;
+    uint8_t qname_len;
+    char qname[GBW_PROBE_DNS_QNAME_KEEP+1];
+};
+
+/*Per flow transaction id table,from the worker's object pool*/
+struct gbw_probe_dns_flow_t {
+
+    gbw_probe_dns_txn_t txns[GBW_PROBE_DNS_TXNS];
+};
+
+/*
+ * DNS over TCP,the 2 bytes length framing of each direction. A message
+ * cut by the end of a chunk is gathered in buf,from the session pool.
+ */
+struct gbw_probe_dns_tcp_t {
+
+    uint8_t *buf[2];
+    uint32_t have[2];
+    uint8_t lost[2];
+};
+
+/*
+ * Gets the packed records,a run of msgpack maps,when the store fills up
+ * to DnsFlushSize or every DnsFlushInterval. data is only valid during
+ * the call.
+ */
+typedef void (*gbw_probe_dns_sink_fn)(const void *data,size_t len,void *priv);
+
+struct gbw_probe_dns_ctx_t {
+
+    gbw_object_pool_t *flows;
+
+    /*decoded message and its names,reused by every packet*/
+    gbw_dns_msg_t msg;
+    gbw_dns_scratch_t sc;
+
+    gbw_msgpack_store_t *store;
+    size_t flush_size;
+    uint64_t flush_cycles;
+    uint64_t last_flush;
+
+    unsigned int nb_sinks;
+    gbw_probe_dns_sink_fn sink_fns[GBW_PROBE_DNS_MAX_SINKS];
+    void *sink_privs[GBW_PROBE_DNS_MAX_SINKS];
+
+    uint64_t msgs;
+    uint64_t tcp_msgs;
+    uint64_t malformed;
+    uint64_t queries;
+    uint64_t retrans;
+    uint64_t responses;
+    uint64_t answered;
+    uint64_t unanswered;
+    uint64_t orphans;
+    uint64_t no_mem;
+    uint64_t chained;
+    uint64_t records;
+    uint64_t flushes;
+    uint64_t dropped;
+
+    uint8_t gather[GBW_PROBE_DNS_GATHER_SIZE];
+};
+
+/*
+ * Adds a record sink,from the init of a later stage,with the ctx found
+ * by gbw_probe_stage_ctx(worker,"dns"). Without sinks records are dropped.
+ */
+extern int gbw_probe_dns_listen(gbw_probe_dns_ctx_t *ctx,gbw_probe_dns_sink_fn fn,void *priv);
+
+extern const gbw_probe_stage_t gbw_probe_dns_stage;
+
+#endif /*GBW_PROBE_DNS_H*/
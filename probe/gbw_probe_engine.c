@@ -0,0 +1,619 @@
+/*
+ *
+ *      Filename: gbw_probe_engine.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: run to completion probe engine,rx lcores feed worker
+ *                lcores that push bursts of mbufs through the stages
+ *
+ */
+
+#include <string.h>
+#include <rte_eal.h>
+#include <rte_lcore.h>
+#include <rte_launch.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_prefetch.h>
+#include <rte_malloc.h>
+
+#include "gbw_probe_engine.h"
+#include "gbw_probe_dist.h"
+#include "gbw_log.h"
+
+#define PROBE_STATS_POLL_MS 100
+
+/*stage timers run about every millisecond on each worker*/
+#define PROBE_TIMER_HZ 1000
+
+/*RSS key giving the same queue for both directions of a flow*/
+static uint8_t sym_rss_key[40] = {
+    0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,
+    0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,
+    0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,
+    0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,0x6d,0x5a,
+};
+
+static int _port_setup(gbw_probe_engine_t *engine){
+
+    struct rte_eth_conf port_conf;
+    struct rte_eth_dev_info dev_info;
+    uint16_t port_id = engine->port_id;
+    uint16_t nb_rxd = (uint16_t)engine->pcfg->rx_desc;
+    uint16_t nb_txd = 0;
+    uint16_t q;
+    int rc;
+
+    if(!rte_eth_dev_is_valid_port(port_id)){
+        gbw_log(GBW_LOG_ERR,"Port:%u is not available",port_id);
+        return -1;
+    }
+
+    rc = rte_eth_dev_info_get(port_id,&dev_info);
+    if(rc!=0){
+        gbw_log(GBW_LOG_ERR,"Cannot get info of port:%u,rc:%d",port_id,rc);
+        return -1;
+    }
+
+    if(engine->nb_rx>dev_info.max_rx_queues){
+        gbw_log(GBW_LOG_ERR,"Port:%u has only %u rx queues,%u configured",
+                port_id,dev_info.max_rx_queues,engine->nb_rx);
+        return -1;
+    }
+
+    memset(&port_conf,0,sizeof(port_conf));
+
+    if(engine->nb_rx>1&&dev_info.flow_type_rss_offloads){
+
+        port_conf.rxmode.mq_mode = RTE_ETH_MQ_RX_RSS;
+        port_conf.rx_adv_conf.rss_conf.rss_key = sym_rss_key;
+        port_conf.rx_adv_conf.rss_conf.rss_key_len = sizeof(sym_rss_key);
+        port_conf.rx_adv_conf.rss_conf.rss_hf = RTE_ETH_RSS_IP&dev_info.flow_type_rss_offloads;
+    }
+
+    rc = rte_eth_dev_configure(port_id,engine->nb_rx,0,&port_conf);
+    if(rc!=0){
+        gbw_log(GBW_LOG_ERR,"Cannot configure port:%u,rc:%d",port_id,rc);
+        return -1;
+    }
+
+    rc = rte_eth_dev_adjust_nb_rx_tx_desc(port_id,&nb_rxd,&nb_txd);
+    if(rc!=0){
+        gbw_log(GBW_LOG_ERR,"Cannot adjust descriptors of port:%u,rc:%d",port_id,rc);
+        return -1;
+    }
+
+    for(q = 0;q<engine->nb_rx;q++){
+
+        rc = rte_eth_rx_queue_setup(port_id,q,nb_rxd,engine->socket_id,NULL,engine->pktmbuf_pool);
+        if(rc<0){
+            gbw_log(GBW_LOG_ERR,"Cannot setup rx queue:%u of port:%u,rc:%d",q,port_id,rc);
+            return -1;
+        }
+    }
+
+    rc = rte_eth_dev_start(port_id);
+    if(rc<0){
+        gbw_log(GBW_LOG_ERR,"Cannot start port:%u,rc:%d",port_id,rc);
+        return -1;
+    }
+
+    engine->port_started = 1;
+
+    /*virtual devices don't support it,not an error*/
+    rte_eth_promiscuous_enable(port_id);
+
+    return 0;
+}
+
+static int _lcores_assign(gbw_probe_engine_t *engine){
+
+    unsigned int lcore_id;
+    unsigned int n = 0;
+    unsigned int need = engine->nb_rx+engine->nb_workers;
+    gbw_probe_rx_t *rx;
+    gbw_probe_worker_t *worker;
+    char name[RTE_RING_NAMESIZE];
+    uint16_t r;
+
+    if(rte_lcore_count()<need+1){
+        gbw_log(GBW_LOG_ERR,"Need %u lcores:the main one,%u rx and %u workers,only %u given",
+                need+1,engine->nb_rx,engine->nb_workers,rte_lcore_count());
+        return -1;
+    }
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id){
+
+        if(n<engine->nb_rx){
+
+            rx = &engine->rxs[n];
+            rx->engine = engine;
+            rx->lcore_id = lcore_id;
+            rx->queue_id = (uint16_t)n;
+
+            rx->dist_bufs = rte_zmalloc_socket("gbw_probe_dist",
+                    sizeof(struct rte_mbuf*)*GBW_PROBE_MAX_BURST*engine->nb_workers,
+                    RTE_CACHE_LINE_SIZE,(int)rte_lcore_to_socket_id(lcore_id));
+            if(rx->dist_bufs == NULL){
+                gbw_log(GBW_LOG_ERR,"Cannot alloc distribution buffers of rx lcore:%u",lcore_id);
+                return -1;
+            }
+
+            if(rte_lcore_to_socket_id(lcore_id)!=(unsigned int)engine->socket_id)
+                gbw_log(GBW_LOG_WARN,"rx lcore:%u is not on the socket:%d of port:%u",
+                        lcore_id,engine->socket_id,engine->port_id);
+        }else if(n<need){
+
+            worker = &engine->workers[n-engine->nb_rx];
+            worker->engine = engine;
+            worker->lcore_id = lcore_id;
+            worker->id = (uint16_t)(n-engine->nb_rx);
+            worker->socket_id = (int)rte_lcore_to_socket_id(lcore_id);
+
+            for(r = 0;r<engine->nb_rx;r++){
+
+                snprintf(name,sizeof(name),"gbw_worker_ring_%u_%u",worker->id,r);
+                worker->rings[r] = rte_ring_create(name,engine->pcfg->worker_ring_size,worker->socket_id,
+                        RING_F_SP_ENQ|RING_F_SC_DEQ);
+                if(worker->rings[r] == NULL){
+                    gbw_log(GBW_LOG_ERR,"Cannot create the input ring of worker:%u from rx:%u",worker->id,r);
+                    return -1;
+                }
+            }
+        }else
+            break;
+
+        engine->last_lcore = lcore_id;
+        n++;
+    }
+
+    return 0;
+}
+
+gbw_probe_engine_t * gbw_probe_engine_create(gbw_pool_t *mp,gbw_probe_config_t *pcfg){
+
+    gbw_probe_engine_t *engine;
+    int rc;
+
+    if(pcfg->nb_rx_queues>GBW_PROBE_MAX_RX||pcfg->nb_workers>GBW_PROBE_MAX_WORKERS||
+            pcfg->burst_size>GBW_PROBE_MAX_BURST){
+        gbw_log(GBW_LOG_ERR,"At most %d rx queues,%d workers and burst size %d are supported",
+                GBW_PROBE_MAX_RX,GBW_PROBE_MAX_WORKERS,GBW_PROBE_MAX_BURST);
+        return NULL;
+    }
+
+    engine = (gbw_probe_engine_t*)gbw_pmemalign(mp,sizeof(*engine),RTE_CACHE_LINE_SIZE);
+    if(engine == NULL)
+        return NULL;
+
+    memset(engine,0,sizeof(*engine));
+
+    engine->mp = mp;
+    engine->pcfg = pcfg;
+    engine->port_id = (uint16_t)pcfg->port_id;
+    engine->nb_rx = (uint16_t)pcfg->nb_rx_queues;
+    engine->nb_workers = (uint16_t)pcfg->nb_workers;
+    engine->burst_size = (uint16_t)pcfg->burst_size;
+
+    rc = rte_eal_init(pcfg->eal_argc,pcfg->eal_argv);
+    if(rc<0){
+        gbw_log(GBW_LOG_ERR,"Cannot init EAL:%s",rte_strerror(rte_errno));
+        return NULL;
+    }
+
+    engine->eal_inited = 1;
+
+    engine->socket_id = rte_eth_dev_socket_id(engine->port_id);
+    if(engine->socket_id<0)
+        engine->socket_id = (int)rte_socket_id();
+
+    engine->pktmbuf_pool = rte_pktmbuf_pool_create("gbw_pktmbuf_pool",pcfg->mbuf_num,pcfg->mbuf_cache,
+            0,RTE_MBUF_DEFAULT_BUF_SIZE,engine->socket_id);
+
+    if(engine->pktmbuf_pool == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot create the mbuf pool:%s",rte_strerror(rte_errno));
+        goto fail;
+    }
+
+    if(_lcores_assign(engine))
+        goto fail;
+
+    if(_port_setup(engine))
+        goto fail;
+
+    return engine;
+
+fail:
+    gbw_probe_engine_destroy(engine);
+    return NULL;
+}
+
+int gbw_probe_stage_register(gbw_probe_engine_t *engine,const gbw_probe_stage_t *stage){
+
+    if(engine->nb_stages>=GBW_PROBE_MAX_STAGES||stage->process == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot register probe stage:%s",stage->name);
+        return -1;
+    }
+
+    engine->stages[engine->nb_stages++] = *stage;
+
+    return 0;
+}
+
+int gbw_probe_service_register(gbw_probe_engine_t *engine,const char *name,int (*fn)(void *arg),void *arg){
+
+    gbw_probe_service_t *service;
+    unsigned int lcore_id;
+
+    if(engine->nb_services>=GBW_PROBE_MAX_SERVICES){
+        gbw_log(GBW_LOG_ERR,"Cannot register probe service:%s",name);
+        return -1;
+    }
+
+    lcore_id = rte_get_next_lcore(engine->last_lcore,1,0);
+    if(lcore_id>=RTE_MAX_LCORE){
+        gbw_log(GBW_LOG_ERR,"No lcore left for probe service:%s",name);
+        return -1;
+    }
+
+    service = &engine->services[engine->nb_services++];
+    service->name = name;
+    service->lcore_id = lcore_id;
+    service->fn = fn;
+    service->arg = arg;
+
+    engine->last_lcore = lcore_id;
+
+    return 0;
+}
+
+void * gbw_probe_stage_ctx(gbw_probe_worker_t *worker,const char *name){
+
+    gbw_probe_engine_t *engine = worker->engine;
+    unsigned int s;
+
+    for(s = 0;s<engine->nb_stages;s++){
+
+        if(strcmp(engine->stages[s].name,name) == 0)
+            return worker->stage_ctx[s];
+    }
+
+    return NULL;
+}
+
+static int _stages_init(gbw_probe_engine_t *engine){
+
+    gbw_probe_worker_t *worker;
+    gbw_probe_stage_t *stage;
+    uint16_t w;
+    unsigned int s;
+
+    for(w = 0;w<engine->nb_workers;w++){
+
+        worker = &engine->workers[w];
+
+        for(s = 0;s<engine->nb_stages;s++){
+
+            stage = &engine->stages[s];
+            if(stage->init == NULL)
+                continue;
+
+            worker->stage_ctx[s] = stage->init(worker,stage->priv);
+            if(worker->stage_ctx[s] == NULL){
+                gbw_log(GBW_LOG_ERR,"Cannot init stage:%s of worker:%u",stage->name,w);
+                return -1;
+            }
+        }
+    }
+
+    engine->stages_inited = 1;
+
+    return 0;
+}
+
+static void _stages_fin(gbw_probe_engine_t *engine){
+
+    gbw_probe_worker_t *worker;
+    gbw_probe_stage_t *stage;
+    uint16_t w;
+    unsigned int s;
+
+    for(w = 0;w<engine->nb_workers;w++){
+
+        worker = &engine->workers[w];
+
+        for(s = 0;s<engine->nb_stages;s++){
+
+            stage = &engine->stages[s];
+            if(stage->fin&&worker->stage_ctx[s])
+                stage->fin(worker,worker->stage_ctx[s]);
+
+            worker->stage_ctx[s] = NULL;
+        }
+    }
+
+    engine->stages_inited = 0;
+}
+
+/*
+ * Packets are spread by a symmetric flow hash,so each flow and both of
+ * its directions belong to one worker and flow state needs no locks.
+ */
+static int _rx_loop(void *arg){
+
+    gbw_probe_rx_t *rx = (gbw_probe_rx_t*)arg;
+    gbw_probe_engine_t *engine = rx->engine;
+    struct rte_mbuf *pkts[GBW_PROBE_MAX_BURST];
+    uint16_t n,i;
+    uint64_t bytes;
+
+    gbw_log(GBW_LOG_INFO,"rx lcore:%u polls queue:%u",rx->lcore_id,rx->queue_id);
+
+    while(!engine->quit){
+
+        n = rte_eth_rx_burst(engine->port_id,rx->queue_id,pkts,engine->burst_size);
+        if(n == 0)
+            continue;
+
+        bytes = 0;
+        for(i = 0;i<n;i++)
+            bytes += rte_pktmbuf_pkt_len(pkts[i]);
+
+        rx->rx_pkts += n;
+        rx->rx_bytes += bytes;
+
+        gbw_probe_dist_burst(rx,pkts,n);
+    }
+
+    return 0;
+}
+
+static inline void _worker_process(gbw_probe_worker_t *worker,struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_engine_t *engine = worker->engine;
+    uint64_t t0 = rte_rdtsc(),t1;
+    unsigned int s;
+
+    for(s = 0;s<engine->nb_stages&&n;s++){
+
+        worker->stage_pkts[s] += n;
+        n = engine->stages[s].process(worker,worker->stage_ctx[s],pkts,n);
+
+        t1 = rte_rdtsc();
+        worker->stage_cycles[s] += t1-t0;
+        t0 = t1;
+    }
+
+    if(n)
+        rte_pktmbuf_free_bulk(pkts,n);
+}
+
+static inline void _worker_timers(gbw_probe_worker_t *worker,uint64_t cycles){
+
+    gbw_probe_engine_t *engine = worker->engine;
+    unsigned int s;
+
+    for(s = 0;s<engine->nb_stages;s++){
+
+        if(engine->stages[s].timer)
+            engine->stages[s].timer(worker,worker->stage_ctx[s],cycles);
+    }
+}
+
+static int _worker_loop(void *arg){
+
+    gbw_probe_worker_t *worker = (gbw_probe_worker_t*)arg;
+    gbw_probe_engine_t *engine = worker->engine;
+    struct rte_mbuf *pkts[GBW_PROBE_MAX_BURST];
+    uint16_t n,i;
+    uint16_t r = 0;
+    uint64_t bytes;
+    uint64_t now,next_timer = 0;
+
+    gbw_log(GBW_LOG_INFO,"worker lcore:%u runs worker:%u",worker->lcore_id,worker->id);
+
+    while(!engine->quit){
+
+        now = rte_get_timer_cycles();
+        if(now>=next_timer){
+            _worker_timers(worker,now);
+            next_timer = now+engine->timer_cycles;
+        }
+
+        n = (uint16_t)rte_ring_sc_dequeue_burst(worker->rings[r],(void**)pkts,engine->burst_size,NULL);
+        if(++r == engine->nb_rx)
+            r = 0;
+
+        if(n == 0)
+            continue;
+
+        bytes = 0;
+        for(i = 0;i<n;i++)
+            bytes += rte_pktmbuf_pkt_len(pkts[i]);
+
+        worker->pkts += n;
+        worker->bytes += bytes;
+        worker->bursts++;
+
+        _worker_process(worker,pkts,n);
+    }
+
+    return 0;
+}
+
+static int _launch_lcores(gbw_probe_engine_t *engine){
+
+    gbw_probe_service_t *service;
+    uint16_t i;
+
+    for(i = 0;i<engine->nb_services;i++){
+
+        service = &engine->services[i];
+        if(rte_eal_remote_launch(service->fn,service->arg,service->lcore_id)){
+            gbw_log(GBW_LOG_ERR,"Cannot launch probe service:%s",service->name);
+            return -1;
+        }
+    }
+
+    for(i = 0;i<engine->nb_workers;i++){
+
+        if(rte_eal_remote_launch(_worker_loop,&engine->workers[i],engine->workers[i].lcore_id)){
+            gbw_log(GBW_LOG_ERR,"Cannot launch worker:%u",i);
+            return -1;
+        }
+    }
+
+    for(i = 0;i<engine->nb_rx;i++){
+
+        if(rte_eal_remote_launch(_rx_loop,&engine->rxs[i],engine->rxs[i].lcore_id)){
+            gbw_log(GBW_LOG_ERR,"Cannot launch rx lcore of queue:%u",i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*mbufs still sitting in the worker rings once everybody stopped*/
+static void _rings_drain(gbw_probe_engine_t *engine){
+
+    struct rte_mbuf *pkts[GBW_PROBE_MAX_BURST];
+    struct rte_ring *ring;
+    uint16_t i,r;
+    unsigned int n;
+
+    for(i = 0;i<engine->nb_workers;i++){
+
+        for(r = 0;r<engine->nb_rx;r++){
+
+            ring = engine->workers[i].rings[r];
+            if(ring == NULL)
+                continue;
+
+            while((n = rte_ring_dequeue_burst(ring,(void**)pkts,GBW_PROBE_MAX_BURST,NULL))!=0)
+                rte_pktmbuf_free_bulk(pkts,n);
+        }
+    }
+}
+
+int gbw_probe_engine_run(gbw_probe_engine_t *engine){
+
+    uint64_t hz = rte_get_timer_hz();
+    uint64_t interval = (uint64_t)engine->pcfg->stats_interval*hz;
+    uint64_t last = rte_get_timer_cycles();
+    uint64_t now;
+    int rc = 0;
+
+    engine->timer_cycles = hz/PROBE_TIMER_HZ;
+
+    if(_stages_init(engine)){
+        _stages_fin(engine);
+        return -1;
+    }
+
+    if(_launch_lcores(engine)){
+        engine->quit = 1;
+        rc = -1;
+    }
+
+    while(!engine->quit){
+
+        rte_delay_ms(PROBE_STATS_POLL_MS);
+
+        now = rte_get_timer_cycles();
+        if(interval&&now-last>=interval){
+            gbw_probe_engine_stats_dump(engine,stdout);
+            last = now;
+        }
+    }
+
+    rte_eal_mp_wait_lcore();
+
+    _rings_drain(engine);
+    gbw_probe_engine_stats_dump(engine,stdout);
+    _stages_fin(engine);
+
+    return rc;
+}
+
+void gbw_probe_engine_destroy(gbw_probe_engine_t *engine){
+
+    uint16_t i,r;
+
+    if(engine->stages_inited)
+        _stages_fin(engine);
+
+    if(engine->port_started){
+
+        rte_eth_dev_stop(engine->port_id);
+        rte_eth_dev_close(engine->port_id);
+        engine->port_started = 0;
+    }
+
+    for(i = 0;i<engine->nb_workers;i++){
+
+        for(r = 0;r<engine->nb_rx;r++){
+            rte_ring_free(engine->workers[i].rings[r]);
+            engine->workers[i].rings[r] = NULL;
+        }
+    }
+
+    for(i = 0;i<engine->nb_rx;i++){
+        rte_free(engine->rxs[i].dist_bufs);
+        engine->rxs[i].dist_bufs = NULL;
+    }
+
+    if(engine->pktmbuf_pool){
+        rte_mempool_free(engine->pktmbuf_pool);
+        engine->pktmbuf_pool = NULL;
+    }
+
+    if(engine->eal_inited){
+        rte_eal_cleanup();
+        engine->eal_inited = 0;
+    }
+}
+
+void gbw_probe_engine_stats_dump(gbw_probe_engine_t *engine,FILE *out){
+
+    struct rte_eth_stats stats;
+    gbw_probe_rx_t *rx;
+    gbw_probe_worker_t *worker;
+    gbw_probe_stage_t *stage;
+    uint16_t i;
+    unsigned int s;
+
+    fprintf(out,"Dump probe engine stats:\n");
+
+    if(rte_eth_stats_get(engine->port_id,&stats) == 0)
+        fprintf(out,"port:%u ipackets:%lu ibytes:%lu imissed:%lu ierrors:%lu rx_nombuf:%lu\n",
+                engine->port_id,(unsigned long)stats.ipackets,(unsigned long)stats.ibytes,
+                (unsigned long)stats.imissed,(unsigned long)stats.ierrors,(unsigned long)stats.rx_nombuf);
+
+    for(i = 0;i<engine->nb_rx;i++){
+
+        rx = &engine->rxs[i];
+        fprintf(out,"rx[%u] lcore:%u pkts:%lu bytes:%lu drops:%lu\n",i,rx->lcore_id,
+                (unsigned long)rx->rx_pkts,(unsigned long)rx->rx_bytes,(unsigned long)rx->rx_drops);
+    }
+
+    for(i = 0;i<engine->nb_workers;i++){
+
+        worker = &engine->workers[i];
+        fprintf(out,"worker[%u] lcore:%u pkts:%lu bytes:%lu bursts:%lu\n",i,worker->lcore_id,
+                (unsigned long)worker->pkts,(unsigned long)worker->bytes,(unsigned long)worker->bursts);
+
+        fprintf(out,"    cycles/pkt");
+        for(s = 0;s<engine->nb_stages;s++)
+            fprintf(out," %s:%lu",engine->stages[s].name,(unsigned long)(worker->stage_pkts[s]?
+                        worker->stage_cycles[s]/worker->stage_pkts[s]:0));
+        fprintf(out,"\n");
+
+        for(s = 0;s<engine->nb_stages;s++){
+
+            stage = &engine->stages[s];
+            if(stage->dump&&worker->stage_ctx[s])
+                stage->dump(worker,worker->stage_ctx[s],out);
+        }
+    }
+}
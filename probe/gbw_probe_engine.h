@@ -0,0 +1,209 @@
+/*
+ *
+ *      Filename: gbw_probe_engine.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: run to completion probe engine,rx lcores feed worker
+ *                lcores that push bursts of mbufs through the stages
+ *
+ */
+
+#ifndef GBW_PROBE_ENGINE_H
+#define GBW_PROBE_ENGINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <rte_common.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+#include <rte_ring.h>
+#include <rte_mempool.h>
+
+#include "gbw_mpool.h"
+#include "gbw_probe_config.h"
+
+#define GBW_PROBE_MAX_RX 16
+#define GBW_PROBE_MAX_WORKERS 64
+#define GBW_PROBE_MAX_STAGES 16
+#define GBW_PROBE_MAX_SERVICES 4
+#define GBW_PROBE_MAX_BURST 256
+
+typedef struct gbw_probe_engine_t gbw_probe_engine_t;
+typedef struct gbw_probe_rx_t gbw_probe_rx_t;
+typedef struct gbw_probe_worker_t gbw_probe_worker_t;
+typedef struct gbw_probe_stage_t gbw_probe_stage_t;
+typedef struct gbw_probe_service_t gbw_probe_service_t;
+
+/*
+ * A worker stage,one burst at a time.
+ * init/fin run on the main lcore,once per worker,and own the per worker
+ * context handed to process.
+ * process may drop or keep mbufs by compacting pkts,those are its own to
+ * free,and returns how many go on to the next stage.
+ * Whatever is left after the last stage is freed by the worker.
+ * timer,if set,runs on the worker lcore between bursts about every
+ * millisecond with the current timer cycles,for time driven work such
+ * as flow expiry.
+ */
+struct gbw_probe_stage_t {
+
+    const char *name;
+
+    void *(*init)(gbw_probe_worker_t *worker,void *priv);
+    uint16_t (*process)(gbw_probe_worker_t *worker,void *ctx,struct rte_mbuf **pkts,uint16_t n);
+    void (*fin)(gbw_probe_worker_t *worker,void *ctx);
+    void (*timer)(gbw_probe_worker_t *worker,void *ctx,uint64_t cycles);
+    void (*dump)(gbw_probe_worker_t *worker,void *ctx,FILE *out);
+
+    void *priv;
+};
+
+/*
+ * A loop of its own on a spare lcore,next to the rx and worker ones,for
+ * work that must not hold a worker up such as I/O. fn runs until
+ * engine->quit,stages are still there when it starts and after it ends.
+ */
+struct gbw_probe_service_t {
+
+    const char *name;
+    unsigned int lcore_id;
+
+    int (*fn)(void *arg);
+    void *arg;
+};
+
+struct gbw_probe_rx_t {
+
+    gbw_probe_engine_t *engine;
+
+    unsigned int lcore_id;
+    uint16_t queue_id;
+
+    /*per worker staging of a burst,GBW_PROBE_MAX_BURST slots each*/
+    struct rte_mbuf **dist_bufs;
+
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    uint64_t rx_drops;
+
+}__rte_cache_aligned;
+
+struct gbw_probe_worker_t {
+
+    gbw_probe_engine_t *engine;
+
+    unsigned int lcore_id;
+    uint16_t id;
+    int socket_id;
+
+    /*one SPSC input ring per rx lcore*/
+    struct rte_ring *rings[GBW_PROBE_MAX_RX];
+
+    void *stage_ctx[GBW_PROBE_MAX_STAGES];
+
+    uint64_t pkts;
+    uint64_t bytes;
+    uint64_t bursts;
+
+    /*packets handed to each stage and the tsc cycles it took on them*/
+    uint64_t stage_pkts[GBW_PROBE_MAX_STAGES];
+    uint64_t stage_cycles[GBW_PROBE_MAX_STAGES];
+
+}__rte_cache_aligned;
+
+struct gbw_probe_engine_t {
+
+    gbw_pool_t *mp;
+    gbw_probe_config_t *pcfg;
+
+    uint16_t port_id;
+    int socket_id;
+
+    struct rte_mempool *pktmbuf_pool;
+
+    uint16_t nb_rx;
+    uint16_t nb_workers;
+    uint16_t burst_size;
+
+    /*timer cycles between two runs of the stage timers*/
+    uint64_t timer_cycles;
+
+    gbw_probe_rx_t rxs[GBW_PROBE_MAX_RX];
+    gbw_probe_worker_t workers[GBW_PROBE_MAX_WORKERS];
+
+    unsigned int nb_stages;
+    gbw_probe_stage_t stages[GBW_PROBE_MAX_STAGES];
+
+    /*last lcore taken,services get the ones after it*/
+    unsigned int last_lcore;
+    unsigned int nb_services;
+    gbw_probe_service_t services[GBW_PROBE_MAX_SERVICES];
+
+    volatile int quit;
+    unsigned int eal_inited:1;
+    unsigned int port_started:1;
+    unsigned int stages_inited:1;
+};
+
+/*
+ * Initializes EAL with pcfg->eal_argv,the packet pool and the port,
+ * and assigns lcores: RxQueues rx lcores then Workers worker lcores.
+ * Returns NULL if anything is missing,already set up parts are released.
+ */
+extern gbw_probe_engine_t * gbw_probe_engine_create(gbw_pool_t *mp,gbw_probe_config_t *pcfg);
+
+/*Appends a stage to the worker pipeline,before the engine runs*/
+extern int gbw_probe_stage_register(gbw_probe_engine_t *engine,const gbw_probe_stage_t *stage);
+
+/*
+ * Takes the next free lcore for a service,before the engine runs.
+ * Fails if EAL was given no lcore left over.
+ */
+extern int gbw_probe_service_register(gbw_probe_engine_t *engine,const char *name,int (*fn)(void *arg),void *arg);
+
+/*
+ * Context of the worker's stage called name,NULL if there is none or it
+ * is not initialized yet. Stages are initialized in register order,so a
+ * stage finds the ones registered before it from its init.
+ */
+extern void * gbw_probe_stage_ctx(gbw_probe_worker_t *worker,const char *name);
+
+/*
+ * Launches all rx and worker lcores and dumps stats from the main lcore
+ * until gbw_probe_engine_stop is called,returns once all lcores are back.
+ */
+extern int gbw_probe_engine_run(gbw_probe_engine_t *engine);
+
+/*Async signal safe*/
+static inline void gbw_probe_engine_stop(gbw_probe_engine_t *engine){
+
+    engine->quit = 1;
+}
+
+extern void gbw_probe_engine_destroy(gbw_probe_engine_t *engine);
+
+extern void gbw_probe_engine_stats_dump(gbw_probe_engine_t *engine,FILE *out);
+
+/*
+ * Capture time of the pcap port in usecs,ts_offset being the rx
+ * timestamp dynfield or -1,otherwise the wall clock read once per burst
+ * into now,0 before the first packet of the burst.
+ */
+static inline uint64_t gbw_probe_pkt_time(int ts_offset,uint64_t ts_flag,struct rte_mbuf *m,uint64_t *now){
+
+    struct timespec ts;
+
+    if(ts_offset>=0&&(m->ol_flags&ts_flag))
+        return *RTE_MBUF_DYNFIELD(m,ts_offset,rte_mbuf_timestamp_t*);
+
+    if(*now == 0){
+        clock_gettime(CLOCK_REALTIME,&ts);
+        *now = (uint64_t)ts.tv_sec*1000000+(uint64_t)ts.tv_nsec/1000;
+    }
+
+    return *now;
+}
+
+#endif /*GBW_PROBE_ENGINE_H*/
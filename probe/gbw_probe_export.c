@@ -0,0 +1,624 @@
+/*
+ *
+ *      Filename: gbw_probe_export.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: record export,workers pack msgpack records into batches
+ *                a writer lcore turns into length prefixed frames on
+ *                rotated files or a unix socket
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+
+#include "gbw_probe_export.h"
+#include "gbw_probe_flow.h"
+#include "gbw_probe_proto.h"
+#include "gbw_probe_dns.h"
+#include "gbw_probe_http.h"
+#include "gbw_probe_tls.h"
+#include "gbw_probe_sketch.h"
+#include "gbw_log.h"
+
+#define EXPORT_WRITER_BURST 32
+
+/*
+ * Output,writer side. A file is written as name.part and renamed once
+ * rotated or closed,so readers only ever see whole files.
+ */
+static int _output_open(gbw_probe_export_t *exp){
+
+    struct sockaddr_un addr;
+    char part[sizeof(exp->file_path)+8];
+    int n;
+
+    if(exp->dir){
+
+        n = snprintf(exp->file_path,sizeof(exp->file_path),"%s/gbw_export_%lu_%u.mpk",
+                exp->dir,(unsigned long)time(NULL),exp->file_seq++);
+        if(n<0||(size_t)n>=sizeof(exp->file_path))
+            return -1;
+
+        snprintf(part,sizeof(part),"%s.part",exp->file_path);
+
+        exp->fd = open(part,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+        if(exp->fd<0){
+            gbw_log(GBW_LOG_ERR,"Cannot open export file:%s:%s",part,strerror(errno));
+            return -1;
+        }
+
+        exp->file_bytes = 0;
+        exp->files++;
+
+        return 0;
+    }
+
+    /*a consumer that went away is tried again about every second*/
+    if(rte_get_timer_cycles()<exp->retry_at)
+        return -1;
+
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path,exp->unix_path,sizeof(addr.sun_path)-1);
+
+    exp->fd = socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if(exp->fd<0||connect(exp->fd,(struct sockaddr*)&addr,sizeof(addr))){
+
+        if(exp->fd>=0)
+            close(exp->fd);
+        exp->fd = -1;
+        exp->retry_at = rte_get_timer_cycles()+rte_get_timer_hz();
+        return -1;
+    }
+
+    return 0;
+}
+
+static void _output_close(gbw_probe_export_t *exp){
+
+    char part[sizeof(exp->file_path)+8];
+
+    if(exp->fd<0)
+        return;
+
+    close(exp->fd);
+    exp->fd = -1;
+
+    if(exp->dir){
+
+        snprintf(part,sizeof(part),"%s.part",exp->file_path);
+        if(rename(part,exp->file_path))
+            gbw_log(GBW_LOG_ERR,"Cannot rename export file:%s:%s",part,strerror(errno));
+    }
+}
+
+static int _output_write(gbw_probe_export_t *exp,struct iovec *iov,int iovcnt){
+
+    struct msghdr msg;
+    ssize_t n;
+
+    while(iovcnt){
+
+        if(exp->dir){
+            n = writev(exp->fd,iov,iovcnt);
+        }else{
+            /*no SIGPIPE from a consumer gone*/
+            memset(&msg,0,sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = (size_t)iovcnt;
+            n = sendmsg(exp->fd,&msg,MSG_NOSIGNAL);
+        }
+
+        if(n<0){
+
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while(iovcnt&&(size_t)n>=iov->iov_len){
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if(iovcnt){
+            iov->iov_base = (char*)iov->iov_base+n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+
+    return 0;
+}
+
+static void _frame_write(gbw_probe_export_t *exp,gbw_probe_export_batch_t *b){
+
+    uint8_t hdr[GBW_PROBE_EXPORT_FRAME_HDR];
+    struct iovec iov[2];
+    uint64_t size = GBW_PROBE_EXPORT_FRAME_HDR+b->len;
+
+    if(exp->dir&&exp->fd>=0&&exp->file_bytes&&exp->file_bytes+size>exp->file_size)
+        _output_close(exp);
+
+    if(exp->fd<0&&_output_open(exp)){
+        exp->lost_frames++;
+        return;
+    }
+
+    hdr[0] = (uint8_t)(b->len>>24);
+    hdr[1] = (uint8_t)(b->len>>16);
+    hdr[2] = (uint8_t)(b->len>>8);
+    hdr[3] = (uint8_t)b->len;
+
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = b->data;
+    iov[1].iov_len = b->len;
+
+    if(_output_write(exp,iov,2)){
+
+        gbw_log(GBW_LOG_ERR,"Cannot write export frame:%s",strerror(errno));
+        exp->errors++;
+        exp->lost_frames++;
+        _output_close(exp);
+        return;
+    }
+
+    exp->file_bytes += size;
+    exp->frames++;
+    exp->bytes += size;
+}
+
+/*Writes the batches handed over so far,returns how many*/
+static unsigned int _writer_drain(gbw_probe_export_t *exp){
+
+    gbw_probe_export_batch_t *batches[EXPORT_WRITER_BURST];
+    unsigned int n,i,total = 0;
+
+    while((n = rte_ring_sc_dequeue_burst(exp->ring,(void**)batches,EXPORT_WRITER_BURST,NULL))!=0){
+
+        for(i = 0;i<n;i++){
+
+            _frame_write(exp,batches[i]);
+
+            batches[i]->len = 0;
+            __atomic_store_n(&batches[i]->busy,0,__ATOMIC_RELEASE);
+        }
+
+        total += n;
+    }
+
+    return total;
+}
+
+static int _writer_loop(void *arg){
+
+    gbw_probe_export_t *exp = (gbw_probe_export_t*)arg;
+    gbw_probe_engine_t *engine = exp->engine;
+
+    gbw_log(GBW_LOG_INFO,"export writer runs to %s",exp->dir?exp->dir:exp->unix_path);
+
+    while(!engine->quit){
+
+        if(_writer_drain(exp) == 0)
+            rte_pause();
+    }
+
+    return 0;
+}
+
+/*Batching,worker side*/
+
+static inline int _batch_busy(const gbw_probe_export_batch_t *b){
+
+    return __atomic_load_n(&b->busy,__ATOMIC_ACQUIRE)!=0;
+}
+
+/*
+ * Hands the batch being filled to the writer and moves to the other one,
+ * which is still the writer's when it falls behind,records are dropped
+ * until it comes back rather than the worker waiting.
+ */
+static void _batch_handoff(gbw_probe_export_ctx_t *ctx){
+
+    gbw_probe_export_batch_t *b = &ctx->batches[ctx->cur];
+
+    /*still the writer's,it was handed over already*/
+    if(b->len == 0||_batch_busy(b))
+        return;
+
+    b->busy = 1;
+
+    /*can't be full,it has room for every batch*/
+    if(rte_ring_mp_enqueue(ctx->exp->ring,b)){
+        ctx->dropped_bytes += b->len;
+        b->len = 0;
+        b->busy = 0;
+        return;
+    }
+
+    ctx->batches_sent++;
+    ctx->cur = (ctx->cur+1)%GBW_PROBE_EXPORT_BATCHES;
+}
+
+void gbw_probe_export_append(gbw_probe_export_ctx_t *ctx,const void *data,size_t len){
+
+    gbw_probe_export_batch_t *b = &ctx->batches[ctx->cur];
+
+    if(len>ctx->exp->batch_size)
+        goto drop;
+
+    if(_batch_busy(b))
+        goto drop;
+
+    if(b->len+len>ctx->exp->batch_size){
+
+        _batch_handoff(ctx);
+
+        b = &ctx->batches[ctx->cur];
+        if(_batch_busy(b))
+            goto drop;
+    }
+
+    memcpy(b->data+b->len,data,len);
+    b->len += (uint32_t)len;
+
+    return;
+
+drop:
+    ctx->dropped++;
+    ctx->dropped_bytes += len;
+}
+
+void gbw_probe_export_end(gbw_probe_export_ctx_t *ctx){
+
+    msgpack_sbuffer *sb = &ctx->store->pk_buf;
+
+    ctx->records++;
+    gbw_probe_export_append(ctx,sb->data,sb->size);
+}
+
+/*Records,the end that sent the first packet of the flow is the client*/
+
+static void _flow_record(gbw_probe_flow_t *flow,void *priv){
+
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)priv;
+    gbw_msgpack_store_t *st = gbw_probe_export_begin(ctx);
+
+    gbw_msgpack_store_map_start(st,NULL,11);
+
+    gbw_msgpack_store_write_kv(st,"t","flow");
+    gbw_msgpack_store_write_uint64(st,"ts",flow->first_seen);
+    gbw_msgpack_store_write_uint64(st,"te",flow->last_seen);
+    gbw_probe_export_pack_ends(st,flow,GBW_FLOW_DIR_ORIG);
+    gbw_msgpack_store_write_uint8(st,"pr",gbw_flow_entry_of(flow)->key.proto);
+    gbw_msgpack_store_write_kv(st,"ap",gbw_probe_proto_name(flow->app_proto));
+
+    gbw_msgpack_store_array_start(st,"pk",2);
+    gbw_msgpack_store_write_uint64(st,NULL,flow->pkts[GBW_FLOW_DIR_ORIG]);
+    gbw_msgpack_store_write_uint64(st,NULL,flow->pkts[GBW_FLOW_DIR_REPLY]);
+
+    gbw_msgpack_store_array_start(st,"by",2);
+    gbw_msgpack_store_write_uint64(st,NULL,flow->bytes[GBW_FLOW_DIR_ORIG]);
+    gbw_msgpack_store_write_uint64(st,NULL,flow->bytes[GBW_FLOW_DIR_REPLY]);
+
+    gbw_probe_export_end(ctx);
+}
+
+static void _http_record(gbw_probe_flow_t *flow,const gbw_probe_http_txn_t *txn,void *priv){
+
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)priv;
+    gbw_msgpack_store_t *st = gbw_probe_export_begin(ctx);
+
+    gbw_msgpack_store_map_start(st,NULL,14);
+
+    gbw_msgpack_store_write_kv(st,"t","http");
+    gbw_msgpack_store_write_uint64(st,"ts",flow->last_seen);
+    gbw_probe_export_pack_ends(st,flow,GBW_FLOW_DIR_ORIG);
+    gbw_msgpack_store_write_kv(st,"me",txn->method);
+    gbw_msgpack_store_write_kv(st,"ho",txn->host);
+    gbw_msgpack_store_write_kv(st,"ur",txn->uri);
+    gbw_msgpack_store_write_kv(st,"ua",txn->user_agent);
+    gbw_msgpack_store_write_kv(st,"ct",txn->content_type);
+    gbw_msgpack_store_write_uint16(st,"sc",(uint16_t)txn->status);
+    gbw_msgpack_store_write_uint64(st,"rqb",txn->req_body);
+    gbw_msgpack_store_write_uint64(st,"rsb",txn->resp_body);
+
+    gbw_probe_export_end(ctx);
+}
+
+static void _pack_hello(gbw_msgpack_store_t *st,const char *k,const gbw_tls_hello_t *hello){
+
+    if(hello == NULL){
+        gbw_msgpack_store_write_str(st,k);
+        msgpack_pack_nil(&st->pk);
+        return;
+    }
+
+    gbw_msgpack_store_map_start(st,k,hello->type == GBW_TLS_CLIENT_HELLO?5:6);
+
+    gbw_msgpack_store_write_uint16(st,"v",hello->version);
+    gbw_msgpack_store_write_str_wlen(st,"alpn",hello->alpn,hello->alpn_len);
+    gbw_msgpack_store_write_kv(st,"ja3",hello->ja3);
+    gbw_msgpack_store_write_kv(st,"ja4",hello->ja4);
+
+    if(hello->type == GBW_TLS_CLIENT_HELLO){
+        gbw_msgpack_store_write_str_wlen(st,"sni",hello->sni,hello->sni_len);
+    }else{
+        gbw_msgpack_store_write_uint16(st,"cs",hello->ciphers[0]);
+        gbw_msgpack_store_write_uint16(st,"lv",hello->legacy_version);
+    }
+}
+
+static void _tls_record(gbw_probe_flow_t *flow,const gbw_tls_hello_t *client,
+        const gbw_tls_hello_t *server,void *priv){
+
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)priv;
+    gbw_msgpack_store_t *st = gbw_probe_export_begin(ctx);
+
+    gbw_msgpack_store_map_start(st,NULL,8);
+
+    gbw_msgpack_store_write_kv(st,"t","tls");
+    gbw_msgpack_store_write_uint64(st,"ts",flow->last_seen);
+    gbw_probe_export_pack_ends(st,flow,GBW_FLOW_DIR_ORIG);
+    _pack_hello(st,"c",client);
+    _pack_hello(st,"s",server);
+
+    gbw_probe_export_end(ctx);
+}
+
+/*
+ * A worker's distinct counters of the interval it just left,mergeable
+ * with those of the other workers and intervals downstream.
+ */
+static void _card_record(const gbw_probe_sketch_set_t *set,uint32_t epoch,void *priv){
+
+    static const char *keys[GBW_PROBE_SKETCH_CARDS] = {"src","dst","fl"};
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)priv;
+    gbw_msgpack_store_t *st;
+    struct timespec ts;
+    size_t offs[GBW_PROBE_SKETCH_CARDS+1];
+    int d;
+
+    GBW_DOUT_RESET(&ctx->dout);
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++){
+
+        offs[d] = GBW_DOUT_CONTENT_SIZE(&ctx->dout);
+        if(gbw_hll_serialize(set->hll[d],&ctx->dout)<0){
+            ctx->dropped++;
+            return;
+        }
+    }
+
+    offs[d] = GBW_DOUT_CONTENT_SIZE(&ctx->dout);
+
+    clock_gettime(CLOCK_REALTIME,&ts);
+
+    st = gbw_probe_export_begin(ctx);
+
+    gbw_msgpack_store_map_start(st,NULL,6+GBW_PROBE_SKETCH_CARDS);
+
+    gbw_msgpack_store_write_kv(st,"t","card");
+    gbw_msgpack_store_write_uint64(st,"ts",(uint64_t)ts.tv_sec*1000000+(uint64_t)ts.tv_nsec/1000);
+    gbw_msgpack_store_write_uint32(st,"ep",epoch);
+    gbw_msgpack_store_write_uint64(st,"pk",set->pkts);
+    gbw_msgpack_store_write_uint64(st,"by",set->bytes);
+    gbw_msgpack_store_write_uint8(st,"hp",set->hll[0]->p);
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++)
+        gbw_msgpack_store_write_bin_kv(st,keys[d],GBW_DOUT_CONTENT(&ctx->dout)+offs[d],offs[d+1]-offs[d]);
+
+    gbw_probe_export_end(ctx);
+}
+
+/*dns packs its own records,a flush of them goes into one batch*/
+static void _dns_records(const void *data,size_t len,void *priv){
+
+    gbw_probe_export_append((gbw_probe_export_ctx_t*)priv,data,len);
+}
+
+/*the work is done from the other stages' callbacks*/
+static uint16_t _export_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx __rte_unused,
+        struct rte_mbuf **pkts __rte_unused,uint16_t n){
+
+    return n;
+}
+
+static int _listen(gbw_probe_worker_t *worker,gbw_probe_export_ctx_t *ctx){
+
+    void *stage_ctx;
+    int rc = 0;
+
+    if((stage_ctx = gbw_probe_stage_ctx(worker,"flow"))!=NULL)
+        rc |= gbw_probe_flow_end_listen((gbw_probe_flow_ctx_t*)stage_ctx,_flow_record,ctx);
+
+    if((stage_ctx = gbw_probe_stage_ctx(worker,"dns"))!=NULL)
+        rc |= gbw_probe_dns_listen((gbw_probe_dns_ctx_t*)stage_ctx,_dns_records,ctx);
+
+    if((stage_ctx = gbw_probe_stage_ctx(worker,"http"))!=NULL)
+        rc |= gbw_probe_http_listen((gbw_probe_http_ctx_t*)stage_ctx,_http_record,ctx);
+
+    if((stage_ctx = gbw_probe_stage_ctx(worker,"tls"))!=NULL)
+        rc |= gbw_probe_tls_listen((gbw_probe_tls_ctx_t*)stage_ctx,_tls_record,ctx);
+
+    if((stage_ctx = gbw_probe_stage_ctx(worker,"sketch"))!=NULL){
+
+        if(gbw_dout_init(&ctx->dout))
+            return -1;
+
+        rc |= gbw_probe_sketch_listen((gbw_probe_sketch_ctx_t*)stage_ctx,_card_record,ctx);
+    }
+
+    return rc;
+}
+
+static void _ctx_free(gbw_probe_export_ctx_t *ctx){
+
+    unsigned int i;
+
+    for(i = 0;i<GBW_PROBE_EXPORT_BATCHES;i++)
+        rte_free(ctx->batches[i].data);
+
+    if(ctx->store)
+        gbw_msgpack_store_destroy(ctx->store);
+
+    free(ctx->dout.base);
+
+    rte_free(ctx);
+}
+
+static void *_export_init(gbw_probe_worker_t *worker,void *priv){
+
+    gbw_probe_export_t *exp = (gbw_probe_export_t*)priv;
+    gbw_probe_export_ctx_t *ctx;
+    unsigned int i;
+
+    ctx = (gbw_probe_export_ctx_t*)rte_zmalloc_socket("gbw_probe_export",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the export stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->exp = exp;
+
+    ctx->store = gbw_msgpack_store_create(worker->engine->mp);
+    if(ctx->store == NULL)
+        goto fail;
+
+    for(i = 0;i<GBW_PROBE_EXPORT_BATCHES;i++){
+
+        ctx->batches[i].data = (uint8_t*)rte_malloc_socket("gbw_probe_export_batch",exp->batch_size,
+                RTE_CACHE_LINE_SIZE,worker->socket_id);
+        if(ctx->batches[i].data == NULL)
+            goto fail;
+    }
+
+    ctx->flush_cycles = rte_get_timer_hz()/1000*worker->engine->pcfg->export_flush_interval;
+    ctx->last_flush = rte_get_timer_cycles();
+
+    if(_listen(worker,ctx)){
+        _ctx_free(ctx);
+        return NULL;
+    }
+
+    exp->nb_workers_left++;
+
+    return ctx;
+
+fail:
+    gbw_log(GBW_LOG_ERR,"No memory for the export batches of worker:%u",worker->id);
+    _ctx_free(ctx);
+    return NULL;
+}
+
+static void _export_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles){
+
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)_ctx;
+
+    if(cycles-ctx->last_flush<ctx->flush_cycles)
+        return;
+
+    ctx->last_flush = cycles;
+    _batch_handoff(ctx);
+}
+
+/*
+ * All lcores are back by now,the writer too. The stages before ran their
+ * fin and flushed their last records,those are written from here.
+ */
+static void _export_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)_ctx;
+    gbw_probe_export_t *exp = ctx->exp;
+
+    _writer_drain(exp);
+    _batch_handoff(ctx);
+    _writer_drain(exp);
+
+    if(--exp->nb_workers_left == 0){
+        _output_close(exp);
+        rte_ring_free(exp->ring);
+        exp->ring = NULL;
+    }
+
+    _ctx_free(ctx);
+}
+
+static void _export_dump(gbw_probe_worker_t *worker,void *_ctx,FILE *out){
+
+    gbw_probe_export_ctx_t *ctx = (gbw_probe_export_ctx_t*)_ctx;
+    gbw_probe_export_t *exp = ctx->exp;
+
+    fprintf(out,"    export records:%lu batches:%lu dropped:%lu dropped_bytes:%lu\n",
+            (unsigned long)ctx->records,(unsigned long)ctx->batches_sent,
+            (unsigned long)ctx->dropped,(unsigned long)ctx->dropped_bytes);
+
+    if(worker->id == 0)
+        fprintf(out,"    export writer frames:%lu bytes:%lu files:%lu lost_frames:%lu errors:%lu\n",
+                (unsigned long)exp->frames,(unsigned long)exp->bytes,(unsigned long)exp->files,
+                (unsigned long)exp->lost_frames,(unsigned long)exp->errors);
+}
+
+static const gbw_probe_stage_t _export_stage = {
+    .name = "export",
+    .init = _export_init,
+    .process = _export_process,
+    .fin = _export_fin,
+    .timer = _export_timer,
+    .dump = _export_dump,
+    .priv = NULL,
+};
+
+gbw_probe_export_t * gbw_probe_export_create(gbw_probe_engine_t *engine){
+
+    gbw_probe_config_t *pcfg = engine->pcfg;
+    gbw_probe_export_t *exp;
+    gbw_probe_stage_t stage;
+    unsigned int size = 1;
+
+    if(pcfg->export_dir == NULL&&pcfg->export_unix == NULL)
+        return NULL;
+
+    exp = (gbw_probe_export_t*)gbw_pcalloc(engine->mp,sizeof(*exp));
+    if(exp == NULL)
+        return NULL;
+
+    exp->engine = engine;
+    exp->dir = pcfg->export_dir;
+    exp->unix_path = pcfg->export_unix;
+    exp->file_size = (uint64_t)pcfg->export_file_size*1024*1024;
+    exp->batch_size = (size_t)pcfg->export_batch_size*1024;
+    exp->fd = -1;
+
+    /*every batch of every worker fits,a ring holds one less than its size*/
+    while(size<=(unsigned int)engine->nb_workers*GBW_PROBE_EXPORT_BATCHES)
+        size <<= 1;
+
+    exp->ring = rte_ring_create("gbw_export_ring",size,engine->socket_id,RING_F_SC_DEQ);
+    if(exp->ring == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot create the export ring");
+        return NULL;
+    }
+
+    stage = _export_stage;
+    stage.priv = exp;
+
+    if(gbw_probe_service_register(engine,"export",_writer_loop,exp)||
+            gbw_probe_stage_register(engine,&stage)){
+        rte_ring_free(exp->ring);
+        return NULL;
+    }
+
+    return exp;
+}
@@ -0,0 +1,141 @@
+/*
+ *
+ *      Filename: gbw_probe_export.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: record export,workers pack msgpack records into batches
+ *                a writer lcore turns into length prefixed frames on
+ *                rotated files or a unix socket
+ *
+ */
+
+#ifndef GBW_PROBE_EXPORT_H
+#define GBW_PROBE_EXPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <rte_ring.h>
+
+#include "gbw_msgpack_store.h"
+#include "gbw_data_output.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+
+/*
+ * A frame is the 32 bits big endian length of its records,then the
+ * records: msgpack maps whose "t" key names their kind,"flow","dns",
+ * "http","tls" or "card",the distinct counters of a worker's interval
+ * serialized by gbw_hll_serialize.
+ */
+#define GBW_PROBE_EXPORT_FRAME_HDR 4
+
+/*batches of a worker,one filled while the writer has the other*/
+#define GBW_PROBE_EXPORT_BATCHES 2
+
+typedef struct gbw_probe_export_batch_t gbw_probe_export_batch_t;
+typedef struct gbw_probe_export_t gbw_probe_export_t;
+typedef struct gbw_probe_export_ctx_t gbw_probe_export_ctx_t;
+
+struct gbw_probe_export_batch_t {
+
+    /*set by the worker handing it over,cleared by the writer once written*/
+    volatile uint32_t busy;
+
+    uint32_t len;
+    uint8_t *data;
+};
+
+/*Shared by all workers,the writer state is only touched by the writer*/
+struct gbw_probe_export_t {
+
+    gbw_probe_engine_t *engine;
+
+    /*full batches of all workers,multi producer single consumer*/
+    struct rte_ring *ring;
+    size_t batch_size;
+
+    const char *dir;
+    const char *unix_path;
+    uint64_t file_size;
+
+    int fd;
+    uint64_t file_bytes;
+    uint32_t file_seq;
+    char file_path[256];
+
+    /*timer cycles before another connect is tried*/
+    uint64_t retry_at;
+
+    uint16_t nb_workers_left;
+
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t lost_frames;
+    uint64_t errors;
+};
+
+struct gbw_probe_export_ctx_t {
+
+    gbw_probe_export_t *exp;
+
+    /*the record being packed,appended to the batch once whole*/
+    gbw_msgpack_store_t *store;
+
+    /*distinct counters being serialized,base is NULL without the sketch stage*/
+    gbw_data_output_t dout;
+
+    gbw_probe_export_batch_t batches[GBW_PROBE_EXPORT_BATCHES];
+    unsigned int cur;
+
+    uint64_t flush_cycles;
+    uint64_t last_flush;
+
+    uint64_t records;
+    uint64_t batches_sent;
+    uint64_t dropped;
+    uint64_t dropped_bytes;
+};
+
+/*
+ * Creates the exporter out of the Export* config,takes a service lcore
+ * for its writer and registers the export stage,after every stage whose
+ * records it exports. Returns NULL when no output is configured or on
+ * failure.
+ */
+extern gbw_probe_export_t * gbw_probe_export_create(gbw_probe_engine_t *engine);
+
+/*
+ * For stages with records of their own,from a worker lcore: begin hands
+ * out the store to pack one record into,end appends it to the batch.
+ * ctx is found by gbw_probe_stage_ctx(worker,"export").
+ */
+static inline gbw_msgpack_store_t * gbw_probe_export_begin(gbw_probe_export_ctx_t *ctx){
+
+    gbw_msgpack_store_reset(ctx->store);
+    return ctx->store;
+}
+
+extern void gbw_probe_export_end(gbw_probe_export_ctx_t *ctx);
+
+/*Appends whole records already packed,they go in one batch*/
+extern void gbw_probe_export_append(gbw_probe_export_ctx_t *ctx,const void *data,size_t len);
+
+/*
+ * Packs the endpoints of a flow as cip,sip,cp and sp,the client being the
+ * end that sends in dir: GBW_FLOW_DIR_ORIG for the one that sent first.
+ */
+static inline void gbw_probe_export_pack_ends(gbw_msgpack_store_t *st,gbw_probe_flow_t *flow,int dir){
+
+    const gbw_flow_key_t *key = &gbw_flow_entry_of(flow)->key;
+    size_t alen = key->ip_version == 4?4:16;
+    int from_hi = dir == GBW_FLOW_DIR_ORIG?flow->orig_swapped:!flow->orig_swapped;
+
+    gbw_msgpack_store_write_bin_kv(st,"cip",(void*)(from_hi?key->addr_hi:key->addr_lo),alen);
+    gbw_msgpack_store_write_bin_kv(st,"sip",(void*)(from_hi?key->addr_lo:key->addr_hi),alen);
+    gbw_msgpack_store_write_uint16(st,"cp",from_hi?key->port_hi:key->port_lo);
+    gbw_msgpack_store_write_uint16(st,"sp",from_hi?key->port_lo:key->port_hi);
+}
+
+#endif /*GBW_PROBE_EXPORT_H*/
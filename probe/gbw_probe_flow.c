@@ -0,0 +1,453 @@
+/*
+ *
+ *      Filename: gbw_probe_flow.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: flow tracking stage,one flow table per worker,runs
+ *                right after the decode stage
+ *
+ */
+
+#include <time.h>
+#include <netinet/in.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+
+#include "gbw_probe_flow.h"
+#include "gbw_probe_decode.h"
+#include "gbw_log.h"
+
+/*flow timers tick every 100ms*/
+#define FLOW_TICK_US 100000
+
+/*most flows expired per advance,the rest wait for the next one*/
+#define FLOW_EXPIRE_BUDGET 2048
+
+#define TCP_FLAGS_OFF 13
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_RST 0x04
+
+int gbw_probe_pkt_flow_dynfield_offset = -1;
+
+static const struct rte_mbuf_dynfield pkt_flow_dynfield_desc = {
+    .name = "gbw_probe_dynfield_flow",
+    .size = sizeof(gbw_probe_pkt_flow_t),
+    .align = __alignof__(gbw_probe_pkt_flow_t),
+};
+
+/*
+ * Capture time of the pcap port on the packet clock,otherwise the wall
+ * clock time the burst is handled,read once per burst off the timer.
+ */
+static inline uint64_t _pkt_time(gbw_probe_flow_ctx_t *ctx,struct rte_mbuf *m,uint64_t *now){
+
+    uint64_t ts;
+
+    if(ctx->packet_clock&&ctx->ts_offset>=0&&(m->ol_flags&ctx->ts_flag)){
+
+        ts = *RTE_MBUF_DYNFIELD(m,ctx->ts_offset,rte_mbuf_timestamp_t*);
+        if(ts>ctx->now)
+            ctx->now = ts;
+
+        return ts;
+    }
+
+    if(*now == 0){
+
+        *now = rte_get_timer_cycles()/ctx->cycles_per_us+ctx->wall_offset;
+        if(*now>ctx->now)
+            ctx->now = *now;
+    }
+
+    return *now;
+}
+
+/*
+ * Flows are not re-armed per packet,a timer that fires early for a flow
+ * that saw packets since just moves on to last_seen plus the timeout.
+ */
+static void _flow_expire(gbw_timer_t *timer,void *priv){
+
+    gbw_probe_flow_ctx_t *ctx = (gbw_probe_flow_ctx_t*)priv;
+    gbw_probe_flow_t *flow = container_of(timer,gbw_probe_flow_t,timer);
+    uint64_t deadline = flow->last_seen+(flow->closing?ctx->close_timeout:ctx->idle_timeout);
+    unsigned int i;
+
+    if(deadline>ctx->now){
+        gbw_timer_wheel_add(ctx->tw,timer,deadline);
+        return;
+    }
+
+    for(i = 0;i<ctx->nb_listeners;i++)
+        ctx->end_fns[i](flow,ctx->end_privs[i]);
+
+    ctx->expired++;
+    gbw_flow_table_del(ctx->ft,gbw_flow_entry_of(flow));
+}
+
+int gbw_probe_flow_end_listen(gbw_probe_flow_ctx_t *ctx,gbw_probe_flow_end_fn fn,void *priv){
+
+    if(ctx->nb_listeners>=GBW_PROBE_FLOW_MAX_LISTENERS){
+        gbw_log(GBW_LOG_ERR,"Too many flow end listeners");
+        return -1;
+    }
+
+    ctx->end_fns[ctx->nb_listeners] = fn;
+    ctx->end_privs[ctx->nb_listeners] = priv;
+    ctx->nb_listeners++;
+
+    return 0;
+}
+
+int gbw_probe_flow_bypass_listen(gbw_probe_flow_ctx_t *ctx,gbw_probe_flow_end_fn fn,void *priv){
+
+    if(ctx->nb_bypass_listeners>=GBW_PROBE_FLOW_MAX_LISTENERS){
+        gbw_log(GBW_LOG_ERR,"Too many flow bypass listeners");
+        return -1;
+    }
+
+    ctx->bypass_fns[ctx->nb_bypass_listeners] = fn;
+    ctx->bypass_privs[ctx->nb_bypass_listeners] = priv;
+    ctx->nb_bypass_listeners++;
+
+    return 0;
+}
+
+static inline void _flow_tcp_flags(gbw_probe_flow_ctx_t *ctx,gbw_probe_flow_t *flow,struct rte_mbuf *m,uint64_t ts){
+
+    gbw_probe_pkt_t *pkt = gbw_probe_pkt(m);
+    uint8_t flags;
+
+    if(flow->closing||pkt->proto!=IPPROTO_TCP||!(pkt->flags&GBW_PKT_F_L4))
+        return;
+
+    flags = *rte_pktmbuf_mtod_offset(m,const uint8_t*,pkt->l4_off+TCP_FLAGS_OFF);
+    if(flags&(TCP_FLAG_FIN|TCP_FLAG_RST)){
+
+        flow->closing = 1;
+        gbw_timer_wheel_add(ctx->tw,&flow->timer,ts+ctx->close_timeout);
+    }
+}
+
+/*
+ * Whether the packet is only counted,the flow being past its cutoff.
+ * The packet that takes it there is the last one the later stages see,
+ * unless the flow is being recorded.
+ */
+static inline int _flow_bypass(gbw_probe_flow_ctx_t *ctx,gbw_probe_flow_t *flow){
+
+    unsigned int i;
+
+    if(flow->bypass)
+        return flow->record_id == 0;
+
+    if((ctx->cutoff_bytes&&flow->bytes[0]+flow->bytes[1]>=ctx->cutoff_bytes)||
+            (ctx->cutoff_pkts&&flow->pkts[0]+flow->pkts[1]>=ctx->cutoff_pkts)){
+
+        flow->bypass = 1;
+        ctx->bypassed_flows++;
+
+        for(i = 0;i<ctx->nb_bypass_listeners;i++)
+            ctx->bypass_fns[i](flow,ctx->bypass_privs[i]);
+    }
+
+    return 0;
+}
+
+/*
+ * Key of a decoded packet,returns -1 for packets no flow is kept for:
+ * non IP,later fragments and port protocols whose ports were not decoded.
+ * ICMP type/code are not ports,ICMP flows are keyed on addresses only.
+ */
+static inline int _pkt_key(struct rte_mbuf *m,gbw_flow_key_t *key,int *swap){
+
+    gbw_probe_pkt_t *pkt = gbw_probe_pkt(m);
+    uint16_t sport = 0,dport = 0;
+
+    if(pkt->l3_type!=GBW_PKT_L3_IPV4&&pkt->l3_type!=GBW_PKT_L3_IPV6)
+        return -1;
+
+    if(pkt->flags&GBW_PKT_F_FRAG_NEXT)
+        return -1;
+
+    switch(pkt->proto){
+    case IPPROTO_TCP:
+    case IPPROTO_UDP:
+    case IPPROTO_SCTP:
+        if(!(pkt->flags&GBW_PKT_F_L4))
+            return -1;
+        sport = pkt->sport;
+        dport = pkt->dport;
+        break;
+    default:
+        break;
+    }
+
+    *swap = gbw_flow_key_make(key,pkt->l3_type == GBW_PKT_L3_IPV4?4:6,
+            gbw_probe_pkt_src_addr(m,pkt),gbw_probe_pkt_dst_addr(m,pkt),
+            sport,dport,pkt->proto,0);
+
+    return 0;
+}
+
+static uint16_t _flow_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_flow_ctx_t *ctx = (gbw_probe_flow_ctx_t*)_ctx;
+    gbw_flow_key_t keys[GBW_FLOW_BURST_MAX];
+    uint32_t hashes[GBW_FLOW_BURST_MAX];
+    gbw_flow_entry_t *entries[GBW_FLOW_BURST_MAX];
+    struct rte_mbuf *keyed[GBW_FLOW_BURST_MAX];
+    struct rte_mbuf *bypassed[GBW_PROBE_MAX_BURST];
+    int swaps[GBW_FLOW_BURST_MAX];
+    gbw_probe_pkt_flow_t *pf;
+    gbw_probe_flow_t *flow;
+    gbw_flow_entry_t *entry;
+    struct rte_mbuf *m;
+    uint64_t now = 0,ts;
+    uint16_t off,i,k,chunk,nb_bypassed = 0;
+    int added;
+    uint8_t dir;
+
+    for(off = 0;off<n;off += chunk){
+
+        chunk = n-off<GBW_FLOW_BURST_MAX?n-off:GBW_FLOW_BURST_MAX;
+
+        for(i = 0,k = 0;i<chunk;i++){
+
+            m = pkts[off+i];
+            gbw_probe_pkt_flow(m)->entry = NULL;
+
+            if(_pkt_key(m,&keys[k],&swaps[k])){
+                ctx->untracked++;
+                continue;
+            }
+
+            hashes[k] = gbw_flow_key_hash(&keys[k]);
+            keyed[k++] = m;
+        }
+
+        gbw_flow_table_lookup_burst(ctx->ft,keys,hashes,k,entries);
+
+        for(i = 0,added = 0;i<k;i++){
+
+            m = keyed[i];
+            entry = entries[i];
+            ts = _pkt_time(ctx,m,&now);
+
+            /*a flow may have been added by an earlier packet of this burst*/
+            if(entry == NULL&&added)
+                entry = gbw_flow_table_lookup(ctx->ft,&keys[i],hashes[i]);
+
+            if(entry == NULL){
+
+                entry = gbw_flow_table_add(ctx->ft,&keys[i],hashes[i]);
+                if(entry == NULL){
+                    ctx->table_full++;
+                    continue;
+                }
+
+                flow = gbw_probe_flow(entry);
+                flow->first_seen = ts;
+                flow->orig_swapped = (uint8_t)swaps[i];
+
+                /*the first flow starts the wheel at its packet's time*/
+                gbw_timer_wheel_start(ctx->tw,ts);
+
+                gbw_timer_init(&flow->timer);
+                gbw_timer_wheel_add(ctx->tw,&flow->timer,ts+ctx->idle_timeout);
+                gbw_timer_init(&flow->export_timer);
+
+                added = 1;
+                ctx->new_flows++;
+            }else{
+
+                flow = gbw_probe_flow(entry);
+                ctx->hits++;
+            }
+
+            dir = swaps[i] == flow->orig_swapped?GBW_FLOW_DIR_ORIG:GBW_FLOW_DIR_REPLY;
+
+            flow->pkts[dir]++;
+            flow->bytes[dir] += rte_pktmbuf_pkt_len(m);
+            flow->last_seen = ts;
+
+            _flow_tcp_flags(ctx,flow,m,ts);
+
+            pf = gbw_probe_pkt_flow(m);
+            pf->entry = entry;
+            pf->dir = dir;
+
+            if(_flow_bypass(ctx,flow)){
+                ctx->bypassed_pkts++;
+                ctx->bypassed_bytes += rte_pktmbuf_pkt_len(m);
+                bypassed[nb_bypassed++] = m;
+            }
+        }
+    }
+
+    /*bypassed packets end here,the rest keep their order*/
+    if(nb_bypassed){
+
+        for(i = 0,k = 0,off = 0;i<n;i++){
+
+            if(k<nb_bypassed&&pkts[i] == bypassed[k]){
+                k++;
+                continue;
+            }
+
+            pkts[off++] = pkts[i];
+        }
+
+        rte_pktmbuf_free_bulk(bypassed,nb_bypassed);
+        n = off;
+    }
+
+    /*packet time only moves with packets*/
+    if(ctx->packet_clock)
+        gbw_timer_wheel_advance(ctx->tw,ctx->now,FLOW_EXPIRE_BUDGET);
+
+    return n;
+}
+
+static void _flow_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles){
+
+    gbw_probe_flow_ctx_t *ctx = (gbw_probe_flow_ctx_t*)_ctx;
+    uint64_t now;
+
+    if(ctx->packet_clock)
+        return;
+
+    now = cycles/ctx->cycles_per_us+ctx->wall_offset;
+    if(now>ctx->now)
+        ctx->now = now;
+
+    gbw_timer_wheel_advance(ctx->tw,ctx->now,FLOW_EXPIRE_BUDGET);
+}
+
+static void *_flow_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_flow_ctx_t *ctx;
+    struct timespec ts;
+
+    if(gbw_probe_pkt_flow_dynfield_offset<0){
+
+        gbw_probe_pkt_flow_dynfield_offset = rte_mbuf_dynfield_register(&pkt_flow_dynfield_desc);
+        if(gbw_probe_pkt_flow_dynfield_offset<0){
+            gbw_log(GBW_LOG_ERR,"Cannot register the packet flow dynfield:%s",rte_strerror(rte_errno));
+            return NULL;
+        }
+    }
+
+    ctx = (gbw_probe_flow_ctx_t*)rte_zmalloc_socket("gbw_probe_flow",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the flow stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    /*pages are left untouched here,the worker lcore faults them in locally*/
+    ctx->ft = gbw_flow_table_create(worker->engine->mp,pcfg->flow_max,sizeof(gbw_probe_flow_t),
+            (int)pcfg->flow_hugepage);
+    if(ctx->ft == NULL){
+        rte_free(ctx);
+        return NULL;
+    }
+
+    if(rte_mbuf_dyn_rx_timestamp_register(&ctx->ts_offset,&ctx->ts_flag))
+        ctx->ts_offset = -1;
+
+    ctx->cycles_per_us = rte_get_timer_hz()/1000000;
+    if(ctx->cycles_per_us == 0)
+        ctx->cycles_per_us = 1;
+
+    clock_gettime(CLOCK_REALTIME,&ts);
+    ctx->wall_offset = (uint64_t)ts.tv_sec*1000000+(uint64_t)ts.tv_nsec/1000-
+        rte_get_timer_cycles()/ctx->cycles_per_us;
+
+    ctx->packet_clock = pcfg->flow_clock == GBW_PROBE_CLOCK_PACKET;
+    ctx->idle_timeout = (uint64_t)pcfg->flow_idle_timeout*1000000;
+    ctx->close_timeout = (uint64_t)pcfg->flow_close_timeout*1000000;
+    ctx->cutoff_bytes = pcfg->flow_cutoff_bytes;
+    ctx->cutoff_pkts = pcfg->flow_cutoff_pkts;
+
+    ctx->tw = gbw_timer_wheel_create(worker->engine->mp,FLOW_TICK_US,_flow_expire,ctx);
+    if(ctx->tw == NULL){
+        gbw_flow_table_destroy(ctx->ft);
+        rte_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void _flow_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_flow_ctx_t *ctx = (gbw_probe_flow_ctx_t*)_ctx;
+
+    /*every flow left ends now*/
+    ctx->now = UINT64_MAX;
+    gbw_timer_wheel_flush(ctx->tw);
+
+    gbw_flow_table_destroy(ctx->ft);
+    rte_free(ctx);
+}
+
+/*
+ * Cycles the bypassed packets would have cost the stages after this one,
+ * at what those take per packet they do see.
+ */
+static uint64_t _bypass_saved(gbw_probe_worker_t *worker,gbw_probe_flow_ctx_t *ctx,uint64_t *total){
+
+    gbw_probe_engine_t *engine = worker->engine;
+    uint64_t saved = 0;
+    unsigned int s,after = 0;
+
+    *total = 0;
+
+    for(s = 0;s<engine->nb_stages;s++){
+
+        *total += worker->stage_cycles[s];
+
+        if(after&&worker->stage_pkts[s])
+            saved += (uint64_t)((double)worker->stage_cycles[s]/worker->stage_pkts[s]*ctx->bypassed_pkts);
+
+        if(worker->stage_ctx[s] == ctx)
+            after = 1;
+    }
+
+    return saved;
+}
+
+static void _flow_dump(gbw_probe_worker_t *worker,void *_ctx,FILE *out){
+
+    gbw_probe_flow_ctx_t *ctx = (gbw_probe_flow_ctx_t*)_ctx;
+    uint64_t saved,total;
+
+    fprintf(out,"    flow active:%lu new:%lu expired:%lu hits:%lu untracked:%lu full:%lu overflows:%lu\n",
+            (unsigned long)ctx->ft->n_entries,(unsigned long)ctx->new_flows,
+            (unsigned long)ctx->expired,(unsigned long)ctx->hits,(unsigned long)ctx->untracked,
+            (unsigned long)ctx->table_full,(unsigned long)ctx->ft->n_overflows);
+
+    if(ctx->cutoff_bytes == 0&&ctx->cutoff_pkts == 0)
+        return;
+
+    saved = _bypass_saved(worker,ctx,&total);
+
+    fprintf(out,"    flow bypassed flows:%lu pkts:%lu bytes:%lu saved_cycles:%lu saved:%.1f%%\n",
+            (unsigned long)ctx->bypassed_flows,(unsigned long)ctx->bypassed_pkts,
+            (unsigned long)ctx->bypassed_bytes,(unsigned long)saved,
+            saved?100.0*saved/(saved+total):0.0);
+}
+
+const gbw_probe_stage_t gbw_probe_flow_stage = {
+    .name = "flow",
+    .init = _flow_init,
+    .process = _flow_process,
+    .fin = _flow_fin,
+    .timer = _flow_timer,
+    .dump = _flow_dump,
+    .priv = NULL,
+};
@@ -0,0 +1,165 @@
+/*
+ *
+ *      Filename: gbw_probe_flow.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: flow tracking stage,one flow table per worker,runs
+ *                right after the decode stage
+ *
+ */
+
+#ifndef GBW_PROBE_FLOW_H
+#define GBW_PROBE_FLOW_H
+
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+
+#include "gbw_flow_table.h"
+#include "gbw_timer_wheel.h"
+#include "gbw_probe_engine.h"
+
+/*most callbacks of each kind,see gbw_probe_flow_end_listen and gbw_probe_flow_bypass_listen*/
+#define GBW_PROBE_FLOW_MAX_LISTENERS 8
+
+/*direction of a packet,relative to the first packet of its flow*/
+#define GBW_FLOW_DIR_ORIG  0
+#define GBW_FLOW_DIR_REPLY 1
+
+typedef struct gbw_probe_flow_t gbw_probe_flow_t;
+typedef struct gbw_probe_pkt_flow_t gbw_probe_pkt_flow_t;
+typedef struct gbw_probe_flow_ctx_t gbw_probe_flow_ctx_t;
+
+/*Per flow state,the user data of a flow table entry*/
+struct gbw_probe_flow_t {
+
+    uint64_t pkts[2];
+    uint64_t bytes[2];
+
+    /*usecs since the epoch,of capture time or of the wall clock,see FlowClock*/
+    uint64_t first_seen;
+    uint64_t last_seen;
+
+    /*armed for the idle or close timeout,only re-armed once it fires*/
+    gbw_timer_t timer;
+
+    /*key side the first packet came from,see gbw_flow_key_make*/
+    uint8_t orig_swapped;
+
+    /*a FIN or RST was seen,the close timeout applies*/
+    uint8_t closing;
+
+    /*past FlowCutoffBytes/Packets,only counted from now on*/
+    uint8_t bypass;
+
+    /*application protocol,final once proto_done,see gbw_probe_proto.h*/
+    uint8_t proto_done;
+    uint8_t proto_pkts;
+    uint16_t app_proto;
+
+    /*protocols whose probes ruled the flow out*/
+    uint32_t proto_tried;
+
+    /*TCP reassembly session,NULL until the tcp stage sees the flow*/
+    void *tcp;
+
+    /*DNS queries waiting for their responses,NULL until the dns stage sees one*/
+    void *dns;
+
+    /*counts at the last IPFIX record of a live flow,and when it was sent*/
+    uint64_t exported_pkts[2];
+    uint64_t exported_bytes[2];
+    uint64_t exported_at;
+
+    /*armed by the ipfix stage for the next active report*/
+    gbw_timer_t export_timer;
+
+    /*nonzero while the record stage writes the flow's packets out*/
+    uint64_t record_id;
+
+    /*the record stage matched the flow against the RecordFlow rules*/
+    uint8_t record_checked;
+};
+
+/*Flow of a packet,kept in an mbuf dynfield,entry is NULL if not tracked*/
+struct gbw_probe_pkt_flow_t {
+
+    gbw_flow_entry_t *entry;
+    uint8_t dir;
+};
+
+extern int gbw_probe_pkt_flow_dynfield_offset;
+
+static inline gbw_probe_pkt_flow_t * gbw_probe_pkt_flow(struct rte_mbuf *m){
+
+    return RTE_MBUF_DYNFIELD(m,gbw_probe_pkt_flow_dynfield_offset,gbw_probe_pkt_flow_t*);
+}
+
+static inline gbw_probe_flow_t * gbw_probe_flow(gbw_flow_entry_t *entry){
+
+    return (gbw_probe_flow_t*)gbw_flow_entry_data(entry);
+}
+
+typedef void (*gbw_probe_flow_end_fn)(gbw_probe_flow_t *flow,void *priv);
+
+struct gbw_probe_flow_ctx_t {
+
+    gbw_flow_table_t *ft;
+
+    unsigned int nb_listeners;
+    gbw_probe_flow_end_fn end_fns[GBW_PROBE_FLOW_MAX_LISTENERS];
+    void *end_privs[GBW_PROBE_FLOW_MAX_LISTENERS];
+
+    unsigned int nb_bypass_listeners;
+    gbw_probe_flow_end_fn bypass_fns[GBW_PROBE_FLOW_MAX_LISTENERS];
+    void *bypass_privs[GBW_PROBE_FLOW_MAX_LISTENERS];
+
+    gbw_timer_wheel_t *tw;
+
+    /*rx timestamp dynfield of the pcap port,-1 if none*/
+    int ts_offset;
+    uint64_t ts_flag;
+    uint64_t cycles_per_us;
+
+    /*timer cycles in usecs plus this are usecs since the epoch,taken once at init*/
+    uint64_t wall_offset;
+
+    int packet_clock;
+    uint64_t idle_timeout;
+    uint64_t close_timeout;
+
+    /*totals of both directions a flow is bypassed past,0 for no cutoff*/
+    uint64_t cutoff_bytes;
+    uint64_t cutoff_pkts;
+
+    /*latest time seen in usecs,flows expire against it*/
+    uint64_t now;
+
+    uint64_t hits;
+    uint64_t new_flows;
+    uint64_t untracked;
+    uint64_t table_full;
+    uint64_t expired;
+
+    uint64_t bypassed_flows;
+    uint64_t bypassed_pkts;
+    uint64_t bypassed_bytes;
+};
+
+/*
+ * Calls fn for every flow of the worker that ends,by timeout or at
+ * shutdown,right before its entry is freed. Later stages register from
+ * their init,with the ctx found by gbw_probe_stage_ctx(worker,"flow").
+ */
+extern int gbw_probe_flow_end_listen(gbw_probe_flow_ctx_t *ctx,gbw_probe_flow_end_fn fn,void *priv);
+
+/*
+ * Calls fn once for every flow of the worker going past its cutoff,so
+ * stages drop what they keep for it early. The packet taking it there
+ * and those of a recorded flow still go by,stages skip flows with bypass
+ * set. The flow still ends as any other.
+ */
+extern int gbw_probe_flow_bypass_listen(gbw_probe_flow_ctx_t *ctx,gbw_probe_flow_end_fn fn,void *priv);
+
+extern const gbw_probe_stage_t gbw_probe_flow_stage;
+
+#endif /*GBW_PROBE_FLOW_H*/
@@ -0,0 +1,346 @@
+/*
+ *
+ *      Filename: gbw_probe_http.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: HTTP metadata stage,parses the reassembled streams of
+ *                HTTP flows into request/response transactions
+ *
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <rte_malloc.h>
+
+#include "gbw_probe_http.h"
+#include "gbw_probe_proto.h"
+#include "gbw_log.h"
+
+#define _str_is(s,lit) ((s)->len == sizeof(lit)-1&&strncasecmp((const char*)(s)->data,lit,sizeof(lit)-1) == 0)
+
+/*the only copies made of a request,into the fixed buffers of its txn*/
+static inline void _copy(char *dst,size_t size,const void *src,size_t len){
+
+    if(len>=size)
+        len = size-1;
+
+    memcpy(dst,src,len);
+    dst[len] = 0;
+}
+
+static inline gbw_probe_http_txn_t * _txn_head(gbw_probe_http_session_t *sess){
+
+    return sess->txn_n?&sess->txns[sess->txn_head]:NULL;
+}
+
+static inline gbw_probe_http_txn_t * _txn_tail(gbw_probe_http_session_t *sess){
+
+    return sess->txn_n?&sess->txns[(sess->txn_head+sess->txn_n-1)%GBW_PROBE_HTTP_PIPELINE]:NULL;
+}
+
+static void _txn_done(gbw_probe_http_session_t *sess){
+
+    gbw_probe_http_ctx_t *ctx = sess->ctx;
+    gbw_probe_http_txn_t *txn = _txn_head(sess);
+    unsigned int i;
+
+    ctx->txns++;
+
+    for(i = 0;i<ctx->nb_listeners;i++)
+        ctx->txn_fns[i](sess->flow,txn,ctx->txn_privs[i]);
+
+    sess->txn_head = (sess->txn_head+1)%GBW_PROBE_HTTP_PIPELINE;
+    sess->txn_n--;
+}
+
+static int _on_request(gbw_http_parser_t *p,const gbw_str_t *method,const gbw_str_t *target,
+        const gbw_str_t *version __rte_unused){
+
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)p->priv;
+    gbw_probe_http_txn_t *txn;
+    const gbw_uri_t *uri;
+
+    sess->ctx->requests++;
+
+    /*too many requests in flight,the oldest goes out unanswered*/
+    if(sess->txn_n == GBW_PROBE_HTTP_PIPELINE){
+        sess->ctx->overflows++;
+        sess->ctx->unanswered++;
+        _txn_done(sess);
+    }
+
+    sess->txn_n++;
+    txn = _txn_tail(sess);
+    memset(txn,0,sizeof(*txn));
+
+    _copy(txn->method,sizeof(txn->method),method->data,method->len);
+    _copy(txn->uri,sizeof(txn->uri),target->data,target->len);
+
+    /*a proxy request names the host in its target,the only URI worth parsing*/
+    if(target->data[0]!='/'&&target->data[0]!='*'){
+
+        uri = gbw_http_parser_uri(p);
+        if(uri&&uri->hostname)
+            _copy(txn->host,sizeof(txn->host),uri->hostname,strlen(uri->hostname));
+    }
+
+    gbw_http_parser_expect(&sess->parsers[!sess->req_dir],_str_is(method,"HEAD"));
+
+    return 0;
+}
+
+static int _on_response(gbw_http_parser_t *p,const gbw_str_t *version __rte_unused,int status,
+        const gbw_str_t *reason __rte_unused){
+
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)p->priv;
+    gbw_probe_http_txn_t *txn;
+
+    /*interim responses say nothing of the transaction*/
+    if(status<200&&status!=101)
+        return 0;
+
+    sess->ctx->responses++;
+
+    txn = _txn_head(sess);
+    if(txn == NULL){
+        /*joined the flow after the request*/
+        sess->ctx->orphans++;
+        return 0;
+    }
+
+    txn->status = status;
+
+    return 0;
+}
+
+static int _on_header(gbw_http_parser_t *p,const gbw_str_t *name,const gbw_str_t *value){
+
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)p->priv;
+    gbw_probe_http_txn_t *txn;
+
+    if(p->type == GBW_HTTP_REQUEST){
+
+        txn = _txn_tail(sess);
+        if(txn == NULL)
+            return 0;
+
+        if(txn->host[0] == 0&&_str_is(name,"Host"))
+            _copy(txn->host,sizeof(txn->host),value->data,value->len);
+        else if(_str_is(name,"User-Agent"))
+            _copy(txn->user_agent,sizeof(txn->user_agent),value->data,value->len);
+
+    }else if(p->status>=200||p->status == 101){
+
+        txn = _txn_head(sess);
+        if(txn == NULL)
+            return 0;
+
+        if(_str_is(name,"Content-Type"))
+            _copy(txn->content_type,sizeof(txn->content_type),value->data,value->len);
+    }
+
+    return 0;
+}
+
+static int _on_message_done(gbw_http_parser_t *p){
+
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)p->priv;
+    gbw_probe_http_txn_t *txn;
+
+    if(p->type == GBW_HTTP_REQUEST){
+
+        txn = _txn_tail(sess);
+        if(txn)
+            txn->req_body = p->body_len;
+
+        return 0;
+    }
+
+    if(p->status<200&&p->status!=101)
+        return 0;
+
+    txn = _txn_head(sess);
+    if(txn == NULL)
+        return 0;
+
+    txn->resp_body = p->body_len;
+    _txn_done(sess);
+
+    return 0;
+}
+
+static const gbw_http_callbacks_t _http_callbacks = {
+    .on_request = _on_request,
+    .on_response = _on_response,
+    .on_header = _on_header,
+    .on_headers_done = NULL,
+    .on_body = NULL,
+    .on_message_done = _on_message_done,
+};
+
+static gbw_probe_http_session_t * _session_create(gbw_probe_http_ctx_t *ctx,gbw_probe_tcp_session_t *tsess,
+        int dir,const uint8_t *data,uint32_t len){
+
+    gbw_probe_http_session_t *sess;
+
+    sess = (gbw_probe_http_session_t*)gbw_pcalloc(tsess->mp,sizeof(*sess));
+    if(sess == NULL)
+        return NULL;
+
+    sess->ctx = ctx;
+    sess->flow = tsess->flow;
+
+    /*the server may be the first one heard,when the flow is joined late*/
+    if(len>=5&&memcmp(data,"HTTP/",5) == 0)
+        sess->req_dir = !dir;
+    else
+        sess->req_dir = dir;
+
+    gbw_http_parser_init(&sess->parsers[sess->req_dir],tsess->mp,GBW_HTTP_REQUEST,&_http_callbacks,sess);
+    gbw_http_parser_init(&sess->parsers[!sess->req_dir],tsess->mp,GBW_HTTP_RESPONSE,&_http_callbacks,sess);
+
+    ctx->sessions++;
+
+    return sess;
+}
+
+static void _http_data(gbw_probe_tcp_session_t *tsess,void **user,void *priv,int dir,
+        const uint8_t *data,uint32_t len){
+
+    gbw_probe_http_ctx_t *ctx = (gbw_probe_http_ctx_t*)priv;
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)*user;
+
+    if(sess == NULL){
+
+        if(tsess->flow->app_proto!=GBW_PROTO_HTTP){
+
+            if(tsess->flow->proto_done)
+                gbw_probe_tcp_detach(tsess,user);
+            return;
+        }
+
+        sess = _session_create(ctx,tsess,dir,data,len);
+        if(sess == NULL)
+            return;
+
+        *user = sess;
+    }
+
+    gbw_http_parser_execute(&sess->parsers[dir],data,len);
+}
+
+static void _http_gap(gbw_probe_tcp_session_t *tsess __rte_unused,void **user,void *priv,int dir,uint32_t len){
+
+    gbw_probe_http_ctx_t *ctx = (gbw_probe_http_ctx_t*)priv;
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)*user;
+
+    if(sess == NULL)
+        return;
+
+    ctx->gaps++;
+    gbw_http_parser_gap(&sess->parsers[dir],len);
+}
+
+static void _http_close(gbw_probe_tcp_session_t *tsess,void **user,void *priv){
+
+    gbw_probe_http_ctx_t *ctx = (gbw_probe_http_ctx_t*)priv;
+    gbw_probe_http_session_t *sess = (gbw_probe_http_session_t*)*user;
+
+    if(sess == NULL)
+        return;
+
+    /*a body running to the close completes its transaction,not one cut by a bypass*/
+    if(!tsess->bypassed)
+        gbw_http_parser_finish(&sess->parsers[!sess->req_dir]);
+
+    while(sess->txn_n){
+        ctx->unanswered++;
+        _txn_done(sess);
+    }
+
+    ctx->errors += sess->parsers[0].errors+sess->parsers[1].errors;
+
+    gbw_http_parser_fin(&sess->parsers[0]);
+    gbw_http_parser_fin(&sess->parsers[1]);
+
+    /*the memory goes back with the tcp session pool*/
+    *user = NULL;
+}
+
+static const gbw_probe_tcp_ops_t _http_ops = {
+    .name = "http",
+    .data = _http_data,
+    .gap = _http_gap,
+    .close = _http_close,
+};
+
+int gbw_probe_http_listen(gbw_probe_http_ctx_t *ctx,gbw_probe_http_txn_fn fn,void *priv){
+
+    if(ctx->nb_listeners>=GBW_PROBE_HTTP_MAX_LISTENERS){
+        gbw_log(GBW_LOG_ERR,"Too many http transaction listeners");
+        return -1;
+    }
+
+    ctx->txn_fns[ctx->nb_listeners] = fn;
+    ctx->txn_privs[ctx->nb_listeners] = priv;
+    ctx->nb_listeners++;
+
+    return 0;
+}
+
+/*the work is done from the tcp stage callbacks*/
+static uint16_t _http_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx __rte_unused,
+        struct rte_mbuf **pkts __rte_unused,uint16_t n){
+
+    return n;
+}
+
+static void *_http_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_tcp_ctx_t *tcp_ctx;
+    gbw_probe_http_ctx_t *ctx;
+
+    tcp_ctx = (gbw_probe_tcp_ctx_t*)gbw_probe_stage_ctx(worker,"tcp");
+    if(tcp_ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"The http stage needs the tcp stage registered before it");
+        return NULL;
+    }
+
+    ctx = (gbw_probe_http_ctx_t*)rte_zmalloc_socket("gbw_probe_http",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the http stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    if(gbw_probe_tcp_listen(tcp_ctx,&_http_ops,ctx)){
+        rte_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void _http_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    rte_free(_ctx);
+}
+
+static void _http_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_http_ctx_t *ctx = (gbw_probe_http_ctx_t*)_ctx;
+
+    fprintf(out,"    http sessions:%lu requests:%lu responses:%lu txns:%lu unanswered:%lu orphans:%lu overflows:%lu errors:%lu gaps:%lu\n",
+            (unsigned long)ctx->sessions,(unsigned long)ctx->requests,(unsigned long)ctx->responses,
+            (unsigned long)ctx->txns,(unsigned long)ctx->unanswered,(unsigned long)ctx->orphans,
+            (unsigned long)ctx->overflows,(unsigned long)ctx->errors,(unsigned long)ctx->gaps);
+}
+
+const gbw_probe_stage_t gbw_probe_http_stage = {
+    .name = "http",
+    .init = _http_init,
+    .process = _http_process,
+    .fin = _http_fin,
+    .dump = _http_dump,
+    .priv = NULL,
+};
@@ -0,0 +1,101 @@
+/*
+ *
+ *      Filename: gbw_probe_http.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: HTTP metadata stage,parses the reassembled streams of
+ *                HTTP flows into request/response transactions
+ *
+ */
+
+#ifndef GBW_PROBE_HTTP_H
+#define GBW_PROBE_HTTP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_http_parser.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+#include "gbw_probe_tcp.h"
+
+/*requests a session keeps waiting for their responses*/
+#define GBW_PROBE_HTTP_PIPELINE 4
+
+/*most callbacks told about transactions,see gbw_probe_http_listen*/
+#define GBW_PROBE_HTTP_MAX_LISTENERS 4
+
+#define GBW_PROBE_HTTP_METHOD_LEN 16
+#define GBW_PROBE_HTTP_HOST_LEN   128
+#define GBW_PROBE_HTTP_URI_LEN    256
+#define GBW_PROBE_HTTP_UA_LEN     128
+#define GBW_PROBE_HTTP_CTYPE_LEN  64
+
+typedef struct gbw_probe_http_txn_t gbw_probe_http_txn_t;
+typedef struct gbw_probe_http_session_t gbw_probe_http_session_t;
+typedef struct gbw_probe_http_ctx_t gbw_probe_http_ctx_t;
+
+/*
+ * One request and its response,strings are NUL terminated and cut to
+ * their buffer. status is 0 when the flow ended before the response.
+ */
+struct gbw_probe_http_txn_t {
+
+    char method[GBW_PROBE_HTTP_METHOD_LEN];
+    char host[GBW_PROBE_HTTP_HOST_LEN];
+    char uri[GBW_PROBE_HTTP_URI_LEN];
+    char user_agent[GBW_PROBE_HTTP_UA_LEN];
+    char content_type[GBW_PROBE_HTTP_CTYPE_LEN];
+
+    int status;
+    uint64_t req_body;
+    uint64_t resp_body;
+};
+
+typedef void (*gbw_probe_http_txn_fn)(gbw_probe_flow_t *flow,const gbw_probe_http_txn_t *txn,void *priv);
+
+/*
+ * Per flow state,from the tcp session pool on the first HTTP bytes.
+ * Transactions live in a small ring,reused,so a request costs no memory.
+ */
+struct gbw_probe_http_session_t {
+
+    gbw_probe_http_ctx_t *ctx;
+    gbw_probe_flow_t *flow;
+
+    /*flow direction the requests go,found on the first bytes*/
+    int req_dir;
+    gbw_http_parser_t parsers[2];
+
+    gbw_probe_http_txn_t txns[GBW_PROBE_HTTP_PIPELINE];
+    unsigned int txn_head;
+    unsigned int txn_n;
+};
+
+struct gbw_probe_http_ctx_t {
+
+    unsigned int nb_listeners;
+    gbw_probe_http_txn_fn txn_fns[GBW_PROBE_HTTP_MAX_LISTENERS];
+    void *txn_privs[GBW_PROBE_HTTP_MAX_LISTENERS];
+
+    uint64_t sessions;
+    uint64_t requests;
+    uint64_t responses;
+    uint64_t txns;
+    uint64_t unanswered;
+    uint64_t orphans;
+    uint64_t overflows;
+    uint64_t errors;
+    uint64_t gaps;
+};
+
+/*
+ * Calls fn for every transaction once its response is done,or when the
+ * flow ends without one. Later stages register from their init,with the
+ * ctx found by gbw_probe_stage_ctx(worker,"http").
+ */
+extern int gbw_probe_http_listen(gbw_probe_http_ctx_t *ctx,gbw_probe_http_txn_fn fn,void *priv);
+
+extern const gbw_probe_stage_t gbw_probe_http_stage;
+
+#endif /*GBW_PROBE_HTTP_H*/
@@ -0,0 +1,394 @@
+/*
+ *
+ *      Filename: gbw_probe_ipfix.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: IPFIX/NetFlow v9 stage,reports flows to a UDP collector
+ *                when they end and every active timeout while they live
+ *
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+
+#include "gbw_probe_ipfix.h"
+#include "gbw_log.h"
+
+/*active timers tick every 100ms*/
+#define IPFIX_TICK_US 100000
+
+/*most active reports per advance,the rest wait for the next one*/
+#define IPFIX_REPORT_BUDGET 2048
+
+/*One direction of a flow,as the field tables see it*/
+typedef struct {
+
+    uint8_t src[16];
+    uint8_t dst[16];
+
+    uint64_t octets;
+    uint64_t packets;
+    uint64_t start_ms;
+    uint64_t end_ms;
+
+    /*NetFlow v9 times,msecs of the exporter's uptime*/
+    uint32_t first_sw;
+    uint32_t last_sw;
+
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t proto;
+    uint8_t ip_version;
+    uint8_t reason;
+
+}_ipfix_rec_t;
+
+#define _FIELD(t,ie,l,member,is_raw) do{                        \
+    (t)->fields[(t)->n_fields].id = (ie);                       \
+    (t)->fields[(t)->n_fields].len = (l);                       \
+    (t)->fields[(t)->n_fields].off = offsetof(_ipfix_rec_t,member); \
+    (t)->fields[(t)->n_fields].raw = (is_raw);                  \
+    (t)->n_fields++;                                            \
+}while(0)
+
+static void _template_build(gbw_ipfix_template_t *t,uint16_t id,int v6,int version){
+
+    memset(t,0,sizeof(*t));
+    t->id = id;
+
+    if(v6){
+        _FIELD(t,GBW_IPFIX_IE_SRC_IPV6,16,src,1);
+        _FIELD(t,GBW_IPFIX_IE_DST_IPV6,16,dst,1);
+    }else{
+        _FIELD(t,GBW_IPFIX_IE_SRC_IPV4,4,src,1);
+        _FIELD(t,GBW_IPFIX_IE_DST_IPV4,4,dst,1);
+    }
+
+    _FIELD(t,GBW_IPFIX_IE_SRC_PORT,2,sport,0);
+    _FIELD(t,GBW_IPFIX_IE_DST_PORT,2,dport,0);
+    _FIELD(t,GBW_IPFIX_IE_PROTOCOL,1,proto,0);
+    _FIELD(t,GBW_IPFIX_IE_IP_VERSION,1,ip_version,0);
+    _FIELD(t,GBW_IPFIX_IE_OCTET_DELTA_COUNT,8,octets,0);
+    _FIELD(t,GBW_IPFIX_IE_PACKET_DELTA_COUNT,8,packets,0);
+
+    /*NetFlow v9 has neither absolute times nor end reasons*/
+    if(version == GBW_IPFIX_VERSION){
+        _FIELD(t,GBW_IPFIX_IE_FLOW_START_MS,8,start_ms,0);
+        _FIELD(t,GBW_IPFIX_IE_FLOW_END_MS,8,end_ms,0);
+        _FIELD(t,GBW_IPFIX_IE_FLOW_END_REASON,1,reason,0);
+    }else{
+        _FIELD(t,GBW_IPFIX_IE_FIRST_SWITCHED,4,first_sw,0);
+        _FIELD(t,GBW_IPFIX_IE_LAST_SWITCHED,4,last_sw,0);
+    }
+}
+
+static inline uint64_t _now_ms(gbw_probe_ipfix_ctx_t *ctx){
+
+    return rte_get_timer_cycles()/ctx->cycles_per_ms+ctx->wall_offset_ms;
+}
+
+static uint64_t _wall_us(void){
+
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+
+    return (uint64_t)tv.tv_sec*1000000+(uint64_t)tv.tv_usec;
+}
+
+/*msecs since uptime_base_ms,0 for a time before it*/
+static inline uint32_t _uptime_ms(gbw_probe_ipfix_ctx_t *ctx,uint64_t ms){
+
+    if(ctx->uptime_base_ms == 0)
+        ctx->uptime_base_ms = ms;
+
+    return ms>ctx->uptime_base_ms?(uint32_t)(ms-ctx->uptime_base_ms):0;
+}
+
+/*
+ * Reports what each direction did since the last report,the sender of
+ * the first packet being the source of the orig one.
+ */
+static void _flow_report(gbw_probe_ipfix_ctx_t *ctx,gbw_probe_flow_t *flow,uint8_t reason){
+
+    const gbw_flow_key_t *key = &gbw_flow_entry_of(flow)->key;
+    const gbw_ipfix_template_t *tmpl = key->ip_version == 4?&ctx->tmpl4:&ctx->tmpl6;
+    size_t alen = key->ip_version == 4?4:16;
+    uint64_t now_ms = _now_ms(ctx);
+    uint64_t start = flow->exported_at?flow->exported_at:flow->first_seen;
+    _ipfix_rec_t rec;
+    int dir,from_hi;
+
+    rec.proto = key->proto;
+    rec.ip_version = key->ip_version;
+    rec.reason = reason;
+    rec.start_ms = start/1000;
+    rec.end_ms = flow->last_seen/1000;
+    rec.first_sw = _uptime_ms(ctx,rec.start_ms);
+    rec.last_sw = _uptime_ms(ctx,rec.end_ms);
+
+    for(dir = GBW_FLOW_DIR_ORIG;dir<=GBW_FLOW_DIR_REPLY;dir++){
+
+        rec.packets = flow->pkts[dir]-flow->exported_pkts[dir];
+        if(rec.packets == 0)
+            continue;
+
+        rec.octets = flow->bytes[dir]-flow->exported_bytes[dir];
+
+        from_hi = dir == GBW_FLOW_DIR_ORIG?flow->orig_swapped:!flow->orig_swapped;
+
+        memcpy(rec.src,from_hi?key->addr_hi:key->addr_lo,alen);
+        memcpy(rec.dst,from_hi?key->addr_lo:key->addr_hi,alen);
+        rec.sport = from_hi?key->port_hi:key->port_lo;
+        rec.dport = from_hi?key->port_lo:key->port_hi;
+
+        gbw_ipfix_record_add(&ctx->ex,tmpl,&rec,now_ms);
+
+        flow->exported_pkts[dir] = flow->pkts[dir];
+        flow->exported_bytes[dir] = flow->bytes[dir];
+    }
+
+    flow->exported_at = flow->last_seen;
+}
+
+static void _ipfix_flow_end(gbw_probe_flow_t *flow,void *priv){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)priv;
+    uint8_t reason;
+
+    /*flows still there when the probe stops are ended by the flow stage fin*/
+    if(ctx->engine->quit)
+        reason = GBW_IPFIX_END_FORCED;
+    else
+        reason = flow->closing?GBW_IPFIX_END_FLOW:GBW_IPFIX_END_IDLE;
+
+    gbw_timer_wheel_del(ctx->tw,&flow->export_timer);
+
+    ctx->end_reports++;
+    _flow_report(ctx,flow,reason);
+}
+
+/*
+ * Every active timeout of a live flow,from the stage timer,so flows past
+ * their cutoff whose packets no longer get here are reported too. One
+ * quiet since its last report is looked at again a timeout later.
+ */
+static void _active_expire(gbw_timer_t *timer,void *priv){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)priv;
+    gbw_probe_flow_t *flow = container_of(timer,gbw_probe_flow_t,export_timer);
+    uint64_t start = flow->exported_at?flow->exported_at:flow->first_seen;
+    uint64_t now = ctx->flow_ctx->now;
+
+    if(flow->last_seen-start>=ctx->active_timeout){
+
+        ctx->active_reports++;
+        _flow_report(ctx,flow,GBW_IPFIX_END_ACTIVE);
+        start = flow->exported_at;
+    }
+
+    gbw_timer_wheel_add(ctx->tw,timer,start+ctx->active_timeout>now?start+ctx->active_timeout:now+ctx->active_timeout);
+}
+
+/*Flows are armed for their active timeout the first time they go by*/
+static uint16_t _ipfix_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)_ctx;
+    gbw_probe_pkt_flow_t *pf;
+    gbw_probe_flow_t *flow;
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        pf = gbw_probe_pkt_flow(pkts[i]);
+        if(pf->entry == NULL)
+            continue;
+
+        flow = gbw_probe_flow(pf->entry);
+        if(gbw_timer_pending(&flow->export_timer))
+            continue;
+
+        gbw_timer_wheel_start(ctx->tw,ctx->flow_ctx->now);
+        gbw_timer_wheel_add(ctx->tw,&flow->export_timer,flow->first_seen+ctx->active_timeout);
+    }
+
+    return n;
+}
+
+static int _ipfix_send(const void *msg,size_t len,void *priv){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)priv;
+
+    /*a collector not listening is no reason to hold the worker*/
+    return send(ctx->fd,msg,len,MSG_DONTWAIT) == (ssize_t)len?0:-1;
+}
+
+/*host:port,an IPv6 host in brackets*/
+static int _collector_connect(const char *collector){
+
+    struct addrinfo hints,*res = NULL;
+    char host[256];
+    const char *port;
+    const char *h = collector;
+    size_t hlen;
+    int fd,rc;
+
+    port = strrchr(collector,':');
+    if(port == NULL)
+        return -1;
+
+    hlen = (size_t)(port-collector);
+    if(*h == '['&&hlen>=2&&h[hlen-1] == ']'){
+        h++;
+        hlen -= 2;
+    }
+
+    if(hlen == 0||hlen>=sizeof(host))
+        return -1;
+
+    memcpy(host,h,hlen);
+    host[hlen] = 0;
+
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    rc = getaddrinfo(host,port+1,&hints,&res);
+    if(rc){
+        gbw_log(GBW_LOG_ERR,"Cannot resolve the IPFIX collector:%s:%s",collector,gai_strerror(rc));
+        return -1;
+    }
+
+    fd = socket(res->ai_family,SOCK_DGRAM|SOCK_CLOEXEC,0);
+    if(fd>=0&&connect(fd,res->ai_addr,res->ai_addrlen)){
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+static void *_ipfix_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_flow_ctx_t *flow_ctx;
+    gbw_probe_ipfix_ctx_t *ctx;
+    uint64_t wall_us = _wall_us();
+    uint64_t cycles_per_us = rte_get_timer_hz()/1000000;
+    int version = (int)pcfg->ipfix_version;
+
+    flow_ctx = (gbw_probe_flow_ctx_t*)gbw_probe_stage_ctx(worker,"flow");
+    if(flow_ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"The ipfix stage needs the flow stage registered before it");
+        return NULL;
+    }
+
+    ctx = (gbw_probe_ipfix_ctx_t*)rte_zmalloc_socket("gbw_probe_ipfix",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the ipfix stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->engine = worker->engine;
+    ctx->flow_ctx = flow_ctx;
+    ctx->active_timeout = (uint64_t)pcfg->ipfix_active_timeout*1000000;
+
+    if(cycles_per_us == 0)
+        cycles_per_us = 1;
+
+    ctx->cycles_per_ms = cycles_per_us*1000;
+    ctx->wall_offset_ms = wall_us/1000-rte_get_timer_cycles()/ctx->cycles_per_ms;
+
+    ctx->tw = gbw_timer_wheel_create(worker->engine->mp,IPFIX_TICK_US,_active_expire,ctx);
+    if(ctx->tw == NULL){
+        rte_free(ctx);
+        return NULL;
+    }
+
+    ctx->fd = _collector_connect(pcfg->ipfix_collector);
+    if(ctx->fd<0){
+        gbw_log(GBW_LOG_ERR,"Cannot open a socket to the IPFIX collector:%s",pcfg->ipfix_collector);
+        rte_free(ctx);
+        return NULL;
+    }
+
+    if(gbw_ipfix_exporter_init(&ctx->ex,version,pcfg->ipfix_domain_id+worker->id,pcfg->ipfix_mtu,
+                (uint64_t)pcfg->ipfix_template_refresh*1000,_now_ms(ctx),_ipfix_send,ctx)){
+        gbw_log(GBW_LOG_ERR,"Cannot init the IPFIX exporter of worker:%u",worker->id);
+        goto fail;
+    }
+
+    if(pcfg->flow_clock!=GBW_PROBE_CLOCK_PACKET)
+        ctx->uptime_base_ms = ctx->ex.start_ms;
+
+    _template_build(&ctx->tmpl4,GBW_PROBE_IPFIX_TMPL_IPV4,0,version);
+    _template_build(&ctx->tmpl6,GBW_PROBE_IPFIX_TMPL_IPV6,1,version);
+
+    if(gbw_ipfix_template_add(&ctx->ex,&ctx->tmpl4)||gbw_ipfix_template_add(&ctx->ex,&ctx->tmpl6)||
+            gbw_probe_flow_end_listen(flow_ctx,_ipfix_flow_end,ctx)){
+        gbw_ipfix_exporter_fin(&ctx->ex);
+        goto fail;
+    }
+
+    return ctx;
+
+fail:
+    close(ctx->fd);
+    rte_free(ctx);
+    return NULL;
+}
+
+static void _ipfix_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)_ctx;
+    uint64_t now_ms = cycles/ctx->cycles_per_ms+ctx->wall_offset_ms;
+
+    /*on the flow stage's time,started by the first flow armed*/
+    if(ctx->tw->started)
+        gbw_timer_wheel_advance(ctx->tw,ctx->flow_ctx->now,IPFIX_REPORT_BUDGET);
+
+    if(gbw_ipfix_pending_ms(&ctx->ex,now_ms)>=GBW_PROBE_IPFIX_FLUSH_MS)
+        gbw_ipfix_flush(&ctx->ex,now_ms);
+}
+
+/*The flow stage ran its fin first,the last flows are in the message*/
+static void _ipfix_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)_ctx;
+
+    gbw_ipfix_flush(&ctx->ex,_now_ms(ctx));
+    gbw_ipfix_exporter_fin(&ctx->ex);
+
+    close(ctx->fd);
+    rte_free(ctx);
+}
+
+static void _ipfix_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_ipfix_ctx_t *ctx = (gbw_probe_ipfix_ctx_t*)_ctx;
+
+    fprintf(out,"    ipfix messages:%lu records:%lu bytes:%lu send_errors:%lu active_reports:%lu end_reports:%lu\n",
+            (unsigned long)ctx->ex.messages,(unsigned long)ctx->ex.records,(unsigned long)ctx->ex.bytes,
+            (unsigned long)ctx->ex.send_errors,(unsigned long)ctx->active_reports,(unsigned long)ctx->end_reports);
+}
+
+const gbw_probe_stage_t gbw_probe_ipfix_stage = {
+    .name = "ipfix",
+    .init = _ipfix_init,
+    .process = _ipfix_process,
+    .fin = _ipfix_fin,
+    .timer = _ipfix_timer,
+    .dump = _ipfix_dump,
+    .priv = NULL,
+};
@@ -0,0 +1,70 @@
+/*
+ *
+ *      Filename: gbw_probe_ipfix.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: IPFIX/NetFlow v9 stage,reports flows to a UDP collector
+ *                when they end and every active timeout while they live
+ *
+ */
+
+#ifndef GBW_PROBE_IPFIX_H
+#define GBW_PROBE_IPFIX_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_ipfix.h"
+#include "gbw_timer_wheel.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+
+/*template ids of the records of IPv4 and IPv6 flows*/
+#define GBW_PROBE_IPFIX_TMPL_IPV4 256
+#define GBW_PROBE_IPFIX_TMPL_IPV6 257
+
+/*most msecs records wait in a message before it is sent*/
+#define GBW_PROBE_IPFIX_FLUSH_MS 1000
+
+typedef struct gbw_probe_ipfix_ctx_t gbw_probe_ipfix_ctx_t;
+
+/*
+ * Per worker,each with its own socket and observation domain,so the
+ * sequence numbers a collector checks are never shared.
+ */
+struct gbw_probe_ipfix_ctx_t {
+
+    gbw_probe_engine_t *engine;
+
+    gbw_ipfix_exporter_t ex;
+    gbw_ipfix_template_t tmpl4;
+    gbw_ipfix_template_t tmpl6;
+
+    int fd;
+
+    gbw_probe_flow_ctx_t *flow_ctx;
+
+    /*usecs,as flow times are*/
+    uint64_t active_timeout;
+
+    /*export_timer of every flow seen,on flow time*/
+    gbw_timer_wheel_t *tw;
+
+    uint64_t cycles_per_ms;
+    uint64_t wall_offset_ms;
+
+    /*
+     * msecs NetFlow v9 flow times count from: the exporter start,or on
+     * the packet clock the start of the first flow reported,as capture
+     * times may be older than the probe,0 until then
+     */
+    uint64_t uptime_base_ms;
+
+    uint64_t active_reports;
+    uint64_t end_reports;
+};
+
+/*Registered only when IpfixCollector is set,after the flow stage*/
+extern const gbw_probe_stage_t gbw_probe_ipfix_stage;
+
+#endif /*GBW_PROBE_IPFIX_H*/
@@ -0,0 +1,402 @@
+/*
+ *
+ *      Filename: gbw_probe_proto.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: application protocol detection stage,labels each flow
+ *                from the first payloads and ports,after the flow stage
+ *
+ */
+
+#include <string.h>
+#include <netinet/in.h>
+#include <rte_malloc.h>
+
+#include "gbw_probe_proto.h"
+#include "gbw_probe_decode.h"
+#include "gbw_log.h"
+
+#define rd16(p) ((uint16_t)(((uint16_t)(p)[0]<<8)|(p)[1]))
+#define rd32(p) (((uint32_t)(p)[0]<<24)|((uint32_t)(p)[1]<<16)|((uint32_t)(p)[2]<<8)|(p)[3])
+
+#define PROTO_L4_TCP 0
+#define PROTO_L4_UDP 1
+
+/*registry,set up before the workers start and only read by them*/
+static const gbw_probe_proto_t *protos[GBW_PROBE_MAX_PROTOS];
+static unsigned int nb_protos;
+
+/*protocols of each l4 protocol,by id bit*/
+static uint32_t l4_masks[2];
+
+/*registered ports sorted,with the protocols using each*/
+static uint16_t port_keys[GBW_PROBE_MAX_PROTOS*GBW_PROBE_PROTO_PORTS];
+static uint32_t port_masks[GBW_PROBE_MAX_PROTOS*GBW_PROBE_PROTO_PORTS];
+static unsigned int nb_ports;
+
+/*Request methods and the status line,a prefix of one is enough to wait*/
+static int _http_probe(const uint8_t *data,uint32_t len,int dir __rte_unused){
+
+    static const char *starts[] = {"GET ","POST ","HEAD ","PUT ","DELETE ","OPTIONS ",
+        "CONNECT ","PATCH ","TRACE ","HTTP/1.",NULL};
+    uint32_t i,slen;
+
+    for(i = 0;starts[i];i++){
+
+        slen = (uint32_t)strlen(starts[i]);
+        if(memcmp(data,starts[i],len<slen?len:slen) == 0)
+            return len<slen?GBW_PROTO_MORE:GBW_PROTO_YES;
+    }
+
+    return GBW_PROTO_NO;
+}
+
+/*A handshake record of SSL 3.0 to TLS 1.3 opening with a client or server hello*/
+static int _tls_probe(const uint8_t *data,uint32_t len,int dir __rte_unused){
+
+    if(data[0]!=0x16)
+        return GBW_PROTO_NO;
+
+    if(len<6)
+        return len<3||(data[1] == 3&&data[2]<=4)?GBW_PROTO_MORE:GBW_PROTO_NO;
+
+    if(data[1]!=3||data[2]>4||(data[5]!=1&&data[5]!=2))
+        return GBW_PROTO_NO;
+
+    return GBW_PROTO_YES;
+}
+
+/*
+ * A sane header and a well formed first question,over UDP or behind the
+ * 2 byte length of DNS over TCP.
+ */
+static int _dns_probe(const uint8_t *data,uint32_t len,int dir __rte_unused){
+
+    uint32_t off,qclass;
+    uint16_t qd;
+
+    if(len>=14&&rd16(data) == len-2){
+        data += 2;
+        len -= 2;
+    }
+
+    if(len<17)
+        return GBW_PROTO_NO;
+
+    qd = rd16(data+4);
+
+    /*opcode 3 is unassigned,above 6 too*/
+    if(((data[2]>>3)&0x0f) == 3||((data[2]>>3)&0x0f)>6||qd == 0||qd>16||
+            rd16(data+6)>256||rd16(data+8)>256||rd16(data+10)>256)
+        return GBW_PROTO_NO;
+
+    for(off = 12;off<len&&data[off];off += data[off]+1){
+        if(data[off]>63||off-12>255)
+            return GBW_PROTO_NO;
+    }
+
+    if(off+5>len)
+        return GBW_PROTO_NO;
+
+    /*IN,CH,HS,NONE or ANY,mDNS sets the top bit*/
+    qclass = rd16(data+off+3)&0x7fff;
+    if(qclass!=1&&qclass!=3&&qclass!=4&&qclass!=254&&qclass!=255)
+        return GBW_PROTO_NO;
+
+    return GBW_PROTO_YES;
+}
+
+static int _ssh_probe(const uint8_t *data,uint32_t len,int dir __rte_unused){
+
+    if(memcmp(data,"SSH-",len<4?len:4))
+        return GBW_PROTO_NO;
+
+    return len<4?GBW_PROTO_MORE:GBW_PROTO_YES;
+}
+
+/*SMB1,SMB2/3 or SMB3 transform header in a NetBIOS session message*/
+static int _smb_probe(const uint8_t *data,uint32_t len,int dir __rte_unused){
+
+    if(data[0]!=0)
+        return GBW_PROTO_NO;
+
+    if(len<8)
+        return GBW_PROTO_MORE;
+
+    if((data[4]!=0xff&&data[4]!=0xfe&&data[4]!=0xfd)||memcmp(data+5,"SMB",3))
+        return GBW_PROTO_NO;
+
+    return GBW_PROTO_YES;
+}
+
+/*
+ * Long header packet of QUIC v1,v2,a draft or a version negotiation,
+ * short header ones carry nothing to tell them from noise.
+ */
+static int _quic_probe(const uint8_t *data,uint32_t len,int dir __rte_unused){
+
+    uint32_t version;
+
+    if(len<7||!(data[0]&0x80))
+        return GBW_PROTO_NO;
+
+    version = rd32(data+1);
+
+    if(version == 0)
+        return GBW_PROTO_YES;
+
+    if(!(data[0]&0x40))
+        return GBW_PROTO_NO;
+
+    if(version == 0x00000001||version == 0x6b3343cf||(version&0xffffff00) == 0xff000000)
+        return GBW_PROTO_YES;
+
+    return GBW_PROTO_NO;
+}
+
+static const gbw_probe_proto_t builtin_protos[] = {
+    {"http",IPPROTO_TCP,{80,8080,8000,8008,8888,3128},_http_probe},
+    {"tls",IPPROTO_TCP,{443,8443,993,995,465,636,853,5061},_tls_probe},
+    {"dns",0,{53,5353,5355},_dns_probe},
+    {"ssh",IPPROTO_TCP,{22,2222},_ssh_probe},
+    {"smb",IPPROTO_TCP,{445,139},_smb_probe},
+    {"quic",IPPROTO_UDP,{443,8443},_quic_probe},
+};
+
+static int _proto_add(const gbw_probe_proto_t *proto){
+
+    unsigned int id,i,j;
+
+    if(nb_protos>=GBW_PROBE_MAX_PROTOS||proto->probe == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot register protocol:%s,%u are registered",proto->name,nb_protos);
+        return -1;
+    }
+
+    id = nb_protos++;
+    protos[id] = proto;
+
+    if(proto->l4_proto!=IPPROTO_UDP)
+        l4_masks[PROTO_L4_TCP] |= 1U<<id;
+    if(proto->l4_proto!=IPPROTO_TCP)
+        l4_masks[PROTO_L4_UDP] |= 1U<<id;
+
+    for(i = 0;i<GBW_PROBE_PROTO_PORTS&&proto->ports[i];i++){
+
+        for(j = 0;j<nb_ports&&port_keys[j]<proto->ports[i];j++);
+
+        if(j == nb_ports||port_keys[j]!=proto->ports[i]){
+
+            memmove(port_keys+j+1,port_keys+j,sizeof(port_keys[0])*(nb_ports-j));
+            memmove(port_masks+j+1,port_masks+j,sizeof(port_masks[0])*(nb_ports-j));
+            port_keys[j] = proto->ports[i];
+            port_masks[j] = 0;
+            nb_ports++;
+        }
+
+        port_masks[j] |= 1U<<id;
+    }
+
+    return (int)id;
+}
+
+/*id 0 stays unknown,the built in ones take the ids they are defined with*/
+static void _builtins_add(void){
+
+    unsigned int i;
+
+    if(nb_protos)
+        return;
+
+    nb_protos = 1;
+
+    for(i = 0;i<sizeof(builtin_protos)/sizeof(builtin_protos[0]);i++)
+        _proto_add(&builtin_protos[i]);
+}
+
+int gbw_probe_proto_register(const gbw_probe_proto_t *proto){
+
+    _builtins_add();
+
+    return _proto_add(proto);
+}
+
+const char * gbw_probe_proto_name(uint16_t id){
+
+    if(id == GBW_PROTO_UNKNOWN||id>=nb_protos)
+        return "unknown";
+
+    return protos[id]->name;
+}
+
+static inline uint32_t _port_mask(uint16_t port){
+
+    unsigned int lo = 0,hi = nb_ports,mid;
+
+    while(lo<hi){
+
+        mid = (lo+hi)>>1;
+
+        if(port_keys[mid] == port)
+            return port_masks[mid];
+
+        if(port_keys[mid]<port)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+
+    return 0;
+}
+
+static inline void _flow_label(gbw_probe_proto_ctx_t *ctx,gbw_probe_flow_t *flow,uint16_t id){
+
+    flow->app_proto = id;
+    flow->proto_done = 1;
+
+    if(id == GBW_PROTO_UNKNOWN)
+        ctx->unknown++;
+    else
+        ctx->flows[id]++;
+}
+
+/*
+ * Runs the probes still possible for the flow,those registered on one of
+ * its ports first,until one says yes.
+ */
+static void _classify(gbw_probe_proto_ctx_t *ctx,gbw_probe_flow_t *flow,gbw_probe_pkt_t *pkt,
+        const uint8_t *data,uint32_t len,int dir){
+
+    uint32_t l4_mask = l4_masks[pkt->proto == IPPROTO_TCP?PROTO_L4_TCP:PROTO_L4_UDP];
+    uint32_t cands = l4_mask&~flow->proto_tried;
+    uint32_t ports = _port_mask(pkt->sport)|_port_mask(pkt->dport);
+    uint32_t mask;
+    int pass,id,rc;
+
+    ctx->inspected++;
+
+    for(pass = 0;pass<2;pass++){
+
+        mask = pass?cands&~ports:cands&ports;
+
+        while(mask){
+
+            id = __builtin_ctz(mask);
+            mask &= mask-1;
+
+            ctx->probes++;
+            rc = protos[id]->probe(data,len,dir);
+
+            if(rc == GBW_PROTO_YES){
+                _flow_label(ctx,flow,(uint16_t)id);
+                return;
+            }
+
+            if(rc == GBW_PROTO_NO)
+                flow->proto_tried |= 1U<<id;
+        }
+    }
+
+    if(++flow->proto_pkts>=ctx->max_pkts||!(l4_mask&~flow->proto_tried))
+        _flow_label(ctx,flow,GBW_PROTO_UNKNOWN);
+}
+
+static uint16_t _proto_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_proto_ctx_t *ctx = (gbw_probe_proto_ctx_t*)_ctx;
+    gbw_probe_pkt_flow_t *pf;
+    gbw_probe_flow_t *flow;
+    gbw_probe_pkt_t *pkt;
+    struct rte_mbuf *m;
+    uint32_t len;
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        m = pkts[i];
+        pf = gbw_probe_pkt_flow(m);
+        if(pf->entry == NULL)
+            continue;
+
+        flow = gbw_probe_flow(pf->entry);
+
+        /*labelled flows cost nothing more*/
+        if(flow->proto_done){
+            ctx->skipped++;
+            continue;
+        }
+
+        pkt = gbw_probe_pkt(m);
+
+        if(pkt->proto!=IPPROTO_TCP&&pkt->proto!=IPPROTO_UDP){
+            _flow_label(ctx,flow,GBW_PROTO_UNKNOWN);
+            continue;
+        }
+
+        if(!(pkt->flags&GBW_PKT_F_L4)||pkt->payload_len == 0)
+            continue;
+
+        /*a reassembled datagram may go on in further segments,its start is enough*/
+        len = rte_pktmbuf_data_len(m)-pkt->payload_off;
+        if(len>pkt->payload_len)
+            len = pkt->payload_len;
+        if(len == 0)
+            continue;
+
+        _classify(ctx,flow,pkt,gbw_probe_pkt_payload(m,pkt),len,pf->dir);
+    }
+
+    return n;
+}
+
+static void *_proto_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_proto_ctx_t *ctx;
+
+    if(gbw_probe_stage_ctx(worker,"flow") == NULL){
+        gbw_log(GBW_LOG_ERR,"The proto stage needs the flow stage registered before it");
+        return NULL;
+    }
+
+    _builtins_add();
+
+    ctx = (gbw_probe_proto_ctx_t*)rte_zmalloc_socket("gbw_probe_proto",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the proto stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->max_pkts = worker->engine->pcfg->proto_max_pkts;
+
+    return ctx;
+}
+
+static void _proto_fin(gbw_probe_worker_t *worker __rte_unused,void *ctx){
+
+    rte_free(ctx);
+}
+
+static void _proto_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_proto_ctx_t *ctx = (gbw_probe_proto_ctx_t*)_ctx;
+    unsigned int i;
+
+    fprintf(out,"    proto inspected:%lu probes:%lu skipped:%lu unknown:%lu",
+            (unsigned long)ctx->inspected,(unsigned long)ctx->probes,
+            (unsigned long)ctx->skipped,(unsigned long)ctx->unknown);
+
+    for(i = 1;i<nb_protos;i++)
+        fprintf(out," %s:%lu",protos[i]->name,(unsigned long)ctx->flows[i]);
+
+    fprintf(out,"\n");
+}
+
+const gbw_probe_stage_t gbw_probe_proto_stage = {
+    .name = "proto",
+    .init = _proto_init,
+    .process = _proto_process,
+    .fin = _proto_fin,
+    .dump = _proto_dump,
+    .priv = NULL,
+};
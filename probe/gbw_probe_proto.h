@@ -0,0 +1,82 @@
+/*
+ *
+ *      Filename: gbw_probe_proto.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: application protocol detection stage,labels each flow
+ *                from the first payloads and ports,after the flow stage
+ *
+ */
+
+#ifndef GBW_PROBE_PROTO_H
+#define GBW_PROBE_PROTO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+
+/*protocols flows can be labelled with,a flow keeps its candidates in a 32 bit mask*/
+#define GBW_PROBE_MAX_PROTOS 32
+#define GBW_PROBE_PROTO_PORTS 8
+
+/*ids of the built in protocols,registered first,later ones follow*/
+#define GBW_PROTO_UNKNOWN 0
+#define GBW_PROTO_HTTP    1
+#define GBW_PROTO_TLS     2
+#define GBW_PROTO_DNS     3
+#define GBW_PROTO_SSH     4
+#define GBW_PROTO_SMB     5
+#define GBW_PROTO_QUIC    6
+
+/*what a probe makes of a payload*/
+#define GBW_PROTO_NO   0
+#define GBW_PROTO_YES  1
+#define GBW_PROTO_MORE 2
+
+typedef struct gbw_probe_proto_t gbw_probe_proto_t;
+typedef struct gbw_probe_proto_ctx_t gbw_probe_proto_ctx_t;
+
+/*
+ * A protocol,probe looks at the payload of one packet,dir relative to
+ * the first packet of the flow. It must be cheap: it runs on the first
+ * packets of every flow of its l4 protocol. NO drops the protocol for
+ * the rest of the flow,MORE keeps it for the next packet.
+ * The protocols whose ports the flow uses are probed first.
+ */
+struct gbw_probe_proto_t {
+
+    const char *name;
+
+    /*IPPROTO_TCP or IPPROTO_UDP,0 for both*/
+    uint8_t l4_proto;
+    uint16_t ports[GBW_PROBE_PROTO_PORTS];
+
+    int (*probe)(const uint8_t *data,uint32_t len,int dir);
+};
+
+struct gbw_probe_proto_ctx_t {
+
+    /*payload packets looked at before a flow is given up as unknown*/
+    uint32_t max_pkts;
+
+    uint64_t inspected;
+    uint64_t probes;
+    uint64_t skipped;
+    uint64_t unknown;
+    uint64_t flows[GBW_PROBE_MAX_PROTOS];
+};
+
+/*
+ * Adds a protocol after the built in ones,before the engine runs.
+ * Returns its id,or -1 once all GBW_PROBE_MAX_PROTOS are taken.
+ */
+extern int gbw_probe_proto_register(const gbw_probe_proto_t *proto);
+
+/*"unknown" for GBW_PROTO_UNKNOWN and ids never registered*/
+extern const char * gbw_probe_proto_name(uint16_t id);
+
+extern const gbw_probe_stage_t gbw_probe_proto_stage;
+
+#endif /*GBW_PROBE_PROTO_H*/
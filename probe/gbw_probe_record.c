@@ -0,0 +1,618 @@
+/*
+ *
+ *      Filename: gbw_probe_record.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: per flow pcap recording,packets of the flows flagged for
+ *                it are held by refcount and written by a writer lcore to
+ *                a pcap file of each flow
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+#include <rte_mbuf_dyn.h>
+
+#include "gbw_probe_record.h"
+#include "gbw_pcap_store.h"
+#include "gbw_log.h"
+
+#define RECORD_WRITER_BURST 32
+
+#define RECORD_ID(worker,seq) ((uint64_t)(worker)<<32|(seq))
+
+/*Writer*/
+
+static inline struct hlist_head * _file_bucket(gbw_probe_record_t *rec,uint64_t id){
+
+    return &rec->files[(id^id>>32)&(GBW_PROBE_RECORD_HASH_SIZE-1)];
+}
+
+static gbw_probe_record_file_t * _file_find(gbw_probe_record_t *rec,uint64_t id){
+
+    gbw_probe_record_file_t *f;
+
+    hlist_for_each_entry(f,_file_bucket(rec,id),hnode){
+        if(f->id == id)
+            return f;
+    }
+
+    return NULL;
+}
+
+static void _file_close(gbw_probe_record_t *rec,gbw_probe_record_file_t *f){
+
+    if(fclose(f->fp))
+        rec->errors++;
+
+    hlist_del(&f->hnode);
+    list_del(&f->lru_node);
+    rec->nb_files--;
+
+    rte_free(f);
+}
+
+/*
+ * The open file of a flow,the least recently written one makes room for
+ * it. A flow whose file was closed that way is appended to.
+ */
+static gbw_probe_record_file_t * _file_get(gbw_probe_record_t *rec,uint64_t id){
+
+    gbw_probe_record_file_t *f = _file_find(rec,id);
+    char path[1024];
+    long size;
+
+    if(f){
+        list_move_tail(&f->lru_node,&rec->lru);
+        return f;
+    }
+
+    if(rec->nb_files>=rec->max_files)
+        _file_close(rec,list_first_entry(&rec->lru,gbw_probe_record_file_t,lru_node));
+
+    f = (gbw_probe_record_file_t*)rte_zmalloc("gbw_probe_record_file",sizeof(*f),0);
+    if(f == NULL)
+        return NULL;
+
+    snprintf(path,sizeof(path),"%s/flow_%lu_%u_%u.pcap",rec->dir,(unsigned long)rec->started,
+            (unsigned int)(id>>32),(unsigned int)id);
+
+    f->fp = fopen(path,"ab");
+    if(f->fp == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot open %s:%s",path,strerror(errno));
+        rte_free(f);
+        return NULL;
+    }
+
+    fseek(f->fp,0,SEEK_END);
+    size = ftell(f->fp);
+
+    if(size>0)
+        rec->reopened++;
+    else if(gbw_pcap_store_file_hdr_write(f->fp,GBW_PROBE_RECORD_SNAPLEN) == 0)
+        rec->opened++;
+    else{
+        fclose(f->fp);
+        rte_free(f);
+        return NULL;
+    }
+
+    f->id = id;
+    hlist_add_head(&f->hnode,_file_bucket(rec,id));
+    list_add_tail(&f->lru_node,&rec->lru);
+    rec->nb_files++;
+
+    return f;
+}
+
+static void _item_write(gbw_probe_record_t *rec,gbw_probe_record_item_t *item){
+
+    gbw_probe_record_file_t *f;
+    uint32_t len,caplen,hdr[4];
+    const void *p;
+
+    /*the flow ended,its file is done*/
+    if(item->m == NULL){
+
+        f = _file_find(rec,item->id);
+        if(f)
+            _file_close(rec,f);
+        return;
+    }
+
+    f = _file_get(rec,item->id);
+    if(f == NULL){
+        rec->errors++;
+        goto out;
+    }
+
+    len = rte_pktmbuf_pkt_len(item->m);
+    caplen = len>GBW_PROBE_RECORD_SNAPLEN?GBW_PROBE_RECORD_SNAPLEN:len;
+
+    hdr[0] = (uint32_t)(item->ts/1000000);
+    hdr[1] = (uint32_t)(item->ts%1000000);
+    hdr[2] = caplen;
+    hdr[3] = len;
+
+    p = rte_pktmbuf_read(item->m,0,caplen,rec->buf);
+
+    if(fwrite(hdr,sizeof(hdr),1,f->fp)!=1||(caplen&&fwrite(p,caplen,1,f->fp)!=1))
+        rec->errors++;
+    else
+        rec->written++;
+
+out:
+    rte_pktmbuf_free(item->m);
+}
+
+static unsigned int _writer_drain(gbw_probe_record_t *rec){
+
+    gbw_probe_record_batch_t *batches[RECORD_WRITER_BURST];
+    unsigned int n,i,j,total = 0;
+
+    while((n = rte_ring_sc_dequeue_burst(rec->ring,(void**)batches,RECORD_WRITER_BURST,NULL))!=0){
+
+        for(i = 0;i<n;i++){
+
+            for(j = 0;j<batches[i]->n;j++)
+                _item_write(rec,&batches[i]->items[j]);
+
+            batches[i]->n = 0;
+            __atomic_store_n(&batches[i]->busy,0,__ATOMIC_RELEASE);
+        }
+
+        total += n;
+    }
+
+    return total;
+}
+
+static int _writer_loop(void *arg){
+
+    gbw_probe_record_t *rec = (gbw_probe_record_t*)arg;
+    gbw_probe_engine_t *engine = rec->engine;
+    gbw_probe_record_file_t *f;
+
+    gbw_log(GBW_LOG_INFO,"record writer runs to %s",rec->dir);
+
+    while(!engine->quit){
+
+        if(_writer_drain(rec) == 0){
+
+            /*what is written so far is there to read*/
+            list_for_each_entry(f,&rec->lru,lru_node)
+                fflush(f->fp);
+
+            rte_delay_ms(1);
+        }
+    }
+
+    return 0;
+}
+
+/*Batching,worker side*/
+
+static inline int _batch_busy(const gbw_probe_record_batch_t *b){
+
+    return __atomic_load_n(&b->busy,__ATOMIC_ACQUIRE)!=0;
+}
+
+static void _batch_handoff(gbw_probe_record_ctx_t *ctx){
+
+    gbw_probe_record_batch_t *b = &ctx->batches[ctx->cur];
+
+    /*still the writer's,it was handed over already*/
+    if(b->n == 0||_batch_busy(b))
+        return;
+
+    b->busy = 1;
+
+    /*can't be full,it has room for every batch*/
+    if(rte_ring_mp_enqueue(ctx->rec->ring,b)){
+        b->busy = 0;
+        return;
+    }
+
+    ctx->cur = (ctx->cur+1)%GBW_PROBE_RECORD_BATCHES;
+}
+
+/*
+ * Every segment is held,the pipeline frees its own reference of each and
+ * the writer the other once the packet is written.
+ */
+static int _item_put(gbw_probe_record_ctx_t *ctx,struct rte_mbuf *m,uint64_t ts,uint64_t id){
+
+    gbw_probe_record_batch_t *b = &ctx->batches[ctx->cur];
+    gbw_probe_record_item_t *item;
+    struct rte_mbuf *seg;
+
+    if(_batch_busy(b))
+        goto drop;
+
+    if(b->n == GBW_PROBE_RECORD_BATCH_PKTS){
+
+        _batch_handoff(ctx);
+
+        b = &ctx->batches[ctx->cur];
+        if(_batch_busy(b)||b->n == GBW_PROBE_RECORD_BATCH_PKTS)
+            goto drop;
+    }
+
+    /*the shm ring is given back in order,a batch waiting on the writer must not stall it*/
+    if(m&&RTE_MBUF_HAS_EXTBUF(m)){
+
+        m = rte_pktmbuf_copy(m,m->pool,0,UINT32_MAX);
+        if(m == NULL)
+            goto drop;
+    }else{
+
+        for(seg = m;seg;seg = seg->next)
+            rte_mbuf_refcnt_update(seg,1);
+    }
+
+    item = &b->items[b->n++];
+    item->m = m;
+    item->ts = ts;
+    item->id = id;
+
+    return 0;
+
+drop:
+    return -1;
+}
+
+/*Ends a busy batch had no room for,in the order their flows ended*/
+static void _ends_put(gbw_probe_record_ctx_t *ctx){
+
+    uint32_t i = 0;
+
+    while(i<ctx->nb_ends&&_item_put(ctx,NULL,0,ctx->ends[i]) == 0)
+        i++;
+
+    if(i){
+        memmove(ctx->ends,ctx->ends+i,(ctx->nb_ends-i)*sizeof(ctx->ends[0]));
+        ctx->nb_ends -= i;
+    }
+}
+
+static uint64_t _flow_start(gbw_probe_record_ctx_t *ctx,gbw_flow_entry_t *entry){
+
+    gbw_probe_flow_t *flow = gbw_probe_flow(entry);
+
+    if(flow->record_id)
+        return flow->record_id;
+
+    flow->record_id = RECORD_ID(ctx->worker,++ctx->seq);
+
+    ctx->recording++;
+    ctx->flows++;
+
+    gbw_log(GBW_LOG_INFO,"Recording a flow to %s/flow_%lu_%u_%u.pcap",ctx->rec->dir,
+            (unsigned long)ctx->rec->started,ctx->worker,ctx->seq);
+
+    return flow->record_id;
+}
+
+static void _flow_end(gbw_probe_flow_t *flow,void *priv){
+
+    gbw_probe_record_ctx_t *ctx = (gbw_probe_record_ctx_t*)priv;
+
+    if(flow->record_id == 0)
+        return;
+
+    /*the writer closes the file on it,kept until a batch has room*/
+    if(ctx->nb_ends||_item_put(ctx,NULL,0,flow->record_id)){
+
+        if(ctx->nb_ends<GBW_PROBE_RECORD_MAX_ENDS)
+            ctx->ends[ctx->nb_ends++] = flow->record_id;
+        else
+            ctx->ends_lost++;
+    }
+
+    flow->record_id = 0;
+    ctx->recording--;
+}
+
+/*Keys other lcores asked for,the flows this worker has are recorded*/
+static void _reqs_check(gbw_probe_record_ctx_t *ctx){
+
+    gbw_probe_record_t *rec = ctx->rec;
+    uint32_t n = __atomic_load_n(&rec->nb_reqs,__ATOMIC_ACQUIRE);
+    gbw_flow_entry_t *entry;
+    const gbw_flow_key_t *key;
+
+    if(n-ctx->reqs_seen>GBW_PROBE_RECORD_MAX_REQS){
+        ctx->reqs_lost += n-ctx->reqs_seen-GBW_PROBE_RECORD_MAX_REQS;
+        ctx->reqs_seen = n-GBW_PROBE_RECORD_MAX_REQS;
+    }
+
+    for(;ctx->reqs_seen!=n;ctx->reqs_seen++){
+
+        key = &rec->reqs[ctx->reqs_seen%GBW_PROBE_RECORD_MAX_REQS];
+
+        entry = gbw_flow_table_lookup(ctx->flow_ctx->ft,key,gbw_flow_key_hash(key));
+        if(entry)
+            _flow_start(ctx,entry);
+    }
+}
+
+/*The first packet the stage sees of a flow against the RecordFlow rules*/
+static void _rules_check(gbw_probe_record_ctx_t *ctx,gbw_flow_entry_t *entry,struct rte_mbuf *m){
+
+    gbw_pcap_store_tuple_t tuple;
+    uint32_t i;
+
+    gbw_probe_flow(entry)->record_checked = 1;
+
+    if(gbw_pcap_store_tuple_parse(rte_pktmbuf_mtod(m,const uint8_t*),rte_pktmbuf_data_len(m),&tuple))
+        return;
+
+    for(i = 0;i<ctx->nb_rules;i++){
+
+        if(gbw_pcap_store_query_match(&ctx->rules[i],0,&tuple)){
+            _flow_start(ctx,entry);
+            return;
+        }
+    }
+}
+
+static uint16_t _record_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_record_ctx_t *ctx = (gbw_probe_record_ctx_t*)_ctx;
+    gbw_flow_entry_t *entry;
+    gbw_probe_flow_t *flow;
+    uint64_t now = 0;
+    uint16_t i;
+
+    if(ctx->nb_ends)
+        _ends_put(ctx);
+
+    /*nothing flagged and nothing to flag,nothing to look at*/
+    if(ctx->recording == 0&&ctx->nb_rules == 0)
+        return n;
+
+    for(i = 0;i<n;i++){
+
+        entry = gbw_probe_pkt_flow(pkts[i])->entry;
+        if(entry == NULL)
+            continue;
+
+        flow = gbw_probe_flow(entry);
+        if(ctx->nb_rules&&flow->record_checked == 0)
+            _rules_check(ctx,entry,pkts[i]);
+
+        if(flow->record_id == 0)
+            continue;
+
+        if(_item_put(ctx,pkts[i],gbw_probe_pkt_time(ctx->ts_offset,ctx->ts_flag,pkts[i],&now),flow->record_id) == 0){
+            ctx->pkts++;
+            ctx->bytes += rte_pktmbuf_pkt_len(pkts[i]);
+        }else{
+            ctx->dropped++;
+        }
+    }
+
+    return n;
+}
+
+static void _ctx_free(gbw_probe_record_ctx_t *ctx){
+
+    unsigned int i;
+
+    for(i = 0;i<GBW_PROBE_RECORD_BATCHES;i++)
+        rte_free(ctx->batches[i].items);
+
+    rte_free(ctx);
+}
+
+static void *_record_init(gbw_probe_worker_t *worker,void *priv){
+
+    gbw_probe_record_t *rec = (gbw_probe_record_t*)priv;
+    gbw_probe_record_ctx_t *ctx;
+    unsigned int i;
+
+    ctx = (gbw_probe_record_ctx_t*)rte_zmalloc_socket("gbw_probe_record",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the record stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->rec = rec;
+    ctx->worker = worker->id;
+
+    ctx->flow_ctx = (gbw_probe_flow_ctx_t*)gbw_probe_stage_ctx(worker,"flow");
+    if(ctx->flow_ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"The record stage needs the flow stage before it");
+        rte_free(ctx);
+        return NULL;
+    }
+
+    for(i = 0;i<GBW_PROBE_RECORD_BATCHES;i++){
+
+        ctx->batches[i].items = (gbw_probe_record_item_t*)rte_malloc_socket("gbw_probe_record_batch",
+                GBW_PROBE_RECORD_BATCH_PKTS*sizeof(gbw_probe_record_item_t),RTE_CACHE_LINE_SIZE,worker->socket_id);
+        if(ctx->batches[i].items == NULL){
+            gbw_log(GBW_LOG_ERR,"No memory for the record batches of worker:%u",worker->id);
+            _ctx_free(ctx);
+            return NULL;
+        }
+    }
+
+    if(gbw_probe_flow_end_listen(ctx->flow_ctx,_flow_end,ctx)){
+        _ctx_free(ctx);
+        return NULL;
+    }
+
+    if(rte_mbuf_dyn_rx_timestamp_register(&ctx->ts_offset,&ctx->ts_flag))
+        ctx->ts_offset = -1;
+
+    ctx->rules = rec->engine->pcfg->record_rules;
+    ctx->nb_rules = rec->engine->pcfg->nb_record_rules;
+
+    ctx->reqs_seen = rec->nb_reqs;
+    ctx->flush_cycles = rte_get_timer_hz()/1000*GBW_PROBE_RECORD_FLUSH_MS;
+    ctx->last_flush = rte_get_timer_cycles();
+
+    rec->nb_workers_left++;
+
+    return ctx;
+}
+
+static void _record_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles){
+
+    gbw_probe_record_ctx_t *ctx = (gbw_probe_record_ctx_t*)_ctx;
+
+    if(ctx->reqs_seen!=ctx->rec->nb_reqs)
+        _reqs_check(ctx);
+
+    if(cycles-ctx->last_flush<ctx->flush_cycles)
+        return;
+
+    ctx->last_flush = cycles;
+    _batch_handoff(ctx);
+
+    if(ctx->nb_ends)
+        _ends_put(ctx);
+}
+
+/*
+ * All lcores are back,the writer too,and the flows of the worker have
+ * ended. What is left is written from here.
+ */
+static void _record_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_record_ctx_t *ctx = (gbw_probe_record_ctx_t*)_ctx;
+    gbw_probe_record_t *rec = ctx->rec;
+
+    _writer_drain(rec);
+    _batch_handoff(ctx);
+    _writer_drain(rec);
+
+    /*every batch is free again,the ends left fit in them*/
+    while(ctx->nb_ends){
+
+        _ends_put(ctx);
+        _batch_handoff(ctx);
+        _writer_drain(rec);
+    }
+
+    if(--rec->nb_workers_left == 0){
+
+        while(!list_empty(&rec->lru))
+            _file_close(rec,list_first_entry(&rec->lru,gbw_probe_record_file_t,lru_node));
+
+        rte_ring_free(rec->ring);
+        rec->ring = NULL;
+
+        rte_free(rec->buf);
+        rec->buf = NULL;
+    }
+
+    _ctx_free(ctx);
+}
+
+static void _record_dump(gbw_probe_worker_t *worker,void *_ctx,FILE *out){
+
+    gbw_probe_record_ctx_t *ctx = (gbw_probe_record_ctx_t*)_ctx;
+    gbw_probe_record_t *rec = ctx->rec;
+
+    fprintf(out,"    record flows:%lu recording:%u pkts:%lu bytes:%lu dropped:%lu reqs_lost:%lu ends:%u ends_lost:%lu\n",
+            (unsigned long)ctx->flows,ctx->recording,(unsigned long)ctx->pkts,
+            (unsigned long)ctx->bytes,(unsigned long)ctx->dropped,(unsigned long)ctx->reqs_lost,
+            ctx->nb_ends,(unsigned long)ctx->ends_lost);
+
+    if(worker->id == 0)
+        fprintf(out,"    record writer files:%u opened:%lu reopened:%lu written:%lu errors:%lu\n",
+                rec->nb_files,(unsigned long)rec->opened,(unsigned long)rec->reopened,
+                (unsigned long)rec->written,(unsigned long)rec->errors);
+}
+
+static const gbw_probe_stage_t _record_stage = {
+    .name = "record",
+    .init = _record_init,
+    .process = _record_process,
+    .fin = _record_fin,
+    .timer = _record_timer,
+    .dump = _record_dump,
+    .priv = NULL,
+};
+
+gbw_probe_record_t * gbw_probe_record_create(gbw_probe_engine_t *engine){
+
+    gbw_probe_config_t *pcfg = engine->pcfg;
+    gbw_probe_record_t *rec;
+    gbw_probe_stage_t stage;
+    unsigned int i,size = 1;
+
+    if(pcfg->record_dir == NULL)
+        return NULL;
+
+    rec = (gbw_probe_record_t*)gbw_pcalloc(engine->mp,sizeof(*rec));
+    if(rec == NULL)
+        return NULL;
+
+    rec->engine = engine;
+    rec->dir = pcfg->record_dir;
+    rec->max_files = pcfg->record_max_files;
+    rec->started = (uint64_t)time(NULL);
+
+    for(i = 0;i<GBW_PROBE_RECORD_HASH_SIZE;i++)
+        INIT_HLIST_HEAD(&rec->files[i]);
+
+    INIT_LIST_HEAD(&rec->lru);
+    rte_spinlock_init(&rec->lock);
+
+    rec->buf = (uint8_t*)rte_malloc_socket("gbw_probe_record_buf",GBW_PROBE_RECORD_SNAPLEN,0,engine->socket_id);
+    if(rec->buf == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the record writer");
+        return NULL;
+    }
+
+    /*every batch of every worker fits,a ring holds one less than its size*/
+    while(size<=(unsigned int)engine->nb_workers*GBW_PROBE_RECORD_BATCHES)
+        size <<= 1;
+
+    rec->ring = rte_ring_create("gbw_record_ring",size,engine->socket_id,RING_F_SC_DEQ);
+    if(rec->ring == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot create the record ring");
+        rte_free(rec->buf);
+        return NULL;
+    }
+
+    stage = _record_stage;
+    stage.priv = rec;
+
+    if(gbw_probe_service_register(engine,"record",_writer_loop,rec)||
+            gbw_probe_stage_register(engine,&stage)){
+        rte_ring_free(rec->ring);
+        rte_free(rec->buf);
+        return NULL;
+    }
+
+    return rec;
+}
+
+uint64_t gbw_probe_record_flow(gbw_probe_worker_t *worker,gbw_flow_entry_t *entry){
+
+    gbw_probe_record_ctx_t *ctx = (gbw_probe_record_ctx_t*)gbw_probe_stage_ctx(worker,"record");
+
+    if(ctx == NULL)
+        return 0;
+
+    return _flow_start(ctx,entry);
+}
+
+void gbw_probe_record_request(gbw_probe_record_t *rec,const gbw_flow_key_t *key){
+
+    rte_spinlock_lock(&rec->lock);
+
+    rec->reqs[rec->nb_reqs%GBW_PROBE_RECORD_MAX_REQS] = *key;
+    __atomic_store_n(&rec->nb_reqs,rec->nb_reqs+1,__ATOMIC_RELEASE);
+
+    rte_spinlock_unlock(&rec->lock);
+}
@@ -0,0 +1,178 @@
+/*
+ *
+ *      Filename: gbw_probe_record.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: per flow pcap recording,packets of the flows flagged for
+ *                it are held by refcount and written by a writer lcore to
+ *                a pcap file of each flow
+ *
+ */
+
+#ifndef GBW_PROBE_RECORD_H
+#define GBW_PROBE_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <rte_ring.h>
+#include <rte_spinlock.h>
+
+#include "gbw_list.h"
+#include "gbw_flow_table.h"
+#include "gbw_probe_flow.h"
+#include "gbw_probe_engine.h"
+
+/*batches of a worker,filled one after another while the writer has the others*/
+#define GBW_PROBE_RECORD_BATCHES 4
+
+/*packets of a batch,so a worker pins at most BATCHES times as many mbufs*/
+#define GBW_PROBE_RECORD_BATCH_PKTS 256
+
+/*ms a batch waits at most before it is handed over*/
+#define GBW_PROBE_RECORD_FLUSH_MS 100
+
+/*requests by key from other lcores not yet seen by all workers at most*/
+#define GBW_PROBE_RECORD_MAX_REQS 64
+
+/*ends of recorded flows waiting for room in a batch at most*/
+#define GBW_PROBE_RECORD_MAX_ENDS 256
+
+#define GBW_PROBE_RECORD_HASH_SIZE 1024
+#define GBW_PROBE_RECORD_SNAPLEN 65535
+
+typedef struct gbw_probe_record_item_t gbw_probe_record_item_t;
+typedef struct gbw_probe_record_batch_t gbw_probe_record_batch_t;
+typedef struct gbw_probe_record_file_t gbw_probe_record_file_t;
+typedef struct gbw_probe_record_t gbw_probe_record_t;
+typedef struct gbw_probe_record_ctx_t gbw_probe_record_ctx_t;
+
+/*A packet of a recorded flow,or its end when m is NULL*/
+struct gbw_probe_record_item_t {
+
+    struct rte_mbuf *m;
+    uint64_t ts;
+    uint64_t id;
+};
+
+struct gbw_probe_record_batch_t {
+
+    /*set by the worker handing it over,cleared by the writer once written*/
+    volatile uint32_t busy;
+
+    uint32_t n;
+    gbw_probe_record_item_t *items;
+};
+
+/*
+ * Pcap file of a flow the writer holds open,the least recently written
+ * one is closed for a new one past RecordMaxFiles and appended to again
+ * if the flow goes on.
+ */
+struct gbw_probe_record_file_t {
+
+    struct hlist_node hnode;
+    struct list_head lru_node;
+
+    uint64_t id;
+    FILE *fp;
+};
+
+/*Shared by all workers,the files are only touched by the writer*/
+struct gbw_probe_record_t {
+
+    gbw_probe_engine_t *engine;
+
+    const char *dir;
+
+    /*secs at start,in file names so a restart does not append to old ones*/
+    uint64_t started;
+
+    /*full batches of all workers,multi producer single consumer*/
+    struct rte_ring *ring;
+
+    /*open files by flow id,most recently written at the tail of lru*/
+    struct hlist_head files[GBW_PROBE_RECORD_HASH_SIZE];
+    struct list_head lru;
+    unsigned int nb_files;
+    unsigned int max_files;
+
+    uint8_t *buf;
+
+    /*keys asked for from other lcores,each worker looks them up in its flows*/
+    rte_spinlock_t lock;
+    gbw_flow_key_t reqs[GBW_PROBE_RECORD_MAX_REQS];
+    volatile uint32_t nb_reqs;
+
+    uint16_t nb_workers_left;
+
+    uint64_t opened;
+    uint64_t reopened;
+    uint64_t written;
+    uint64_t errors;
+};
+
+struct gbw_probe_record_ctx_t {
+
+    gbw_probe_record_t *rec;
+    gbw_probe_flow_ctx_t *flow_ctx;
+
+    uint16_t worker;
+
+    gbw_probe_record_batch_t batches[GBW_PROBE_RECORD_BATCHES];
+    unsigned int cur;
+
+    /*flows of the worker being recorded,none and the stage does nothing*/
+    uint32_t recording;
+    uint32_t seq;
+
+    uint32_t reqs_seen;
+    uint64_t reqs_lost;
+
+    /*RecordFlow rules,looked at on the first packet of every flow*/
+    const gbw_pcap_store_query_t *rules;
+    uint32_t nb_rules;
+
+    /*ids of ended flows whose end the batches had no room for,oldest first*/
+    uint64_t ends[GBW_PROBE_RECORD_MAX_ENDS];
+    uint32_t nb_ends;
+    uint64_t ends_lost;
+
+    /*rx timestamp dynfield of the pcap port,-1 if none*/
+    int ts_offset;
+    uint64_t ts_flag;
+
+    uint64_t flush_cycles;
+    uint64_t last_flush;
+
+    uint64_t flows;
+    uint64_t pkts;
+    uint64_t bytes;
+    uint64_t dropped;
+};
+
+/*
+ * Creates the recording out of the Record* config,takes a service lcore
+ * for its writer and registers the record stage. It goes after the
+ * stages that flag flows,so the packet a flow is flagged on is recorded.
+ * The stage itself flags the flows matching a RecordFlow rule on their
+ * first packet. Returns NULL when no RecordDir is set or on failure.
+ */
+extern gbw_probe_record_t * gbw_probe_record_create(gbw_probe_engine_t *engine);
+
+/*
+ * From a stage of the worker,starts recording the flow of entry to
+ * RecordDir/flow_<start secs>_<worker>_<seq>.pcap until it ends. Returns
+ * the flow's record id,its worker and seq,or 0 when there is no record
+ * stage.
+ */
+extern uint64_t gbw_probe_record_flow(gbw_probe_worker_t *worker,gbw_flow_entry_t *entry);
+
+/*
+ * From any lcore,has the worker with the flow of key,as made by
+ * gbw_flow_key_make,record it. Workers look at requests every timer
+ * tick,one more than GBW_PROBE_RECORD_MAX_REQS behind is lost.
+ */
+extern void gbw_probe_record_request(gbw_probe_record_t *rec,const gbw_flow_key_t *key);
+
+#endif /*GBW_PROBE_RECORD_H*/
@@ -0,0 +1,554 @@
+/*
+ *
+ *      Filename: gbw_probe_retro.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: retrospective packet buffer,a hugepage ring per worker
+ *                holding the last packets a dumper lcore writes out to
+ *                pcap files on a trigger,while the workers go on
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+#include <rte_mbuf_dyn.h>
+
+#include "gbw_probe_retro.h"
+#include "gbw_log.h"
+
+/*ms the dumper sleeps when there is nothing to dump*/
+#define RETRO_POLL_MS 10
+
+#define RETRO_REC_SIZE(caplen) (GBW_PROBE_RETRO_REC_HDR+RTE_ALIGN_CEIL((uint64_t)(caplen),8))
+
+typedef struct {
+
+    uint64_t ts;
+    uint32_t caplen;
+    uint32_t len;
+}retro_rec_hdr_t;
+
+/*A ring being read by the dumper,rec holds its next packet*/
+typedef struct {
+
+    gbw_probe_retro_ctx_t *ctx;
+
+    uint64_t off;
+    uint64_t end;
+
+    retro_rec_hdr_t hdr;
+    uint8_t *rec;
+    int has_rec;
+}retro_cursor_t;
+
+/*Ring,worker side*/
+
+/*
+ * Moves tail past the records that writing up to end overwrites,before
+ * a byte of them is written.
+ */
+static void _ring_evict(gbw_probe_retro_ctx_t *ctx,uint64_t end){
+
+    uint64_t tail = ctx->tail,pos;
+    retro_rec_hdr_t hdr;
+
+    if(end-tail<=ctx->size)
+        return;
+
+    while(end-tail>ctx->size){
+
+        pos = tail%ctx->size;
+
+        if(pos+GBW_PROBE_RETRO_REC_HDR>ctx->size){
+            tail += ctx->size-pos;
+            continue;
+        }
+
+        memcpy(&hdr,ctx->data+pos,sizeof(hdr));
+
+        if(hdr.caplen == GBW_PROBE_RETRO_SKIP){
+            tail += ctx->size-pos;
+            continue;
+        }
+
+        tail += RETRO_REC_SIZE(hdr.caplen);
+        ctx->evicted++;
+    }
+
+    __atomic_store_n(&ctx->tail,tail,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _ring_put(gbw_probe_retro_ctx_t *ctx,struct rte_mbuf *m,uint64_t ts){
+
+    uint32_t len = rte_pktmbuf_pkt_len(m);
+    uint32_t caplen = len>GBW_PROBE_RETRO_SNAPLEN?GBW_PROBE_RETRO_SNAPLEN:len;
+    uint64_t head = ctx->head,pos = head%ctx->size;
+    uint64_t size = RETRO_REC_SIZE(caplen);
+    retro_rec_hdr_t hdr;
+    uint8_t *dst;
+    const void *p;
+
+    /*no room left before the end,the record goes at the start*/
+    if(pos+size>ctx->size){
+
+        _ring_evict(ctx,head+ctx->size-pos+size);
+
+        if(pos+GBW_PROBE_RETRO_REC_HDR<=ctx->size){
+            hdr.ts = 0;
+            hdr.caplen = GBW_PROBE_RETRO_SKIP;
+            hdr.len = 0;
+            memcpy(ctx->data+pos,&hdr,sizeof(hdr));
+        }
+
+        head += ctx->size-pos;
+        pos = 0;
+    }else{
+        _ring_evict(ctx,head+size);
+    }
+
+    hdr.ts = ts;
+    hdr.caplen = caplen;
+    hdr.len = len;
+
+    dst = ctx->data+pos;
+    memcpy(dst,&hdr,sizeof(hdr));
+    dst += GBW_PROBE_RETRO_REC_HDR;
+
+    p = rte_pktmbuf_read(m,0,caplen,dst);
+    if(p!=dst)
+        memcpy(dst,p,caplen);
+
+    __atomic_store_n(&ctx->last_ts,ts,__ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->head,head+size,__ATOMIC_RELEASE);
+
+    ctx->pkts++;
+    ctx->bytes += len;
+}
+
+/*Ring,dumper side*/
+
+/*
+ * Whether the record at off was still whole when it was copied,the
+ * worker moves tail past it before it overwrites a byte of it.
+ */
+static inline int _cursor_valid(gbw_probe_retro_t *retro,retro_cursor_t *cur){
+
+    uint64_t tail;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    tail = __atomic_load_n(&cur->ctx->tail,__ATOMIC_RELAXED);
+
+    if(tail<=cur->off)
+        return 1;
+
+    /*the worker went round over us,go on from what it kept*/
+    retro->overruns++;
+    cur->off = tail;
+
+    return 0;
+}
+
+/*The next packet of the ring matching q into cur->rec,0 when there is none*/
+static int _cursor_next(gbw_probe_retro_t *retro,retro_cursor_t *cur,const gbw_pcap_store_query_t *q){
+
+    gbw_probe_retro_ctx_t *ctx = cur->ctx;
+    gbw_pcap_store_tuple_t tuple;
+    uint64_t pos;
+
+    cur->has_rec = 0;
+
+    while(cur->off<cur->end){
+
+        pos = cur->off%ctx->size;
+
+        if(pos+GBW_PROBE_RETRO_REC_HDR>ctx->size){
+            cur->off += ctx->size-pos;
+            continue;
+        }
+
+        memcpy(&cur->hdr,ctx->data+pos,sizeof(cur->hdr));
+        if(!_cursor_valid(retro,cur))
+            continue;
+
+        if(cur->hdr.caplen == GBW_PROBE_RETRO_SKIP){
+            cur->off += ctx->size-pos;
+            continue;
+        }
+
+        if(cur->hdr.caplen>GBW_PROBE_RETRO_SNAPLEN)
+            break;
+
+        if((q->ts_from&&cur->hdr.ts<q->ts_from)||(q->ts_to&&cur->hdr.ts>q->ts_to)){
+            cur->off += RETRO_REC_SIZE(cur->hdr.caplen);
+            continue;
+        }
+
+        memcpy(cur->rec,ctx->data+pos+GBW_PROBE_RETRO_REC_HDR,cur->hdr.caplen);
+        if(!_cursor_valid(retro,cur))
+            continue;
+
+        cur->off += RETRO_REC_SIZE(cur->hdr.caplen);
+
+        if(gbw_pcap_store_query_match(q,cur->hdr.ts,
+                    gbw_pcap_store_tuple_parse(cur->rec,cur->hdr.caplen,&tuple)?NULL:&tuple)){
+            cur->has_rec = 1;
+            return 1;
+        }
+    }
+
+    cur->off = cur->end;
+    return 0;
+}
+
+static int _write_rec(FILE *out,const retro_cursor_t *cur){
+
+    uint32_t hdr[4];
+
+    hdr[0] = (uint32_t)(cur->hdr.ts/1000000);
+    hdr[1] = (uint32_t)(cur->hdr.ts%1000000);
+    hdr[2] = cur->hdr.caplen;
+    hdr[3] = cur->hdr.len;
+
+    if(fwrite(hdr,sizeof(hdr),1,out)!=1)
+        return -1;
+
+    return fwrite(cur->rec,cur->hdr.caplen,1,out) == 1||cur->hdr.caplen == 0?0:-1;
+}
+
+/*
+ * What the rings hold when it starts,packets coming in meanwhile are left
+ * out,the workers' rings merged on time.
+ */
+static int _dump(gbw_probe_retro_t *retro,const gbw_probe_retro_trigger_t *trig){
+
+    retro_cursor_t curs[GBW_PROBE_MAX_WORKERS];
+    gbw_pcap_store_query_t q = trig->q;
+    char path[256],tmp[272];
+    retro_cursor_t *min;
+    uint64_t newest = 0,ts,pkts = 0;
+    unsigned int i,n = 0;
+    FILE *out;
+    int rc = 0;
+
+    for(i = 0;i<GBW_PROBE_MAX_WORKERS;i++){
+
+        if(retro->ctxs[i] == NULL)
+            continue;
+
+        curs[n].ctx = retro->ctxs[i];
+        curs[n].end = __atomic_load_n(&retro->ctxs[i]->head,__ATOMIC_ACQUIRE);
+        curs[n].off = __atomic_load_n(&retro->ctxs[i]->tail,__ATOMIC_RELAXED);
+        curs[n].rec = retro->recs[i];
+        curs[n].has_rec = 0;
+
+        ts = __atomic_load_n(&retro->ctxs[i]->last_ts,__ATOMIC_RELAXED);
+        if(ts>newest)
+            newest = ts;
+
+        n++;
+    }
+
+    if(q.ts_from == 0&&newest>retro->window_usecs)
+        q.ts_from = newest-retro->window_usecs;
+
+    if(trig->path[0])
+        snprintf(path,sizeof(path),"%s",trig->path);
+    else
+        snprintf(path,sizeof(path),"%s/retro_%lu_%u.pcap",retro->dir,
+                (unsigned long)time(NULL),retro->seq++);
+
+    snprintf(tmp,sizeof(tmp),"%s.part",path);
+
+    out = fopen(tmp,"wb");
+    if(out == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot open %s:%s",tmp,strerror(errno));
+        retro->failed++;
+        return -1;
+    }
+
+    rc = gbw_pcap_store_file_hdr_write(out,GBW_PROBE_RETRO_SNAPLEN);
+
+    for(i = 0;i<n;i++)
+        _cursor_next(retro,&curs[i],&q);
+
+    while(rc == 0){
+
+        min = NULL;
+        for(i = 0;i<n;i++){
+            if(curs[i].has_rec&&(min == NULL||curs[i].hdr.ts<min->hdr.ts))
+                min = &curs[i];
+        }
+
+        if(min == NULL)
+            break;
+
+        rc = _write_rec(out,min);
+        pkts++;
+
+        _cursor_next(retro,min,&q);
+    }
+
+    if(fclose(out))
+        rc = -1;
+
+    if(rc == 0&&rename(tmp,path))
+        rc = -1;
+
+    if(rc){
+        gbw_log(GBW_LOG_ERR,"Cannot write %s:%s",path,strerror(errno));
+        unlink(tmp);
+        retro->failed++;
+        return -1;
+    }
+
+    retro->dumps++;
+    retro->dumped_pkts += pkts;
+
+    gbw_log(GBW_LOG_INFO,"retro dumped %lu packets to %s",(unsigned long)pkts,path);
+
+    return 0;
+}
+
+/*Dumps what was asked for,returns how many*/
+static unsigned int _dump_pending(gbw_probe_retro_t *retro){
+
+    gbw_probe_retro_trigger_t trig;
+    unsigned int done = 0;
+    int got;
+
+    if(retro->signalled){
+
+        retro->signalled = 0;
+
+        memset(&trig,0,sizeof(trig));
+        _dump(retro,&trig);
+        done++;
+    }
+
+    for(;;){
+
+        rte_spinlock_lock(&retro->lock);
+
+        got = retro->nb_triggers>0;
+        if(got){
+            trig = retro->triggers[0];
+            memmove(&retro->triggers[0],&retro->triggers[1],
+                    (retro->nb_triggers-1)*sizeof(trig));
+            retro->nb_triggers--;
+        }
+
+        rte_spinlock_unlock(&retro->lock);
+
+        if(!got)
+            break;
+
+        _dump(retro,&trig);
+        done++;
+    }
+
+    return done;
+}
+
+static int _dumper_loop(void *arg){
+
+    gbw_probe_retro_t *retro = (gbw_probe_retro_t*)arg;
+    gbw_probe_engine_t *engine = retro->engine;
+
+    gbw_log(GBW_LOG_INFO,"retro dumper runs to %s",retro->dir);
+
+    while(!engine->quit){
+
+        if(_dump_pending(retro) == 0)
+            rte_delay_ms(RETRO_POLL_MS);
+    }
+
+    return 0;
+}
+
+/*Stage*/
+
+static uint16_t _retro_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_retro_ctx_t *ctx = (gbw_probe_retro_ctx_t*)_ctx;
+    uint64_t now = 0;
+    uint16_t i;
+
+    for(i = 0;i<n;i++)
+        _ring_put(ctx,pkts[i],gbw_probe_pkt_time(ctx->ts_offset,ctx->ts_flag,pkts[i],&now));
+
+    return n;
+}
+
+static void _ctx_free(gbw_probe_retro_ctx_t *ctx){
+
+    rte_free(ctx->data);
+    rte_free(ctx);
+}
+
+static void *_retro_init(gbw_probe_worker_t *worker,void *priv){
+
+    gbw_probe_retro_t *retro = (gbw_probe_retro_t*)priv;
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_retro_ctx_t *ctx;
+
+    ctx = (gbw_probe_retro_ctx_t*)rte_zmalloc_socket("gbw_probe_retro",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the retro stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->retro = retro;
+    ctx->size = (uint64_t)pcfg->retro_size*1024*1024;
+
+    ctx->data = (uint8_t*)rte_malloc_socket("gbw_probe_retro_ring",ctx->size,
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx->data == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the %uMB retro ring of worker:%u",pcfg->retro_size,worker->id);
+        rte_free(ctx);
+        return NULL;
+    }
+
+    retro->recs[worker->id] = (uint8_t*)rte_malloc_socket("gbw_probe_retro_rec",
+            GBW_PROBE_RETRO_SNAPLEN,0,retro->engine->socket_id);
+    if(retro->recs[worker->id] == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the retro dumper of worker:%u",worker->id);
+        _ctx_free(ctx);
+        return NULL;
+    }
+
+    if(rte_mbuf_dyn_rx_timestamp_register(&ctx->ts_offset,&ctx->ts_flag))
+        ctx->ts_offset = -1;
+
+    retro->ctxs[worker->id] = ctx;
+    retro->nb_ctxs++;
+
+    return ctx;
+}
+
+/*
+ * All lcores are back,the dumper too. The first worker in dumps what is
+ * still asked for while all rings are there.
+ */
+static void _retro_fin(gbw_probe_worker_t *worker,void *_ctx){
+
+    gbw_probe_retro_ctx_t *ctx = (gbw_probe_retro_ctx_t*)_ctx;
+    gbw_probe_retro_t *retro = ctx->retro;
+
+    if(!retro->finished){
+        retro->finished = 1;
+        _dump_pending(retro);
+    }
+
+    retro->ctxs[worker->id] = NULL;
+    retro->nb_ctxs--;
+
+    rte_free(retro->recs[worker->id]);
+    retro->recs[worker->id] = NULL;
+
+    _ctx_free(ctx);
+}
+
+static void _retro_dump(gbw_probe_worker_t *worker,void *_ctx,FILE *out){
+
+    gbw_probe_retro_ctx_t *ctx = (gbw_probe_retro_ctx_t*)_ctx;
+    gbw_probe_retro_t *retro = ctx->retro;
+
+    fprintf(out,"    retro pkts:%lu bytes:%lu evicted:%lu held:%lu/%lu\n",
+            (unsigned long)ctx->pkts,(unsigned long)ctx->bytes,(unsigned long)ctx->evicted,
+            (unsigned long)(ctx->head-ctx->tail),(unsigned long)ctx->size);
+
+    if(worker->id == 0)
+        fprintf(out,"    retro dumps:%lu pkts:%lu overruns:%lu failed:%lu waiting:%u\n",
+                (unsigned long)retro->dumps,(unsigned long)retro->dumped_pkts,
+                (unsigned long)retro->overruns,(unsigned long)retro->failed,retro->nb_triggers);
+}
+
+static const gbw_probe_stage_t _retro_stage = {
+    .name = "retro",
+    .init = _retro_init,
+    .process = _retro_process,
+    .fin = _retro_fin,
+    .timer = NULL,
+    .dump = _retro_dump,
+    .priv = NULL,
+};
+
+gbw_probe_retro_t * gbw_probe_retro_create(gbw_probe_engine_t *engine){
+
+    gbw_probe_config_t *pcfg = engine->pcfg;
+    gbw_probe_retro_t *retro;
+    gbw_probe_stage_t stage;
+
+    if(pcfg->retro_size == 0)
+        return NULL;
+
+    retro = (gbw_probe_retro_t*)gbw_pcalloc(engine->mp,sizeof(*retro));
+    if(retro == NULL)
+        return NULL;
+
+    retro->engine = engine;
+    retro->dir = pcfg->retro_dir;
+    retro->window_usecs = (uint64_t)pcfg->retro_secs*1000000;
+
+    rte_spinlock_init(&retro->lock);
+
+    stage = _retro_stage;
+    stage.priv = retro;
+
+    if(gbw_probe_service_register(engine,"retro",_dumper_loop,retro)||
+            gbw_probe_stage_register(engine,&stage))
+        return NULL;
+
+    return retro;
+}
+
+int gbw_probe_retro_trigger(gbw_probe_retro_t *retro,const gbw_pcap_store_query_t *q,const char *path){
+
+    gbw_probe_retro_trigger_t *trig;
+    int rc = -1;
+
+    rte_spinlock_lock(&retro->lock);
+
+    if(retro->nb_triggers<GBW_PROBE_RETRO_MAX_TRIGGERS){
+
+        trig = &retro->triggers[retro->nb_triggers];
+        memset(trig,0,sizeof(*trig));
+
+        if(q)
+            trig->q = *q;
+        if(path)
+            snprintf(trig->path,sizeof(trig->path),"%s",path);
+
+        retro->nb_triggers++;
+        rc = 0;
+    }
+
+    rte_spinlock_unlock(&retro->lock);
+
+    return rc;
+}
+
+void gbw_probe_retro_flow_query(const gbw_flow_key_t *key,gbw_pcap_store_query_t *q){
+
+    uint8_t alen = key->ip_version == 6?16:4;
+
+    memset(q,0,sizeof(*q));
+
+    q->proto = key->proto;
+
+    q->ends[0].addr_len = alen;
+    memcpy(q->ends[0].addr,key->addr_lo,alen);
+    q->ends[0].port = key->port_lo;
+
+    q->ends[1].addr_len = alen;
+    memcpy(q->ends[1].addr,key->addr_hi,alen);
+    q->ends[1].port = key->port_hi;
+}
@@ -0,0 +1,136 @@
+/*
+ *
+ *      Filename: gbw_probe_retro.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: retrospective packet buffer,a hugepage ring per worker
+ *                holding the last packets a dumper lcore writes out to
+ *                pcap files on a trigger,while the workers go on
+ *
+ */
+
+#ifndef GBW_PROBE_RETRO_H
+#define GBW_PROBE_RETRO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <rte_spinlock.h>
+
+#include "gbw_flow_table.h"
+#include "gbw_pcap_store.h"
+#include "gbw_probe_engine.h"
+
+/*
+ * A record is its 64 bits usec timestamp,32 bits caplen and wire
+ * length,then the packet padded to 8 bytes. Records never wrap: the
+ * room left at the end of the ring is skipped,marked by a record of
+ * caplen GBW_PROBE_RETRO_SKIP if it has space for one.
+ */
+#define GBW_PROBE_RETRO_REC_HDR 16
+#define GBW_PROBE_RETRO_SKIP UINT32_MAX
+#define GBW_PROBE_RETRO_SNAPLEN 65535
+
+/*triggers waiting for the dumper at most*/
+#define GBW_PROBE_RETRO_MAX_TRIGGERS 8
+
+typedef struct gbw_probe_retro_trigger_t gbw_probe_retro_trigger_t;
+typedef struct gbw_probe_retro_t gbw_probe_retro_t;
+typedef struct gbw_probe_retro_ctx_t gbw_probe_retro_ctx_t;
+
+struct gbw_probe_retro_trigger_t {
+
+    gbw_pcap_store_query_t q;
+    char path[256];
+};
+
+/*Shared by all workers and the dumper*/
+struct gbw_probe_retro_t {
+
+    gbw_probe_engine_t *engine;
+
+    const char *dir;
+    uint64_t window_usecs;
+
+    rte_spinlock_t lock;
+    uint32_t nb_triggers;
+    uint32_t seq;
+    gbw_probe_retro_trigger_t triggers[GBW_PROBE_RETRO_MAX_TRIGGERS];
+
+    /*set from a signal handler,a dump of everything*/
+    volatile int signalled;
+
+    uint16_t nb_ctxs;
+    gbw_probe_retro_ctx_t *ctxs[GBW_PROBE_MAX_WORKERS];
+
+    /*dumper side,a record of each ring being merged*/
+    uint8_t *recs[GBW_PROBE_MAX_WORKERS];
+
+    /*the stage fin dumps what is still waiting once*/
+    int finished;
+
+    uint64_t dumps;
+    uint64_t dumped_pkts;
+    uint64_t overruns;
+    uint64_t failed;
+};
+
+/*
+ * The worker is the only writer of the ring. It moves tail past the
+ * records it is about to overwrite before it writes,so a reader that
+ * copied a record at off and then still sees tail<=off got it whole.
+ */
+struct gbw_probe_retro_ctx_t {
+
+    gbw_probe_retro_t *retro;
+
+    uint8_t *data;
+    uint64_t size;
+
+    /*bytes ever written,the next record goes at head%size*/
+    volatile uint64_t head;
+    /*where the oldest record still kept starts*/
+    volatile uint64_t tail;
+
+    /*of the newest packet*/
+    volatile uint64_t last_ts;
+
+    /*rx timestamp dynfield of the pcap port,-1 if none*/
+    int ts_offset;
+    uint64_t ts_flag;
+
+    uint64_t pkts;
+    uint64_t bytes;
+    uint64_t evicted;
+
+}__rte_cache_aligned;
+
+/*
+ * Creates the rings out of the Retro* config,takes a service lcore for
+ * the dumper and registers the retro stage,right after decode so packets
+ * are kept as they came in. Returns NULL when RetroSize is 0 or on
+ * failure.
+ */
+extern gbw_probe_retro_t * gbw_probe_retro_create(gbw_probe_engine_t *engine);
+
+/*
+ * From any lcore,queues a dump of the packets matching q,or of all when
+ * it is NULL,to path,or to RetroDir/retro_<secs>_<seq>.pcap when NULL.
+ * Without ts_from the window is the last RetroSeconds up to the newest
+ * packet. Returns -1 when too many dumps are waiting.
+ */
+extern int gbw_probe_retro_trigger(gbw_probe_retro_t *retro,const gbw_pcap_store_query_t *q,const char *path);
+
+/*
+ * A query for the packets of a flow,ts left open. Packets are matched on
+ * their outermost IP header,tunneled flows are not found by their key.
+ */
+extern void gbw_probe_retro_flow_query(const gbw_flow_key_t *key,gbw_pcap_store_query_t *q);
+
+/*From a signal handler,a dump of everything in the window*/
+static inline void gbw_probe_retro_signal(gbw_probe_retro_t *retro){
+
+    retro->signalled = 1;
+}
+
+#endif /*GBW_PROBE_RETRO_H*/
@@ -0,0 +1,589 @@
+/*
+ *
+ *      Filename: gbw_probe_sketch.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: top talkers,ports and protocols and distinct counts,per
+ *                worker sketches an aggregator lcore swaps out,merges and
+ *                reports every interval
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <rte_malloc.h>
+#include <rte_cycles.h>
+
+#include "gbw_probe_sketch.h"
+#include "gbw_probe_decode.h"
+#include "gbw_log.h"
+
+#define SKETCH_POLL_MS 10
+
+/*entries of each dimension the stats dump shows*/
+#define SKETCH_DUMP_TOP 5
+
+/*keys there can be of a dimension,its sketches need no more room*/
+#define SKETCH_PORT_KEYS  (1U<<17)
+#define SKETCH_PROTO_KEYS 256U
+
+static const char *dim_names[GBW_PROBE_SKETCH_DIMS] = {"talker","port","proto"};
+static const char *card_names[GBW_PROBE_SKETCH_CARDS] = {"sources","destinations","flows"};
+
+static void _set_destroy(gbw_probe_sketch_set_t *set){
+
+    int d;
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+
+        if(set->cms[d])
+            gbw_sketch_cms_destroy(set->cms[d]);
+        if(set->ss[d])
+            gbw_sketch_ss_destroy(set->ss[d]);
+
+        set->cms[d] = NULL;
+        set->ss[d] = NULL;
+    }
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++){
+
+        if(set->hll[d])
+            gbw_hll_destroy(set->hll[d]);
+
+        set->hll[d] = NULL;
+    }
+}
+
+static int _set_create(gbw_probe_sketch_set_t *set,gbw_probe_config_t *pcfg,gbw_pool_t *mp){
+
+    uint32_t keys[GBW_PROBE_SKETCH_DIMS] = {UINT32_MAX,SKETCH_PORT_KEYS,SKETCH_PROTO_KEYS};
+    uint32_t width,counters;
+    int d;
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+
+        width = pcfg->sketch_width<keys[d]?pcfg->sketch_width:keys[d];
+        counters = pcfg->sketch_counters<keys[d]?pcfg->sketch_counters:keys[d];
+
+        set->cms[d] = gbw_sketch_cms_create(mp,pcfg->sketch_depth,width);
+        set->ss[d] = gbw_sketch_ss_create(mp,counters);
+
+        if(set->cms[d] == NULL||set->ss[d] == NULL){
+            _set_destroy(set);
+            return -1;
+        }
+    }
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++){
+
+        set->hll[d] = gbw_hll_create(mp,(uint8_t)pcfg->sketch_hll_precision);
+        if(set->hll[d] == NULL){
+            _set_destroy(set);
+            return -1;
+        }
+    }
+
+    set->pkts = 0;
+    set->bytes = 0;
+
+    return 0;
+}
+
+static void _set_clear(gbw_probe_sketch_set_t *set){
+
+    int d;
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+        gbw_sketch_cms_clear(set->cms[d]);
+        gbw_sketch_ss_clear(set->ss[d]);
+    }
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++)
+        gbw_hll_clear(set->hll[d]);
+
+    set->pkts = 0;
+    set->bytes = 0;
+}
+
+static inline uint64_t _count(gbw_probe_sketch_set_t *set,int d,const gbw_sketch_key_t *key,uint64_t bytes){
+
+    uint64_t hash = gbw_sketch_key_hash(key);
+
+    gbw_sketch_cms_update(set->cms[d],hash,bytes);
+    gbw_sketch_ss_update(set->ss[d],key,hash,bytes);
+
+    return hash;
+}
+
+/*IPv4 addresses as IPv4-mapped IPv6 ones*/
+static inline void _addr_key(gbw_sketch_key_t *key,const gbw_probe_pkt_t *pkt,const uint8_t *addr){
+
+    uint8_t *a = (uint8_t*)key->w;
+
+    if(pkt->l3_type == GBW_PKT_L3_IPV6){
+        memcpy(a,addr,16);
+        return;
+    }
+
+    key->w[0] = 0;
+    key->w[1] = 0;
+    a[10] = a[11] = 0xff;
+    memcpy(a+12,addr,4);
+}
+
+/*Worker side,no atomics: the set belongs to this worker until it moves on*/
+static uint16_t _sketch_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_sketch_ctx_t *ctx = (gbw_probe_sketch_ctx_t*)_ctx;
+    gbw_probe_sketch_set_t *set = ctx->set;
+    gbw_probe_pkt_t *pkt;
+    gbw_sketch_key_t key;
+    uint64_t bytes,src_hash,dst_hash,flow_hash;
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        pkt = gbw_probe_pkt(pkts[i]);
+        bytes = pkts[i]->pkt_len;
+
+        set->pkts++;
+        set->bytes += bytes;
+
+        if(pkt->l3_type!=GBW_PKT_L3_IPV4&&pkt->l3_type!=GBW_PKT_L3_IPV6)
+            continue;
+
+        _addr_key(&key,pkt,gbw_probe_pkt_src_addr(pkts[i],pkt));
+        src_hash = _count(set,GBW_PROBE_SKETCH_TALKER,&key,bytes);
+
+        _addr_key(&key,pkt,gbw_probe_pkt_dst_addr(pkts[i],pkt));
+        dst_hash = gbw_sketch_key_hash(&key);
+
+        /*both directions of a flow count once*/
+        flow_hash = gbw_sketch_mix64(gbw_sketch_mix64(src_hash^pkt->sport)+gbw_sketch_mix64(dst_hash^pkt->dport)+pkt->proto);
+
+        gbw_hll_add(set->hll[GBW_PROBE_SKETCH_SRCS],src_hash);
+        gbw_hll_add(set->hll[GBW_PROBE_SKETCH_DSTS],dst_hash);
+        gbw_hll_add(set->hll[GBW_PROBE_SKETCH_FLOWS],flow_hash);
+
+        key.w[1] = 0;
+
+        if(pkt->flags&GBW_PKT_F_L4){
+            key.w[0] = (uint64_t)pkt->proto<<16|pkt->dport;
+            _count(set,GBW_PROBE_SKETCH_PORT,&key,bytes);
+        }
+
+        key.w[0] = pkt->proto;
+        _count(set,GBW_PROBE_SKETCH_PROTO,&key,bytes);
+    }
+
+    return n;
+}
+
+/*Moves to the set of a new epoch,the release orders every count before it*/
+static void _sketch_timer(gbw_probe_worker_t *worker __rte_unused,void *_ctx,uint64_t cycles __rte_unused){
+
+    gbw_probe_sketch_ctx_t *ctx = (gbw_probe_sketch_ctx_t*)_ctx;
+    uint32_t epoch = __atomic_load_n(&ctx->sk->epoch,__ATOMIC_ACQUIRE);
+    unsigned int i;
+
+    if(epoch == ctx->epoch)
+        return;
+
+    ctx->set = &ctx->sets[epoch&1];
+    ctx->swaps++;
+
+    for(i = 0;i<ctx->nb_listeners;i++)
+        ctx->swap_fns[i](&ctx->sets[(epoch&1)^1],epoch,ctx->swap_privs[i]);
+
+    __atomic_store_n(&ctx->epoch,epoch,__ATOMIC_RELEASE);
+}
+
+/*Aggregator side*/
+
+static int _epoch_swap(gbw_probe_sketch_t *sk,uint32_t epoch){
+
+    uint16_t i;
+
+    __atomic_store_n(&sk->epoch,epoch,__ATOMIC_RELEASE);
+
+    /*within a timer period of each worker*/
+    for(i = 0;i<sk->nb_ctxs;i++){
+
+        while(__atomic_load_n(&sk->ctxs[i]->epoch,__ATOMIC_ACQUIRE)!=epoch){
+
+            if(sk->engine->quit)
+                return -1;
+
+            rte_pause();
+        }
+    }
+
+    return 0;
+}
+
+static void _merge(gbw_probe_sketch_t *sk,uint32_t epoch){
+
+    gbw_probe_sketch_set_t *merged = &sk->merged;
+    gbw_probe_sketch_set_t *old;
+    uint16_t i;
+    int d;
+
+    _set_clear(merged);
+
+    for(i = 0;i<sk->nb_ctxs;i++){
+
+        old = &sk->ctxs[i]->sets[(epoch&1)^1];
+
+        for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+            gbw_sketch_cms_merge(merged->cms[d],old->cms[d]);
+            gbw_sketch_ss_merge(merged->ss[d],old->ss[d]);
+        }
+
+        for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++)
+            gbw_hll_merge(merged->hll[d],old->hll[d]);
+
+        merged->pkts += old->pkts;
+        merged->bytes += old->bytes;
+
+        /*ready for when the worker comes back to it*/
+        _set_clear(old);
+    }
+}
+
+/*
+ * Space-Saving picks the keys and bounds their bytes from below,
+ * Count-Min tightens the bound from above.
+ */
+static void _publish(gbw_probe_sketch_t *sk,uint32_t epoch){
+
+    gbw_probe_sketch_report_t *r = &sk->report;
+    gbw_probe_sketch_set_t *merged = &sk->merged;
+    gbw_sketch_ss_entry_t *e;
+    gbw_probe_sketch_top_t *t;
+    uint64_t est;
+    uint32_t i,n;
+    int d;
+
+    __atomic_store_n(&sk->report_seq,sk->report_seq+1,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r->at = (uint64_t)time(NULL);
+    r->epoch = epoch;
+    r->pkts = merged->pkts;
+    r->bytes = merged->bytes;
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++)
+        r->distinct[d] = gbw_hll_count(merged->hll[d]);
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+
+        n = gbw_sketch_ss_top(merged->ss[d],sk->scratch,sk->top_k);
+
+        for(i = 0;i<n;i++){
+
+            e = &sk->scratch[i];
+            t = &r->top[d][i];
+
+            est = gbw_sketch_cms_estimate(merged->cms[d],gbw_sketch_key_hash(&e->key));
+
+            t->key = e->key;
+            t->bytes = est<e->count?est:e->count;
+            t->bytes_min = e->count-e->err;
+        }
+
+        r->n[d] = n;
+    }
+
+    __atomic_store_n(&sk->report_seq,sk->report_seq+1,__ATOMIC_RELEASE);
+}
+
+int gbw_probe_sketch_listen(gbw_probe_sketch_ctx_t *ctx,gbw_probe_sketch_swap_fn fn,void *priv){
+
+    if(ctx->nb_listeners>=GBW_PROBE_SKETCH_MAX_LISTENERS){
+        gbw_log(GBW_LOG_ERR,"Too many sketch swap listeners");
+        return -1;
+    }
+
+    ctx->swap_fns[ctx->nb_listeners] = fn;
+    ctx->swap_privs[ctx->nb_listeners] = priv;
+    ctx->nb_listeners++;
+
+    return 0;
+}
+
+uint32_t gbw_probe_sketch_top(gbw_probe_sketch_t *sk,int dim,gbw_probe_sketch_top_t *out,uint32_t max,
+        gbw_probe_sketch_report_t *hdr){
+
+    gbw_probe_sketch_report_t *r = &sk->report;
+    uint32_t seq,n;
+
+    if(dim<0||dim>=GBW_PROBE_SKETCH_DIMS)
+        return 0;
+
+    for(;;){
+
+        seq = __atomic_load_n(&sk->report_seq,__ATOMIC_ACQUIRE);
+        if(seq&1){
+            rte_pause();
+            continue;
+        }
+
+        n = r->n[dim]<max?r->n[dim]:max;
+        memcpy(out,r->top[dim],n*sizeof(*out));
+
+        if(hdr){
+            *hdr = *r;
+            hdr->top[0] = hdr->top[1] = hdr->top[2] = NULL;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&sk->report_seq,__ATOMIC_RELAXED) == seq)
+            return n;
+    }
+}
+
+static const char *_key_str(int dim,const gbw_sketch_key_t *key,char *buf,size_t size){
+
+    static const uint8_t v4_mapped[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+    const uint8_t *a = (const uint8_t*)key->w;
+
+    switch(dim){
+    case GBW_PROBE_SKETCH_TALKER:
+        if(memcmp(a,v4_mapped,12) == 0)
+            return inet_ntop(AF_INET,a+12,buf,(socklen_t)size);
+        return inet_ntop(AF_INET6,a,buf,(socklen_t)size);
+    case GBW_PROBE_SKETCH_PORT:
+        snprintf(buf,size,"%u/%u",(unsigned int)(key->w[0]>>16),(unsigned int)(key->w[0]&0xffff));
+        return buf;
+    default:
+        snprintf(buf,size,"%u",(unsigned int)key->w[0]);
+        return buf;
+    }
+}
+
+static void _report_print(gbw_probe_sketch_t *sk,FILE *out,const char *indent,uint32_t max){
+
+    gbw_probe_sketch_report_t *r = &sk->report;
+    gbw_probe_sketch_top_t *t;
+    char buf[64];
+    uint32_t i;
+    int d;
+
+    fprintf(out,"%ssketch report at:%lu epoch:%u pkts:%lu bytes:%lu\n",indent,
+            (unsigned long)r->at,r->epoch,(unsigned long)r->pkts,(unsigned long)r->bytes);
+
+    for(d = 0;d<GBW_PROBE_SKETCH_CARDS;d++)
+        fprintf(out,"%sdistinct %s:%lu\n",indent,card_names[d],(unsigned long)r->distinct[d]);
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+
+        for(i = 0;i<r->n[d]&&i<max;i++){
+
+            t = &r->top[d][i];
+            fprintf(out,"%s%s %s bytes:%lu min:%lu\n",indent,dim_names[d],_key_str(d,&t->key,buf,sizeof(buf)),
+                    (unsigned long)t->bytes,(unsigned long)t->bytes_min);
+        }
+    }
+}
+
+/*Rewritten whole,readers never see half a report*/
+static void _report_write(gbw_probe_sketch_t *sk){
+
+    char tmp[256];
+    FILE *fp;
+
+    if(sk->report_file == NULL)
+        return;
+
+    snprintf(tmp,sizeof(tmp),"%s.tmp",sk->report_file);
+
+    fp = fopen(tmp,"w");
+    if(fp == NULL){
+        gbw_log(GBW_LOG_ERR,"Cannot open the sketch report:%s",tmp);
+        return;
+    }
+
+    _report_print(sk,fp,"",sk->top_k);
+
+    if(fclose(fp)||rename(tmp,sk->report_file))
+        gbw_log(GBW_LOG_ERR,"Cannot write the sketch report:%s",sk->report_file);
+}
+
+static int _aggregator_loop(void *arg){
+
+    gbw_probe_sketch_t *sk = (gbw_probe_sketch_t*)arg;
+    gbw_probe_engine_t *engine = sk->engine;
+    uint64_t next = rte_get_timer_cycles()+sk->interval_cycles;
+    uint32_t epoch = 0;
+
+    gbw_log(GBW_LOG_INFO,"sketch aggregator runs every %lu cycles",(unsigned long)sk->interval_cycles);
+
+    while(!engine->quit){
+
+        rte_delay_ms(SKETCH_POLL_MS);
+
+        if(rte_get_timer_cycles()<next)
+            continue;
+
+        next += sk->interval_cycles;
+
+        if(_epoch_swap(sk,++epoch))
+            break;
+
+        _merge(sk,epoch);
+        _publish(sk,epoch);
+        _report_write(sk);
+    }
+
+    return 0;
+}
+
+static void _ctx_free(gbw_probe_sketch_ctx_t *ctx){
+
+    _set_destroy(&ctx->sets[0]);
+    _set_destroy(&ctx->sets[1]);
+    rte_free(ctx);
+}
+
+static void *_sketch_init(gbw_probe_worker_t *worker,void *priv){
+
+    gbw_probe_sketch_t *sk = (gbw_probe_sketch_t*)priv;
+    gbw_probe_engine_t *engine = worker->engine;
+    gbw_probe_sketch_ctx_t *ctx;
+
+    ctx = (gbw_probe_sketch_ctx_t*)rte_zmalloc_socket("gbw_probe_sketch",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the sketch stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->sk = sk;
+
+    if(_set_create(&ctx->sets[0],engine->pcfg,engine->mp)||_set_create(&ctx->sets[1],engine->pcfg,engine->mp)){
+        gbw_log(GBW_LOG_ERR,"No memory for the sketches of worker:%u",worker->id);
+        _ctx_free(ctx);
+        return NULL;
+    }
+
+    ctx->epoch = sk->epoch;
+    ctx->set = &ctx->sets[ctx->epoch&1];
+
+    sk->ctxs[sk->nb_ctxs++] = ctx;
+    sk->nb_workers_left++;
+
+    return ctx;
+}
+
+/*All lcores are back,the aggregator too*/
+static void _sketch_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_sketch_ctx_t *ctx = (gbw_probe_sketch_ctx_t*)_ctx;
+    gbw_probe_sketch_t *sk = ctx->sk;
+
+    if(--sk->nb_workers_left == 0){
+        sk->nb_ctxs = 0;
+        _set_destroy(&sk->merged);
+    }
+
+    _ctx_free(ctx);
+}
+
+static void _sketch_dump(gbw_probe_worker_t *worker,void *_ctx,FILE *out){
+
+    gbw_probe_sketch_ctx_t *ctx = (gbw_probe_sketch_ctx_t*)_ctx;
+    gbw_probe_sketch_t *sk = ctx->sk;
+    gbw_probe_sketch_set_t *set = ctx->set;
+    gbw_probe_sketch_report_t r;
+    gbw_probe_sketch_top_t top[SKETCH_DUMP_TOP];
+    char buf[64];
+    uint32_t i,n;
+    int d;
+
+    fprintf(out,"    sketch epoch:%u swaps:%lu pkts:%lu bytes:%lu\n",ctx->epoch,(unsigned long)ctx->swaps,
+            (unsigned long)set->pkts,(unsigned long)set->bytes);
+
+    if(worker->id!=0)
+        return;
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+
+        n = gbw_probe_sketch_top(sk,d,top,SKETCH_DUMP_TOP,&r);
+
+        if(d == 0)
+            fprintf(out,"    sketch report at:%lu epoch:%u pkts:%lu bytes:%lu sources:%lu destinations:%lu flows:%lu\n",
+                    (unsigned long)r.at,r.epoch,(unsigned long)r.pkts,(unsigned long)r.bytes,
+                    (unsigned long)r.distinct[GBW_PROBE_SKETCH_SRCS],(unsigned long)r.distinct[GBW_PROBE_SKETCH_DSTS],
+                    (unsigned long)r.distinct[GBW_PROBE_SKETCH_FLOWS]);
+
+        for(i = 0;i<n;i++)
+            fprintf(out,"      %s %s bytes:%lu min:%lu\n",dim_names[d],_key_str(d,&top[i].key,buf,sizeof(buf)),
+                    (unsigned long)top[i].bytes,(unsigned long)top[i].bytes_min);
+    }
+}
+
+static const gbw_probe_stage_t _sketch_stage = {
+    .name = "sketch",
+    .init = _sketch_init,
+    .process = _sketch_process,
+    .fin = _sketch_fin,
+    .timer = _sketch_timer,
+    .dump = _sketch_dump,
+    .priv = NULL,
+};
+
+gbw_probe_sketch_t * gbw_probe_sketch_create(gbw_probe_engine_t *engine){
+
+    gbw_probe_config_t *pcfg = engine->pcfg;
+    gbw_probe_sketch_t *sk;
+    gbw_probe_stage_t stage;
+    int d;
+
+    if(pcfg->sketch_interval == 0)
+        return NULL;
+
+    sk = (gbw_probe_sketch_t*)gbw_pcalloc(engine->mp,sizeof(*sk));
+    if(sk == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the sketch aggregator");
+        return NULL;
+    }
+
+    sk->engine = engine;
+    sk->top_k = pcfg->sketch_top_k;
+    sk->interval_cycles = rte_get_timer_hz()*pcfg->sketch_interval;
+    sk->report_file = pcfg->sketch_report_file;
+
+    sk->scratch = (gbw_sketch_ss_entry_t*)gbw_pcalloc(engine->mp,sk->top_k*sizeof(gbw_sketch_ss_entry_t));
+    if(sk->scratch == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the top %u of the sketch report",sk->top_k);
+        return NULL;
+    }
+
+    for(d = 0;d<GBW_PROBE_SKETCH_DIMS;d++){
+
+        sk->report.top[d] = (gbw_probe_sketch_top_t*)gbw_pcalloc(engine->mp,sk->top_k*sizeof(gbw_probe_sketch_top_t));
+        if(sk->report.top[d] == NULL){
+            gbw_log(GBW_LOG_ERR,"No memory for the top %u of the sketch report",sk->top_k);
+            return NULL;
+        }
+    }
+
+    if(_set_create(&sk->merged,pcfg,engine->mp)){
+        gbw_log(GBW_LOG_ERR,"No memory for the merged sketches");
+        return NULL;
+    }
+
+    stage = _sketch_stage;
+    stage.priv = sk;
+
+    if(gbw_probe_service_register(engine,"sketch",_aggregator_loop,sk)||
+            gbw_probe_stage_register(engine,&stage)){
+        _set_destroy(&sk->merged);
+        return NULL;
+    }
+
+    return sk;
+}
@@ -0,0 +1,149 @@
+/*
+ *
+ *      Filename: gbw_probe_sketch.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: top talkers,ports and protocols and distinct counts,per
+ *                worker sketches an aggregator lcore swaps out,merges and
+ *                reports every interval
+ *
+ */
+
+#ifndef GBW_PROBE_SKETCH_H
+#define GBW_PROBE_SKETCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_sketch.h"
+#include "gbw_hll.h"
+#include "gbw_probe_engine.h"
+
+/*
+ * What the sketches count bytes of: source addresses as IPv6 or
+ * IPv4-mapped ones,IP protocol<<16|destination port,IP protocol.
+ */
+#define GBW_PROBE_SKETCH_TALKER 0
+#define GBW_PROBE_SKETCH_PORT   1
+#define GBW_PROBE_SKETCH_PROTO  2
+#define GBW_PROBE_SKETCH_DIMS   3
+
+/*What the HyperLogLogs count distinct: source and destination addresses,flows*/
+#define GBW_PROBE_SKETCH_SRCS  0
+#define GBW_PROBE_SKETCH_DSTS  1
+#define GBW_PROBE_SKETCH_FLOWS 2
+#define GBW_PROBE_SKETCH_CARDS 3
+
+/*most callbacks told about swapped out sets,see gbw_probe_sketch_listen*/
+#define GBW_PROBE_SKETCH_MAX_LISTENERS 4
+
+typedef struct gbw_probe_sketch_set_t gbw_probe_sketch_set_t;
+typedef struct gbw_probe_sketch_top_t gbw_probe_sketch_top_t;
+typedef struct gbw_probe_sketch_report_t gbw_probe_sketch_report_t;
+typedef struct gbw_probe_sketch_t gbw_probe_sketch_t;
+typedef struct gbw_probe_sketch_ctx_t gbw_probe_sketch_ctx_t;
+
+/*
+ * Called on the worker with the set it just left,before the aggregator
+ * gets it,to read only.
+ */
+typedef void (*gbw_probe_sketch_swap_fn)(const gbw_probe_sketch_set_t *set,uint32_t epoch,void *priv);
+
+struct gbw_probe_sketch_set_t {
+
+    gbw_sketch_cms_t *cms[GBW_PROBE_SKETCH_DIMS];
+    gbw_sketch_ss_t *ss[GBW_PROBE_SKETCH_DIMS];
+    gbw_hll_t *hll[GBW_PROBE_SKETCH_CARDS];
+
+    uint64_t pkts;
+    uint64_t bytes;
+};
+
+/*The true bytes of key are in [bytes_min,bytes]*/
+struct gbw_probe_sketch_top_t {
+
+    gbw_sketch_key_t key;
+    uint64_t bytes;
+    uint64_t bytes_min;
+};
+
+struct gbw_probe_sketch_report_t {
+
+    /*wall clock secs it was made,0 before the first one*/
+    uint64_t at;
+    uint32_t epoch;
+
+    uint64_t pkts;
+    uint64_t bytes;
+
+    uint64_t distinct[GBW_PROBE_SKETCH_CARDS];
+
+    uint32_t n[GBW_PROBE_SKETCH_DIMS];
+    gbw_probe_sketch_top_t *top[GBW_PROBE_SKETCH_DIMS];
+};
+
+/*Shared by all workers,the merged sketches are only touched by the aggregator*/
+struct gbw_probe_sketch_t {
+
+    gbw_probe_engine_t *engine;
+
+    uint32_t top_k;
+    uint64_t interval_cycles;
+    const char *report_file;
+
+    /*
+     * Bumped by the aggregator,a worker moves to the set of the new
+     * epoch on its next timer and acks it in its ctx: the set it left is
+     * the aggregator's until the epoch after.
+     */
+    volatile uint32_t epoch;
+
+    uint16_t nb_ctxs;
+    uint16_t nb_workers_left;
+    gbw_probe_sketch_ctx_t *ctxs[GBW_PROBE_MAX_WORKERS];
+
+    gbw_probe_sketch_set_t merged;
+    gbw_sketch_ss_entry_t *scratch;
+
+    /*odd while the aggregator writes the report*/
+    volatile uint32_t report_seq;
+    gbw_probe_sketch_report_t report;
+};
+
+struct gbw_probe_sketch_ctx_t {
+
+    gbw_probe_sketch_t *sk;
+
+    /*sets[epoch&1],the one packets go to*/
+    gbw_probe_sketch_set_t *set;
+
+    /*the last epoch the worker moved to*/
+    volatile uint32_t epoch;
+
+    gbw_probe_sketch_set_t sets[2];
+
+    unsigned int nb_listeners;
+    gbw_probe_sketch_swap_fn swap_fns[GBW_PROBE_SKETCH_MAX_LISTENERS];
+    void *swap_privs[GBW_PROBE_SKETCH_MAX_LISTENERS];
+
+    uint64_t swaps;
+
+}__rte_cache_aligned;
+
+/*
+ * Creates the sketches out of the Sketch* config,takes a service lcore
+ * for the aggregator and registers the sketch stage,after decode.
+ * Returns NULL when SketchInterval is 0 or on failure.
+ */
+extern gbw_probe_sketch_t * gbw_probe_sketch_create(gbw_probe_engine_t *engine);
+
+extern int gbw_probe_sketch_listen(gbw_probe_sketch_ctx_t *ctx,gbw_probe_sketch_swap_fn fn,void *priv);
+
+/*
+ * Copies at most max entries of dimension dim of the last report,largest
+ * first,from any lcore. Returns how many,hdr gets the rest if not NULL.
+ */
+extern uint32_t gbw_probe_sketch_top(gbw_probe_sketch_t *sk,int dim,gbw_probe_sketch_top_t *out,uint32_t max,
+        gbw_probe_sketch_report_t *hdr);
+
+#endif /*GBW_PROBE_SKETCH_H*/
@@ -0,0 +1,680 @@
+/*
+ *
+ *      Filename: gbw_probe_tcp.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: TCP reassembly stage,turns the segments of each flow into
+ *                in order byte streams for the protocol parsers
+ *
+ */
+
+#include <netinet/in.h>
+#include <rte_malloc.h>
+
+#include "gbw_probe_tcp.h"
+#include "gbw_probe_decode.h"
+#include "gbw_log.h"
+
+#define SEQ_LT(a,b)  ((int32_t)((a)-(b))<0)
+#define SEQ_LEQ(a,b) ((int32_t)((a)-(b))<=0)
+#define SEQ_GT(a,b)  ((int32_t)((a)-(b))>0)
+#define SEQ_GEQ(a,b) ((int32_t)((a)-(b))>=0)
+
+#define TCP_SEQ_OFF 4
+#define TCP_FLAGS_OFF 13
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+
+#define rd32(p) (((uint32_t)(p)[0]<<24)|((uint32_t)(p)[1]<<16)|((uint32_t)(p)[2]<<8)|(p)[3])
+
+/*what a waiting segment pins: the whole mbuf buffer,not just its bytes*/
+static inline uint32_t _seg_cost(struct rte_mbuf *m){
+
+    return (uint32_t)m->buf_len+sizeof(gbw_probe_tcp_seg_t);
+}
+
+static inline void _lru_update(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess){
+
+    if(sess->held){
+
+        if(sess->in_lru)
+            list_move_tail(&sess->lru_node,&ctx->lru);
+        else
+            list_add_tail(&sess->lru_node,&ctx->lru);
+
+        sess->in_lru = 1;
+    }else if(sess->in_lru){
+
+        list_del(&sess->lru_node);
+        sess->in_lru = 0;
+    }
+}
+
+static inline gbw_probe_tcp_seg_t * _seg_get(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,
+        struct rte_mbuf *m,uint32_t seq,uint32_t len,uint16_t off){
+
+    gbw_probe_tcp_seg_t *seg;
+    uint32_t cost;
+
+    /*
+     * an external buffer is the producer's shm ring,given back in ring
+     * order only: holding it would stall the ring behind it for as long
+     * as the hole stays open,so the bytes are copied out instead,as are
+     * those of a chain that segments could not be read from in place
+     */
+    if(RTE_MBUF_HAS_EXTBUF(m)||m->nb_segs>1){
+
+        m = rte_pktmbuf_copy(m,m->pool,off,len);
+        if(m == NULL)
+            return NULL;
+
+        if(m->nb_segs>1){
+            rte_pktmbuf_free(m);
+            return NULL;
+        }
+
+        off = 0;
+        ctx->copied++;
+    }else{
+
+        rte_mbuf_refcnt_update(m,1);
+    }
+
+    cost = _seg_cost(m);
+
+    if(!list_empty(&sess->free_segs)){
+
+        seg = list_first_entry(&sess->free_segs,gbw_probe_tcp_seg_t,node);
+        list_del(&seg->node);
+    }else{
+
+        seg = (gbw_probe_tcp_seg_t*)gbw_pcalloc(sess->mp,sizeof(*seg));
+        if(seg == NULL){
+            rte_pktmbuf_free(m);
+            return NULL;
+        }
+    }
+
+    seg->m = m;
+    seg->seq = seq;
+    seg->len = len;
+    seg->off = off;
+
+    sess->held += cost;
+    ctx->held += cost;
+
+    return seg;
+}
+
+static inline void _seg_put(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,
+        gbw_probe_tcp_dir_t *d,gbw_probe_tcp_seg_t *seg){
+
+    uint32_t cost = _seg_cost(seg->m);
+
+    list_del(&seg->node);
+    d->n_segs--;
+
+    rte_pktmbuf_free(seg->m);
+    seg->m = NULL;
+
+    sess->held -= cost;
+    ctx->held -= cost;
+
+    list_add(&seg->node,&sess->free_segs);
+}
+
+static inline void _deliver(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,int dir,
+        const uint8_t *data,uint32_t len){
+
+    unsigned int i;
+
+    if(len == 0)
+        return;
+
+    for(i = 0;i<ctx->nb_ops;i++){
+
+        if(ctx->ops[i]->data&&!(sess->detached&(1u<<i)))
+            ctx->ops[i]->data(sess,&sess->user[i],ctx->privs[i],dir,data,len);
+    }
+
+    sess->dirs[dir].delivered += len;
+}
+
+/*hands out waiting segments that became contiguous*/
+static void _drain(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,int dir){
+
+    gbw_probe_tcp_dir_t *d = &sess->dirs[dir];
+    gbw_probe_tcp_seg_t *seg;
+    uint32_t end,skip;
+
+    while(!list_empty(&d->segs)){
+
+        seg = list_first_entry(&d->segs,gbw_probe_tcp_seg_t,node);
+        if(SEQ_GT(seg->seq,d->next_seq))
+            break;
+
+        end = seg->seq+seg->len;
+        if(SEQ_GT(end,d->next_seq)){
+
+            skip = d->next_seq-seg->seq;
+            _deliver(ctx,sess,dir,rte_pktmbuf_mtod_offset(seg->m,const uint8_t*,seg->off+skip),seg->len-skip);
+            d->next_seq = end;
+        }
+
+        _seg_put(ctx,sess,d,seg);
+    }
+}
+
+/*gives up on the hole before the first waiting segment*/
+static void _skip_gap(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,int dir){
+
+    gbw_probe_tcp_dir_t *d = &sess->dirs[dir];
+    gbw_probe_tcp_seg_t *seg;
+    uint32_t gap;
+    unsigned int i;
+
+    if(list_empty(&d->segs))
+        return;
+
+    seg = list_first_entry(&d->segs,gbw_probe_tcp_seg_t,node);
+    gap = seg->seq-d->next_seq;
+
+    if(gap){
+
+        for(i = 0;i<ctx->nb_ops;i++){
+
+            if(ctx->ops[i]->gap&&!(sess->detached&(1u<<i)))
+                ctx->ops[i]->gap(sess,&sess->user[i],ctx->privs[i],dir,gap);
+        }
+
+        d->gap_bytes += gap;
+        d->next_seq = seg->seq;
+    }
+
+    _drain(ctx,sess,dir);
+}
+
+static inline int _all_detached(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess){
+
+    return ctx->nb_ops&&sess->detached == (uint8_t)((1u<<ctx->nb_ops)-1);
+}
+
+/*drops what a session holds,nobody wants it*/
+static void _session_drop(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess){
+
+    gbw_probe_tcp_dir_t *d;
+    int dir;
+
+    for(dir = 0;dir<2;dir++){
+
+        d = &sess->dirs[dir];
+
+        while(!list_empty(&d->segs))
+            _seg_put(ctx,sess,d,list_first_entry(&d->segs,gbw_probe_tcp_seg_t,node));
+    }
+
+    _lru_update(ctx,sess);
+}
+
+/*flushes everything a session holds,in order and with its holes*/
+static void _session_flush(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess){
+
+    int dir;
+
+    for(dir = 0;dir<2;dir++){
+
+        while(!list_empty(&sess->dirs[dir].segs))
+            _skip_gap(ctx,sess,dir);
+    }
+
+    _lru_update(ctx,sess);
+}
+
+/*
+ * Queues [seq,seq+len) of m,all after next_seq.
+ * With the first policy bytes already queued win and only the holes
+ * between them are filled,with the last policy the new bytes replace
+ * whatever they overlap,splitting a segment that covers them.
+ */
+static int _insert(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,int dir,
+        struct rte_mbuf *m,uint16_t off,uint32_t seq,uint32_t len){
+
+    gbw_probe_tcp_dir_t *d = &sess->dirs[dir];
+    gbw_probe_tcp_seg_t *x,*n,*seg;
+    struct list_head *pos = &d->segs;
+    uint32_t end = seq+len;
+    uint32_t cur = seq;
+    uint32_t xe;
+
+    if(ctx->overlap_policy == GBW_TCP_OVERLAP_FIRST){
+
+        list_for_each_entry_safe(x,n,&d->segs,node){
+
+            xe = x->seq+x->len;
+
+            if(SEQ_LEQ(end,x->seq)){
+                pos = &x->node;
+                break;
+            }
+
+            if(SEQ_GEQ(cur,xe))
+                continue;
+
+            d->overlaps++;
+
+            if(SEQ_LT(cur,x->seq)){
+
+                seg = _seg_get(ctx,sess,m,cur,x->seq-cur,(uint16_t)(off+(cur-seq)));
+                if(seg == NULL)
+                    return -1;
+
+                list_add_tail(&seg->node,&x->node);
+                d->n_segs++;
+            }
+
+            cur = xe;
+            if(SEQ_GEQ(cur,end))
+                return 0;
+        }
+
+        seg = _seg_get(ctx,sess,m,cur,end-cur,(uint16_t)(off+(cur-seq)));
+        if(seg == NULL)
+            return -1;
+
+        list_add_tail(&seg->node,pos);
+        d->n_segs++;
+
+        return 0;
+    }
+
+    list_for_each_entry_safe(x,n,&d->segs,node){
+
+        xe = x->seq+x->len;
+
+        if(SEQ_LEQ(xe,seq))
+            continue;
+
+        if(SEQ_GEQ(x->seq,end)){
+            pos = &x->node;
+            break;
+        }
+
+        d->overlaps++;
+
+        if(SEQ_LT(x->seq,seq)&&SEQ_GT(xe,end)){
+
+            /*x covers both ends,its tail becomes a segment of its own*/
+            seg = _seg_get(ctx,sess,x->m,end,xe-end,(uint16_t)(x->off+(end-x->seq)));
+            x->len = seq-x->seq;
+
+            if(seg){
+                list_add(&seg->node,&x->node);
+                d->n_segs++;
+                pos = &seg->node;
+            }else{
+                pos = x->node.next;
+            }
+            break;
+        }
+
+        if(SEQ_LT(x->seq,seq)){
+            x->len = seq-x->seq;
+            continue;
+        }
+
+        if(SEQ_GT(xe,end)){
+
+            x->off = (uint16_t)(x->off+(end-x->seq));
+            x->len = xe-end;
+            x->seq = end;
+            pos = &x->node;
+            break;
+        }
+
+        _seg_put(ctx,sess,d,x);
+    }
+
+    seg = _seg_get(ctx,sess,m,seq,len,off);
+    if(seg == NULL)
+        return -1;
+
+    list_add_tail(&seg->node,pos);
+    d->n_segs++;
+
+    return 0;
+}
+
+/*data is the payload at off,gathered when m is a chain*/
+static void _segment(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess,int dir,
+        struct rte_mbuf *m,const uint8_t *data,uint16_t off,uint32_t seq,uint32_t len){
+
+    gbw_probe_tcp_dir_t *d = &sess->dirs[dir];
+    gbw_probe_tcp_seg_t *first;
+    uint32_t end = seq+len;
+    uint32_t cost = _seg_cost(m);
+    uint32_t n,trim;
+    int evicted = 0;
+
+again:
+    if(SEQ_LEQ(end,d->next_seq)){
+        d->retrans++;
+        return;
+    }
+
+    if(SEQ_LT(seq,d->next_seq)){
+
+        trim = d->next_seq-seq;
+        seq += trim;
+        off = (uint16_t)(off+trim);
+        data += trim;
+        len -= trim;
+        d->retrans++;
+    }
+
+    if(seq == d->next_seq){
+
+        n = len;
+        if(ctx->overlap_policy == GBW_TCP_OVERLAP_FIRST&&!list_empty(&d->segs)){
+
+            first = list_first_entry(&d->segs,gbw_probe_tcp_seg_t,node);
+            if(SEQ_LT(first->seq,end))
+                n = first->seq-seq;
+        }
+
+        _deliver(ctx,sess,dir,data,n);
+        d->next_seq += n;
+        ctx->in_order++;
+
+        if(n == len){
+            _drain(ctx,sess,dir);
+            _lru_update(ctx,sess);
+            return;
+        }
+
+        /*the rest overlaps queued bytes,only its holes are kept*/
+        seq += n;
+        off = (uint16_t)(off+n);
+        data += n;
+        len -= n;
+    }
+
+    if(!evicted&&(sess->held+cost>ctx->flow_cap||ctx->held+cost>ctx->mem_cap)){
+
+        while(sess->held&&sess->held+cost>ctx->flow_cap){
+
+            _skip_gap(ctx,sess,list_empty(&sess->dirs[dir].segs)?!dir:dir);
+            ctx->flow_evicts++;
+        }
+
+        while(ctx->held+cost>ctx->mem_cap&&!list_empty(&ctx->lru)){
+
+            _session_flush(ctx,list_first_entry(&ctx->lru,gbw_probe_tcp_session_t,lru_node));
+            ctx->mem_evicts++;
+        }
+
+        _lru_update(ctx,sess);
+
+        /*next_seq may have moved past or up to the segment*/
+        evicted = 1;
+        goto again;
+    }
+
+    if(_insert(ctx,sess,dir,m,off,seq,len) == 0)
+        ctx->queued++;
+
+    _drain(ctx,sess,dir);
+    _lru_update(ctx,sess);
+}
+
+static gbw_probe_tcp_session_t * _session_create(gbw_probe_tcp_ctx_t *ctx,gbw_probe_flow_t *flow){
+
+    gbw_probe_tcp_session_t *sess;
+    gbw_pool_t *mp;
+
+    mp = gbw_mpool_agent_alloc(ctx->agent);
+    if(mp == NULL)
+        return NULL;
+
+    sess = (gbw_probe_tcp_session_t*)gbw_pcalloc(mp,sizeof(*sess));
+    if(sess == NULL){
+        gbw_mpool_agent_free(ctx->agent,mp);
+        return NULL;
+    }
+
+    sess->mp = mp;
+    sess->flow = flow;
+
+    INIT_LIST_HEAD(&sess->dirs[0].segs);
+    INIT_LIST_HEAD(&sess->dirs[1].segs);
+    INIT_LIST_HEAD(&sess->free_segs);
+    INIT_LIST_HEAD(&sess->lru_node);
+
+    flow->tcp = sess;
+
+    ctx->sessions++;
+    ctx->active++;
+
+    return sess;
+}
+
+static void _session_close(gbw_probe_tcp_ctx_t *ctx,gbw_probe_tcp_session_t *sess){
+
+    unsigned int i;
+
+    for(i = 0;i<ctx->nb_ops;i++){
+
+        if(ctx->ops[i]->close)
+            ctx->ops[i]->close(sess,&sess->user[i],ctx->privs[i]);
+    }
+
+    sess->flow->tcp = NULL;
+    gbw_mpool_agent_free(ctx->agent,sess->mp);
+
+    ctx->active--;
+}
+
+/*flow end,from the flow stage: what is held goes out,then close*/
+static void _session_end(gbw_probe_flow_t *flow,void *priv){
+
+    gbw_probe_tcp_ctx_t *ctx = (gbw_probe_tcp_ctx_t*)priv;
+    gbw_probe_tcp_session_t *sess = (gbw_probe_tcp_session_t*)flow->tcp;
+
+    if(sess == NULL)
+        return;
+
+    _session_flush(ctx,sess);
+    _session_close(ctx,sess);
+}
+
+/*flow bypass,from the flow stage: the rest never comes,what is held is dropped*/
+static void _session_bypass(gbw_probe_flow_t *flow,void *priv){
+
+    gbw_probe_tcp_ctx_t *ctx = (gbw_probe_tcp_ctx_t*)priv;
+    gbw_probe_tcp_session_t *sess = (gbw_probe_tcp_session_t*)flow->tcp;
+
+    if(sess == NULL)
+        return;
+
+    sess->bypassed = 1;
+    ctx->bypassed++;
+
+    _session_drop(ctx,sess);
+    _session_close(ctx,sess);
+}
+
+int gbw_probe_tcp_listen(gbw_probe_tcp_ctx_t *ctx,const gbw_probe_tcp_ops_t *ops,void *priv){
+
+    if(ctx->nb_ops>=GBW_PROBE_TCP_MAX_OPS){
+        gbw_log(GBW_LOG_ERR,"Too many tcp stream consumers,cannot add:%s",ops->name);
+        return -1;
+    }
+
+    ctx->ops[ctx->nb_ops] = ops;
+    ctx->privs[ctx->nb_ops] = priv;
+    ctx->nb_ops++;
+
+    return 0;
+}
+
+static uint16_t _tcp_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx,
+        struct rte_mbuf **pkts,uint16_t n){
+
+    gbw_probe_tcp_ctx_t *ctx = (gbw_probe_tcp_ctx_t*)_ctx;
+    gbw_probe_tcp_session_t *sess;
+    gbw_probe_pkt_flow_t *pf;
+    gbw_probe_pkt_t *pkt;
+    gbw_probe_tcp_dir_t *d;
+    gbw_probe_flow_t *flow;
+    const uint8_t *th,*data;
+    struct rte_mbuf *m;
+    uint32_t seq;
+    uint8_t flags;
+    uint16_t i;
+
+    for(i = 0;i<n;i++){
+
+        m = pkts[i];
+        pkt = gbw_probe_pkt(m);
+
+        if(pkt->proto!=IPPROTO_TCP||!(pkt->flags&GBW_PKT_F_L4))
+            continue;
+
+        pf = gbw_probe_pkt_flow(m);
+        if(pf->entry == NULL)
+            continue;
+
+        flow = gbw_probe_flow(pf->entry);
+
+        /*its session went with the bypass,see _session_bypass*/
+        if(flow->bypass)
+            continue;
+
+        sess = (gbw_probe_tcp_session_t*)flow->tcp;
+
+        if(sess == NULL){
+
+            sess = _session_create(ctx,flow);
+            if(sess == NULL){
+                ctx->no_session++;
+                continue;
+            }
+        }
+
+        /*every consumer is done with the flow,it is not reassembled any more*/
+        if(_all_detached(ctx,sess))
+            continue;
+
+        th = rte_pktmbuf_mtod_offset(m,const uint8_t*,pkt->l4_off);
+        seq = rd32(th+TCP_SEQ_OFF);
+        flags = th[TCP_FLAGS_OFF];
+        d = &sess->dirs[pf->dir];
+
+        if(flags&TCP_FLAG_SYN){
+
+            if(!d->seq_inited){
+                d->next_seq = seq+1;
+                d->seq_inited = 1;
+            }
+
+            /*data on a SYN starts after it*/
+            seq++;
+        }
+
+        if(flags&TCP_FLAG_FIN)
+            d->fin = 1;
+
+        if(pkt->payload_len == 0)
+            continue;
+
+        /*joined mid stream,the stream starts here*/
+        if(!d->seq_inited){
+            d->next_seq = seq;
+            d->seq_inited = 1;
+        }
+
+        /*a reassembled IP datagram too big for one mbuf is gathered*/
+        data = (const uint8_t*)rte_pktmbuf_read(m,pkt->payload_off,pkt->payload_len,ctx->gather);
+        if(data == NULL)
+            continue;
+
+        if(m->nb_segs>1)
+            ctx->chained++;
+
+        _segment(ctx,sess,pf->dir,m,data,pkt->payload_off,seq,pkt->payload_len);
+
+        /*the last consumer detached on these bytes*/
+        if(_all_detached(ctx,sess)){
+            ctx->detached++;
+            _session_drop(ctx,sess);
+        }
+    }
+
+    return n;
+}
+
+static void *_tcp_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_config_t *pcfg = worker->engine->pcfg;
+    gbw_probe_flow_ctx_t *flow_ctx;
+    gbw_probe_tcp_ctx_t *ctx;
+
+    flow_ctx = (gbw_probe_flow_ctx_t*)gbw_probe_stage_ctx(worker,"flow");
+    if(flow_ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"The tcp stage needs the flow stage registered before it");
+        return NULL;
+    }
+
+    ctx = (gbw_probe_tcp_ctx_t*)rte_zmalloc_socket("gbw_probe_tcp",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the tcp stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    ctx->agent = gbw_mpool_agent_create(worker->engine->mp,pcfg->tcp_pool_cache,pcfg->tcp_pool_size,1);
+    ctx->overlap_policy = (int)pcfg->tcp_overlap;
+    ctx->flow_cap = pcfg->tcp_flow_cap;
+    ctx->mem_cap = (uint64_t)pcfg->tcp_mem_cap*1024*1024/worker->engine->nb_workers;
+
+    INIT_LIST_HEAD(&ctx->lru);
+
+    if(gbw_probe_flow_end_listen(flow_ctx,_session_end,ctx)||
+            gbw_probe_flow_bypass_listen(flow_ctx,_session_bypass,ctx)){
+        rte_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+/*
+ * The flow stage ran its fin first and ended every flow,so no session is
+ * left,only the cached pools.
+ */
+static void _tcp_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    gbw_probe_tcp_ctx_t *ctx = (gbw_probe_tcp_ctx_t*)_ctx;
+
+    gbw_mpool_agent_clear(ctx->agent);
+    rte_free(ctx);
+}
+
+static void _tcp_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_tcp_ctx_t *ctx = (gbw_probe_tcp_ctx_t*)_ctx;
+
+    fprintf(out,"    tcp sessions:%lu active:%lu no_session:%lu in_order:%lu queued:%lu held:%lu flow_evicts:%lu mem_evicts:%lu chained:%lu copied:%lu detached:%lu bypassed:%lu\n",
+            (unsigned long)ctx->sessions,(unsigned long)ctx->active,(unsigned long)ctx->no_session,
+            (unsigned long)ctx->in_order,(unsigned long)ctx->queued,(unsigned long)ctx->held,
+            (unsigned long)ctx->flow_evicts,(unsigned long)ctx->mem_evicts,(unsigned long)ctx->chained,
+            (unsigned long)ctx->copied,(unsigned long)ctx->detached,(unsigned long)ctx->bypassed);
+}
+
+const gbw_probe_stage_t gbw_probe_tcp_stage = {
+    .name = "tcp",
+    .init = _tcp_init,
+    .process = _tcp_process,
+    .fin = _tcp_fin,
+    .dump = _tcp_dump,
+    .priv = NULL,
+};
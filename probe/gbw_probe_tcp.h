@@ -0,0 +1,167 @@
+/*
+ *
+ *      Filename: gbw_probe_tcp.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: TCP reassembly stage,turns the segments of each flow into
+ *                in order byte streams for the protocol parsers
+ *
+ */
+
+#ifndef GBW_PROBE_TCP_H
+#define GBW_PROBE_TCP_H
+
+#include <rte_mbuf.h>
+
+#include "gbw_mpool.h"
+#include "gbw_mpool_agent.h"
+#include "gbw_list.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+
+/*most stream consumers,see gbw_probe_tcp_listen*/
+#define GBW_PROBE_TCP_MAX_OPS 8
+
+/*a reassembled datagram left as a chain is gathered here,payload_len is 16 bits*/
+#define GBW_PROBE_TCP_GATHER_SIZE 65536
+
+/*which copy of bytes sent twice with different data is kept*/
+#define GBW_TCP_OVERLAP_FIRST 0
+#define GBW_TCP_OVERLAP_LAST  1
+
+typedef struct gbw_probe_tcp_seg_t gbw_probe_tcp_seg_t;
+typedef struct gbw_probe_tcp_dir_t gbw_probe_tcp_dir_t;
+typedef struct gbw_probe_tcp_session_t gbw_probe_tcp_session_t;
+typedef struct gbw_probe_tcp_ops_t gbw_probe_tcp_ops_t;
+typedef struct gbw_probe_tcp_ctx_t gbw_probe_tcp_ctx_t;
+
+/*
+ * Out of order bytes,a reference on the mbuf that carried them,no copy
+ * but for external buffers and chains,whose bytes are copied to an mbuf
+ * of their own.
+ * One mbuf may back several segments once overlaps split it.
+ */
+struct gbw_probe_tcp_seg_t {
+
+    struct list_head node;
+
+    struct rte_mbuf *m;
+    uint32_t seq;
+    uint32_t len;
+    uint16_t off;
+};
+
+struct gbw_probe_tcp_dir_t {
+
+    /*next byte the consumers get*/
+    uint32_t next_seq;
+    uint8_t seq_inited;
+    uint8_t fin;
+
+    /*waiting segments,sorted and not overlapping,all after next_seq*/
+    struct list_head segs;
+    uint32_t n_segs;
+
+    uint64_t delivered;
+    uint64_t gap_bytes;
+    uint64_t overlaps;
+    uint64_t retrans;
+};
+
+/*
+ * Per flow reassembly state,allocated with everything it needs from a
+ * pool of the worker's gbw_mpool_agent and handed back when the flow ends.
+ * Consumers keep their per flow state in user[],from mp.
+ */
+struct gbw_probe_tcp_session_t {
+
+    gbw_pool_t *mp;
+    gbw_probe_flow_t *flow;
+
+    gbw_probe_tcp_dir_t dirs[2];
+
+    /*recycled segments*/
+    struct list_head free_segs;
+
+    /*bytes pinned by waiting segments,counted by mbuf buffer size*/
+    uint32_t held;
+
+    /*in the ctx LRU while holding anything*/
+    struct list_head lru_node;
+    uint8_t in_lru;
+
+    /*bit of each consumer done with the flow,see gbw_probe_tcp_detach*/
+    uint8_t detached;
+
+    /*the flow went past its cutoff,close runs early and the rest never comes*/
+    uint8_t bypassed;
+
+    void *user[GBW_PROBE_TCP_MAX_OPS];
+};
+
+/*
+ * A stream consumer,usually a protocol parser.
+ * data gets every in order chunk of a direction,gap the number of bytes
+ * that will never come because a cap forced them out,close runs once
+ * when the flow ends or is bypassed. user points to the consumer's slot
+ * of the session.
+ */
+struct gbw_probe_tcp_ops_t {
+
+    const char *name;
+
+    void (*data)(gbw_probe_tcp_session_t *sess,void **user,void *priv,int dir,const uint8_t *data,uint32_t len);
+    void (*gap)(gbw_probe_tcp_session_t *sess,void **user,void *priv,int dir,uint32_t len);
+    void (*close)(gbw_probe_tcp_session_t *sess,void **user,void *priv);
+};
+
+struct gbw_probe_tcp_ctx_t {
+
+    gbw_mpool_agent_t *agent;
+
+    int overlap_policy;
+
+    /*hard caps on bytes held by one flow and by the whole worker*/
+    uint32_t flow_cap;
+    uint64_t mem_cap;
+    uint64_t held;
+
+    /*sessions holding segments,least recently grown first,for eviction*/
+    struct list_head lru;
+
+    unsigned int nb_ops;
+    const gbw_probe_tcp_ops_t *ops[GBW_PROBE_TCP_MAX_OPS];
+    void *privs[GBW_PROBE_TCP_MAX_OPS];
+
+    uint64_t sessions;
+    uint64_t active;
+    uint64_t no_session;
+    uint64_t queued;
+    uint64_t in_order;
+    uint64_t flow_evicts;
+    uint64_t mem_evicts;
+    uint64_t chained;
+    uint64_t copied;
+    uint64_t detached;
+    uint64_t bypassed;
+
+    uint8_t gather[GBW_PROBE_TCP_GATHER_SIZE];
+};
+
+/*Adds a consumer,from the init of a stage registered after "tcp"*/
+extern int gbw_probe_tcp_listen(gbw_probe_tcp_ctx_t *ctx,const gbw_probe_tcp_ops_t *ops,void *priv);
+
+/*
+ * From a data or gap callback,the consumer of user wants nothing more of
+ * the flow: it gets no more data or gaps,close still runs. Once every
+ * consumer is detached the segments held are dropped and the rest of the
+ * flow is not reassembled.
+ */
+static inline void gbw_probe_tcp_detach(gbw_probe_tcp_session_t *sess,void **user){
+
+    sess->detached |= (uint8_t)(1u<<(user-sess->user));
+}
+
+extern const gbw_probe_stage_t gbw_probe_tcp_stage;
+
+#endif /*GBW_PROBE_TCP_H*/
@@ -0,0 +1,240 @@
+/*
+ *
+ *      Filename: gbw_probe_tls.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: TLS metadata stage,reads the hellos off the reassembled
+ *                streams of TLS flows for SNI,ALPN and JA3/JA4
+ *
+ */
+
+#include <string.h>
+#include <rte_malloc.h>
+
+#include "gbw_probe_tls.h"
+#include "gbw_probe_proto.h"
+#include "gbw_log.h"
+
+static void _hello_done(gbw_probe_tls_session_t *sess){
+
+    gbw_probe_tls_ctx_t *ctx = sess->ctx;
+    const gbw_tls_hello_t *hello,*client = NULL,*server = NULL;
+    unsigned int i;
+
+    sess->done = 1;
+
+    for(i = 0;i<2;i++){
+
+        if(sess->parsers[i].state!=GBW_TLS_HELLO)
+            continue;
+
+        hello = &sess->hellos[i];
+        if(hello->type == GBW_TLS_CLIENT_HELLO)
+            client = hello;
+        else
+            server = hello;
+    }
+
+    if(client == NULL&&server == NULL)
+        return;
+
+    if(client&&server)
+        ctx->handshakes++;
+
+    for(i = 0;i<ctx->nb_listeners;i++)
+        ctx->hello_fns[i](sess->flow,client,server,ctx->hello_privs[i]);
+}
+
+static gbw_probe_tls_session_t * _session_create(gbw_probe_tls_ctx_t *ctx,gbw_probe_tcp_session_t *tsess){
+
+    gbw_probe_tls_session_t *sess;
+
+    /*the hellos aren't cleared,the parser fills what it reports*/
+    sess = (gbw_probe_tls_session_t*)gbw_palloc(tsess->mp,sizeof(*sess));
+    if(sess == NULL)
+        return NULL;
+
+    sess->ctx = ctx;
+    sess->flow = tsess->flow;
+    sess->done = 0;
+
+    gbw_tls_parser_init(&sess->parsers[0],tsess->mp);
+    gbw_tls_parser_init(&sess->parsers[1],tsess->mp);
+
+    ctx->sessions++;
+
+    return sess;
+}
+
+static void _tls_data(gbw_probe_tcp_session_t *tsess,void **user,void *priv,int dir,
+        const uint8_t *data,uint32_t len){
+
+    gbw_probe_tls_ctx_t *ctx = (gbw_probe_tls_ctx_t*)priv;
+    gbw_probe_tls_session_t *sess = (gbw_probe_tls_session_t*)*user;
+    gbw_tls_hello_t *hello;
+
+    if(sess == NULL){
+
+        if(tsess->flow->app_proto!=GBW_PROTO_TLS){
+
+            if(tsess->flow->proto_done)
+                gbw_probe_tcp_detach(tsess,user);
+            return;
+        }
+
+        sess = _session_create(ctx,tsess);
+        if(sess == NULL)
+            return;
+
+        *user = sess;
+    }
+
+    /*past the handshake,nothing but ciphertext*/
+    if(sess->done){
+        gbw_probe_tcp_detach(tsess,user);
+        return;
+    }
+
+    hello = &sess->hellos[dir];
+
+    switch(gbw_tls_parser_execute(&sess->parsers[dir],data,len,hello)){
+
+    case GBW_TLS_HELLO:
+        if(hello->type == GBW_TLS_CLIENT_HELLO)
+            ctx->client_hellos++;
+        else
+            ctx->server_hellos++;
+
+        if(hello->truncated)
+            ctx->truncated++;
+        break;
+
+    case GBW_TLS_FAILED:
+        ctx->failed++;
+        break;
+
+    default:
+        return;
+    }
+
+    if(gbw_tls_parser_done(&sess->parsers[!dir])){
+        _hello_done(sess);
+        gbw_probe_tcp_detach(tsess,user);
+    }
+}
+
+static void _tls_gap(gbw_probe_tcp_session_t *tsess,void **user,void *priv,int dir,uint32_t len __rte_unused){
+
+    gbw_probe_tls_ctx_t *ctx = (gbw_probe_tls_ctx_t*)priv;
+    gbw_probe_tls_session_t *sess = (gbw_probe_tls_session_t*)*user;
+
+    if(sess == NULL||sess->done)
+        return;
+
+    ctx->gaps++;
+
+    /*a hello missing bytes can't be fingerprinted,that direction is given up*/
+    if(!gbw_tls_parser_done(&sess->parsers[dir])){
+
+        sess->parsers[dir].state = GBW_TLS_FAILED;
+        ctx->failed++;
+
+        if(gbw_tls_parser_done(&sess->parsers[!dir])){
+            _hello_done(sess);
+            gbw_probe_tcp_detach(tsess,user);
+        }
+    }
+}
+
+static void _tls_close(gbw_probe_tcp_session_t *tsess __rte_unused,void **user,void *priv __rte_unused){
+
+    gbw_probe_tls_session_t *sess = (gbw_probe_tls_session_t*)*user;
+
+    if(sess == NULL)
+        return;
+
+    /*a client hello the server never answered*/
+    if(!sess->done)
+        _hello_done(sess);
+
+    /*the memory goes back with the tcp session pool*/
+    *user = NULL;
+}
+
+static const gbw_probe_tcp_ops_t _tls_ops = {
+    .name = "tls",
+    .data = _tls_data,
+    .gap = _tls_gap,
+    .close = _tls_close,
+};
+
+int gbw_probe_tls_listen(gbw_probe_tls_ctx_t *ctx,gbw_probe_tls_hello_fn fn,void *priv){
+
+    if(ctx->nb_listeners>=GBW_PROBE_TLS_MAX_LISTENERS){
+        gbw_log(GBW_LOG_ERR,"Too many tls hello listeners");
+        return -1;
+    }
+
+    ctx->hello_fns[ctx->nb_listeners] = fn;
+    ctx->hello_privs[ctx->nb_listeners] = priv;
+    ctx->nb_listeners++;
+
+    return 0;
+}
+
+/*the work is done from the tcp stage callbacks*/
+static uint16_t _tls_process(gbw_probe_worker_t *worker __rte_unused,void *_ctx __rte_unused,
+        struct rte_mbuf **pkts __rte_unused,uint16_t n){
+
+    return n;
+}
+
+static void *_tls_init(gbw_probe_worker_t *worker,void *priv __rte_unused){
+
+    gbw_probe_tcp_ctx_t *tcp_ctx;
+    gbw_probe_tls_ctx_t *ctx;
+
+    tcp_ctx = (gbw_probe_tcp_ctx_t*)gbw_probe_stage_ctx(worker,"tcp");
+    if(tcp_ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"The tls stage needs the tcp stage registered before it");
+        return NULL;
+    }
+
+    ctx = (gbw_probe_tls_ctx_t*)rte_zmalloc_socket("gbw_probe_tls",sizeof(*ctx),
+            RTE_CACHE_LINE_SIZE,worker->socket_id);
+    if(ctx == NULL){
+        gbw_log(GBW_LOG_ERR,"No memory for the tls stage of worker:%u",worker->id);
+        return NULL;
+    }
+
+    if(gbw_probe_tcp_listen(tcp_ctx,&_tls_ops,ctx)){
+        rte_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void _tls_fin(gbw_probe_worker_t *worker __rte_unused,void *_ctx){
+
+    rte_free(_ctx);
+}
+
+static void _tls_dump(gbw_probe_worker_t *worker __rte_unused,void *_ctx,FILE *out){
+
+    gbw_probe_tls_ctx_t *ctx = (gbw_probe_tls_ctx_t*)_ctx;
+
+    fprintf(out,"    tls sessions:%lu client_hellos:%lu server_hellos:%lu handshakes:%lu failed:%lu truncated:%lu gaps:%lu\n",
+            (unsigned long)ctx->sessions,(unsigned long)ctx->client_hellos,(unsigned long)ctx->server_hellos,
+            (unsigned long)ctx->handshakes,(unsigned long)ctx->failed,(unsigned long)ctx->truncated,
+            (unsigned long)ctx->gaps);
+}
+
+const gbw_probe_stage_t gbw_probe_tls_stage = {
+    .name = "tls",
+    .init = _tls_init,
+    .process = _tls_process,
+    .fin = _tls_fin,
+    .dump = _tls_dump,
+    .priv = NULL,
+};
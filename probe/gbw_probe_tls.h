@@ -0,0 +1,73 @@
+/*
+ *
+ *      Filename: gbw_probe_tls.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: TLS metadata stage,reads the hellos off the reassembled
+ *                streams of TLS flows for SNI,ALPN and JA3/JA4
+ *
+ */
+
+#ifndef GBW_PROBE_TLS_H
+#define GBW_PROBE_TLS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gbw_tls_parser.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_flow.h"
+#include "gbw_probe_tcp.h"
+
+/*most callbacks told about handshakes,see gbw_probe_tls_listen*/
+#define GBW_PROBE_TLS_MAX_LISTENERS 4
+
+typedef struct gbw_probe_tls_session_t gbw_probe_tls_session_t;
+typedef struct gbw_probe_tls_ctx_t gbw_probe_tls_ctx_t;
+
+/*either hello is NULL when it wasn't seen or couldn't be parsed*/
+typedef void (*gbw_probe_tls_hello_fn)(gbw_probe_flow_t *flow,const gbw_tls_hello_t *client,
+        const gbw_tls_hello_t *server,void *priv);
+
+/*
+ * Per flow state,from the tcp session pool on the first TLS bytes. Once
+ * both directions are done the session is done,the rest of the flow is
+ * encrypted and the session detaches from the tcp stage,which stops
+ * reassembling it when no other consumer wants it.
+ */
+struct gbw_probe_tls_session_t {
+
+    gbw_probe_tls_ctx_t *ctx;
+    gbw_probe_flow_t *flow;
+
+    gbw_tls_parser_t parsers[2];
+    gbw_tls_hello_t hellos[2];
+
+    uint8_t done;
+};
+
+struct gbw_probe_tls_ctx_t {
+
+    unsigned int nb_listeners;
+    gbw_probe_tls_hello_fn hello_fns[GBW_PROBE_TLS_MAX_LISTENERS];
+    void *hello_privs[GBW_PROBE_TLS_MAX_LISTENERS];
+
+    uint64_t sessions;
+    uint64_t client_hellos;
+    uint64_t server_hellos;
+    uint64_t handshakes;
+    uint64_t failed;
+    uint64_t truncated;
+    uint64_t gaps;
+};
+
+/*
+ * Calls fn once a flow's hellos are parsed,or when it ends with only
+ * one of them. Later stages register from their init,with the ctx found
+ * by gbw_probe_stage_ctx(worker,"tls").
+ */
+extern int gbw_probe_tls_listen(gbw_probe_tls_ctx_t *ctx,gbw_probe_tls_hello_fn fn,void *priv);
+
+extern const gbw_probe_stage_t gbw_probe_tls_stage;
+
+#endif /*GBW_PROBE_TLS_H*/
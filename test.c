@@ -1,7 +1,178 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
+
+#include "gbw_mpool.h"
+#include "gbw_log.h"
+#include "gbw_signal.h"
+#include <unistd.h>
+#include "gbw_probe_config.h"
+#include "gbw_probe_engine.h"
+#include "gbw_probe_decode.h"
+#include "gbw_probe_capture.h"
+#include "gbw_probe_retro.h"
+#include "gbw_probe_defrag.h"
+#include "gbw_probe_flow.h"
+#include "gbw_probe_proto.h"
+#include "gbw_probe_tcp.h"
+#include "gbw_probe_http.h"
+#include "gbw_probe_dns.h"
+#include "gbw_probe_tls.h"
+#include "gbw_probe_ipfix.h"
+#include "gbw_probe_sketch.h"
+#include "gbw_probe_export.h"
+#include "gbw_probe_record.h"
+
+#define PROBE_DEFAULT_CONFIG "/usr/local/GBWProbe/conf/probe.conf"
+
+static gbw_probe_engine_t *probe_engine = NULL;
+static gbw_probe_retro_t *probe_retro = NULL;
+
+static void _probe_quit(int signo){
+
+    (void)signo;
+
+    if(probe_engine)
+        gbw_probe_engine_stop(probe_engine);
+}
+
+static void _probe_retro_dump(int signo){
+
+    (void)signo;
+
+    if(probe_retro)
+        gbw_probe_retro_signal(probe_retro);
+}
+
+static void usage(const char *prog){
+
+    fprintf(stderr,"Usage:%s [-c <config file>]\n",prog);
+}
 
 int main(int argc,char ** argv){
 
+    const char *cfname = PROBE_DEFAULT_CONFIG;
+    gbw_pool_t *mp;
+    gbw_probe_config_t *pcfg;
+    int opt;
+    int rc;
+
     printf("GBWNProbe is a network stream probe base on dpdk!\n");
-}
\ No newline at end of file
+
+    while((opt = getopt(argc,argv,"c:h"))!=-1){
+
+        switch(opt){
+        case 'c':
+            cfname = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    mp = gbw_pool_create(4096);
+    if(mp == NULL){
+        fprintf(stderr,"Cannot create the global memory pool\n");
+        return -1;
+    }
+
+    pcfg = gbw_probe_config_load(mp,cfname);
+    if(pcfg == NULL){
+        fprintf(stderr,"Cannot load probe config file:%s\n",cfname);
+        gbw_pool_destroy(mp);
+        return -1;
+    }
+
+    gbw_log_init(mp,pcfg->log_file,(int)pcfg->log_level);
+    gbw_probe_config_dump(pcfg,stdout);
+
+    probe_engine = gbw_probe_engine_create(mp,pcfg);
+    if(probe_engine == NULL){
+        fprintf(stderr,"Cannot create the probe engine,see %s\n",pcfg->log_file);
+        gbw_pool_destroy(mp);
+        return -1;
+    }
+
+    gbw_signal(SIGINT,_probe_quit);
+    gbw_signal(SIGTERM,_probe_quit);
+
+    gbw_probe_stage_register(probe_engine,&gbw_probe_decode_stage);
+
+    /*packets as they came in,before defrag takes fragments*/
+    if(pcfg->capture_dir&&gbw_probe_capture_create(probe_engine) == NULL){
+        fprintf(stderr,"Cannot create the packet capture,see %s\n",pcfg->log_file);
+        gbw_probe_engine_destroy(probe_engine);
+        gbw_pool_destroy(mp);
+        return -1;
+    }
+
+    if(pcfg->retro_size){
+
+        probe_retro = gbw_probe_retro_create(probe_engine);
+        if(probe_retro == NULL){
+            fprintf(stderr,"Cannot create the retrospective ring,see %s\n",pcfg->log_file);
+            gbw_probe_engine_destroy(probe_engine);
+            gbw_pool_destroy(mp);
+            return -1;
+        }
+
+        gbw_signal(SIGUSR1,_probe_retro_dump);
+    }
+
+    /*
+     * queues of a split file are not in order with each other,a flow's
+     * fragments and segments reach the workers at unrelated times: only
+     * the stages that look at packets one at a time run then
+     */
+    if(pcfg->rx_split){
+
+        gbw_log(GBW_LOG_NOTICE,"pcap vdev reads a file split in %u,no defrag,dpi or tcp reassembly",
+                pcfg->rx_split);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_flow_stage);
+    }else{
+
+        gbw_probe_stage_register(probe_engine,&gbw_probe_defrag_stage);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_flow_stage);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_proto_stage);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_tcp_stage);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_http_stage);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_dns_stage);
+        gbw_probe_stage_register(probe_engine,&gbw_probe_tls_stage);
+    }
+
+    if(pcfg->ipfix_collector)
+        gbw_probe_stage_register(probe_engine,&gbw_probe_ipfix_stage);
+
+    if(pcfg->sketch_interval&&gbw_probe_sketch_create(probe_engine) == NULL){
+        fprintf(stderr,"Cannot create the sketches,see %s\n",pcfg->log_file);
+        gbw_probe_engine_destroy(probe_engine);
+        gbw_pool_destroy(mp);
+        return -1;
+    }
+
+    /*after the stages whose records it exports*/
+    if((pcfg->export_dir||pcfg->export_unix)&&gbw_probe_export_create(probe_engine) == NULL){
+        fprintf(stderr,"Cannot create the record export,see %s\n",pcfg->log_file);
+        gbw_probe_engine_destroy(probe_engine);
+        gbw_pool_destroy(mp);
+        return -1;
+    }
+
+    /*last,so a flow flagged by any stage has the packet it was flagged on*/
+    if(pcfg->record_dir&&gbw_probe_record_create(probe_engine) == NULL){
+        fprintf(stderr,"Cannot create the flow recording,see %s\n",pcfg->log_file);
+        gbw_probe_engine_destroy(probe_engine);
+        gbw_pool_destroy(mp);
+        return -1;
+    }
+
+    rc = gbw_probe_engine_run(probe_engine);
+
+    gbw_probe_engine_destroy(probe_engine);
+    probe_engine = NULL;
+
+    gbw_pool_destroy(mp);
+
+    return rc;
+}
@@ -0,0 +1,280 @@
+/*
+ *
+ *      Filename: test_ac.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: unit tests of the Aho-Corasick matcher against a brute
+ *                force search,whole and streamed,dense and sparse states
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "gbw_ac_matcher.h"
+#include "test_check.h"
+
+#define MAX_PATTERNS 2048
+#define MAX_MATCHES  (1<<16)
+#define TEXT_LEN     8192
+
+typedef struct {
+
+    uint32_t id;
+    uint64_t end;
+}ac_match_t;
+
+typedef struct {
+
+    ac_match_t m[MAX_MATCHES];
+    uint32_t n;
+    uint32_t stop_after;
+}ac_found_t;
+
+typedef struct {
+
+    uint8_t data[MAX_PATTERNS][32];
+    uint32_t len[MAX_PATTERNS];
+    uint32_t n;
+}ac_set_t;
+
+static uint64_t rnd_state = 42;
+
+static uint32_t _rnd(void){
+
+    rnd_state = rnd_state*6364136223846793005ULL+1442695040888963407ULL;
+    return (uint32_t)(rnd_state>>33);
+}
+
+static int _on_match(void *priv,uint32_t id,uint64_t end){
+
+    ac_found_t *f = (ac_found_t*)priv;
+
+    if(f->n<MAX_MATCHES){
+        f->m[f->n].id = id;
+        f->m[f->n].end = end;
+    }
+    f->n++;
+
+    return f->stop_after&&f->n == f->stop_after;
+}
+
+static int _cmp(const void *a,const void *b){
+
+    const ac_match_t *x = (const ac_match_t*)a,*y = (const ac_match_t*)b;
+
+    if(x->end!=y->end)
+        return x->end<y->end?-1:1;
+    return x->id<y->id?-1:(x->id>y->id);
+}
+
+static int _eq(const uint8_t *a,const uint8_t *b,uint32_t len,int nocase){
+
+    uint32_t i;
+
+    for(i = 0;i<len;i++){
+
+        if(nocase?tolower(a[i])!=tolower(b[i]):a[i]!=b[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+static void _brute(const ac_set_t *set,const uint8_t *text,uint32_t len,int nocase,ac_found_t *f){
+
+    uint32_t i,j;
+
+    f->n = 0;
+
+    for(i = 0;i<set->n;i++)
+        for(j = 0;j+set->len[i]<=len;j++)
+            if(_eq(set->data[i],text+j,set->len[i],nocase))
+                _on_match(f,i,j+set->len[i]);
+
+    qsort(f->m,f->n,sizeof(ac_match_t),_cmp);
+}
+
+static gbw_ac_matcher_t * _compile(gbw_pool_t *mp,const ac_set_t *set,int flags){
+
+    gbw_ac_matcher_t *ac = gbw_ac_matcher_create(mp,flags);
+    uint32_t i;
+
+    if(ac == NULL)
+        return NULL;
+
+    for(i = 0;i<set->n;i++)
+        gbw_ac_matcher_add(ac,set->data[i],set->len[i],i);
+
+    if(gbw_ac_matcher_compile(ac))
+        return NULL;
+
+    return ac;
+}
+
+/*the same matches whole and in chunks of every size in sizes*/
+static void _check(const gbw_ac_matcher_t *ac,const ac_set_t *set,const uint8_t *text,uint32_t len,int nocase){
+
+    static ac_found_t want,got;
+    static const uint32_t sizes[] = {1,3,64,1000};
+    gbw_ac_stream_t st;
+    uint32_t i,off,n;
+
+    _brute(set,text,len,nocase,&want);
+    TEST_CHECK(want.n<=MAX_MATCHES);
+
+    got.n = 0;
+    got.stop_after = 0;
+    gbw_ac_matcher_scan(ac,text,len,_on_match,&got);
+    qsort(got.m,got.n,sizeof(ac_match_t),_cmp);
+    TEST_CHECK(got.n == want.n&&memcmp(got.m,want.m,want.n*sizeof(ac_match_t)) == 0);
+
+    for(i = 0;i<sizeof(sizes)/sizeof(sizes[0]);i++){
+
+        got.n = 0;
+        gbw_ac_stream_init(&st);
+
+        for(off = 0;off<len;off += n){
+            n = len-off<sizes[i]?len-off:sizes[i];
+            gbw_ac_matcher_scan_stream(ac,&st,text+off,n,_on_match,&got);
+        }
+
+        qsort(got.m,got.n,sizeof(ac_match_t),_cmp);
+        TEST_CHECK(got.n == want.n&&memcmp(got.m,want.m,want.n*sizeof(ac_match_t)) == 0);
+    }
+}
+
+/*patterns and text over a small alphabet,so they overlap a lot*/
+static void test_small_alphabet(gbw_pool_t *mp){
+
+    static ac_set_t set;
+    static uint8_t text[TEXT_LEN];
+    gbw_ac_matcher_t *ac;
+    uint32_t i,j;
+
+    set.n = 64;
+    for(i = 0;i<set.n;i++){
+
+        set.len[i] = 1+_rnd()%8;
+        for(j = 0;j<set.len[i];j++)
+            set.data[i][j] = "abcAB"[_rnd()%5];
+    }
+
+    for(i = 0;i<TEXT_LEN;i++)
+        text[i] = "abcdAB"[_rnd()%6];
+
+    ac = _compile(mp,&set,0);
+    TEST_CHECK(ac!=NULL);
+    if(ac)
+        _check(ac,&set,text,TEXT_LEN,0);
+
+    ac = _compile(mp,&set,GBW_AC_NOCASE);
+    TEST_CHECK(ac!=NULL);
+    if(ac)
+        _check(ac,&set,text,TEXT_LEN,1);
+}
+
+/*
+ * Many long binary patterns,far more states than the dense table holds,
+ * some planted in the text so the deep ones are walked.
+ */
+static void test_sparse(gbw_pool_t *mp){
+
+    static ac_set_t set;
+    static uint8_t text[TEXT_LEN];
+    gbw_ac_matcher_t *ac;
+    uint32_t i,j,k,at;
+
+    set.n = MAX_PATTERNS;
+    for(i = 0;i<set.n;i++){
+
+        set.len[i] = 4+_rnd()%28;
+        for(j = 0;j<set.len[i];j++)
+            set.data[i][j] = (uint8_t)_rnd();
+
+        /*families sharing prefixes*/
+        if(i%4&&set.len[i-1]>2)
+            memcpy(set.data[i],set.data[i-1],2+_rnd()%(set.len[i-1]-2<set.len[i]?set.len[i-1]-2:set.len[i]-2));
+    }
+
+    for(i = 0;i<TEXT_LEN;i++)
+        text[i] = (uint8_t)_rnd();
+
+    for(i = 0;i<100;i++){
+
+        k = _rnd()%set.n;
+        at = _rnd()%(TEXT_LEN-32);
+        memcpy(text+at,set.data[k],set.len[k]);
+    }
+
+    ac = _compile(mp,&set,0);
+    TEST_CHECK(ac!=NULL);
+    if(ac == NULL)
+        return;
+
+    TEST_CHECK(ac->n_dense<ac->n_states);
+    _check(ac,&set,text,TEXT_LEN,0);
+}
+
+static void test_stop(gbw_pool_t *mp){
+
+    static ac_set_t set;
+    static ac_found_t got;
+    static const char text[] = "she sells sea shells";
+    gbw_ac_matcher_t *ac;
+    gbw_ac_stream_t st;
+    uint32_t len = (uint32_t)strlen(text),done;
+
+    set.n = 3;
+    memcpy(set.data[0],"he",2);
+    set.len[0] = 2;
+    memcpy(set.data[1],"she",3);
+    set.len[1] = 3;
+    memcpy(set.data[2],"hell",4);
+    set.len[2] = 4;
+
+    ac = _compile(mp,&set,0);
+    TEST_CHECK(ac!=NULL);
+    if(ac == NULL)
+        return;
+
+    _check(ac,&set,(const uint8_t*)text,len,0);
+
+    /*
+     * stopped at each match,resumed right after the byte it ends on:
+     * "he" and "she" end on the same one,one of them is all that comes
+     */
+    memset(&got,0,sizeof(got));
+    got.stop_after = 1;
+    gbw_ac_stream_init(&st);
+
+    while(gbw_ac_matcher_scan_stream(ac,&st,(const uint8_t*)text+st.offset,len-(uint32_t)st.offset,_on_match,&got) == 1){
+        TEST_CHECK(st.offset == got.m[got.n-1].end);
+        got.stop_after++;
+    }
+
+    done = got.n;
+    TEST_CHECK(done == 3&&got.m[0].end == 3&&got.m[1].end == 17&&got.m[2].end == 19&&got.m[2].id == 2);
+    TEST_CHECK(st.offset == len);
+
+    /*none,or added too late*/
+    TEST_CHECK(gbw_ac_matcher_compile(gbw_ac_matcher_create(mp,0)) == -1);
+    TEST_CHECK(gbw_ac_matcher_add(ac,"x",1,9) == -1);
+}
+
+int main(void){
+
+    gbw_pool_t *mp = gbw_pool_create(4096);
+
+    if(mp == NULL)
+        return 1;
+
+    test_small_alphabet(mp);
+    test_sparse(mp);
+    test_stop(mp);
+
+    gbw_pool_destroy(mp);
+
+    TEST_DONE("ac");
+}
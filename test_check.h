@@ -0,0 +1,34 @@
+/*
+ *
+ *      Filename: test_check.h
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: checks of the unit tests,a failed one is reported and
+ *                counted,main returns the count
+ *
+ */
+
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <stdio.h>
+
+static int test_failed = 0;
+
+#define TEST_CHECK(cond) do{                                                    \
+    if(!(cond)){                                                                \
+        fprintf(stderr,"%s:%d: %s failed\n",__FILE__,__LINE__,#cond);           \
+        test_failed++;                                                          \
+    }                                                                           \
+}while(0)
+
+/*ends main,0 if every check passed*/
+#define TEST_DONE(name) do{                                                     \
+    if(test_failed)                                                             \
+        fprintf(stderr,"%s: %d checks failed\n",name,test_failed);              \
+    else                                                                        \
+        fprintf(stdout,"%s: ok\n",name);                                        \
+    return test_failed?1:0;                                                     \
+}while(0)
+
+#endif /*TEST_CHECK_H*/
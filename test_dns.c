@@ -0,0 +1,352 @@
+/*
+ *
+ *      Filename: test_dns.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: unit tests of the DNS decoder: compression pointers,
+ *                loops of them,name limits,EDNS and messages cut short
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gbw_dns_parser.h"
+#include "test_check.h"
+
+typedef struct {
+
+    uint8_t data[2048];
+    uint32_t len;
+}dns_buf_t;
+
+static void _put8(dns_buf_t *b,uint8_t v){
+
+    b->data[b->len++] = v;
+}
+
+static void _put16(dns_buf_t *b,uint16_t v){
+
+    _put8(b,(uint8_t)(v>>8));
+    _put8(b,(uint8_t)v);
+}
+
+static void _put32(dns_buf_t *b,uint32_t v){
+
+    _put16(b,(uint16_t)(v>>16));
+    _put16(b,(uint16_t)v);
+}
+
+/*labels of a dotted name,without the terminating root label*/
+static void _labels(dns_buf_t *b,const char *name){
+
+    const char *dot;
+    uint32_t n;
+
+    while(*name){
+
+        dot = strchr(name,'.');
+        n = dot?(uint32_t)(dot-name):(uint32_t)strlen(name);
+
+        _put8(b,(uint8_t)n);
+        memcpy(b->data+b->len,name,n);
+        b->len += n;
+
+        name += n;
+        if(*name == '.')
+            name++;
+    }
+}
+
+static void _name(dns_buf_t *b,const char *name){
+
+    _labels(b,name);
+    _put8(b,0);
+}
+
+static void _ptr(dns_buf_t *b,uint16_t off){
+
+    _put16(b,0xc000|off);
+}
+
+static void _header(dns_buf_t *b,uint16_t flags,uint16_t qd,uint16_t an,uint16_t ns,uint16_t ar){
+
+    b->len = 0;
+    _put16(b,0x1234);
+    _put16(b,flags);
+    _put16(b,qd);
+    _put16(b,an);
+    _put16(b,ns);
+    _put16(b,ar);
+}
+
+static void _question(dns_buf_t *b,const char *name,uint16_t type){
+
+    _name(b,name);
+    _put16(b,type);
+    _put16(b,1);
+}
+
+/*owner as a pointer,rdata length patched by _rr_end*/
+static uint32_t _rr_start(dns_buf_t *b,uint16_t owner,uint16_t type,uint16_t rclass,uint32_t ttl){
+
+    uint32_t at;
+
+    _ptr(b,owner);
+    _put16(b,type);
+    _put16(b,rclass);
+    _put32(b,ttl);
+    at = b->len;
+    _put16(b,0);
+
+    return at;
+}
+
+static void _rr_end(dns_buf_t *b,uint32_t at){
+
+    uint32_t n = b->len-at-2;
+
+    b->data[at] = (uint8_t)(n>>8);
+    b->data[at+1] = (uint8_t)n;
+}
+
+static void test_answers(gbw_dns_scratch_t *sc){
+
+    gbw_dns_msg_t msg;
+    dns_buf_t b;
+    uint32_t at,cdn;
+
+    /*www.example.com CNAME cdn.example.com,CNAME www.cdn.example.com,A*/
+    _header(&b,0x8180,1,3,0,0);
+    _question(&b,"www.example.com",GBW_DNS_TYPE_A);
+
+    at = _rr_start(&b,12,GBW_DNS_TYPE_CNAME,1,300);
+    cdn = b.len;
+    _labels(&b,"cdn");
+    _ptr(&b,12+4);
+    _rr_end(&b,at);
+
+    /*a chain of pointers,each before the last*/
+    at = _rr_start(&b,12,GBW_DNS_TYPE_CNAME,1,300);
+    _labels(&b,"www");
+    _ptr(&b,(uint16_t)cdn);
+    _rr_end(&b,at);
+
+    at = _rr_start(&b,12,GBW_DNS_TYPE_A,1,60);
+    _put32(&b,0xc0a80001);
+    _rr_end(&b,at);
+
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(msg.id == 0x1234&&GBW_DNS_QR(msg.flags)&&msg.rcode == 0);
+    TEST_CHECK(strcmp(msg.qname,"www.example.com") == 0&&msg.qname_len == 15);
+    TEST_CHECK(msg.qtype == GBW_DNS_TYPE_A&&msg.qclass == 1);
+    TEST_CHECK(msg.n_answers == 3);
+
+    TEST_CHECK(msg.answers[0].type == GBW_DNS_TYPE_CNAME&&msg.answers[0].ttl == 300);
+    TEST_CHECK(msg.answers[0].name&&strcmp(msg.answers[0].name,"cdn.example.com") == 0);
+    TEST_CHECK(msg.answers[1].name&&strcmp(msg.answers[1].name,"www.cdn.example.com") == 0);
+    TEST_CHECK(msg.answers[1].name_len == 19);
+
+    TEST_CHECK(msg.answers[2].type == GBW_DNS_TYPE_A&&msg.answers[2].rdlen == 4);
+    TEST_CHECK(msg.answers[2].name == NULL);
+    TEST_CHECK(memcmp(msg.answers[2].rdata,"\xc0\xa8\x00\x01",4) == 0);
+
+    /*cut inside the last answer,the ones before it are kept*/
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len-2) == 0);
+    TEST_CHECK(msg.n_answers == 2);
+
+    /*the root*/
+    _header(&b,0,1,0,0,0);
+    _question(&b,"",GBW_DNS_TYPE_SOA);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(strcmp(msg.qname,".") == 0&&msg.qname_len == 1);
+}
+
+static void test_loops(gbw_dns_scratch_t *sc){
+
+    gbw_dns_msg_t msg;
+    dns_buf_t b;
+    uint32_t at,rdata;
+
+    /*a question pointing at itself*/
+    _header(&b,0,1,0,0,0);
+    _ptr(&b,12);
+    _put16(&b,GBW_DNS_TYPE_A);
+    _put16(&b,1);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == -1);
+
+    /*or at what comes after it*/
+    _header(&b,0,1,0,0,0);
+    _ptr(&b,14);
+    _name(&b,"example.com");
+    _put16(&b,GBW_DNS_TYPE_A);
+    _put16(&b,1);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == -1);
+
+    /*rdata names looping on themselves are dropped,parsing goes on*/
+    _header(&b,0x8180,1,4,0,0);
+    _question(&b,"example.com",GBW_DNS_TYPE_A);
+
+    at = _rr_start(&b,12,GBW_DNS_TYPE_CNAME,1,300);
+    rdata = b.len;
+    _labels(&b,"loop");
+    _ptr(&b,(uint16_t)rdata);
+    _rr_end(&b,at);
+
+    /*
+     * a pair,the first pointing on to the rdata of the second,which
+     * points back: each jump has to go back before the last,so it stops
+     */
+    at = _rr_start(&b,12,GBW_DNS_TYPE_CNAME,1,300);
+    rdata = b.len;
+    _ptr(&b,(uint16_t)(rdata+2+12));
+    _rr_end(&b,at);
+
+    at = _rr_start(&b,12,GBW_DNS_TYPE_NS,1,300);
+    TEST_CHECK(b.len == rdata+2+12);
+    _ptr(&b,(uint16_t)rdata);
+    _rr_end(&b,at);
+
+    at = _rr_start(&b,12,GBW_DNS_TYPE_MX,1,300);
+    _put16(&b,10);
+    _labels(&b,"mail");
+    _ptr(&b,12);
+    _rr_end(&b,at);
+
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(msg.n_answers == 4);
+    TEST_CHECK(msg.answers[0].name == NULL&&msg.answers[0].name_len == 0);
+    TEST_CHECK(msg.answers[1].name == NULL&&msg.answers[2].name == NULL);
+    TEST_CHECK(msg.answers[3].type == GBW_DNS_TYPE_MX);
+    TEST_CHECK(msg.answers[3].name&&strcmp(msg.answers[3].name,"mail.example.com") == 0);
+}
+
+static void test_limits(gbw_dns_scratch_t *sc){
+
+    static char name[5*64+1];
+    gbw_dns_msg_t msg;
+    dns_buf_t b;
+    uint32_t i;
+
+    /*shorter than a header*/
+    _header(&b,0,0,0,0,0);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,GBW_DNS_HEADER_LEN-1) == -1);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,GBW_DNS_HEADER_LEN) == 0);
+    TEST_CHECK(msg.qname_len == 0&&msg.n_answers == 0);
+
+    /*4 labels of 63,255 bytes dotted,as long as a name gets*/
+    for(i = 0;i<5;i++){
+        memset(name+i*64,'a'+i,63);
+        name[i*64+63] = '.';
+    }
+
+    name[4*64-1] = 0;
+    _header(&b,0,1,0,0,0);
+    _question(&b,name,GBW_DNS_TYPE_TXT);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(msg.qname_len == 255&&strcmp(msg.qname,name) == 0);
+
+    name[4*64-1] = '.';
+    name[5*64-1] = 0;
+    _header(&b,0,1,0,0,0);
+    _question(&b,name,GBW_DNS_TYPE_TXT);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == -1);
+
+    /*extended label types*/
+    _header(&b,0,1,0,0,0);
+    _put8(&b,0x41);
+    _put8(&b,0);
+    _put32(&b,0x00010001);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == -1);
+
+    /*a question without its type and class*/
+    _header(&b,0,1,0,0,0);
+    _name(&b,"example.com");
+    _put16(&b,GBW_DNS_TYPE_A);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == -1);
+
+    /*a label past the end*/
+    _header(&b,0,1,0,0,0);
+    _put8(&b,10);
+    _put8(&b,'a');
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == -1);
+
+    /*dots,spaces and control bytes inside labels*/
+    _header(&b,0,1,0,0,0);
+    _put8(&b,4);
+    _put8(&b,'a');
+    _put8(&b,'.');
+    _put8(&b,' ');
+    _put8(&b,0x01);
+    _put8(&b,1);
+    _put8(&b,0xff);
+    _put8(&b,0);
+    _put32(&b,0x00010001);
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(strcmp(msg.qname,"a???.?") == 0);
+}
+
+static void test_edns(gbw_dns_scratch_t *sc){
+
+    gbw_dns_msg_t msg;
+    dns_buf_t b;
+    uint32_t at;
+
+    /*BADVERS,rcode 16: 1 in the OPT ttl and 0 in the header*/
+    _header(&b,0x8180,1,1,1,1);
+    _question(&b,"example.com",GBW_DNS_TYPE_AAAA);
+
+    at = _rr_start(&b,12,GBW_DNS_TYPE_AAAA,1,60);
+    _put32(&b,0x20010db8);
+    _put32(&b,0);
+    _put32(&b,0);
+    _put32(&b,1);
+    _rr_end(&b,at);
+
+    /*an OPT out of place,in authority,is not EDNS*/
+    at = _rr_start(&b,12,GBW_DNS_TYPE_OPT,512,0);
+    _rr_end(&b,at);
+
+    _put8(&b,0);
+    _put16(&b,GBW_DNS_TYPE_OPT);
+    _put16(&b,1232);
+    _put32(&b,0x01008000);
+    _put16(&b,0);
+
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(msg.n_answers == 1&&msg.answers[0].rdlen == 16);
+    TEST_CHECK(msg.edns&&msg.edns_size == 1232);
+    TEST_CHECK(msg.edns_do == 1&&msg.edns_version == 0);
+    TEST_CHECK(msg.rcode == 16);
+
+    /*version and no DO bit,over an rcode of the header*/
+    b.data[3] = 0x83;
+    b.len -= 6;
+    _put32(&b,0x00010000);
+    _put16(&b,0);
+
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len) == 0);
+    TEST_CHECK(msg.edns&&msg.edns_version == 1&&msg.edns_do == 0);
+    TEST_CHECK(msg.rcode == 3);
+
+    /*the OPT cut short is not seen*/
+    TEST_CHECK(gbw_dns_parse(&msg,sc,b.data,b.len-3) == 0);
+    TEST_CHECK(msg.edns == 0&&msg.n_answers == 1);
+}
+
+int main(void){
+
+    gbw_dns_scratch_t *sc = malloc(sizeof(*sc));
+
+    if(sc == NULL)
+        return 1;
+
+    test_answers(sc);
+    test_loops(sc);
+    test_limits(sc);
+    test_edns(sc);
+
+    free(sc);
+
+    TEST_DONE("dns");
+}
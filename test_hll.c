@@ -0,0 +1,280 @@
+/*
+ *
+ *      Filename: test_hll.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: unit tests of the HyperLogLog counters: error against
+ *                1.04/sqrt(m),sparse to dense,merges and serialization
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gbw_hll.h"
+#include "gbw_sketch.h"
+#include "test_check.h"
+
+static inline uint64_t _item_hash(uint64_t seed,uint64_t i){
+
+    return gbw_sketch_mix64(seed^gbw_sketch_mix64(i+1));
+}
+
+static void _add_range(gbw_hll_t *hll,uint64_t seed,uint64_t from,uint64_t to){
+
+    uint64_t i;
+
+    for(i = from;i<to;i++)
+        gbw_hll_add(hll,_item_hash(seed,i));
+}
+
+/*within 3 standard errors,each count is one draw of the estimator*/
+static int _within(uint64_t est,uint64_t n,uint8_t p){
+
+    double err = 1.04/sqrt((double)(1U<<p));
+
+    return fabs((double)est-(double)n)<=3*err*(double)n;
+}
+
+static void test_error(gbw_pool_t *mp){
+
+    static const uint8_t ps[] = {10,12,14,16};
+    static const uint64_t ns[] = {100,1000,10000,100000,1000000};
+    gbw_hll_t *hll;
+    uint64_t n,prev;
+    unsigned int i,j,seed;
+
+    for(i = 0;i<sizeof(ps)/sizeof(ps[0]);i++){
+
+        for(seed = 1;seed<=3;seed++){
+
+            hll = gbw_hll_create(mp,ps[i]);
+            TEST_CHECK(hll!=NULL);
+            if(hll == NULL)
+                return;
+
+            TEST_CHECK(gbw_hll_count(hll) == 0);
+
+            prev = 0;
+
+            for(j = 0;j<sizeof(ns)/sizeof(ns[0]);j++){
+
+                n = ns[j];
+                _add_range(hll,seed,prev,n);
+                prev = n;
+
+                TEST_CHECK(_within(gbw_hll_count(hll),n,ps[i]));
+            }
+
+            /*items seen again don't count*/
+            _add_range(hll,seed,0,1000);
+            TEST_CHECK(_within(gbw_hll_count(hll),prev,ps[i]));
+
+            gbw_hll_destroy(hll);
+        }
+    }
+
+    TEST_CHECK(gbw_hll_create(mp,GBW_HLL_MIN_PRECISION-1) == NULL);
+    TEST_CHECK(gbw_hll_create(mp,GBW_HLL_MAX_PRECISION+1) == NULL);
+}
+
+/*registers of the items added,as a dense counter holds them*/
+static void _ref_registers(uint8_t *ref,uint8_t p,uint64_t seed,uint64_t n){
+
+    uint64_t i,h;
+    uint32_t idx;
+    uint8_t rank;
+
+    memset(ref,0,1U<<p);
+
+    for(i = 0;i<n;i++){
+
+        h = _item_hash(seed,i);
+        idx = (uint32_t)(h>>(64-p));
+        rank = (uint8_t)(__builtin_clzll(h<<p|(1ULL<<(p-1)))+1);
+
+        if(ref[idx]<rank)
+            ref[idx] = rank;
+    }
+}
+
+static void test_sparse_dense(gbw_pool_t *mp){
+
+    gbw_hll_t *hll,*small;
+    uint8_t *ref;
+    uint64_t n = 0;
+
+    hll = gbw_hll_create(mp,14);
+    TEST_CHECK(hll!=NULL&&hll->dense == 0);
+    if(hll == NULL)
+        return;
+
+    /*sparse until the table is full,the count holds all along*/
+    while(hll->dense == 0){
+
+        gbw_hll_add(hll,_item_hash(7,n));
+        n++;
+
+        if(hll->dense == 0&&n%256 == 0)
+            TEST_CHECK(_within(gbw_hll_count(hll),n,14));
+    }
+
+    TEST_CHECK(hll->sparse_n == hll->sparse_max);
+    TEST_CHECK(n>hll->sparse_max);
+
+    /*every register set while sparse made it into the dense ones*/
+    ref = malloc(1U<<14);
+    TEST_CHECK(ref!=NULL);
+    if(ref == NULL)
+        return;
+
+    _ref_registers(ref,14,7,n);
+    TEST_CHECK(memcmp(hll->registers,ref,1U<<14) == 0);
+    TEST_CHECK(_within(gbw_hll_count(hll),n,14));
+
+    _add_range(hll,7,n,50000);
+    _ref_registers(ref,14,7,50000);
+    TEST_CHECK(memcmp(hll->registers,ref,1U<<14) == 0);
+
+    /*cleared,sparse again*/
+    gbw_hll_clear(hll);
+    TEST_CHECK(hll->dense == 0&&hll->sparse_n == 0&&gbw_hll_count(hll) == 0);
+
+    _add_range(hll,7,0,100);
+    TEST_CHECK(hll->dense == 0&&_within(gbw_hll_count(hll),100,14));
+
+    free(ref);
+    gbw_hll_destroy(hll);
+
+    /*too few registers to be worth a sparse table*/
+    small = gbw_hll_create(mp,GBW_HLL_SPARSE_MIN_PRECISION-1);
+    TEST_CHECK(small!=NULL&&small->dense == 1);
+    if(small)
+        gbw_hll_destroy(small);
+}
+
+static void test_merge(gbw_pool_t *mp){
+
+    gbw_hll_t *a,*b,*c,*d;
+
+    a = gbw_hll_create(mp,14);
+    b = gbw_hll_create(mp,14);
+    c = gbw_hll_create(mp,14);
+    d = gbw_hll_create(mp,12);
+    TEST_CHECK(a&&b&&c&&d);
+    if(!(a&&b&&c&&d))
+        return;
+
+    /*overlapping halves,dense into dense*/
+    _add_range(a,9,0,200000);
+    _add_range(b,9,100000,300000);
+    TEST_CHECK(gbw_hll_merge(a,b) == 0);
+    TEST_CHECK(_within(gbw_hll_count(a),300000,14));
+
+    /*sparse into dense and dense into sparse*/
+    _add_range(c,9,299900,300100);
+    TEST_CHECK(c->dense == 0);
+    TEST_CHECK(gbw_hll_merge(a,c) == 0);
+    TEST_CHECK(_within(gbw_hll_count(a),300100,14));
+
+    TEST_CHECK(gbw_hll_merge(c,b) == 0);
+    TEST_CHECK(c->dense == 1);
+    TEST_CHECK(_within(gbw_hll_count(c),200100,14));
+
+    /*sparse into sparse*/
+    gbw_hll_clear(b);
+    gbw_hll_clear(c);
+    _add_range(b,9,0,300);
+    _add_range(c,9,200,500);
+    TEST_CHECK(gbw_hll_merge(b,c) == 0);
+    TEST_CHECK(b->dense == 0&&_within(gbw_hll_count(b),500,14));
+
+    TEST_CHECK(gbw_hll_merge(a,d) == -1);
+
+    gbw_hll_destroy(a);
+    gbw_hll_destroy(b);
+    gbw_hll_destroy(c);
+    gbw_hll_destroy(d);
+}
+
+static void _round_trip(gbw_pool_t *mp,uint64_t n){
+
+    gbw_data_output_t dout;
+    gbw_hll_t *a,*b;
+    ssize_t len;
+    uint8_t *data;
+
+    a = gbw_hll_create(mp,14);
+    b = gbw_hll_create(mp,14);
+    TEST_CHECK(a&&b);
+    if(!(a&&b)||gbw_dout_init(&dout))
+        return;
+
+    _add_range(a,11,0,n);
+
+    len = gbw_hll_serialize(a,&dout);
+    TEST_CHECK(len>0&&(size_t)len == (size_t)GBW_DOUT_CONTENT_SIZE(&dout));
+
+    data = (uint8_t*)GBW_DOUT_CONTENT(&dout);
+    TEST_CHECK(data[0] == GBW_HLL_SERIAL_VERSION&&data[1] == 14);
+    TEST_CHECK(data[2] == (a->dense?GBW_HLL_SERIAL_DENSE:GBW_HLL_SERIAL_SPARSE));
+
+    TEST_CHECK(gbw_hll_merge_serialized(b,data,(size_t)len) == 0);
+    TEST_CHECK(gbw_hll_count(b) == gbw_hll_count(a));
+    TEST_CHECK(b->dense == a->dense);
+
+    if(a->dense&&b->dense)
+        TEST_CHECK(memcmp(a->registers,b->registers,a->m) == 0);
+
+    /*merging it once more changes nothing*/
+    TEST_CHECK(gbw_hll_merge_serialized(b,data,(size_t)len) == 0);
+    TEST_CHECK(gbw_hll_count(b) == gbw_hll_count(a));
+
+    /*broken ones are refused*/
+    TEST_CHECK(gbw_hll_merge_serialized(b,data,(size_t)len-1) == -1);
+    TEST_CHECK(gbw_hll_merge_serialized(b,data,2) == -1);
+
+    data[1] = 12;
+    TEST_CHECK(gbw_hll_merge_serialized(b,data,(size_t)len) == -1);
+    data[1] = 14;
+
+    data[0] = GBW_HLL_SERIAL_VERSION+1;
+    TEST_CHECK(gbw_hll_merge_serialized(b,data,(size_t)len) == -1);
+    data[0] = GBW_HLL_SERIAL_VERSION;
+
+    /*a rank past what 64-p bits can have*/
+    if(a->dense == 0&&len>=11){
+        data[10] = 64-14+2;
+        TEST_CHECK(gbw_hll_merge_serialized(b,data,(size_t)len) == -1);
+    }
+
+    free(dout.base);
+    gbw_hll_destroy(a);
+    gbw_hll_destroy(b);
+}
+
+static void test_serialize(gbw_pool_t *mp){
+
+    /*empty,sparse and dense*/
+    _round_trip(mp,0);
+    _round_trip(mp,500);
+    _round_trip(mp,100000);
+}
+
+int main(void){
+
+    gbw_pool_t *mp = gbw_pool_create(4096);
+
+    if(mp == NULL)
+        return 1;
+
+    test_error(mp);
+    test_sparse_dense(mp);
+    test_merge(mp);
+    test_serialize(mp);
+
+    gbw_pool_destroy(mp);
+
+    TEST_DONE("hll");
+}
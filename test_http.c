@@ -0,0 +1,324 @@
+/*
+ *
+ *      Filename: test_http.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: unit tests of the HTTP/1.x parser: pipelining cut at
+ *                every byte,chunked bodies,gaps and malformed messages
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gbw_http_parser.h"
+#include "test_check.h"
+
+/*what the callbacks saw,as one string to compare*/
+typedef struct {
+
+    char log[4096];
+    uint32_t len;
+    int stop_on_request;
+}http_log_t;
+
+static void _log(gbw_http_parser_t *p,const char *s,uint32_t len){
+
+    http_log_t *l = (http_log_t*)p->priv;
+
+    if(l->len+len<sizeof(l->log)){
+        memcpy(l->log+l->len,s,len);
+        l->len += len;
+        l->log[l->len] = 0;
+    }
+}
+
+static void _log_str(gbw_http_parser_t *p,const char *s){
+
+    _log(p,s,(uint32_t)strlen(s));
+}
+
+static void _log_span(gbw_http_parser_t *p,const gbw_str_t *s){
+
+    _log(p,(const char*)s->data,(uint32_t)s->len);
+}
+
+static int _on_request(gbw_http_parser_t *p,const gbw_str_t *method,const gbw_str_t *target,const gbw_str_t *version){
+
+    _log_str(p,"[");
+    _log_span(p,method);
+    _log_str(p," ");
+    _log_span(p,target);
+    _log_str(p," ");
+    _log_span(p,version);
+    _log_str(p,"]");
+
+    return ((http_log_t*)p->priv)->stop_on_request;
+}
+
+static int _on_response(gbw_http_parser_t *p,const gbw_str_t *version,int status,const gbw_str_t *reason){
+
+    char buf[16];
+
+    (void)version;
+    (void)reason;
+
+    snprintf(buf,sizeof(buf),"[%d]",status);
+    _log_str(p,buf);
+
+    return 0;
+}
+
+static int _on_header(gbw_http_parser_t *p,const gbw_str_t *name,const gbw_str_t *value){
+
+    _log_span(p,name);
+    _log_str(p,"=");
+    _log_span(p,value);
+    _log_str(p,";");
+
+    return 0;
+}
+
+static int _on_headers_done(gbw_http_parser_t *p){
+
+    _log_str(p,"|");
+    return 0;
+}
+
+/*body bytes go in as they are,however the chunks cut them*/
+static int _on_body(gbw_http_parser_t *p,const uint8_t *data,uint32_t len){
+
+    _log(p,(const char*)data,len);
+    return 0;
+}
+
+static int _on_message_done(gbw_http_parser_t *p){
+
+    _log_str(p,"$");
+    return 0;
+}
+
+static const gbw_http_callbacks_t cbs = {
+    .on_request = _on_request,
+    .on_response = _on_response,
+    .on_header = _on_header,
+    .on_headers_done = _on_headers_done,
+    .on_body = _on_body,
+    .on_message_done = _on_message_done,
+};
+
+static void _init(gbw_http_parser_t *p,gbw_pool_t *mp,int type,http_log_t *l){
+
+    memset(l,0,sizeof(*l));
+    gbw_http_parser_init(p,mp,type,&cbs,l);
+}
+
+static int _exec(gbw_http_parser_t *p,const char *s){
+
+    return gbw_http_parser_execute(p,(const uint8_t*)s,(uint32_t)strlen(s));
+}
+
+static const char pipelined[] =
+    "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+    "POST /b?q=1 HTTP/1.1\r\nContent-Length: 3\r\nX-Folded: a\r\n  b\r\n\r\nabc"
+    "\r\n"
+    "PUT /c HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+    "3;ext=1\r\ndef\r\n0\r\nX-Trailer: t\r\n\r\n"
+    "GET /d HTTP/1.0\n\n";
+
+static const char pipelined_log[] =
+    "[GET /a HTTP/1.1]Host=x;|$"
+    "[POST /b?q=1 HTTP/1.1]Content-Length=3;X-Folded=a;|abc$"
+    "[PUT /c HTTP/1.1]Transfer-Encoding=gzip, chunked;|defX-Trailer=t;$"
+    "[GET /d HTTP/1.0]|$";
+
+/*the same log whether the stream comes whole,in two or a byte at a time*/
+static void test_pipelining(gbw_pool_t *mp){
+
+    gbw_http_parser_t p;
+    http_log_t l;
+    uint32_t len = (uint32_t)strlen(pipelined),cut,i;
+
+    _init(&p,mp,GBW_HTTP_REQUEST,&l);
+    TEST_CHECK(_exec(&p,pipelined) == 0);
+    TEST_CHECK(strcmp(l.log,pipelined_log) == 0);
+    TEST_CHECK(p.messages == 4&&p.errors == 0);
+    gbw_http_parser_fin(&p);
+
+    for(cut = 1;cut<len;cut++){
+
+        _init(&p,mp,GBW_HTTP_REQUEST,&l);
+        TEST_CHECK(gbw_http_parser_execute(&p,(const uint8_t*)pipelined,cut) == 0);
+        TEST_CHECK(gbw_http_parser_execute(&p,(const uint8_t*)pipelined+cut,len-cut) == 0);
+        TEST_CHECK(strcmp(l.log,pipelined_log) == 0);
+        gbw_http_parser_fin(&p);
+    }
+
+    _init(&p,mp,GBW_HTTP_REQUEST,&l);
+    for(i = 0;i<len;i++)
+        TEST_CHECK(gbw_http_parser_execute(&p,(const uint8_t*)pipelined+i,1) == 0);
+    TEST_CHECK(strcmp(l.log,pipelined_log) == 0);
+    TEST_CHECK(p.messages == 4);
+    gbw_http_parser_fin(&p);
+}
+
+static void test_responses(gbw_pool_t *mp){
+
+    gbw_http_parser_t p;
+    http_log_t l;
+
+    /*a HEAD then a GET pipelined,the first length has no body behind it*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    gbw_http_parser_expect(&p,1);
+    gbw_http_parser_expect(&p,0);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n"
+                "HTTP/1.1 100 Continue\r\n\r\n"
+                "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello") == 0);
+    TEST_CHECK(strcmp(l.log,"[200]Content-Length=5;|$[100]|$[200]Content-Length=5;|hello$") == 0);
+    TEST_CHECK(p.messages == 3&&p.head_n == 0);
+    gbw_http_parser_fin(&p);
+
+    /*chunked,extensions and a trailer,chunked wins over the length*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\nContent-Length: 99\r\nTransfer-Encoding: chunked\r\n\r\n"
+                "5;x=y\r\nhello\r\n6\r\n world\r\n0\r\n\r\n") == 0);
+    TEST_CHECK(strcmp(l.log,"[200]Content-Length=99;Transfer-Encoding=chunked;|hello world$") == 0);
+    TEST_CHECK(p.body_len == 11);
+    gbw_http_parser_fin(&p);
+
+    /*no framing,the body runs until the stream ends*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    TEST_CHECK(_exec(&p,"HTTP/1.0 200 OK\r\n\r\nabc") == 0);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\n") == 0);
+    TEST_CHECK(p.messages == 0);
+    gbw_http_parser_finish(&p);
+    TEST_CHECK(p.messages == 1&&p.body_len == 20);
+    TEST_CHECK(strcmp(l.log,"[200]|abcHTTP/1.1 200 OK\r\n$") == 0);
+    gbw_http_parser_fin(&p);
+
+    /*204 and 304 have no body,101 hands the stream to another protocol*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 204 No Content\r\nContent-Length: 3\r\n\r\n"
+                "HTTP/1.1 304 Not Modified\r\n\r\n") == 0);
+    TEST_CHECK(p.messages == 2);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n\x81\x05hello") == -1);
+    TEST_CHECK(gbw_http_parser_stopped(&p)&&p.messages == 3&&p.errors == 0);
+    gbw_http_parser_fin(&p);
+}
+
+static void test_gaps(gbw_pool_t *mp){
+
+    gbw_http_parser_t p;
+    http_log_t l;
+
+    /*lost inside a body of known length,the next message is found*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc") == 0);
+    TEST_CHECK(gbw_http_parser_gap(&p,4) == 0);
+    TEST_CHECK(_exec(&p,"xyz") == 0);
+    TEST_CHECK(p.messages == 1&&p.body_len == 10);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n") == 0);
+    TEST_CHECK(p.messages == 2&&p.errors == 0);
+
+    /*up to the end of the body exactly*/
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\n") == 0);
+    TEST_CHECK(gbw_http_parser_gap(&p,4) == 0);
+    TEST_CHECK(p.messages == 3);
+    gbw_http_parser_fin(&p);
+
+    /*within the data of a chunk,the framing after it still parses*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\na\r\n0123") == 0);
+    TEST_CHECK(gbw_http_parser_gap(&p,6) == 0);
+    TEST_CHECK(_exec(&p,"\r\n2\r\nok\r\n0\r\n\r\n") == 0);
+    TEST_CHECK(p.messages == 1&&p.body_len == 12);
+    TEST_CHECK(strcmp(l.log,"[200]Transfer-Encoding=chunked;|0123ok$") == 0);
+
+    /*past the chunk into its framing,no way to resync*/
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nab") == 0);
+    TEST_CHECK(gbw_http_parser_gap(&p,5) == -1);
+    TEST_CHECK(gbw_http_parser_stopped(&p)&&p.errors == 1);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\n\r\n") == -1);
+    gbw_http_parser_fin(&p);
+
+    /*in the headers*/
+    _init(&p,mp,GBW_HTTP_REQUEST,&l);
+    TEST_CHECK(_exec(&p,"GET / HTTP/1.1\r\nHost: ") == 0);
+    TEST_CHECK(gbw_http_parser_gap(&p,10) == -1);
+    TEST_CHECK(gbw_http_parser_stopped(&p)&&p.errors == 1);
+    gbw_http_parser_fin(&p);
+
+    /*a body until the close just counts what was lost*/
+    _init(&p,mp,GBW_HTTP_RESPONSE,&l);
+    TEST_CHECK(_exec(&p,"HTTP/1.1 200 OK\r\n\r\nab") == 0);
+    TEST_CHECK(gbw_http_parser_gap(&p,1000) == 0);
+    TEST_CHECK(_exec(&p,"cd") == 0);
+    gbw_http_parser_finish(&p);
+    TEST_CHECK(p.messages == 1&&p.body_len == 1004);
+    gbw_http_parser_fin(&p);
+}
+
+static void _malformed(gbw_pool_t *mp,int type,const char *s){
+
+    gbw_http_parser_t p;
+    http_log_t l;
+
+    _init(&p,mp,type,&l);
+    TEST_CHECK(_exec(&p,s) == -1);
+    TEST_CHECK(gbw_http_parser_stopped(&p)&&p.errors == 1);
+    gbw_http_parser_fin(&p);
+}
+
+static void test_malformed(gbw_pool_t *mp){
+
+    static char long_line[GBW_HTTP_MAX_LINE+64];
+    gbw_http_parser_t p;
+    http_log_t l;
+    uint32_t half;
+
+    _malformed(mp,GBW_HTTP_REQUEST,"GET /\r\n\r\n");
+    _malformed(mp,GBW_HTTP_REQUEST,"GET  HTTP/1.1\r\n\r\n");
+    _malformed(mp,GBW_HTTP_REQUEST,"GET / HTTP/x.1\r\n\r\n");
+    _malformed(mp,GBW_HTTP_REQUEST,"GET / HTTP/1.1\r\nno colon\r\n\r\n");
+    _malformed(mp,GBW_HTTP_REQUEST,"POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n");
+    _malformed(mp,GBW_HTTP_RESPONSE,"HTTP/1.1 2000 OK\r\n\r\n");
+    _malformed(mp,GBW_HTTP_RESPONSE,"HTTP/1.1 20x OK\r\n\r\n");
+    _malformed(mp,GBW_HTTP_RESPONSE,"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n");
+    _malformed(mp,GBW_HTTP_RESPONSE,"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n");
+
+    /*a line longer than the buffer,once it is cut*/
+    memset(long_line,'a',sizeof(long_line)-1);
+    memcpy(long_line,"GET /",5);
+    half = GBW_HTTP_MAX_LINE/2;
+
+    _init(&p,mp,GBW_HTTP_REQUEST,&l);
+    TEST_CHECK(gbw_http_parser_execute(&p,(const uint8_t*)long_line,half) == 0);
+    TEST_CHECK(_exec(&p,long_line+half) == -1);
+    TEST_CHECK(gbw_http_parser_stopped(&p)&&p.errors == 1);
+    gbw_http_parser_fin(&p);
+
+    /*a callback done with the stream stops it,not an error*/
+    _init(&p,mp,GBW_HTTP_REQUEST,&l);
+    l.stop_on_request = 1;
+    TEST_CHECK(_exec(&p,"GET / HTTP/1.1\r\n\r\nGET /next HTTP/1.1\r\n\r\n") == -1);
+    TEST_CHECK(gbw_http_parser_stopped(&p)&&p.errors == 0);
+    TEST_CHECK(strcmp(l.log,"[GET / HTTP/1.1]") == 0);
+    gbw_http_parser_fin(&p);
+}
+
+int main(void){
+
+    gbw_pool_t *mp = gbw_pool_create(4096);
+
+    if(mp == NULL)
+        return 1;
+
+    test_pipelining(mp);
+    test_responses(mp);
+    test_gaps(mp);
+    test_malformed(mp);
+
+    gbw_pool_destroy(mp);
+
+    TEST_DONE("http");
+}
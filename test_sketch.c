@@ -0,0 +1,278 @@
+/*
+ *
+ *      Filename: test_sketch.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: unit tests of the Count-Min and Space-Saving sketches,
+ *                the bounds of each hold after merges too
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gbw_sketch.h"
+#include "test_check.h"
+
+#define NB_KEYS    5000
+#define NB_STREAMS 4
+#define STREAM_LEN 100000
+
+#define CMS_DEPTH 4
+#define CMS_WIDTH 1024
+
+#define SS_CAPACITY 64
+
+/*skewed key picks,a few heavy keys and a long tail*/
+static uint32_t _pick(uint64_t *state){
+
+    double u;
+
+    *state = *state*6364136223846793005ULL+1442695040888963407ULL;
+    u = (double)(*state>>11)/(double)(1ULL<<53);
+
+    return (uint32_t)(u*u*u*u*NB_KEYS);
+}
+
+static inline void _key(gbw_sketch_key_t *key,uint32_t k){
+
+    gbw_sketch_key_set(key,&k,sizeof(k));
+}
+
+static void test_cms(gbw_pool_t *mp){
+
+    gbw_sketch_cms_t *parts[NB_STREAMS],*all,*other;
+    gbw_sketch_key_t key;
+    uint64_t *truth,state,hash,est,bound;
+    uint32_t i,j,k,over = 0;
+
+    truth = calloc(NB_KEYS,sizeof(uint64_t));
+    all = gbw_sketch_cms_create(mp,CMS_DEPTH,CMS_WIDTH);
+    TEST_CHECK(truth&&all);
+    if(!(truth&&all))
+        return;
+
+    for(i = 0;i<NB_STREAMS;i++){
+
+        parts[i] = gbw_sketch_cms_create(mp,CMS_DEPTH,CMS_WIDTH);
+        TEST_CHECK(parts[i]!=NULL);
+        if(parts[i] == NULL)
+            return;
+
+        state = i+1;
+
+        for(j = 0;j<STREAM_LEN;j++){
+
+            k = _pick(&state);
+            _key(&key,k);
+            hash = gbw_sketch_key_hash(&key);
+
+            gbw_sketch_cms_update(parts[i],hash,1);
+            gbw_sketch_cms_update(all,hash,1);
+            truth[k]++;
+        }
+    }
+
+    for(i = 1;i<NB_STREAMS;i++)
+        TEST_CHECK(gbw_sketch_cms_merge(parts[0],parts[i]) == 0);
+
+    TEST_CHECK(parts[0]->total == (uint64_t)NB_STREAMS*STREAM_LEN);
+    TEST_CHECK(parts[0]->total == all->total);
+
+    /*over by at most total*e/width,but with probability 1-e^-depth*/
+    bound = (uint64_t)ceil(M_E*(double)all->total/all->width);
+
+    for(k = 0;k<NB_KEYS;k++){
+
+        _key(&key,k);
+        hash = gbw_sketch_key_hash(&key);
+        est = gbw_sketch_cms_estimate(parts[0],hash);
+
+        /*merging is adding counters up,as if one sketch saw it all*/
+        TEST_CHECK(est == gbw_sketch_cms_estimate(all,hash));
+        TEST_CHECK(est>=truth[k]);
+
+        if(est-truth[k]>bound)
+            over++;
+    }
+
+    TEST_CHECK(over<=NB_KEYS*exp(-CMS_DEPTH)*2);
+
+    other = gbw_sketch_cms_create(mp,CMS_DEPTH,CMS_WIDTH*2);
+    TEST_CHECK(other!=NULL&&gbw_sketch_cms_merge(parts[0],other) == -1);
+
+    gbw_sketch_cms_clear(all);
+    TEST_CHECK(all->total == 0&&gbw_sketch_cms_estimate(all,gbw_sketch_key_hash(&key)) == 0);
+
+    TEST_CHECK(gbw_sketch_cms_create(mp,0,CMS_WIDTH) == NULL);
+    TEST_CHECK(gbw_sketch_cms_create(mp,GBW_SKETCH_MAX_DEPTH+1,CMS_WIDTH) == NULL);
+
+    /*width rounds up to a power of 2*/
+    if(other){
+        gbw_sketch_cms_destroy(other);
+        other = gbw_sketch_cms_create(mp,1,1000);
+        TEST_CHECK(other!=NULL&&other->width == 1024);
+    }
+
+    for(i = 0;i<NB_STREAMS;i++)
+        gbw_sketch_cms_destroy(parts[i]);
+    gbw_sketch_cms_destroy(all);
+    if(other)
+        gbw_sketch_cms_destroy(other);
+    free(truth);
+}
+
+static gbw_sketch_ss_entry_t * _ss_find(gbw_sketch_ss_t *ss,uint32_t k){
+
+    gbw_sketch_key_t key;
+    uint32_t i;
+
+    _key(&key,k);
+
+    for(i = 0;i<ss->n;i++)
+        if(gbw_sketch_key_equal(&ss->entries[i].key,&key))
+            return &ss->entries[i];
+
+    return NULL;
+}
+
+/*
+ * The Space-Saving bounds for the stream counted in truth: monitored
+ * counts are never under the true count and count-err never over it,
+ * both within total/capacity,and no key above that is left out.
+ */
+static void _ss_bounds(gbw_sketch_ss_t *ss,const uint64_t *truth,uint64_t total){
+
+    gbw_sketch_ss_entry_t *e;
+    uint64_t bound = total/ss->capacity;
+    uint32_t k;
+
+    TEST_CHECK(ss->total == total);
+    TEST_CHECK(ss->n<=ss->capacity);
+
+    for(k = 0;k<NB_KEYS;k++){
+
+        e = _ss_find(ss,k);
+
+        if(e == NULL){
+            TEST_CHECK(truth[k]<=bound);
+            continue;
+        }
+
+        TEST_CHECK(e->count>=truth[k]);
+        TEST_CHECK(e->count-e->err<=truth[k]);
+        TEST_CHECK(e->count-truth[k]<=bound);
+    }
+}
+
+static void test_ss(gbw_pool_t *mp){
+
+    gbw_sketch_ss_t *parts[NB_STREAMS];
+    gbw_sketch_ss_entry_t top[8],*e;
+    gbw_sketch_key_t key;
+    uint64_t *truth[NB_STREAMS],*sum,state;
+    uint32_t i,j,k,n;
+
+    sum = calloc(NB_KEYS,sizeof(uint64_t));
+    TEST_CHECK(sum!=NULL);
+    if(sum == NULL)
+        return;
+
+    for(i = 0;i<NB_STREAMS;i++){
+
+        parts[i] = gbw_sketch_ss_create(mp,SS_CAPACITY);
+        truth[i] = calloc(NB_KEYS,sizeof(uint64_t));
+        TEST_CHECK(parts[i]&&truth[i]);
+        if(!(parts[i]&&truth[i]))
+            return;
+
+        /*each stream skewed to other keys,they disagree on the heavy ones*/
+        state = i+101;
+
+        for(j = 0;j<STREAM_LEN;j++){
+
+            k = (_pick(&state)+i*NB_KEYS/NB_STREAMS/8)%NB_KEYS;
+            _key(&key,k);
+
+            gbw_sketch_ss_update(parts[i],&key,gbw_sketch_key_hash(&key),1);
+            truth[i][k]++;
+        }
+
+        _ss_bounds(parts[i],truth[i],STREAM_LEN);
+    }
+
+    /*a merge tree,as the per worker sketches are merged*/
+    gbw_sketch_ss_merge(parts[0],parts[1]);
+    gbw_sketch_ss_merge(parts[2],parts[3]);
+
+    for(k = 0;k<NB_KEYS;k++){
+        truth[0][k] += truth[1][k];
+        truth[2][k] += truth[3][k];
+    }
+
+    _ss_bounds(parts[0],truth[0],2*STREAM_LEN);
+    _ss_bounds(parts[2],truth[2],2*STREAM_LEN);
+
+    gbw_sketch_ss_merge(parts[0],parts[2]);
+
+    for(k = 0;k<NB_KEYS;k++)
+        sum[k] = truth[0][k]+truth[2][k];
+
+    _ss_bounds(parts[0],sum,(uint64_t)NB_STREAMS*STREAM_LEN);
+
+    /*largest first,the heaviest key of the union on top*/
+    n = gbw_sketch_ss_top(parts[0],top,8);
+    TEST_CHECK(n == 8);
+
+    for(i = 1;i<n;i++)
+        TEST_CHECK(top[i-1].count>=top[i].count);
+
+    for(k = 1,j = 0;k<NB_KEYS;k++)
+        if(sum[k]>sum[j])
+            j = k;
+
+    _key(&key,j);
+    TEST_CHECK(gbw_sketch_key_equal(&top[0].key,&key));
+
+    /*merging an empty one changes nothing*/
+    gbw_sketch_ss_clear(parts[1]);
+    TEST_CHECK(parts[1]->n == 0&&parts[1]->total == 0);
+    gbw_sketch_ss_merge(parts[0],parts[1]);
+    _ss_bounds(parts[0],sum,(uint64_t)NB_STREAMS*STREAM_LEN);
+
+    /*below the capacity the counts are exact*/
+    for(k = 0;k<SS_CAPACITY;k++){
+        _key(&key,k);
+        gbw_sketch_ss_update(parts[1],&key,gbw_sketch_key_hash(&key),k+1);
+    }
+
+    for(k = 0;k<SS_CAPACITY;k++){
+        e = _ss_find(parts[1],k);
+        TEST_CHECK(e!=NULL&&e->count == k+1&&e->err == 0);
+    }
+
+    TEST_CHECK(gbw_sketch_ss_create(mp,0) == NULL);
+
+    for(i = 0;i<NB_STREAMS;i++){
+        gbw_sketch_ss_destroy(parts[i]);
+        free(truth[i]);
+    }
+
+    free(sum);
+}
+
+int main(void){
+
+    gbw_pool_t *mp = gbw_pool_create(4096);
+
+    if(mp == NULL)
+        return 1;
+
+    test_cms(mp);
+    test_ss(mp);
+
+    gbw_pool_destroy(mp);
+
+    TEST_DONE("sketch");
+}
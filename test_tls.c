@@ -0,0 +1,323 @@
+/*
+ *
+ *      Filename: test_tls.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: unit tests of the TLS hello parser,JA3 and JA4 of the
+ *                published example hellos,whole and cut in pieces
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gbw_tls_parser.h"
+#include "test_check.h"
+
+#define GREASE 0x0a0a
+
+typedef struct {
+
+    uint8_t data[2048];
+    uint32_t len;
+}hello_buf_t;
+
+static void _put8(hello_buf_t *b,uint8_t v){
+
+    b->data[b->len++] = v;
+}
+
+static void _put16(hello_buf_t *b,uint16_t v){
+
+    _put8(b,(uint8_t)(v>>8));
+    _put8(b,(uint8_t)v);
+}
+
+static void _put(hello_buf_t *b,const void *data,uint32_t len){
+
+    if(len)
+        memcpy(b->data+b->len,data,len);
+    b->len += len;
+}
+
+/*length fields are written once what they cover is*/
+static uint32_t _len_open(hello_buf_t *b,uint32_t size){
+
+    uint32_t at = b->len;
+
+    b->len += size;
+    return at;
+}
+
+static void _len_close(hello_buf_t *b,uint32_t at,uint32_t size){
+
+    uint32_t n = b->len-at-size,i;
+
+    for(i = 0;i<size;i++)
+        b->data[at+i] = (uint8_t)(n>>(8*(size-1-i)));
+}
+
+static void _list16(hello_buf_t *b,uint32_t len_size,const uint16_t *v,uint32_t n){
+
+    uint32_t at = _len_open(b,len_size),i;
+
+    for(i = 0;i<n;i++)
+        _put16(b,v[i]);
+
+    _len_close(b,at,len_size);
+}
+
+static void _ext(hello_buf_t *b,uint16_t type,const void *data,uint32_t len){
+
+    _put16(b,type);
+    _put16(b,(uint16_t)len);
+    _put(b,data,len);
+}
+
+static void _ext_sni(hello_buf_t *b,const char *host){
+
+    uint32_t ext,list;
+
+    _put16(b,GBW_TLS_EXT_SNI);
+    ext = _len_open(b,2);
+    list = _len_open(b,2);
+    _put8(b,0);
+    _put16(b,(uint16_t)strlen(host));
+    _put(b,host,(uint32_t)strlen(host));
+    _len_close(b,list,2);
+    _len_close(b,ext,2);
+}
+
+static void _ext_list16(hello_buf_t *b,uint16_t type,uint32_t len_size,const uint16_t *v,uint32_t n){
+
+    uint32_t ext;
+
+    _put16(b,type);
+    ext = _len_open(b,2);
+    _list16(b,len_size,v,n);
+    _len_close(b,ext,2);
+}
+
+/*Handshake header,version,random and an empty session id*/
+static uint32_t _hello_start(hello_buf_t *b,uint16_t version){
+
+    uint32_t at;
+    uint8_t random[32];
+
+    memset(random,0x5a,sizeof(random));
+    b->len = 0;
+
+    _put8(b,GBW_TLS_CLIENT_HELLO);
+    at = _len_open(b,3);
+    _put16(b,version);
+    _put(b,random,sizeof(random));
+    _put8(b,0);
+
+    return at;
+}
+
+/*
+ * The example of the JA3 README:
+ * 769,47-53-5-10-49161-49162-49171-49172-50-56-19-4,0-10-11,23-24-25,0
+ * with GREASE values thrown in,which JA3 leaves out.
+ */
+static void _ja3_hello(hello_buf_t *b){
+
+    static const uint16_t ciphers[] = {GREASE,47,53,5,10,49161,49162,49171,49172,50,56,19,4};
+    static const uint16_t groups[] = {GREASE,23,24,25};
+    static const uint8_t point_fmts[] = {1,0};
+    uint32_t msg,exts;
+
+    msg = _hello_start(b,0x0301);
+    _list16(b,2,ciphers,sizeof(ciphers)/sizeof(ciphers[0]));
+    _put8(b,1);
+    _put8(b,0);
+
+    exts = _len_open(b,2);
+    _ext(b,GREASE,NULL,0);
+    _ext_sni(b,"example.com");
+    _ext_list16(b,GBW_TLS_EXT_SUPPORTED_GROUPS,2,groups,sizeof(groups)/sizeof(groups[0]));
+    _ext(b,GBW_TLS_EXT_EC_POINT_FORMATS,point_fmts,sizeof(point_fmts));
+    _len_close(b,exts,2);
+
+    _len_close(b,msg,3);
+}
+
+/*
+ * The Chrome example of the JA4 spec,t13d1516h2_8daaf6152771_e5627efa2ab1:
+ * 15 ciphers and 16 extensions in a random order,GREASE ones as well.
+ */
+static void _ja4_hello(hello_buf_t *b){
+
+    static const uint16_t ciphers[] = {GREASE,0x1301,0x1302,0x1303,0xc02b,0xc02f,0xc02c,0xc030,
+        0xcca9,0xcca8,0xc013,0xc014,0x009c,0x009d,0x002f,0x0035};
+    static const uint16_t groups[] = {GREASE,0x001d,0x0017,0x0018};
+    static const uint16_t sig_algs[] = {0x0403,0x0804,0x0401,0x0503,0x0805,0x0501,0x0806,0x0601};
+    static const uint16_t versions[] = {GREASE,0x0304,0x0303};
+    static const uint8_t point_fmts[] = {1,0};
+    static const uint8_t alpn[] = {0,12,2,'h','2',8,'h','t','t','p','/','1','.','1'};
+    static const uint8_t alps[] = {0,3,2,'h','2'};
+    static const uint8_t status_request[] = {1,0,0,0,0};
+    static const uint8_t compress_cert[] = {2,0,2};
+    static const uint8_t psk_modes[] = {1,1};
+    static const uint8_t reneg[] = {0};
+    uint8_t key_share[2+2+2+32],padding[64];
+    uint32_t msg,exts;
+
+    key_share[0] = 0;
+    key_share[1] = 36;
+    key_share[2] = 0;
+    key_share[3] = 0x1d;
+    key_share[4] = 0;
+    key_share[5] = 32;
+    memset(key_share+6,0x33,32);
+    memset(padding,0,sizeof(padding));
+
+    msg = _hello_start(b,0x0303);
+    _list16(b,2,ciphers,sizeof(ciphers)/sizeof(ciphers[0]));
+    _put8(b,1);
+    _put8(b,0);
+
+    exts = _len_open(b,2);
+    _ext(b,GREASE+0x1010,NULL,0);
+    _ext(b,0x0017,NULL,0);
+    _ext(b,0x4469,alps,sizeof(alps));
+    _ext_sni(b,"www.google.com");
+    _ext(b,0x0023,NULL,0);
+    _ext(b,0x0005,status_request,sizeof(status_request));
+    _ext_list16(b,GBW_TLS_EXT_SIG_ALGS,2,sig_algs,sizeof(sig_algs)/sizeof(sig_algs[0]));
+    _ext(b,0x0012,NULL,0);
+    _ext(b,0x002d,psk_modes,sizeof(psk_modes));
+    _ext(b,GBW_TLS_EXT_ALPN,alpn,sizeof(alpn));
+    _ext_list16(b,GBW_TLS_EXT_SUPPORTED_VERSIONS,1,versions,sizeof(versions)/sizeof(versions[0]));
+    _ext(b,0x0033,key_share,sizeof(key_share));
+    _ext(b,0xff01,reneg,sizeof(reneg));
+    _ext_list16(b,GBW_TLS_EXT_SUPPORTED_GROUPS,2,groups,sizeof(groups)/sizeof(groups[0]));
+    _ext(b,GBW_TLS_EXT_EC_POINT_FORMATS,point_fmts,sizeof(point_fmts));
+    _ext(b,0x001b,compress_cert,sizeof(compress_cert));
+    _ext(b,0x0015,padding,sizeof(padding));
+    _len_close(b,exts,2);
+
+    _len_close(b,msg,3);
+}
+
+static void test_ja3(void){
+
+    gbw_tls_hello_t hello;
+    hello_buf_t b;
+
+    _ja3_hello(&b);
+
+    memset(&hello,0,sizeof(hello));
+    TEST_CHECK(gbw_tls_hello_parse(&hello,b.data,b.len) == 0);
+    TEST_CHECK(hello.type == GBW_TLS_CLIENT_HELLO);
+    TEST_CHECK(hello.version == 0x0301&&hello.n_ciphers == 12);
+    TEST_CHECK(hello.has_sni&&strcmp(hello.sni,"example.com") == 0);
+    TEST_CHECK(strcmp(hello.ja3,"ada70206e40642a3e4461f35503241d5") == 0);
+}
+
+static void test_ja4(void){
+
+    gbw_tls_hello_t hello;
+    hello_buf_t b;
+
+    _ja4_hello(&b);
+
+    memset(&hello,0,sizeof(hello));
+    TEST_CHECK(gbw_tls_hello_parse(&hello,b.data,b.len) == 0);
+    TEST_CHECK(hello.version == 0x0304&&hello.legacy_version == 0x0303);
+    TEST_CHECK(hello.n_ciphers == 15&&hello.n_exts == 16);
+    TEST_CHECK(strcmp(hello.alpn,"h2") == 0);
+    TEST_CHECK(strcmp(hello.ja4,"t13d1516h2_8daaf6152771_e5627efa2ab1") == 0);
+
+    /*a hello cut short*/
+    TEST_CHECK(gbw_tls_hello_parse(&hello,b.data,b.len-1) == -1);
+}
+
+/*
+ * The hello of a stream in records of rec_size,fed chunk bytes at a
+ * time,has to come out as when parsed whole.
+ */
+static int _stream(gbw_pool_t *mp,const hello_buf_t *b,uint32_t rec_size,uint32_t chunk,gbw_tls_hello_t *hello){
+
+    static uint8_t stream[4096];
+    gbw_tls_parser_t p;
+    uint32_t off,n,len = 0;
+    int rc = GBW_TLS_MORE;
+
+    for(off = 0;off<b->len;off += n){
+
+        n = b->len-off<rec_size?b->len-off:rec_size;
+
+        stream[len++] = 0x16;
+        stream[len++] = 3;
+        stream[len++] = 1;
+        stream[len++] = (uint8_t)(n>>8);
+        stream[len++] = (uint8_t)n;
+        memcpy(stream+len,b->data+off,n);
+        len += n;
+    }
+
+    gbw_tls_parser_init(&p,mp);
+    memset(hello,0,sizeof(*hello));
+
+    for(off = 0;off<len&&rc == GBW_TLS_MORE;off += n){
+
+        n = len-off<chunk?len-off:chunk;
+        rc = gbw_tls_parser_execute(&p,stream+off,n,hello);
+    }
+
+    TEST_CHECK(gbw_tls_parser_done(&p));
+
+    /*done,the rest of the stream is not looked at*/
+    TEST_CHECK(gbw_tls_parser_execute(&p,stream,len,hello) == GBW_TLS_MORE);
+
+    return rc;
+}
+
+static void test_stream(gbw_pool_t *mp){
+
+    static const uint32_t rec_sizes[] = {16384,100,7,1};
+    static const uint32_t chunks[] = {4096,333,5,1};
+    gbw_tls_hello_t hello;
+    gbw_tls_parser_t p;
+    hello_buf_t b;
+    unsigned int i,j;
+
+    _ja4_hello(&b);
+
+    for(i = 0;i<sizeof(rec_sizes)/sizeof(rec_sizes[0]);i++){
+
+        for(j = 0;j<sizeof(chunks)/sizeof(chunks[0]);j++){
+
+            TEST_CHECK(_stream(mp,&b,rec_sizes[i],chunks[j],&hello) == GBW_TLS_HELLO);
+            TEST_CHECK(strcmp(hello.ja4,"t13d1516h2_8daaf6152771_e5627efa2ab1") == 0);
+        }
+    }
+
+    /*not TLS*/
+    gbw_tls_parser_init(&p,mp);
+    TEST_CHECK(gbw_tls_parser_execute(&p,(const uint8_t*)"GET / HTTP/1.1\r\n",16,&hello) == GBW_TLS_FAILED);
+    TEST_CHECK(gbw_tls_parser_done(&p));
+
+    /*a handshake that isn't a hello*/
+    _ja3_hello(&b);
+    b.data[0] = 11;
+    TEST_CHECK(_stream(mp,&b,16384,4096,&hello) == GBW_TLS_FAILED);
+}
+
+int main(void){
+
+    gbw_pool_t *mp = gbw_pool_create(4096);
+
+    if(mp == NULL)
+        return 1;
+
+    test_ja3();
+    test_ja4();
+    test_stream(mp);
+
+    gbw_pool_destroy(mp);
+
+    TEST_DONE("tls");
+}
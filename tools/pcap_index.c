@@ -0,0 +1,75 @@
+/*
+ *
+ *      Filename: pcap_index.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: writes the <file>.idx sidecar index the pcap vdev reads
+ *                for capture files it did not write itself,e.g. as the
+ *                tcpdump -z command of each rotated file
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "rte_pcap_file_index.h"
+
+static void usage(const char *prog){
+
+    fprintf(stderr,"Usage:%s [-n <stride>] [-v] file.pcap...\n"
+            "  -n  records between index points,default %u\n"
+            "  -v  print each index to stdout\n"
+            "Only classic pcap files can be indexed,not pcapng.\n",prog,PCAP_INDEX_STRIDE_DEFAULT);
+}
+
+int main(int argc,char **argv){
+
+    struct rte_pcap_index idx;
+    uint32_t stride = PCAP_INDEX_STRIDE_DEFAULT;
+    int verbose = 0;
+    int opt,i,rc = 0;
+
+    while((opt = getopt(argc,argv,"n:vh"))!=-1){
+
+        switch(opt){
+        case 'n':
+            stride = (uint32_t)strtoul(optarg,NULL,10);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(optind>=argc||stride == 0){
+        usage(argv[0]);
+        return -1;
+    }
+
+    for(i = optind;i<argc;i++){
+
+        if(rte_pcap_index_build(&idx,argv[i],stride)){
+            fprintf(stderr,"Cannot index %s,not a readable pcap file\n",argv[i]);
+            rc = -1;
+            continue;
+        }
+
+        if(rte_pcap_index_write(&idx,argv[i])){
+            fprintf(stderr,"Cannot write the index of %s\n",argv[i]);
+            rc = -1;
+        }else if(verbose){
+            fprintf(stdout,"%s:\n",argv[i]);
+            rte_pcap_index_dump(&idx,stdout);
+        }
+
+        rte_pcap_index_free(&idx);
+    }
+
+    return rc;
+}
@@ -0,0 +1,228 @@
+/*
+ *
+ *      Filename: pcap_shm_producer.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: feeds pcap files into the shared memory ring read by the
+ *                pcap vdev rx_shm queue,for testing without a capture card
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <pcap.h>
+
+#include "rte_pcap_shm_ring.h"
+
+static volatile int stop = 0;
+
+static void _on_signal(int sig){
+
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char *prog){
+
+    fprintf(stderr,"Usage:%s -s <socket> [-m <ring MB>] [-l <loops>] [-d] file.pcap...\n"
+            "  -s  unix socket the pcap vdev rx_shm devarg points to\n"
+            "  -m  size of the ring data area in MB,power of 2,default 64\n"
+            "  -l  replay the files this many times,0 forever,default 1\n"
+            "  -d  drop packets when the ring is full instead of waiting\n",prog);
+}
+
+static int _send_fds(int conn,int memfd,int evfd){
+
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(2*sizeof(int))];
+    char dummy = 0;
+    int fds[2] = {memfd,evfd};
+
+    memset(&msg,0,sizeof(msg));
+    memset(cbuf,0,sizeof(cbuf));
+
+    iov.iov_base = &dummy;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg),fds,sizeof(fds));
+
+    return sendmsg(conn,&msg,0)<0?-1:0;
+}
+
+/*wait until the consumer released room or 100ms passed*/
+static void _wait_room(struct pcap_shm_ring *ring,int evfd){
+
+    struct pollfd pfd = {.fd = evfd,.events = POLLIN};
+    uint64_t v;
+
+    __atomic_store_n(&ring->producer_waiting,1,__ATOMIC_SEQ_CST);
+
+    if(poll(&pfd,1,100)>0&&read(evfd,&v,sizeof(v))<0){
+        /*nothing,the loop retries the push anyway*/
+    }
+
+    __atomic_store_n(&ring->producer_waiting,0,__ATOMIC_RELAXED);
+}
+
+static int _replay(struct pcap_shm_ring *ring,int evfd,const char *fname,int drop,uint64_t *pkts){
+
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *hdr;
+    struct pcap_shm_rec_hdr rec;
+    const u_char *data;
+    pcap_t *pcap;
+    int rc;
+
+    pcap = pcap_open_offline(fname,errbuf);
+    if(pcap == NULL){
+        fprintf(stderr,"Cannot open %s:%s\n",fname,errbuf);
+        return -1;
+    }
+
+    while(!stop&&(rc = pcap_next_ex(pcap,&hdr,&data)) == 1){
+
+        rec.ts_sec = (uint32_t)hdr->ts.tv_sec;
+        rec.ts_usec = (uint32_t)hdr->ts.tv_usec;
+        rec.caplen = hdr->caplen;
+        rec.len = hdr->len;
+
+        while((rc = pcap_shm_ring_push(ring,&rec,data))!=0&&!drop&&!stop)
+            _wait_room(ring,evfd);
+
+        if(rc == 0)
+            (*pkts)++;
+        else
+            ring->drops++;
+    }
+
+    pcap_close(pcap);
+
+    return 0;
+}
+
+int main(int argc,char **argv){
+
+    const char *sock_path = NULL;
+    uint64_t size = PCAP_SHM_DEFAULT_SIZE;
+    uint64_t pkts = 0;
+    long loops = 1,loop;
+    int drop = 0;
+    int opt,i;
+    int memfd,evfd,lsock,conn;
+    struct sockaddr_un addr;
+    struct pcap_shm_ring *ring;
+
+    while((opt = getopt(argc,argv,"s:m:l:dh"))!=-1){
+
+        switch(opt){
+        case 's':
+            sock_path = optarg;
+            break;
+        case 'm':
+            size = strtoull(optarg,NULL,10)*1024*1024;
+            break;
+        case 'l':
+            loops = strtol(optarg,NULL,10);
+            break;
+        case 'd':
+            drop = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(sock_path == NULL||optind>=argc||size == 0||(size&(size-1))||
+            strlen(sock_path)>=sizeof(addr.sun_path)){
+        usage(argv[0]);
+        return -1;
+    }
+
+    signal(SIGINT,_on_signal);
+    signal(SIGTERM,_on_signal);
+    signal(SIGPIPE,SIG_IGN);
+
+    memfd = memfd_create("pcap_shm_ring",MFD_CLOEXEC);
+    if(memfd<0||ftruncate(memfd,(off_t)(PCAP_SHM_HDR_SIZE+size))<0){
+        fprintf(stderr,"Cannot create ring memfd:%s\n",strerror(errno));
+        return -1;
+    }
+
+    ring = mmap(NULL,PCAP_SHM_HDR_SIZE+size,PROT_READ|PROT_WRITE,MAP_SHARED,memfd,0);
+    if(ring == MAP_FAILED){
+        fprintf(stderr,"Cannot map ring:%s\n",strerror(errno));
+        return -1;
+    }
+
+    pcap_shm_ring_init(ring,size,DLT_EN10MB,65535);
+
+    evfd = eventfd(0,EFD_CLOEXEC|EFD_NONBLOCK);
+    lsock = socket(AF_UNIX,SOCK_SEQPACKET,0);
+    if(evfd<0||lsock<0){
+        fprintf(stderr,"Cannot create eventfd/socket:%s\n",strerror(errno));
+        return -1;
+    }
+
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,sock_path);
+    unlink(sock_path);
+
+    if(bind(lsock,(struct sockaddr*)&addr,sizeof(addr))<0||listen(lsock,1)<0){
+        fprintf(stderr,"Cannot listen on %s:%s\n",sock_path,strerror(errno));
+        return -1;
+    }
+
+    fprintf(stdout,"Waiting for the consumer on %s\n",sock_path);
+
+    conn = accept(lsock,NULL,NULL);
+    if(conn<0||_send_fds(conn,memfd,evfd)){
+        fprintf(stderr,"Cannot hand the ring to the consumer:%s\n",strerror(errno));
+        return -1;
+    }
+
+    close(conn);
+
+    for(loop = 0;!stop&&(loops == 0||loop<loops);loop++){
+
+        for(i = optind;!stop&&i<argc;i++)
+            _replay(ring,evfd,argv[i],drop,&pkts);
+    }
+
+    /*let the consumer drain before the ring goes away*/
+    while(!stop&&__atomic_load_n(&ring->tail,__ATOMIC_ACQUIRE)!=ring->head)
+        _wait_room(ring,evfd);
+
+    fprintf(stdout,"Produced %llu packets,dropped %llu\n",
+            (unsigned long long)pkts,(unsigned long long)ring->drops);
+
+    unlink(sock_path);
+    munmap(ring,PCAP_SHM_HDR_SIZE+size);
+    close(lsock);
+    close(evfd);
+    close(memfd);
+
+    return 0;
+}
@@ -0,0 +1,401 @@
+/*
+ *
+ *      Filename: pcap_store_query.c
+ *
+ *        Author: shajf,csp001314@163.com
+ *   Description: extracts packets by time and 5-tuple from a packet store
+ *                directory,reading only the segments and blocks their
+ *                indexes say may hold some
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#include "gbw_pcap_store.h"
+
+#define QUERY_MAX_SEGMENTS 65536
+#define QUERY_SNAPLEN 65535
+
+typedef struct {
+
+    uint64_t segments;
+    uint64_t segments_skipped;
+    uint64_t segments_unindexed;
+    uint64_t blocks;
+    uint64_t blocks_skipped;
+    uint64_t bytes_read;
+    uint64_t pkts_read;
+    uint64_t pkts;
+}query_stats_t;
+
+static void usage(const char *prog){
+
+    fprintf(stderr,"Usage:%s -d <dir> -w <file> [-s <secs>] [-e <secs>] [-a <ip>] [-p <port>]\n"
+            "                [-b <ip>] [-q <port>] [-P <proto>] [-v]\n"
+            "  -d  packet store directory,CaptureDir of the probe\n"
+            "  -w  pcap file the packets go to,- for stdout\n"
+            "  -s  from this time,secs since the epoch,may have a fraction\n"
+            "  -e  up to this time\n"
+            "  -a  one end's address   -p  its port\n"
+            "  -b  other end's address -q  its port\n"
+            "  -P  IP protocol,tcp,udp,sctp or a number\n"
+            "  -v  print how much was read to stderr\n"
+            "Either end may be the source. Packets come in segment order.\n",prog);
+}
+
+static int _parse_time(const char *s,uint64_t *ts){
+
+    char *end;
+    double v = strtod(s,&end);
+
+    if(*s == '\0'||*end!='\0'||v<0)
+        return -1;
+
+    *ts = (uint64_t)(v*1000000+0.5);
+    return 0;
+}
+
+static int _parse_addr(const char *s,gbw_pcap_store_query_t *q,int i){
+
+    if(inet_pton(AF_INET,s,q->ends[i].addr) == 1)
+        q->ends[i].addr_len = 4;
+    else if(inet_pton(AF_INET6,s,q->ends[i].addr) == 1)
+        q->ends[i].addr_len = 16;
+    else
+        return -1;
+
+    return 0;
+}
+
+static int _parse_port(const char *s,gbw_pcap_store_query_t *q,int i){
+
+    char *end;
+    unsigned long v = strtoul(s,&end,10);
+
+    if(*s == '\0'||*end!='\0'||v == 0||v>65535)
+        return -1;
+
+    q->ends[i].port = (uint16_t)v;
+    return 0;
+}
+
+static int _parse_proto(const char *s,gbw_pcap_store_query_t *q){
+
+    struct protoent *pe;
+    char *end;
+    unsigned long v = strtoul(s,&end,10);
+
+    if(*s!='\0'&&*end == '\0'&&v>0&&v<256){
+        q->proto = (uint8_t)v;
+        return 0;
+    }
+
+    pe = getprotobyname(s);
+    if(pe == NULL)
+        return -1;
+
+    q->proto = (uint8_t)pe->p_proto;
+    return 0;
+}
+
+/*
+ * Segments are <name>_<secs>_<seq>.pcap,sorted on secs then name so the
+ * ones of all workers come roughly in time order.
+ */
+static unsigned long _seg_secs(const char *name){
+
+    const char *p = strrchr(name,'_');
+
+    while(p&&p>name){
+        p--;
+        if(*p == '_')
+            return strtoul(p+1,NULL,10);
+    }
+
+    return 0;
+}
+
+static int _seg_cmp(const void *a,const void *b){
+
+    const char *na = *(const char*const*)a;
+    const char *nb = *(const char*const*)b;
+    unsigned long sa = _seg_secs(na),sb = _seg_secs(nb);
+
+    if(sa!=sb)
+        return sa<sb?-1:1;
+
+    return strcmp(na,nb);
+}
+
+static int _is_segment(const char *name){
+
+    size_t len = strlen(name);
+
+    return len>5&&strcmp(name+len-5,".pcap") == 0;
+}
+
+/*Walks whole records,the ones matching go out as they are*/
+static int _scan(const uint8_t *data,size_t len,const gbw_pcap_store_query_t *q,FILE *out,query_stats_t *stats){
+
+    gbw_pcap_store_tuple_t tuple;
+    uint32_t hdr[4];
+    uint64_t ts;
+    size_t off = 0;
+    uint32_t caplen;
+
+    while(off+GBW_PCAP_STORE_REC_HDR<=len){
+
+        /*records are packed,one may start at any byte of the map*/
+        memcpy(hdr,data+off,sizeof(hdr));
+        caplen = hdr[2];
+
+        if(off+GBW_PCAP_STORE_REC_HDR+caplen>len)
+            break;
+
+        ts = (uint64_t)hdr[0]*1000000+hdr[1];
+        stats->pkts_read++;
+
+        if(gbw_pcap_store_query_match(q,ts,gbw_pcap_store_tuple_parse(data+off+GBW_PCAP_STORE_REC_HDR,caplen,&tuple)?
+                    NULL:&tuple)){
+
+            if(fwrite(data+off,GBW_PCAP_STORE_REC_HDR+caplen,1,out)!=1)
+                return -1;
+            stats->pkts++;
+        }
+
+        off += GBW_PCAP_STORE_REC_HDR+caplen;
+    }
+
+    return 0;
+}
+
+static int _read_at(int fd,uint8_t **buf,size_t *size,uint64_t off,size_t len){
+
+    uint8_t *p;
+    ssize_t n;
+    size_t got = 0;
+
+    if(len>*size){
+        p = (uint8_t*)realloc(*buf,len);
+        if(p == NULL)
+            return -1;
+        *buf = p;
+        *size = len;
+    }
+
+    while(got<len){
+
+        n = pread(fd,*buf+got,len-got,(off_t)(off+got));
+        if(n<0&&errno == EINTR)
+            continue;
+        if(n<=0)
+            return -1;
+
+        got += (size_t)n;
+    }
+
+    return 0;
+}
+
+static int _query_segment(const char *path,const gbw_pcap_store_query_t *q,FILE *out,
+        uint8_t **buf,size_t *size,query_stats_t *stats){
+
+    gbw_pcap_store_index_t idx;
+    uint64_t off,len;
+    uint32_t i,j;
+    off_t end;
+    int fd,rc = 0;
+
+    if(gbw_pcap_store_index_load(&idx,path) == 0&&!gbw_pcap_store_query_segment(&idx,q)){
+        gbw_pcap_store_index_free(&idx);
+        stats->segments_skipped++;
+        return 0;
+    }
+
+    fd = open(path,O_RDONLY|O_CLOEXEC);
+    if(fd<0){
+        fprintf(stderr,"Cannot open %s:%s\n",path,strerror(errno));
+        gbw_pcap_store_index_free(&idx);
+        return -1;
+    }
+
+    stats->segments++;
+
+    /*no index,or a broken one: all of it*/
+    if(idx.blocks == NULL){
+
+        stats->segments_unindexed++;
+
+        end = lseek(fd,0,SEEK_END);
+        if(end>GBW_PCAP_STORE_FILE_HDR){
+
+            len = (uint64_t)end-GBW_PCAP_STORE_FILE_HDR;
+            if(_read_at(fd,buf,size,GBW_PCAP_STORE_FILE_HDR,len)||_scan(*buf,len,q,out,stats))
+                rc = -1;
+            stats->bytes_read += len;
+        }
+
+        close(fd);
+        return rc;
+    }
+
+    /*runs of matching blocks are read at once*/
+    for(i = 0;i<idx.hdr.nb_blocks&&rc == 0;i = j){
+
+        if(!gbw_pcap_store_query_block(&idx,q,i)){
+            stats->blocks_skipped++;
+            j = i+1;
+            continue;
+        }
+
+        off = idx.blocks[i].offset;
+        len = idx.blocks[i].len;
+
+        for(j = i+1;j<idx.hdr.nb_blocks&&gbw_pcap_store_query_block(&idx,q,j);j++)
+            len += idx.blocks[j].len;
+
+        stats->blocks += j-i;
+        stats->bytes_read += len;
+
+        if(_read_at(fd,buf,size,off,len)||_scan(*buf,len,q,out,stats))
+            rc = -1;
+    }
+
+    close(fd);
+    gbw_pcap_store_index_free(&idx);
+
+    return rc;
+}
+
+int main(int argc,char **argv){
+
+    gbw_pcap_store_query_t q;
+    query_stats_t stats;
+    const char *dir = NULL,*wfile = NULL;
+    char **names,path[1024];
+    struct dirent *de;
+    DIR *d;
+    FILE *out;
+    uint8_t *buf = NULL;
+    size_t size = 0,n = 0,i;
+    int opt,verbose = 0,rc = 0;
+
+    memset(&q,0,sizeof(q));
+    memset(&stats,0,sizeof(stats));
+
+    while((opt = getopt(argc,argv,"d:w:s:e:a:p:b:q:P:vh"))!=-1){
+
+        switch(opt){
+        case 'd':
+            dir = optarg;
+            break;
+        case 'w':
+            wfile = optarg;
+            break;
+        case 's':
+            rc |= _parse_time(optarg,&q.ts_from);
+            break;
+        case 'e':
+            rc |= _parse_time(optarg,&q.ts_to);
+            break;
+        case 'a':
+            rc |= _parse_addr(optarg,&q,0);
+            break;
+        case 'p':
+            rc |= _parse_port(optarg,&q,0);
+            break;
+        case 'b':
+            rc |= _parse_addr(optarg,&q,1);
+            break;
+        case 'q':
+            rc |= _parse_port(optarg,&q,1);
+            break;
+        case 'P':
+            rc |= _parse_proto(optarg,&q);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+
+        if(rc){
+            fprintf(stderr,"Bad value for -%c:%s\n",opt,optarg);
+            return 1;
+        }
+    }
+
+    if(dir == NULL||wfile == NULL){
+        usage(argv[0]);
+        return 1;
+    }
+
+    d = opendir(dir);
+    if(d == NULL){
+        fprintf(stderr,"Cannot open %s:%s\n",dir,strerror(errno));
+        return 1;
+    }
+
+    names = (char**)malloc(QUERY_MAX_SEGMENTS*sizeof(*names));
+    if(names == NULL){
+        closedir(d);
+        return 1;
+    }
+
+    while((de = readdir(d))!=NULL&&n<QUERY_MAX_SEGMENTS){
+        if(_is_segment(de->d_name))
+            names[n++] = strdup(de->d_name);
+    }
+
+    closedir(d);
+
+    qsort(names,n,sizeof(*names),_seg_cmp);
+
+    out = strcmp(wfile,"-") == 0?stdout:fopen(wfile,"wb");
+    if(out == NULL||gbw_pcap_store_file_hdr_write(out,QUERY_SNAPLEN)){
+        fprintf(stderr,"Cannot write %s:%s\n",wfile,strerror(errno));
+        return 1;
+    }
+
+    for(i = 0;i<n;i++){
+
+        snprintf(path,sizeof(path),"%s/%s",dir,names[i]);
+
+        if(_query_segment(path,&q,out,&buf,&size,&stats)){
+            fprintf(stderr,"Cannot query %s\n",path);
+            rc = 1;
+        }
+
+        free(names[i]);
+    }
+
+    if(fflush(out)||(out!=stdout&&fclose(out))){
+        fprintf(stderr,"Cannot write %s:%s\n",wfile,strerror(errno));
+        rc = 1;
+    }
+
+    if(verbose)
+        fprintf(stderr,"segments:%lu skipped:%lu unindexed:%lu blocks:%lu skipped:%lu "
+                "bytes_read:%lu pkts_read:%lu pkts:%lu\n",
+                (unsigned long)stats.segments,(unsigned long)stats.segments_skipped,
+                (unsigned long)stats.segments_unindexed,(unsigned long)stats.blocks,
+                (unsigned long)stats.blocks_skipped,(unsigned long)stats.bytes_read,
+                (unsigned long)stats.pkts_read,(unsigned long)stats.pkts);
+
+    free(names);
+    free(buf);
+
+    return rc;
+}